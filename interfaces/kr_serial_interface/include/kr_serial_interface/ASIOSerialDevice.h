@@ -25,31 +25,104 @@
 #include <boost/asio/serial_port.hpp>
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
+#include <chrono>
 #include <deque>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 // Class version of example ASIO over serial with boost::asio:
 // http://groups.google.com/group/boost-list/browse_thread/thread/5cc7dcc7b90d41fc
 
-#define MAX_READ_LENGTH 16
+// Size of the read buffer, each read takes up to half of it
+#define DEFAULT_READ_BUFFER_SIZE 4096
+
+// Frames preallocated for the writes, and their size
+#define DEFAULT_WRITE_POOL_FRAMES 64
+#define DEFAULT_WRITE_FRAME_SIZE 256
+
+// Longest a frame can wait for the write in progress to finish, in s
+#define DEFAULT_MAX_WRITE_LATENCY 0.005
 
 namespace ba = boost::asio;
 
+// Bytes the link sends in max_latency, 10 bits per byte with the start and stop bits. 0 when the baud is not known.
+inline size_t MaxWriteBytes(double max_latency, unsigned int baud)
+{
+  return (baud > 0) ? static_cast<size_t>(max_latency * baud / 10) : 0;
+}
+
+// Number of frames from the front of the write queue sent in one write: the first one in any case, so the queue always
+// drains, then as many as fit in max_bytes. frame_size(i) is the size of the i-th queued frame.
+template <typename FrameSize>
+size_t WriteBatchFrames(size_t num_queued, size_t max_bytes, FrameSize frame_size)
+{
+  size_t num_frames = 0, bytes = 0;
+  while(num_frames < num_queued && (num_frames == 0 || bytes + frame_size(num_frames) <= max_bytes))
+    bytes += frame_size(num_frames++);
+  return num_frames;
+}
+
+// An io_service shared by many ASIOSerialDevice, run by a few threads instead of one thread for each device. On Linux
+// it waits on all the devices with a single epoll.
+class SerialIOService
+{
+ public:
+  explicit SerialIOService(size_t num_threads = 1);
+  ~SerialIOService();
+
+  ba::io_service &GetIOService() { return io_service; }
+
+ private:
+  ba::io_service io_service;
+  std::unique_ptr<ba::io_service::work> work;
+  boost::thread_group threads;
+};
+
 class ASIOSerialDevice
 {
  public:
   ASIOSerialDevice();
   ASIOSerialDevice(const std::string &device, unsigned int baud);
+  // Runs on the threads of service instead of its own. The handlers of a device still run one at a time.
+  explicit ASIOSerialDevice(const std::shared_ptr<SerialIOService> &service);
   ~ASIOSerialDevice();
 
+  // The data passed to the handler points into the read buffer and is only valid during the call
   void SetReadCallback(const boost::function<void(const unsigned char *, size_t)> &handler);
 
+  // The read buffer is used as two halves: the next read goes into one while the read callback processes the other
+  // in place, so the link is read while the data is processed. Has to be called before Start.
+  void SetReadBufferSize(size_t size);
+
+  // Frames are copied into a pool of num_frames frames of frame_size bytes, a write fails when none is free. Has to be
+  // called before Start.
+  void SetWritePool(size_t num_frames, size_t frame_size);
+
+  // A frame is written right away when the link is idle. The frames queued while a write is in progress are sent
+  // together in the next write, limited to the bytes the link sends in max_latency, so that a large batch does not
+  // hold back the frames queued after it. When a single frame takes longer than max_latency on the link, e.g. at low
+  // baud rates, each write carries one frame.
+  void SetMaxWriteLatency(double max_latency);
+
+  // Writes which failed because no frame was free
+  size_t DroppedWrites();
+
+  struct WriteStats
+  {
+    size_t frames, bytes, dropped;  // Since the device was created
+    double latency_sum;             // Of all the frames written, from Write until the write completed, in s
+    double latency_max;             // Since the previous call
+  };
+  WriteStats GetWriteStats();
+
   void Start();
   void Stop();
   void Close();
 
   void Read();
   bool Write(const std::vector<unsigned char> &msg);
+  bool Write(const unsigned char *data, size_t size);
   void Open(
       const std::string &device_, unsigned int baud_,
       ba::serial_port_base::parity parity = ba::serial_port_base::parity(ba::serial_port_base::parity::none),
@@ -61,25 +134,55 @@ class ASIOSerialDevice
   bool Active();
 
  private:
+  struct WriteFrame
+  {
+    std::vector<unsigned char> data;
+    size_t size;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  void Init();
   void CloseCallback(const boost::system::error_code &error);
 
   void ReadStart();
   void ReadComplete(const boost::system::error_code &error, size_t bytes_transferred);
 
-  void WriteCallback(const std::vector<unsigned char> &msg);
   void WriteStart();
   void WriteComplete(const boost::system::error_code &error);
 
   std::string device;
   unsigned int baud;
   bool async_active, open;
-  std::deque<std::vector<unsigned char> > write_msgs;
+
+  // The frames move from free_frames to queued_frames in Write, then to writing_frames for one async_write
+  boost::mutex write_mutex;
+  std::vector<WriteFrame> write_frames;
+  std::vector<WriteFrame *> free_frames, queued_frames, writing_frames;
+  std::vector<ba::const_buffer> write_buffers;
+  bool write_in_progress;
+  size_t max_write_bytes;
+  double max_write_latency;
+  size_t dropped_writes;
+  WriteStats write_stats;
+
+  void OperationStarted();
+  void OperationDone();
 
   boost::thread thread;
-  ba::io_service io_service;
+  std::shared_ptr<SerialIOService> shared_service;  // Null when the device runs its own io_service
+  ba::io_service own_io_service;
+  ba::io_service &io_service;
+  ba::io_service::strand strand;
   ba::serial_port *serial_port;
+
+  // Asynchronous operations and posted handlers not completed yet, Stop waits for them with a shared service
+  boost::mutex operations_mutex;
+  boost::condition_variable operations_done;
+  size_t pending_operations;
+
   boost::function<void(const unsigned char *, size_t)> read_callback;
 
-  unsigned char read_msg[MAX_READ_LENGTH];
+  std::vector<unsigned char> read_buffer;
+  size_t read_half;  // Half of read_buffer the pending read goes into
 };
 #endif
@@ -20,6 +20,43 @@ struct SO3_CMD_INPUT
   uint8_t seq;
 };
 
+// SO3_CMD_INPUT without the gains and corrections, which are sent as SO3_GAINS only when they change
+#define TYPE_SO3_COMPACT_CMD 'k'
+struct SO3_COMPACT_CMD
+{
+  // Scaling factors as in SO3_CMD_INPUT
+  int16_t force[3];
+  // Smallest three, little endian: index of the largest component in the top 2 bits, then the other three in 10 bits
+  // each, mapped from +-1/sqrt(2) to 0-1023. The largest component is positive.
+  uint8_t des_q[4];
+  int16_t angvel_x, angvel_y, angvel_z;
+  int16_t cur_yaw;
+  uint8_t enable_motors : 1;
+  uint8_t use_external_yaw : 1;
+  uint8_t gains_seq;  // Of the SO3_GAINS the command goes with
+  uint8_t seq;
+};
+
+#define TYPE_SO3_GAINS 'g'
+struct SO3_GAINS
+{
+  // Scaling factors as in SO3_CMD_INPUT
+  uint8_t kR[3];
+  uint8_t kOm[3];
+  int16_t kf_correction;
+  int8_t angle_corrections[2];
+  uint8_t gains_seq;  // Incremented when the gains change
+};
+
+// Latest SO3 commands of several vehicles sharing a radio, one packet per time slot. The header is followed by count
+// entries of a channel byte and the SO3_CMD_INPUT of that channel, each vehicle takes the entry of its channel.
+#define TYPE_SO3_MULTI_CMD 'm'
+struct SO3_MULTI_CMD_HEADER
+{
+  uint8_t slot;  // Incremented every slot, to detect lost packets
+  uint8_t count;
+};
+
 #define TYPE_STATUS_DATA 'c'
 struct STATUS_DATA
 {
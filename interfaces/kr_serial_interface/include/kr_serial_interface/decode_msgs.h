@@ -2,9 +2,12 @@
 #define QUADROTOR_MSGS_DECODE_MSGS_H
 
 #include <kr_mav_msgs/OutputData.h>
+#include <kr_mav_msgs/SO3Command.h>
 #include <kr_mav_msgs/StatusData.h>
+#include <kr_serial_interface/comm_types.h>
 #include <stdint.h>
 
+#include <utility>
 #include <vector>
 
 namespace kr_mav_msgs
@@ -12,6 +15,35 @@ namespace kr_mav_msgs
 bool decodeOutputData(const std::vector<uint8_t> &data, kr_mav_msgs::OutputData &output);
 
 bool decodeStatusData(const std::vector<uint8_t> &data, kr_mav_msgs::StatusData &status);
+
+bool decodeSO3Command(const std::vector<uint8_t> &data, kr_mav_msgs::SO3Command &so3_command);
+
+// The commands of an SO3_MULTI_CMD with their channels, in the order they were packed
+bool decodeSO3MultiCommand(const std::vector<uint8_t> &data, uint8_t &slot,
+                           std::vector<std::pair<uint8_t, kr_mav_msgs::SO3Command>> &commands);
+
+/**
+ * Decodes what SO3CompactEncoder encoded, as the vehicle does: the gains and corrections of a command are the ones of
+ * the last SO3_GAINS received.
+ */
+class SO3CompactDecoder
+{
+ public:
+  SO3CompactDecoder();
+
+  bool decodeGains(const std::vector<uint8_t> &data);
+
+  // Fails until some gains were received. A command going with newer gains than the last received is still decoded,
+  // with the gains at hand, and counted in staleGains.
+  bool decodeCommand(const std::vector<uint8_t> &data, kr_mav_msgs::SO3Command &so3_command);
+
+  unsigned int staleGains() const { return stale_gains_; }
+
+ private:
+  struct SO3_GAINS gains_;
+  bool has_gains_;
+  unsigned int stale_gains_;
+};
 }  // namespace kr_mav_msgs
 
 #endif
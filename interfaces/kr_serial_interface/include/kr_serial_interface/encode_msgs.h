@@ -4,8 +4,10 @@
 #include <kr_mav_msgs/PWMCommand.h>
 #include <kr_mav_msgs/SO3Command.h>
 #include <kr_mav_msgs/TRPYCommand.h>
+#include <kr_serial_interface/comm_types.h>
 #include <stdint.h>
 
+#include <utility>
 #include <vector>
 
 namespace kr_mav_msgs
@@ -13,6 +15,42 @@ namespace kr_mav_msgs
 void encodeSO3Command(const kr_mav_msgs::SO3Command &so3_command, std::vector<uint8_t> &output);
 void encodeTRPYCommand(const kr_mav_msgs::TRPYCommand &trpy_command, std::vector<uint8_t> &output);
 void encodePWMCommand(const kr_mav_msgs::PWMCommand &pwm_command, std::vector<uint8_t> &output);
+
+// Encode into a buffer which has room for the encoded struct, return the encoded size
+size_t encodeSO3Command(const kr_mav_msgs::SO3Command &so3_command, uint8_t *output);
+size_t encodeTRPYCommand(const kr_mav_msgs::TRPYCommand &trpy_command, uint8_t *output);
+size_t encodePWMCommand(const kr_mav_msgs::PWMCommand &pwm_command, uint8_t *output);
+
+// Size of an SO3_MULTI_CMD carrying count commands
+size_t so3MultiCommandSize(size_t count);
+
+/**
+ * Packs the commands of several vehicles sharing a radio into an SO3_MULTI_CMD. Each entry is a channel and the
+ * SO3_CMD_INPUT for it, as encoded by encodeSO3Command. output needs room for so3MultiCommandSize(entries.size()),
+ * returns the encoded size.
+ */
+size_t encodeSO3MultiCommand(uint8_t slot, const std::vector<std::pair<uint8_t, const uint8_t *>> &entries,
+                             uint8_t *output);
+
+/**
+ * Encodes SO3 commands as SO3_COMPACT_CMD, with the gains and corrections as SO3_GAINS only when they changed, or every
+ * gains_period commands in case an SO3_GAINS packet got lost. Keeps what was sent, so each vehicle needs its own.
+ */
+class SO3CompactEncoder
+{
+ public:
+  explicit SO3CompactEncoder(unsigned int gains_period = 50);
+
+  // Returns the size of the SO3_GAINS written to output, 0 when they need not be sent. Call before encodeCommand.
+  size_t encodeGains(const kr_mav_msgs::SO3Command &so3_command, uint8_t *output);
+
+  size_t encodeCommand(const kr_mav_msgs::SO3Command &so3_command, uint8_t *output);
+
+ private:
+  struct SO3_GAINS gains_;
+  bool gains_sent_;
+  unsigned int gains_period_, commands_since_gains_;
+};
 }  // namespace kr_mav_msgs
 
 #endif
@@ -0,0 +1,48 @@
+#ifndef QUAD_SERIAL_COMM_SEQ_CLOCK_SYNC_H
+#define QUAD_SERIAL_COMM_SEQ_CLOCK_SYNC_H
+
+#include <ros/time.h>
+
+/**
+ * Estimates when the robot sampled the packets it sends with a seq counter, from their arrival times. Packets are sent
+ * at a fixed rate onboard, so the arrival time is a line in the unwrapped seq plus the delays of the link, which are
+ * never negative. The line is fit online with an exponentially weighted least squares, and moved down to the lowest
+ * arrivals, so the buffering jitter is removed and only the smallest delay of the link remains in the stamps.
+ */
+class SeqClockSync
+{
+ public:
+  // window: number of packets the fit averages over, seq_modulus: seq counts up to seq_modulus - 1 and wraps around
+  explicit SeqClockSync(double window = 200, unsigned int seq_modulus = 256);
+
+  // Returns the estimated sample time of the packet, the arrival time until the fit has enough packets
+  ros::Time update(unsigned int seq, const ros::Time &arrival);
+
+  void reset();
+
+  // Estimated time between two seq, 0 until the fit has enough packets
+  double period() const;
+
+ private:
+  void rebase();
+
+  double forgetting_;
+  unsigned int seq_modulus_;
+
+  int last_seq_;
+  ros::Time last_arrival_;
+  unsigned int num_samples_;
+
+  // Unwrapped seq and arrival time, relative to n_ref_ and t_ref_ to keep the sums small
+  int64_t n_;
+  int64_t n_ref_;
+  ros::Time t_ref_;
+
+  // Exponentially weighted sums of 1, n, t, n^2 and n t
+  double s_, s_n_, s_t_, s_nn_, s_nt_;
+
+  // Lowest arrival relative to the fitted line
+  double min_offset_;
+};
+
+#endif
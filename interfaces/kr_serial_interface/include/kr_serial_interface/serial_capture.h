@@ -0,0 +1,39 @@
+#ifndef QUAD_SERIAL_COMM_SERIAL_CAPTURE_H
+#define QUAD_SERIAL_COMM_SERIAL_CAPTURE_H
+
+#include <kr_flight_recorder/flight_recorder.h>
+#include <ros/ros.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * Binary capture of the packets sent to and received from the robot, as kr_flight_recorder::SerialFrameRecord, decoded
+ * offline with serial_capture_to_csv. The packets are sent and received on different threads, so record() is
+ * serialized in front of the single producer of the recorder.
+ */
+class SerialCapture
+{
+ public:
+  /**
+   * @brief Open the capture from the params of n: capture_file, nothing is captured if it is empty, capture_buffer,
+   * the records in the ring, and capture_size_mb, the size the file is allocated to
+   *
+   * @param link Inserted before the extension of capture_file, for a nodelet with several links
+   */
+  void open(const ros::NodeHandle &n, const std::string &link = std::string());
+
+  void close();
+
+  bool isOpen() const { return recorder_ != NULL; }
+
+  void record(const ros::Time &stamp, uint8_t direction, uint8_t type, uint8_t channel, const uint8_t *data,
+              size_t length);
+
+ private:
+  std::unique_ptr<kr_flight_recorder::FlightRecorder> recorder_;
+  std::mutex mutex_;
+};
+
+#endif
@@ -6,8 +6,73 @@
 #include <boost/function.hpp>
 #include <vector>
 
+/* Packet format:
+ * Packet: | 0x55 | 0x55 |count|type|---data---|crcL|crcH|
+ * The CRC covers count, type and data.
+ */
+static const unsigned int kPacketOverhead = 6;
+static const unsigned int kPacketDataMaxSize = 100;
+static const unsigned int kPacketDataOffset = 4;
+
+// CRC-16-ITU-T (polynomial 0x1021), continuing from crc
+uint16_t crc16(const uint8_t *data, size_t count, uint16_t crc = 0xffff);
+
 void encode_serial_msg(const kr_mav_msgs::Serial &msg, std::vector<uint8_t> &serial_data);
 
-void process_serial_data(const uint8_t *data, const size_t count,
-                         boost::function<void(kr_mav_msgs::Serial &)> callback);
+// Fills in the rest of a packet whose data_length bytes of data were written at frame + kPacketDataOffset, so the data
+// can be encoded in place. Returns the size of the packet.
+size_t frame_serial_packet(uint8_t type, size_t data_length, uint8_t *frame);
+
+/**
+ * Extracts the packets from the bytes received on a serial link. Each link needs its own parser, since a packet can be
+ * split over several reads.
+ */
+class SerialPacketParser
+{
+ public:
+  // data points into the parser and is only valid during the call
+  typedef boost::function<void(uint8_t type, const uint8_t *data, size_t length)> PacketCallback;
+
+  explicit SerialPacketParser(const PacketCallback &callback = PacketCallback());
+
+  void setCallback(const PacketCallback &callback) { callback_ = callback; }
+
+  // Calls the callback for each complete packet with a valid CRC
+  void process(const uint8_t *data, size_t count);
+
+  // Drops a partially received packet
+  void reset()
+  {
+    state_ = kPacketStart1;
+    hunting_ = true;
+  }
+
+  unsigned int packets() const { return packets_; }
+  unsigned int crcErrors() const { return crc_errors_; }
+  // Times the bytes following a packet were not the start of the next one
+  unsigned int resyncs() const { return resyncs_; }
+
+ private:
+  enum PacketState
+  {
+    kPacketStart1,
+    kPacketStart2,
+    kPacketCount,
+    kPacketType,
+    kPacketData,
+    kPacketCRCL,
+    kPacketCRCH,
+  };
+
+  PacketCallback callback_;
+  PacketState state_;
+  bool hunting_;  // Looking for a packet start, since startup or a bad packet
+  uint8_t type_;
+  uint8_t data_[kPacketDataMaxSize];
+  uint16_t received_length_, data_count_;
+  uint16_t expected_crc_, received_crc_;
+  unsigned int packets_, crc_errors_, resyncs_;
+
+  void lostSync();
+};
 #endif
@@ -0,0 +1,58 @@
+#ifndef QUAD_SERIAL_COMM_SERIAL_LINK_STATS_H
+#define QUAD_SERIAL_COMM_SERIAL_LINK_STATS_H
+
+#include <diagnostic_updater/diagnostic_status_wrapper.h>
+#include <kr_serial_interface/ASIOSerialDevice.h>
+#include <kr_serial_interface/serial_interface.h>
+
+#include <mutex>
+
+/**
+ * Health of a serial link to the robot: rates both ways, CRC errors and resynchronizations of the parser, gaps in the
+ * seq of the packets, and the write latency. There is no reply to the commands to measure a round trip with, so the
+ * round trip is estimated as the write latency of a command plus the time to send an OUTPUT_DATA back.
+ */
+class SerialLinkStats
+{
+ public:
+  explicit SerialLinkStats(unsigned int baud_rate);
+
+  // After the parser processed a read of count bytes, on the read thread
+  void read(size_t count, const SerialPacketParser &parser);
+
+  // A packet from the robot, for the seq of OUTPUT_DATA and STATUS_DATA
+  void received(uint8_t type, const uint8_t *data, size_t length);
+
+  // A packet to the robot, for the seq of the SO3 commands
+  void sent(uint8_t type, const uint8_t *data, size_t length);
+
+  // Summarizes the period since the previous call, to be added to a diagnostic_updater::Updater
+  void diagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat, const ASIOSerialDevice::WriteStats &write_stats);
+
+ private:
+  // seq counts up to modulus - 1 and wraps around
+  struct SeqTracker
+  {
+    explicit SeqTracker(unsigned int modulus) : modulus(modulus), last(-1), gaps(0) {}
+    void update(unsigned int seq);
+
+    unsigned int modulus;
+    int last;
+    unsigned int gaps;
+  };
+
+  std::mutex mutex_;
+  unsigned int baud_rate_;
+
+  size_t read_bytes_;
+  unsigned int packets_, crc_errors_, resyncs_;
+  SeqTracker output_seq_, status_seq_, command_seq_;
+
+  // At the previous diagnostics
+  std::chrono::steady_clock::time_point last_time_;
+  size_t last_read_bytes_, last_write_bytes_, last_write_frames_, last_dropped_;
+  unsigned int last_packets_, last_crc_errors_, last_resyncs_, last_gaps_;
+  double last_latency_sum_;
+};
+
+#endif
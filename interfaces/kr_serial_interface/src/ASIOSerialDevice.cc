@@ -20,26 +20,61 @@
 
 #include <kr_serial_interface/ASIOSerialDevice.h>
 
+#include <algorithm>
+#include <cstring>
+
 #if defined(__linux__)
 #include <linux/serial.h>
 #endif
 
 using namespace std;
 
-ASIOSerialDevice::ASIOSerialDevice()
+SerialIOService::SerialIOService(size_t num_threads) : work(new ba::io_service::work(io_service))
 {
-  async_active = false;
-  open = false;
-  serial_port = 0;
+  for(size_t i = 0; i < std::max<size_t>(num_threads, 1); i++)
+    threads.create_thread(boost::bind(&ba::io_service::run, &io_service));
+}
+
+SerialIOService::~SerialIOService()
+{
+  // The devices hold the service, so they are all gone by now
+  work.reset();
+  io_service.stop();
+  threads.join_all();
+}
+
+ASIOSerialDevice::ASIOSerialDevice() : io_service(own_io_service), strand(own_io_service)
+{
+  Init();
 }
 
 ASIOSerialDevice::ASIOSerialDevice(const string &device, unsigned int baud)
+    : io_service(own_io_service), strand(own_io_service)
+{
+  Init();
+  Open(device, baud);
+}
+
+ASIOSerialDevice::ASIOSerialDevice(const std::shared_ptr<SerialIOService> &service)
+    : shared_service(service), io_service(service->GetIOService()), strand(io_service)
+{
+  Init();
+}
+
+void ASIOSerialDevice::Init()
 {
   async_active = false;
   open = false;
   serial_port = 0;
-
-  Open(device, baud);
+  baud = 0;
+  read_buffer.resize(DEFAULT_READ_BUFFER_SIZE);
+  read_half = 0;
+  write_in_progress = false;
+  pending_operations = 0;
+  dropped_writes = 0;
+  write_stats = WriteStats();
+  SetWritePool(DEFAULT_WRITE_POOL_FRAMES, DEFAULT_WRITE_FRAME_SIZE);
+  SetMaxWriteLatency(DEFAULT_MAX_WRITE_LATENCY);
 }
 
 ASIOSerialDevice::~ASIOSerialDevice()
@@ -60,6 +95,7 @@ void ASIOSerialDevice::Open(const string &device_, unsigned int baud_, ba::seria
 {
   device = device_;
   baud = baud_;
+  SetMaxWriteLatency(max_write_latency);
 
   if(!open)
   {
@@ -117,7 +153,13 @@ void ASIOSerialDevice::Close()
   if(open)
   {
     if(async_active)
-      io_service.post(boost::bind(&ASIOSerialDevice::CloseCallback, this, boost::system::error_code()));
+    {
+      OperationStarted();
+      strand.post([this]() {
+        CloseCallback(boost::system::error_code());
+        OperationDone();
+      });
+    }
     else
       CloseCallback(boost::system::error_code());
   }
@@ -130,7 +172,9 @@ void ASIOSerialDevice::Start()
 
   ReadStart();
 
-  thread = boost::thread(boost::bind(&ba::io_service::run, &io_service));
+  // Otherwise the threads of the shared service run the handlers
+  if(!shared_service)
+    thread = boost::thread(boost::bind(&ba::io_service::run, &io_service));
 
   async_active = true;
 
@@ -139,22 +183,31 @@ void ASIOSerialDevice::Start()
 
 void ASIOSerialDevice::ReadStart()
 {
+  const size_t half_size = read_buffer.size() / 2;
   if(open)
-    serial_port->async_read_some(ba::buffer(read_msg, MAX_READ_LENGTH),
-                                 boost::bind(&ASIOSerialDevice::ReadComplete, this, ba::placeholders::error,
-                                             ba::placeholders::bytes_transferred));
+  {
+    OperationStarted();
+    serial_port->async_read_some(
+        ba::buffer(&read_buffer[read_half * half_size], half_size),
+        strand.wrap(boost::bind(&ASIOSerialDevice::ReadComplete, this, ba::placeholders::error,
+                                ba::placeholders::bytes_transferred)));
+  }
 }
 
 void ASIOSerialDevice::ReadComplete(const boost::system::error_code &error, size_t bytes_transferred)
 {
   if(!error)
   {
-    if(!read_callback.empty())
-      read_callback(read_msg, bytes_transferred);
+    // The next read goes into the other half, its handler runs on the strand so only after the callback returns
+    const unsigned char *data = &read_buffer[read_half * (read_buffer.size() / 2)];
+    read_half = 1 - read_half;
     ReadStart();
+    if(!read_callback.empty())
+      read_callback(data, bytes_transferred);
   }
   else
     CloseCallback(error);
+  OperationDone();
 }
 
 void ASIOSerialDevice::SetReadCallback(const boost::function<void(const unsigned char *, size_t)> &handler)
@@ -162,12 +215,48 @@ void ASIOSerialDevice::SetReadCallback(const boost::function<void(const unsigned
   read_callback = handler;
 }
 
+void ASIOSerialDevice::SetReadBufferSize(size_t size)
+{
+  if(async_active)
+  {
+    cerr << "ASIOSerialDevice read buffer size cannot be changed once started" << endl;
+    return;
+  }
+
+  read_buffer.resize(std::max<size_t>(size, 2));
+  read_half = 0;
+}
+
 void ASIOSerialDevice::Stop()
 {
-  thread.join();
+  if(shared_service)
+  {
+    // The service keeps running for the other devices, so wait for the handlers of this one. The pending read only
+    // completes once the port is closed.
+    if(open)
+      Close();
+    boost::mutex::scoped_lock lock(operations_mutex);
+    while(pending_operations > 0)
+      operations_done.wait(lock);
+  }
+  else
+    thread.join();
   async_active = false;
 }
 
+void ASIOSerialDevice::OperationStarted()
+{
+  boost::mutex::scoped_lock lock(operations_mutex);
+  pending_operations++;
+}
+
+void ASIOSerialDevice::OperationDone()
+{
+  boost::mutex::scoped_lock lock(operations_mutex);
+  if(--pending_operations == 0)
+    operations_done.notify_all();
+}
+
 void ASIOSerialDevice::CloseCallback(const boost::system::error_code &error)
 {
   if(error && (error != ba::error::operation_aborted))
@@ -177,45 +266,152 @@ void ASIOSerialDevice::CloseCallback(const boost::system::error_code &error)
   open = false;
 }
 
+void ASIOSerialDevice::SetWritePool(size_t num_frames, size_t frame_size)
+{
+  if(async_active)
+  {
+    cerr << "ASIOSerialDevice write pool cannot be changed once started" << endl;
+    return;
+  }
+
+  num_frames = std::max<size_t>(num_frames, 1);
+  write_frames.resize(num_frames);
+  free_frames.clear();
+  for(WriteFrame &frame : write_frames)
+  {
+    frame.data.resize(frame_size);
+    frame.size = 0;
+    free_frames.push_back(&frame);
+  }
+  queued_frames.clear();
+  queued_frames.reserve(num_frames);
+  writing_frames.clear();
+  writing_frames.reserve(num_frames);
+  write_buffers.reserve(num_frames);
+}
+
+void ASIOSerialDevice::SetMaxWriteLatency(double max_latency)
+{
+  boost::mutex::scoped_lock lock(write_mutex);
+  max_write_latency = max_latency;
+  max_write_bytes = MaxWriteBytes(max_latency, baud);
+}
+
+size_t ASIOSerialDevice::DroppedWrites()
+{
+  boost::mutex::scoped_lock lock(write_mutex);
+  return dropped_writes;
+}
+
+ASIOSerialDevice::WriteStats ASIOSerialDevice::GetWriteStats()
+{
+  boost::mutex::scoped_lock lock(write_mutex);
+  WriteStats stats = write_stats;
+  stats.dropped = dropped_writes;
+  write_stats.latency_max = 0;
+  return stats;
+}
+
 bool ASIOSerialDevice::Write(const vector<unsigned char> &msg)
+{
+  return Write(msg.data(), msg.size());
+}
+
+bool ASIOSerialDevice::Write(const unsigned char *data, size_t size)
 {
   if(!open)
     return false;
 
-  if(async_active)
-    // Post for an asynchronous write
-    io_service.post(boost::bind(&ASIOSerialDevice::WriteCallback, this, msg));
-  else
+  if(!async_active)
+  {
     // Write synchronously
-    ba::write(*serial_port, ba::buffer(&(msg[0]), msg.size()));
+    ba::write(*serial_port, ba::buffer(data, size));
+    return true;
+  }
 
-  return true;
-}
+  boost::mutex::scoped_lock lock(write_mutex);
+  if(free_frames.empty() || size > write_frames[0].data.size())
+  {
+    dropped_writes++;
+    return false;
+  }
 
-void ASIOSerialDevice::WriteCallback(const vector<unsigned char> &msg)
-{
-  bool write_in_progress = !write_msgs.empty();
-  write_msgs.push_back(msg);
+  WriteFrame *frame = free_frames.back();
+  free_frames.pop_back();
+  memcpy(frame->data.data(), data, size);
+  frame->size = size;
+  frame->queued = std::chrono::steady_clock::now();
+  queued_frames.push_back(frame);
+
+  // Otherwise the frame goes out with the next write, when the one in progress completes
   if(!write_in_progress)
-    WriteStart();
+  {
+    write_in_progress = true;
+    OperationStarted();
+    strand.post([this]() {
+      WriteStart();
+      OperationDone();
+    });
+  }
+  return true;
 }
 
 void ASIOSerialDevice::WriteStart()
 {
-  ba::async_write(*serial_port, ba::buffer(&(write_msgs.front()[0]), write_msgs.front().size()),
-                  boost::bind(&ASIOSerialDevice::WriteComplete, this, ba::placeholders::error));
+  {
+    boost::mutex::scoped_lock lock(write_mutex);
+
+    // Coalesce the queued frames into one write, at least one frame and then as many as fit in max_write_bytes
+    const size_t num_frames = WriteBatchFrames(queued_frames.size(), max_write_bytes,
+                                               [this](size_t i) { return queued_frames[i]->size; });
+
+    writing_frames.assign(queued_frames.begin(), queued_frames.begin() + num_frames);
+    queued_frames.erase(queued_frames.begin(), queued_frames.begin() + num_frames);
+  }
+
+  write_buffers.clear();
+  for(const WriteFrame *frame : writing_frames)
+    write_buffers.push_back(ba::buffer(frame->data.data(), frame->size));
+
+  OperationStarted();
+  ba::async_write(*serial_port, write_buffers,
+                  strand.wrap(boost::bind(&ASIOSerialDevice::WriteComplete, this, ba::placeholders::error)));
 }
 
 void ASIOSerialDevice::WriteComplete(const boost::system::error_code &error)
 {
-  if(!error)
+  bool more;
   {
-    write_msgs.pop_front();
-    if(!write_msgs.empty())
-      WriteStart();
+    boost::mutex::scoped_lock lock(write_mutex);
+    if(!error)
+    {
+      const auto now = std::chrono::steady_clock::now();
+      for(const WriteFrame *frame : writing_frames)
+      {
+        const double latency = std::chrono::duration<double>(now - frame->queued).count();
+        write_stats.frames++;
+        write_stats.bytes += frame->size;
+        write_stats.latency_sum += latency;
+        write_stats.latency_max = std::max(write_stats.latency_max, latency);
+      }
+    }
+    free_frames.insert(free_frames.end(), writing_frames.begin(), writing_frames.end());
+    writing_frames.clear();
+    if(error)
+    {
+      // Nothing more can be written, the queued frames are dropped
+      free_frames.insert(free_frames.end(), queued_frames.begin(), queued_frames.end());
+      queued_frames.clear();
+    }
+    more = !queued_frames.empty();
+    write_in_progress = more;
   }
-  else
+
+  if(error)
     CloseCallback(error);
+  else if(more)
+    WriteStart();
+  OperationDone();
 }
 
 bool ASIOSerialDevice::Active()
@@ -231,8 +427,8 @@ void ASIOSerialDevice::Read()
     return;
   }
 
-  size_t bytes_transferred = serial_port->read_some(ba::buffer(read_msg, MAX_READ_LENGTH));
+  size_t bytes_transferred = serial_port->read_some(ba::buffer(read_buffer));
 
   if(!read_callback.empty() && (bytes_transferred > 0))
-    read_callback(read_msg, bytes_transferred);
+    read_callback(&read_buffer[0], bytes_transferred);
 }
@@ -1,140 +1,160 @@
 #include <kr_serial_interface/serial_interface.h>
 
-/* Packet format:
- * Packet: | 0x55 | 0x55 |count|type|---data---|crcL|crcH|
- * State:     0      1      2    3       4       5    6
- */
+#include <algorithm>
+#include <cstring>
+#include <iostream>
 
-enum PacketState
+static const uint8_t kPacketStartString[] = {0x55, 0x55};
+
+// CRC-16-ITU-T, one entry per value of the top byte of the CRC xor the next data byte
+struct CRCTable
 {
-  kPacketStart1,
-  kPacketStart2,
-  kPacketCount,
-  kPacketType,
-  kPacketData,
-  kPacketCRCL,
-  kPacketCRCH,
+  uint16_t values[256];
+
+  constexpr CRCTable() : values()
+  {
+    for(int i = 0; i < 256; i++)
+    {
+      uint16_t crc = i << 8;
+      for(int bit = 0; bit < 8; bit++)
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+      values[i] = crc;
+    }
+  }
 };
 
-static const unsigned int kPacketOverhead = 6;
-static const unsigned int kPacketDataMaxSize = 100;
-static const uint8_t kPacketStartString[] = {0x55, 0x55};
+static constexpr CRCTable crc_table;
+
+static inline uint16_t crc_update(uint16_t crc, uint8_t data)
+{
+  return (crc << 8) ^ crc_table.values[(crc >> 8) ^ data];
+}
 
-static uint16_t crc16(const uint8_t *data, int count);
-static uint16_t crc_update(uint16_t crc, uint8_t data);
+uint16_t crc16(const uint8_t *data, size_t count, uint16_t crc)
+{
+  for(size_t i = 0; i < count; i++)
+    crc = crc_update(crc, data[i]);
+  return crc;
+}
 
 void encode_serial_msg(const kr_mav_msgs::Serial &msg, std::vector<uint8_t> &serial_data)
 {
   const uint8_t data_length = msg.data.size();
 
-  if(data_length > kPacketDataMaxSize)
+  if(msg.data.size() > kPacketDataMaxSize)
   {
     std::cerr << "encode_serial_msg: Message too large: " << msg.data.size() << ", max: " << kPacketDataMaxSize
               << std::endl;
+    serial_data.clear();
     return;
   }
 
   serial_data.resize(kPacketOverhead + data_length);
-  serial_data[0] = kPacketStartString[0];
-  serial_data[1] = kPacketStartString[1];
-  serial_data[2] = data_length;
-  serial_data[3] = msg.type;
-
-  uint16_t crc = crc16(&data_length, 1);
-  crc = crc_update(crc, msg.type);
+  memcpy(&(serial_data[kPacketDataOffset]), msg.data.data(), data_length);
+  frame_serial_packet(msg.type, data_length, serial_data.data());
+}
 
-  memcpy(&(serial_data[4]), &(msg.data[0]), data_length);
-  for(int i = 0; i < data_length; i++)
-    crc = crc_update(crc, msg.data[i]);
+size_t frame_serial_packet(uint8_t type, size_t data_length, uint8_t *frame)
+{
+  frame[0] = kPacketStartString[0];
+  frame[1] = kPacketStartString[1];
+  frame[2] = data_length;
+  frame[3] = type;
+
+  const uint16_t crc = crc16(&frame[2], 2 + data_length);
+  frame[kPacketDataOffset + data_length + 0] = crc & 0xFF;
+  frame[kPacketDataOffset + data_length + 1] = crc >> 8;
+  return kPacketOverhead + data_length;
+}
 
-  serial_data[4 + data_length + 0] = crc & 0xFF;
-  serial_data[4 + data_length + 1] = crc >> 8;
+SerialPacketParser::SerialPacketParser(const PacketCallback &callback)
+    : callback_(callback),
+      state_(kPacketStart1),
+      hunting_(true),
+      type_(0),
+      received_length_(0),
+      data_count_(0),
+      expected_crc_(0),
+      received_crc_(0),
+      packets_(0),
+      crc_errors_(0),
+      resyncs_(0)
+{
 }
 
-void process_serial_data(const uint8_t *data, const size_t count, boost::function<void(kr_mav_msgs::Serial &)> callback)
+void SerialPacketParser::lostSync()
 {
-  static kr_mav_msgs::Serial serial_msg;
-  static enum PacketState state = kPacketStart1;
-  static uint16_t received_length = 0, data_count = 0;
-  ;
-  static uint16_t expected_crc = 0, received_crc = 0;
+  if(!hunting_)
+    resyncs_++;
+  hunting_ = true;
+  state_ = kPacketStart1;
+}
 
+void SerialPacketParser::process(const uint8_t *data, size_t count)
+{
   for(size_t i = 0; i < count; i++)
   {
     const uint8_t c = data[i];
-    // printf("%d, %X\n", state, c);
-    if(state == kPacketStart1 && c == kPacketStartString[0])
-      state = kPacketStart2;
-    else if(state == kPacketStart2 && c == kPacketStartString[1])
-      state = kPacketCount;
-    else if(state == kPacketCount)
+    if(state_ == kPacketStart1 && c == kPacketStartString[0])
+      state_ = kPacketStart2;
+    else if(state_ == kPacketStart2 && c == kPacketStartString[1])
+      state_ = kPacketCount;
+    else if(state_ == kPacketCount)
     {
-      received_length = c;
-      if(received_length > kPacketDataMaxSize)
-        state = kPacketStart1;
+      received_length_ = c;
+      if(received_length_ > kPacketDataMaxSize)
+        lostSync();
       else
       {
-        expected_crc = crc16(&c, 1);
-        serial_msg.data.resize(received_length);
-        data_count = 0;
-        state = kPacketType;
+        expected_crc_ = crc_update(0xffff, c);
+        data_count_ = 0;
+        state_ = kPacketType;
       }
     }
-    else if(state == kPacketType)
+    else if(state_ == kPacketType)
     {
-      serial_msg.type = c;
-      expected_crc = crc_update(expected_crc, c);
-      if(received_length > 0)
-        state = kPacketData;
+      type_ = c;
+      expected_crc_ = crc_update(expected_crc_, c);
+      if(received_length_ > 0)
+        state_ = kPacketData;
       else
-        state = kPacketCRCL;
+        state_ = kPacketCRCL;
     }
-    else if(state == kPacketData)
+    else if(state_ == kPacketData)
     {
-      serial_msg.data[data_count] = c;
-      expected_crc = crc_update(expected_crc, c);
-      data_count++;
-      if(data_count == received_length)
-        state = kPacketCRCL;
+      // Take as much of the payload as this read has at once
+      const size_t n = std::min<size_t>(received_length_ - data_count_, count - i);
+      memcpy(&data_[data_count_], &data[i], n);
+      expected_crc_ = crc16(&data[i], n, expected_crc_);
+      data_count_ += n;
+      i += n - 1;
+      if(data_count_ == received_length_)
+        state_ = kPacketCRCL;
     }
-    else if(state == kPacketCRCL)
+    else if(state_ == kPacketCRCL)
     {
-      received_crc = c;
-      state = kPacketCRCH;
+      received_crc_ = c;
+      state_ = kPacketCRCH;
     }
-    else if(state == kPacketCRCH)
+    else if(state_ == kPacketCRCH)
     {
-      received_crc = received_crc + 256 * c;
-      if(expected_crc == received_crc)
+      received_crc_ = received_crc_ + 256 * c;
+      if(expected_crc_ == received_crc_)
       {
         // Received complete packet
-        callback(serial_msg);
+        packets_++;
+        hunting_ = false;
+        if(callback_)
+          callback_(type_, data_, received_length_);
+      }
+      else
+      {
+        crc_errors_++;
+        hunting_ = true;
       }
-      state = kPacketStart1;
+      state_ = kPacketStart1;
     }
     else
-      state = kPacketStart1;
-  }
-}
-
-// CRC-16-ITU-T
-static uint16_t crc_update(uint16_t crc, uint8_t data)
-{
-  uint16_t x = ((crc >> 8) ^ data);
-  x ^= x >> 4;
-
-  crc = (crc << 8) ^ (x << 12) ^ (x << 5) ^ x;
-
-  return crc;
-}
-
-static uint16_t crc16(const uint8_t *data, int count)
-{
-  uint16_t crc = 0xffff;
-
-  for(uint16_t i = 0; i < count; i++)
-  {
-    crc = crc_update(crc, data[i]);
+      lostSync();
   }
-  return crc;
 }
@@ -2,9 +2,83 @@
 #include <kr_serial_interface/decode_msgs.h>
 
 #include <Eigen/Geometry>
+#include <cmath>
+#include <cstring>
 
 namespace kr_mav_msgs
 {
+namespace
+{
+// Inverse of encodeQuaternion in encode_msgs.cpp
+void decodeQuaternion(const uint8_t *data, geometry_msgs::Quaternion &orientation)
+{
+  const uint32_t packed = data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+  const int largest = packed >> 30;
+
+  double q[4];
+  double sum = 0;
+  int shift = 20;
+  for(int i = 0; i < 4; i++)
+  {
+    if(i == largest)
+      continue;
+    q[i] = (((packed >> shift) & 0x3FF) / 1023.0 * 2 - 1) / M_SQRT2;
+    sum += q[i] * q[i];
+    shift -= 10;
+  }
+  q[largest] = std::sqrt(std::max(0.0, 1 - sum));
+
+  orientation.x = q[0];
+  orientation.y = q[1];
+  orientation.z = q[2];
+  orientation.w = q[3];
+}
+
+void decodeGainsInto(const struct SO3_GAINS &gains, kr_mav_msgs::SO3Command &so3_command)
+{
+  for(int i = 0; i < 3; i++)
+  {
+    so3_command.kR[i] = gains.kR[i] / 50.0;
+    so3_command.kOm[i] = gains.kOm[i] / 100.0;
+  }
+  so3_command.aux.kf_correction = gains.kf_correction / 1e11;
+  so3_command.aux.angle_corrections[0] = gains.angle_corrections[0] / 2500.0;
+  so3_command.aux.angle_corrections[1] = gains.angle_corrections[1] / 2500.0;
+}
+
+// Decodes the SO3_CMD_INPUT at data, which need not be aligned
+void decodeSO3CmdInput(const uint8_t *data, kr_mav_msgs::SO3Command &so3_command)
+{
+  struct SO3_CMD_INPUT so3_cmd;
+  memcpy(&so3_cmd, data, sizeof(so3_cmd));
+
+  so3_command.force.x = so3_cmd.force[0] / 500.0;
+  so3_command.force.y = so3_cmd.force[1] / 500.0;
+  so3_command.force.z = so3_cmd.force[2] / 500.0;
+
+  so3_command.orientation.x = so3_cmd.des_qx / 125.0;
+  so3_command.orientation.y = so3_cmd.des_qy / 125.0;
+  so3_command.orientation.z = so3_cmd.des_qz / 125.0;
+  so3_command.orientation.w = so3_cmd.des_qw / 125.0;
+
+  so3_command.angular_velocity.x = so3_cmd.angvel_x / 1000.0;
+  so3_command.angular_velocity.y = so3_cmd.angvel_y / 1000.0;
+  so3_command.angular_velocity.z = so3_cmd.angvel_z / 1000.0;
+
+  struct SO3_GAINS gains;
+  memcpy(gains.kR, so3_cmd.kR, sizeof(gains.kR));
+  memcpy(gains.kOm, so3_cmd.kOm, sizeof(gains.kOm));
+  gains.kf_correction = so3_cmd.kf_correction;
+  memcpy(gains.angle_corrections, so3_cmd.angle_corrections, sizeof(gains.angle_corrections));
+  decodeGainsInto(gains, so3_command);
+
+  so3_command.aux.current_yaw = so3_cmd.cur_yaw / 1e4;
+  so3_command.aux.enable_motors = so3_cmd.enable_motors;
+  so3_command.aux.use_external_yaw = so3_cmd.use_external_yaw;
+  so3_command.header.seq = so3_cmd.seq;
+}
+}  // namespace
+
 bool decodeOutputData(const std::vector<uint8_t> &data, kr_mav_msgs::OutputData &output)
 {
   struct OUTPUT_DATA output_data;
@@ -88,4 +162,78 @@ bool decodeStatusData(const std::vector<uint8_t> &data, kr_mav_msgs::StatusData
   return true;
 }
 
+bool decodeSO3Command(const std::vector<uint8_t> &data, kr_mav_msgs::SO3Command &so3_command)
+{
+  if(data.size() != sizeof(struct SO3_CMD_INPUT))
+    return false;
+  decodeSO3CmdInput(&data[0], so3_command);
+  return true;
+}
+
+bool decodeSO3MultiCommand(const std::vector<uint8_t> &data, uint8_t &slot,
+                           std::vector<std::pair<uint8_t, kr_mav_msgs::SO3Command>> &commands)
+{
+  struct SO3_MULTI_CMD_HEADER header;
+  const size_t entry_size = 1 + sizeof(struct SO3_CMD_INPUT);
+  if(data.size() < sizeof(header))
+    return false;
+  memcpy(&header, &data[0], sizeof(header));
+  if(data.size() != sizeof(header) + header.count * entry_size)
+    return false;
+
+  slot = header.slot;
+  commands.resize(header.count);
+  const uint8_t *entry = &data[sizeof(header)];
+  for(auto &command : commands)
+  {
+    command.first = entry[0];
+    decodeSO3CmdInput(entry + 1, command.second);
+    entry += entry_size;
+  }
+  return true;
+}
+
+SO3CompactDecoder::SO3CompactDecoder() : has_gains_(false), stale_gains_(0)
+{
+  memset(&gains_, 0, sizeof(gains_));
+}
+
+bool SO3CompactDecoder::decodeGains(const std::vector<uint8_t> &data)
+{
+  if(data.size() != sizeof(gains_))
+    return false;
+  memcpy(&gains_, &data[0], sizeof(gains_));
+  has_gains_ = true;
+  return true;
+}
+
+bool SO3CompactDecoder::decodeCommand(const std::vector<uint8_t> &data, kr_mav_msgs::SO3Command &so3_command)
+{
+  struct SO3_COMPACT_CMD so3_cmd;
+  if(!has_gains_ || data.size() != sizeof(so3_cmd))
+    return false;
+  memcpy(&so3_cmd, &data[0], sizeof(so3_cmd));
+
+  so3_command.force.x = so3_cmd.force[0] / 500.0;
+  so3_command.force.y = so3_cmd.force[1] / 500.0;
+  so3_command.force.z = so3_cmd.force[2] / 500.0;
+
+  decodeQuaternion(so3_cmd.des_q, so3_command.orientation);
+
+  so3_command.angular_velocity.x = so3_cmd.angvel_x / 1000.0;
+  so3_command.angular_velocity.y = so3_cmd.angvel_y / 1000.0;
+  so3_command.angular_velocity.z = so3_cmd.angvel_z / 1000.0;
+
+  if(so3_cmd.gains_seq != gains_.gains_seq)
+    stale_gains_++;
+  decodeGainsInto(gains_, so3_command);
+
+  so3_command.aux.current_yaw = so3_cmd.cur_yaw / 1e4;
+  so3_command.aux.enable_motors = so3_cmd.enable_motors;
+  so3_command.aux.use_external_yaw = so3_cmd.use_external_yaw;
+  so3_command.header.seq = so3_cmd.seq;
+
+  return true;
+}
+
 }  // namespace kr_mav_msgs
@@ -3,6 +3,8 @@
 #include <ros/console.h>
 
 #include <boost/numeric/conversion/cast.hpp>
+#include <cmath>
+#include <cstring>
 #include <limits>
 
 namespace kr_mav_msgs
@@ -30,12 +32,47 @@ removeref<Target> saturation_cast(Source const src, char const *variable_name =
     return std::numeric_limits<removeref<Target>>::max();
   }
 }
+
+// Smallest three encoding of a quaternion, see SO3_COMPACT_CMD
+void encodeQuaternion(const geometry_msgs::Quaternion &orientation, uint8_t *output)
+{
+  double q[4] = {orientation.x, orientation.y, orientation.z, orientation.w};
+  const double norm = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+  if(norm < 1e-6)
+  {
+    q[0] = q[1] = q[2] = 0;
+    q[3] = 1;
+  }
+
+  int largest = 0;
+  for(int i = 1; i < 4; i++)
+  {
+    if(std::abs(q[i]) > std::abs(q[largest]))
+      largest = i;
+  }
+  // q and -q are the same rotation
+  const double scale = (q[largest] < 0 ? -1 : 1) / (norm < 1e-6 ? 1 : norm);
+
+  uint32_t packed = static_cast<uint32_t>(largest) << 30;
+  int shift = 20;
+  for(int i = 0; i < 4; i++)
+  {
+    if(i == largest)
+      continue;
+    const double v = (q[i] * scale * M_SQRT2 + 1) / 2 * 1023;
+    packed |= static_cast<uint32_t>(std::min(std::max(std::lround(v), 0L), 1023L)) << shift;
+    shift -= 10;
+  }
+
+  for(int i = 0; i < 4; i++)
+    output[i] = (packed >> (8 * i)) & 0xFF;
+}
 }  // namespace
 
 // NOTE(Kartik): Macro needed in order to get the tgt variable name as a string
 #define SATURATE_CAST(tgt, src) tgt = saturation_cast<decltype(tgt)>(src, #tgt)
 
-void encodeSO3Command(const kr_mav_msgs::SO3Command &so3_command, std::vector<uint8_t> &output)
+size_t encodeSO3Command(const kr_mav_msgs::SO3Command &so3_command, uint8_t *output)
 {
   struct SO3_CMD_INPUT so3_cmd_input;
 
@@ -71,11 +108,40 @@ void encodeSO3Command(const kr_mav_msgs::SO3Command &so3_command, std::vector<ui
 
   so3_cmd_input.seq = so3_command.header.seq % 255;
 
-  output.resize(sizeof(so3_cmd_input));
-  memcpy(&output[0], &so3_cmd_input, sizeof(so3_cmd_input));
+  memcpy(output, &so3_cmd_input, sizeof(so3_cmd_input));
+  return sizeof(so3_cmd_input);
 }
 
-void encodeTRPYCommand(const kr_mav_msgs::TRPYCommand &trpy_command, std::vector<uint8_t> &output)
+void encodeSO3Command(const kr_mav_msgs::SO3Command &so3_command, std::vector<uint8_t> &output)
+{
+  output.resize(sizeof(struct SO3_CMD_INPUT));
+  encodeSO3Command(so3_command, output.data());
+}
+
+size_t so3MultiCommandSize(size_t count)
+{
+  return sizeof(struct SO3_MULTI_CMD_HEADER) + count * (1 + sizeof(struct SO3_CMD_INPUT));
+}
+
+size_t encodeSO3MultiCommand(uint8_t slot, const std::vector<std::pair<uint8_t, const uint8_t *>> &entries,
+                             uint8_t *output)
+{
+  struct SO3_MULTI_CMD_HEADER header;
+  header.slot = slot;
+  header.count = entries.size();
+  memcpy(output, &header, sizeof(header));
+
+  uint8_t *entry = output + sizeof(header);
+  for(const auto &e : entries)
+  {
+    entry[0] = e.first;
+    memcpy(entry + 1, e.second, sizeof(struct SO3_CMD_INPUT));
+    entry += 1 + sizeof(struct SO3_CMD_INPUT);
+  }
+  return entry - output;
+}
+
+size_t encodeTRPYCommand(const kr_mav_msgs::TRPYCommand &trpy_command, uint8_t *output)
 {
   struct TRPY_CMD trpy_cmd_input;
 
@@ -88,18 +154,97 @@ void encodeTRPYCommand(const kr_mav_msgs::TRPYCommand &trpy_command, std::vector
   trpy_cmd_input.enable_motors = trpy_command.aux.enable_motors;
   trpy_cmd_input.use_external_yaw = trpy_command.aux.use_external_yaw;
 
-  output.resize(sizeof(trpy_cmd_input));
-  memcpy(&output[0], &trpy_cmd_input, sizeof(trpy_cmd_input));
+  memcpy(output, &trpy_cmd_input, sizeof(trpy_cmd_input));
+  return sizeof(trpy_cmd_input);
 }
 
-void encodePWMCommand(const kr_mav_msgs::PWMCommand &pwm_command, std::vector<uint8_t> &output)
+void encodeTRPYCommand(const kr_mav_msgs::TRPYCommand &trpy_command, std::vector<uint8_t> &output)
+{
+  output.resize(sizeof(struct TRPY_CMD));
+  encodeTRPYCommand(trpy_command, output.data());
+}
+
+size_t encodePWMCommand(const kr_mav_msgs::PWMCommand &pwm_command, uint8_t *output)
 {
   struct PWM_CMD_INPUT pwm_cmd_input;
 
   SATURATE_CAST(pwm_cmd_input.pwm[0], pwm_command.pwm[0] * 255);
   SATURATE_CAST(pwm_cmd_input.pwm[1], pwm_command.pwm[1] * 255);
 
-  output.resize(sizeof(pwm_cmd_input));
-  memcpy(&output[0], &pwm_cmd_input, sizeof(pwm_cmd_input));
+  memcpy(output, &pwm_cmd_input, sizeof(pwm_cmd_input));
+  return sizeof(pwm_cmd_input);
+}
+
+void encodePWMCommand(const kr_mav_msgs::PWMCommand &pwm_command, std::vector<uint8_t> &output)
+{
+  output.resize(sizeof(struct PWM_CMD_INPUT));
+  encodePWMCommand(pwm_command, output.data());
+}
+
+SO3CompactEncoder::SO3CompactEncoder(unsigned int gains_period)
+    : gains_sent_(false), gains_period_(gains_period), commands_since_gains_(0)
+{
+  memset(&gains_, 0, sizeof(gains_));
+}
+
+size_t SO3CompactEncoder::encodeGains(const kr_mav_msgs::SO3Command &so3_command, uint8_t *output)
+{
+  // Zeroed so the padding compares equal
+  struct SO3_GAINS gains;
+  memset(&gains, 0, sizeof(gains));
+
+  SATURATE_CAST(gains.kR[0], so3_command.kR[0] * 50);
+  SATURATE_CAST(gains.kR[1], so3_command.kR[1] * 50);
+  SATURATE_CAST(gains.kR[2], so3_command.kR[2] * 50);
+
+  SATURATE_CAST(gains.kOm[0], so3_command.kOm[0] * 100);
+  SATURATE_CAST(gains.kOm[1], so3_command.kOm[1] * 100);
+  SATURATE_CAST(gains.kOm[2], so3_command.kOm[2] * 100);
+
+  SATURATE_CAST(gains.kf_correction, so3_command.aux.kf_correction * 1e11f);
+  SATURATE_CAST(gains.angle_corrections[0], so3_command.aux.angle_corrections[0] * 2500);
+  SATURATE_CAST(gains.angle_corrections[1], so3_command.aux.angle_corrections[1] * 2500);
+
+  // Compared after quantization, so noise below the resolution does not count as a change
+  gains.gains_seq = gains_.gains_seq;
+  const bool changed = memcmp(&gains, &gains_, sizeof(gains)) != 0;
+  if(gains_sent_ && !changed && commands_since_gains_ < gains_period_)
+    return 0;
+
+  if(changed)
+    gains.gains_seq++;
+  gains_ = gains;
+  gains_sent_ = true;
+  commands_since_gains_ = 0;
+
+  memcpy(output, &gains_, sizeof(gains_));
+  return sizeof(gains_);
+}
+
+size_t SO3CompactEncoder::encodeCommand(const kr_mav_msgs::SO3Command &so3_command, uint8_t *output)
+{
+  struct SO3_COMPACT_CMD so3_cmd;
+
+  SATURATE_CAST(so3_cmd.force[0], so3_command.force.x * 500);
+  SATURATE_CAST(so3_cmd.force[1], so3_command.force.y * 500);
+  SATURATE_CAST(so3_cmd.force[2], so3_command.force.z * 500);
+
+  encodeQuaternion(so3_command.orientation, so3_cmd.des_q);
+
+  SATURATE_CAST(so3_cmd.angvel_x, so3_command.angular_velocity.x * 1000);
+  SATURATE_CAST(so3_cmd.angvel_y, so3_command.angular_velocity.y * 1000);
+  SATURATE_CAST(so3_cmd.angvel_z, so3_command.angular_velocity.z * 1000);
+
+  SATURATE_CAST(so3_cmd.cur_yaw, so3_command.aux.current_yaw * 1e4f);
+
+  so3_cmd.enable_motors = so3_command.aux.enable_motors;
+  so3_cmd.use_external_yaw = so3_command.aux.use_external_yaw;
+
+  so3_cmd.gains_seq = gains_.gains_seq;
+  so3_cmd.seq = so3_command.header.seq % 255;
+  commands_since_gains_++;
+
+  memcpy(output, &so3_cmd, sizeof(so3_cmd));
+  return sizeof(so3_cmd);
 }
 }  // namespace kr_mav_msgs
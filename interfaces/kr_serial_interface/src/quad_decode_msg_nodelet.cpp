@@ -1,5 +1,6 @@
 #include <kr_mav_msgs/Serial.h>
 #include <kr_serial_interface/decode_msgs.h>
+#include <kr_serial_interface/seq_clock_sync.h>
 #include <nodelet/nodelet.h>
 #include <ros/ros.h>
 #include <sensor_msgs/Imu.h>
@@ -13,6 +14,8 @@ class QuadDecodeMsg : public nodelet::Nodelet
   void serial_callback(const kr_mav_msgs::Serial::ConstPtr &msg);
   ros::Publisher output_data_pub_, imu_output_pub_, status_pub_;
   ros::Subscriber serial_sub_;
+  bool sync_seq_clock_;
+  SeqClockSync output_data_clock_;
 };
 
 void QuadDecodeMsg::serial_callback(const kr_mav_msgs::Serial::ConstPtr &msg)
@@ -24,7 +27,9 @@ void QuadDecodeMsg::serial_callback(const kr_mav_msgs::Serial::ConstPtr &msg)
 
     if(kr_mav_msgs::decodeOutputData(msg->data, *output_msg))
     {
-      output_msg->header.stamp = msg->header.stamp;
+      // The arrival time has the buffering jitter of the link, the seq gives the time of the sample
+      output_msg->header.stamp =
+          sync_seq_clock_ ? output_data_clock_.update(output_msg->seq, msg->header.stamp) : msg->header.stamp;
       output_msg->header.frame_id = "/quadrotor";
       output_data_pub_.publish(output_msg);
 
@@ -51,6 +56,11 @@ void QuadDecodeMsg::onInit(void)
 {
   ros::NodeHandle priv_nh(getPrivateNodeHandle());
 
+  priv_nh.param("sync_seq_clock", sync_seq_clock_, true);
+  double clock_sync_window;
+  priv_nh.param("clock_sync_window", clock_sync_window, 200.0);
+  output_data_clock_ = SeqClockSync(clock_sync_window);
+
   output_data_pub_ = priv_nh.advertise<kr_mav_msgs::OutputData>("output_data", 10);
   imu_output_pub_ = priv_nh.advertise<sensor_msgs::Imu>("imu", 10);
   status_pub_ = priv_nh.advertise<kr_mav_msgs::StatusData>("status", 10);
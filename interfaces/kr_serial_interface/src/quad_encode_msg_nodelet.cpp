@@ -20,10 +20,36 @@ class QuadEncodeMsg : public nodelet::Nodelet
   ros::Subscriber trpy_cmd_sub_;
   ros::Subscriber pwm_cmd_sub_;
   int channel_;
+  bool compact_so3_cmd_;
+  kr_mav_msgs::SO3CompactEncoder so3_encoder_;
 };
 
 void QuadEncodeMsg::so3_cmd_callback(const kr_mav_msgs::SO3Command::ConstPtr &msg)
 {
+  if(compact_so3_cmd_)
+  {
+    kr_mav_msgs::Serial::Ptr gains_msg(new kr_mav_msgs::Serial);
+    gains_msg->data.resize(sizeof(SO3_GAINS));
+    if(so3_encoder_.encodeGains(*msg, gains_msg->data.data()) > 0)
+    {
+      gains_msg->header.seq = msg->header.seq;
+      gains_msg->channel = channel_;
+      gains_msg->type = kr_mav_msgs::Serial::SO3_GAINS;
+      gains_msg->header.stamp = ros::Time::now();
+      serial_msg_pub_.publish(gains_msg);
+    }
+
+    kr_mav_msgs::Serial::Ptr serial_msg(new kr_mav_msgs::Serial);
+    serial_msg->header.seq = msg->header.seq;
+    serial_msg->channel = channel_;
+    serial_msg->type = kr_mav_msgs::Serial::SO3_COMPACT_CMD;
+    serial_msg->data.resize(sizeof(SO3_COMPACT_CMD));
+    so3_encoder_.encodeCommand(*msg, serial_msg->data.data());
+    serial_msg->header.stamp = ros::Time::now();
+    serial_msg_pub_.publish(serial_msg);
+    return;
+  }
+
   kr_mav_msgs::Serial::Ptr serial_msg(new kr_mav_msgs::Serial);
   serial_msg->header.seq = msg->header.seq;
   serial_msg->channel = channel_;
@@ -66,6 +92,9 @@ void QuadEncodeMsg::onInit(void)
 
   priv_nh.param("channel", channel_, 0);
 
+  // Send the gains and corrections only when they change, for low bandwidth links
+  priv_nh.param("compact_so3_cmd", compact_so3_cmd_, false);
+
   serial_msg_pub_ = priv_nh.advertise<kr_mav_msgs::Serial>("serial_msg", 10);
 
   so3_cmd_sub_ =
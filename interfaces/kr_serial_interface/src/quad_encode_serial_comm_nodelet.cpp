@@ -0,0 +1,175 @@
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <kr_flight_recorder/records.h>
+#include <kr_mav_msgs/PWMCommand.h>
+#include <kr_mav_msgs/SO3Command.h>
+#include <kr_mav_msgs/Serial.h>
+#include <kr_mav_msgs/TRPYCommand.h>
+#include <kr_serial_interface/ASIOSerialDevice.h>
+#include <kr_serial_interface/comm_types.h>
+#include <kr_serial_interface/encode_msgs.h>
+#include <kr_serial_interface/serial_capture.h>
+#include <kr_serial_interface/serial_interface.h>
+#include <kr_serial_interface/serial_link_stats.h>
+#include <nodelet/nodelet.h>
+#include <ros/ros.h>
+
+#include <memory>
+
+// QuadEncodeMsg and QuadSerialComm in one nodelet: the commands are encoded straight into the frame written to the
+// serial port, without the Serial message in between. The packets received from the robot are published as by
+// QuadSerialComm.
+class QuadEncodeSerialComm : public nodelet::Nodelet
+{
+ public:
+  void onInit(void);
+  ~QuadEncodeSerialComm();
+
+ private:
+  void so3_cmd_callback(const kr_mav_msgs::SO3Command::ConstPtr &msg);
+  void trpy_cmd_callback(const kr_mav_msgs::TRPYCommand::ConstPtr &msg);
+  void pwm_cmd_callback(const kr_mav_msgs::PWMCommand::ConstPtr &msg);
+  void send_frame(const ros::Time &stamp, uint8_t type, size_t data_length);
+  void packet_callback(uint8_t type, const uint8_t *data, size_t length);
+  void serial_read_callback(const unsigned char *data, size_t count);
+  void link_diagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void diagnostics_timer_callback(const ros::TimerEvent &e);
+
+  ASIOSerialDevice sd_;
+  SerialPacketParser parser_;
+  std::unique_ptr<SerialLinkStats> stats_;
+  std::unique_ptr<diagnostic_updater::Updater> updater_;
+  ros::Timer diagnostics_timer_;
+  SerialCapture capture_;
+  ros::Publisher output_data_pub_;
+  ros::Subscriber so3_cmd_sub_, trpy_cmd_sub_, pwm_cmd_sub_;
+  bool compact_so3_cmd_;
+  kr_mav_msgs::SO3CompactEncoder so3_encoder_;
+
+  // The callbacks run one at a time on the nodelet queue, so they share the frame
+  uint8_t frame_[kPacketOverhead + kPacketDataMaxSize];
+};
+
+static_assert(sizeof(SO3_CMD_INPUT) <= kPacketDataMaxSize && sizeof(TRPY_CMD) <= kPacketDataMaxSize &&
+                  sizeof(PWM_CMD_INPUT) <= kPacketDataMaxSize && sizeof(SO3_COMPACT_CMD) <= kPacketDataMaxSize &&
+                  sizeof(SO3_GAINS) <= kPacketDataMaxSize,
+              "The commands have to fit in a packet");
+
+void QuadEncodeSerialComm::so3_cmd_callback(const kr_mav_msgs::SO3Command::ConstPtr &msg)
+{
+  if(compact_so3_cmd_)
+  {
+    const size_t gains_size = so3_encoder_.encodeGains(*msg, &frame_[kPacketDataOffset]);
+    if(gains_size > 0)
+      send_frame(msg->header.stamp, kr_mav_msgs::Serial::SO3_GAINS, gains_size);
+    send_frame(msg->header.stamp, kr_mav_msgs::Serial::SO3_COMPACT_CMD,
+               so3_encoder_.encodeCommand(*msg, &frame_[kPacketDataOffset]));
+    return;
+  }
+
+  send_frame(msg->header.stamp, kr_mav_msgs::Serial::SO3_CMD,
+             kr_mav_msgs::encodeSO3Command(*msg, &frame_[kPacketDataOffset]));
+}
+
+void QuadEncodeSerialComm::trpy_cmd_callback(const kr_mav_msgs::TRPYCommand::ConstPtr &msg)
+{
+  send_frame(msg->header.stamp, kr_mav_msgs::Serial::TRPY_CMD,
+             kr_mav_msgs::encodeTRPYCommand(*msg, &frame_[kPacketDataOffset]));
+}
+
+void QuadEncodeSerialComm::pwm_cmd_callback(const kr_mav_msgs::PWMCommand::ConstPtr &msg)
+{
+  send_frame(msg->header.stamp, kr_mav_msgs::Serial::PWM_CMD,
+             kr_mav_msgs::encodePWMCommand(*msg, &frame_[kPacketDataOffset]));
+}
+
+void QuadEncodeSerialComm::send_frame(const ros::Time &stamp, uint8_t type, size_t data_length)
+{
+  const size_t size = frame_serial_packet(type, data_length, frame_);
+  stats_->sent(type, &frame_[kPacketDataOffset], data_length);
+  capture_.record(stamp.isZero() ? ros::Time::now() : stamp, kr_flight_recorder::FRAME_SENT, type, 0,
+                  &frame_[kPacketDataOffset], data_length);
+  if(!sd_.Write(frame_, size))
+    NODELET_WARN_THROTTLE(1, "Serial write dropped, %zu so far", sd_.DroppedWrites());
+}
+
+void QuadEncodeSerialComm::packet_callback(uint8_t type, const uint8_t *data, size_t length)
+{
+  kr_mav_msgs::Serial::Ptr msg(new kr_mav_msgs::Serial);
+  msg->header.stamp = ros::Time::now();
+  msg->type = type;
+  msg->data.assign(data, data + length);
+  output_data_pub_.publish(msg);
+  stats_->received(type, data, length);
+  capture_.record(msg->header.stamp, kr_flight_recorder::FRAME_RECEIVED, type, 0, data, length);
+}
+
+void QuadEncodeSerialComm::serial_read_callback(const unsigned char *data, size_t count)
+{
+  parser_.process(data, count);
+  stats_->read(count, parser_);
+}
+
+void QuadEncodeSerialComm::link_diagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat)
+{
+  stats_->diagnostics(stat, sd_.GetWriteStats());
+}
+
+void QuadEncodeSerialComm::diagnostics_timer_callback(const ros::TimerEvent &e)
+{
+  updater_->update();
+}
+
+void QuadEncodeSerialComm::onInit(void)
+{
+  ros::NodeHandle n(getPrivateNodeHandle());
+
+  std::string device;
+  n.param("device", device, std::string("/dev/ttyUSB0"));
+
+  int baud_rate;
+  n.param("baud_rate", baud_rate, 57600);
+
+  int read_buffer_size;
+  n.param("read_buffer_size", read_buffer_size, DEFAULT_READ_BUFFER_SIZE);
+
+  sd_.Open(device, baud_rate);
+  sd_.SetReadBufferSize(read_buffer_size);
+
+  double max_write_latency;
+  n.param("max_write_latency", max_write_latency, DEFAULT_MAX_WRITE_LATENCY);
+  sd_.SetMaxWriteLatency(max_write_latency);
+
+  // Send the gains and corrections only when they change, for low bandwidth links
+  n.param("compact_so3_cmd", compact_so3_cmd_, false);
+
+  stats_.reset(new SerialLinkStats(baud_rate));
+  updater_.reset(new diagnostic_updater::Updater(getNodeHandle(), n, getName()));
+  updater_->setHardwareID(device);
+  updater_->add("Serial link", this, &QuadEncodeSerialComm::link_diagnostics);
+  diagnostics_timer_ = n.createTimer(ros::Duration(1.0), &QuadEncodeSerialComm::diagnostics_timer_callback, this);
+
+  // Binary record of the packets both ways, decoded offline with serial_capture_to_csv
+  capture_.open(n);
+
+  output_data_pub_ = n.advertise<kr_mav_msgs::Serial>("from_robot", 10);
+
+  so3_cmd_sub_ =
+      n.subscribe("so3_cmd", 10, &QuadEncodeSerialComm::so3_cmd_callback, this, ros::TransportHints().tcpNoDelay());
+  trpy_cmd_sub_ =
+      n.subscribe("trpy_cmd", 10, &QuadEncodeSerialComm::trpy_cmd_callback, this, ros::TransportHints().tcpNoDelay());
+  pwm_cmd_sub_ =
+      n.subscribe("pwm_cmd", 10, &QuadEncodeSerialComm::pwm_cmd_callback, this, ros::TransportHints().tcpNoDelay());
+
+  parser_.setCallback(boost::bind(&QuadEncodeSerialComm::packet_callback, this, _1, _2, _3));
+  sd_.SetReadCallback(boost::bind(&QuadEncodeSerialComm::serial_read_callback, this, _1, _2));
+  sd_.Start();
+}
+
+QuadEncodeSerialComm::~QuadEncodeSerialComm()
+{
+  sd_.Close();
+  sd_.Stop();
+}
+
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(QuadEncodeSerialComm, nodelet::Nodelet);
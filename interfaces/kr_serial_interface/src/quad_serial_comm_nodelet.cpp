@@ -1,9 +1,15 @@
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <kr_flight_recorder/records.h>
 #include <kr_mav_msgs/Serial.h>
 #include <kr_serial_interface/ASIOSerialDevice.h>
+#include <kr_serial_interface/serial_capture.h>
 #include <kr_serial_interface/serial_interface.h>
+#include <kr_serial_interface/serial_link_stats.h>
 #include <nodelet/nodelet.h>
 #include <ros/ros.h>
 
+#include <memory>
+
 class QuadSerialComm : public nodelet::Nodelet
 {
  public:
@@ -12,32 +18,63 @@ class QuadSerialComm : public nodelet::Nodelet
 
  private:
   void serial_callback(const kr_mav_msgs::Serial::ConstPtr &msg);
-  void output_data_callback(kr_mav_msgs::Serial &msg);
+  void packet_callback(uint8_t type, const uint8_t *data, size_t length);
   void serial_read_callback(const unsigned char *data, size_t count);
+  void link_diagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void diagnostics_timer_callback(const ros::TimerEvent &e);
 
   ASIOSerialDevice sd_;
+  SerialPacketParser parser_;
+  std::unique_ptr<SerialLinkStats> stats_;
+  std::unique_ptr<diagnostic_updater::Updater> updater_;
+  ros::Timer diagnostics_timer_;
+  SerialCapture capture_;
+  std::vector<unsigned char> serial_msg_;
   ros::Publisher output_data_pub_;
   ros::Subscriber serial_sub_;
 };
 
 void QuadSerialComm::serial_callback(const kr_mav_msgs::Serial::ConstPtr &msg)
 {
-  std::vector<unsigned char> serial_msg;
+  // The buffer is kept, so no allocation is needed once it has grown to the largest message
+  encode_serial_msg(*msg, serial_msg_);
+  if(serial_msg_.empty())
+    return;
 
-  encode_serial_msg(*msg, serial_msg);
+  stats_->sent(msg->type, msg->data.data(), msg->data.size());
+  capture_.record(msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp, kr_flight_recorder::FRAME_SENT,
+                  msg->type, msg->channel, msg->data.data(), msg->data.size());
 
-  sd_.Write(serial_msg);
+  if(!sd_.Write(serial_msg_))
+    NODELET_WARN_THROTTLE(1, "Serial write dropped, %zu so far", sd_.DroppedWrites());
 }
 
-void QuadSerialComm::output_data_callback(kr_mav_msgs::Serial &msg)
+void QuadSerialComm::packet_callback(uint8_t type, const uint8_t *data, size_t length)
 {
-  msg.header.stamp = ros::Time::now();
+  // Published as a pointer, so the nodelets in the same manager get it without a copy
+  kr_mav_msgs::Serial::Ptr msg(new kr_mav_msgs::Serial);
+  msg->header.stamp = ros::Time::now();
+  msg->type = type;
+  msg->data.assign(data, data + length);
   output_data_pub_.publish(msg);
+  stats_->received(type, data, length);
+  capture_.record(msg->header.stamp, kr_flight_recorder::FRAME_RECEIVED, type, 0, data, length);
 }
 
 void QuadSerialComm::serial_read_callback(const unsigned char *data, size_t count)
 {
-  process_serial_data(data, count, boost::bind(&QuadSerialComm::output_data_callback, this, _1));
+  parser_.process(data, count);
+  stats_->read(count, parser_);
+}
+
+void QuadSerialComm::link_diagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat)
+{
+  stats_->diagnostics(stat, sd_.GetWriteStats());
+}
+
+void QuadSerialComm::diagnostics_timer_callback(const ros::TimerEvent &e)
+{
+  updater_->update();
 }
 
 void QuadSerialComm::onInit(void)
@@ -50,12 +87,30 @@ void QuadSerialComm::onInit(void)
   int baud_rate;
   n.param("baud_rate", baud_rate, 57600);
 
+  int read_buffer_size;
+  n.param("read_buffer_size", read_buffer_size, DEFAULT_READ_BUFFER_SIZE);
+
   sd_.Open(device, baud_rate);
+  sd_.SetReadBufferSize(read_buffer_size);
+
+  double max_write_latency;
+  n.param("max_write_latency", max_write_latency, DEFAULT_MAX_WRITE_LATENCY);
+  sd_.SetMaxWriteLatency(max_write_latency);
+
+  stats_.reset(new SerialLinkStats(baud_rate));
+  updater_.reset(new diagnostic_updater::Updater(getNodeHandle(), n, getName()));
+  updater_->setHardwareID(device);
+  updater_->add("Serial link", this, &QuadSerialComm::link_diagnostics);
+  diagnostics_timer_ = n.createTimer(ros::Duration(1.0), &QuadSerialComm::diagnostics_timer_callback, this);
+
+  // Binary record of the packets both ways, decoded offline with serial_capture_to_csv
+  capture_.open(n);
 
   output_data_pub_ = n.advertise<kr_mav_msgs::Serial>("from_robot", 10);
 
   serial_sub_ = n.subscribe("to_robot", 10, &QuadSerialComm::serial_callback, this, ros::TransportHints().tcpNoDelay());
 
+  parser_.setCallback(boost::bind(&QuadSerialComm::packet_callback, this, _1, _2, _3));
   sd_.SetReadCallback(boost::bind(&QuadSerialComm::serial_read_callback, this, _1, _2));
   sd_.Start();
 }
@@ -0,0 +1,186 @@
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <kr_flight_recorder/records.h>
+#include <kr_mav_msgs/Serial.h>
+#include <kr_serial_interface/ASIOSerialDevice.h>
+#include <kr_serial_interface/serial_capture.h>
+#include <kr_serial_interface/serial_interface.h>
+#include <kr_serial_interface/serial_link_stats.h>
+#include <nodelet/nodelet.h>
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <string>
+
+// QuadSerialComm for a list of serial devices, e.g. the radios of a base station, all read and written by the threads
+// of one SerialIOService. The topics of each device are under its name: <name>/to_robot and <name>/from_robot. With
+// the capture_file param, each device is captured to its own file, capture_<name>.log for capture.log. A device
+// which cannot be opened is skipped, the others are still served.
+//
+// The vehicles sharing one of the radios are multiplexed by a QuadSerialMux in front of it, a separate nodelet in the
+// same manager with its to_robot_out remapped to <name>/to_robot.
+class QuadSerialMultiComm : public nodelet::Nodelet
+{
+ public:
+  void onInit(void);
+  ~QuadSerialMultiComm();
+
+ private:
+  struct Link
+  {
+    std::string name;
+    std::unique_ptr<ASIOSerialDevice> sd;
+    SerialPacketParser parser;
+    std::unique_ptr<SerialLinkStats> stats;
+    SerialCapture capture;
+    std::vector<unsigned char> serial_msg;
+    ros::Publisher output_data_pub;
+    ros::Subscriber serial_sub;
+  };
+
+  void serial_callback(const kr_mav_msgs::Serial::ConstPtr &msg, Link *link);
+  void packet_callback(Link *link, uint8_t type, const uint8_t *data, size_t length);
+  void serial_read_callback(Link *link, const unsigned char *data, size_t count);
+  void link_diagnostics(Link *link, diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void diagnostics_timer_callback(const ros::TimerEvent &e);
+
+  std::shared_ptr<SerialIOService> io_service_;
+  std::vector<std::unique_ptr<Link>> links_;
+  std::unique_ptr<diagnostic_updater::Updater> updater_;
+  ros::Timer diagnostics_timer_;
+};
+
+void QuadSerialMultiComm::serial_callback(const kr_mav_msgs::Serial::ConstPtr &msg, Link *link)
+{
+  // Each link has its own subscriber, so one callback at a time uses its buffer
+  encode_serial_msg(*msg, link->serial_msg);
+  if(link->serial_msg.empty())
+    return;
+
+  link->stats->sent(msg->type, msg->data.data(), msg->data.size());
+  link->capture.record(msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp,
+                       kr_flight_recorder::FRAME_SENT, msg->type, msg->channel, msg->data.data(), msg->data.size());
+  if(!link->sd->Write(link->serial_msg))
+    NODELET_WARN_THROTTLE(1, "Serial write dropped on %s, %zu so far", link->name.c_str(), link->sd->DroppedWrites());
+}
+
+void QuadSerialMultiComm::packet_callback(Link *link, uint8_t type, const uint8_t *data, size_t length)
+{
+  kr_mav_msgs::Serial::Ptr msg(new kr_mav_msgs::Serial);
+  msg->header.stamp = ros::Time::now();
+  msg->type = type;
+  msg->data.assign(data, data + length);
+  link->output_data_pub.publish(msg);
+  link->stats->received(type, data, length);
+  link->capture.record(msg->header.stamp, kr_flight_recorder::FRAME_RECEIVED, type, 0, data, length);
+}
+
+void QuadSerialMultiComm::serial_read_callback(Link *link, const unsigned char *data, size_t count)
+{
+  link->parser.process(data, count);
+  link->stats->read(count, link->parser);
+}
+
+void QuadSerialMultiComm::link_diagnostics(Link *link, diagnostic_updater::DiagnosticStatusWrapper &stat)
+{
+  link->stats->diagnostics(stat, link->sd->GetWriteStats());
+}
+
+void QuadSerialMultiComm::diagnostics_timer_callback(const ros::TimerEvent &e)
+{
+  updater_->update();
+}
+
+void QuadSerialMultiComm::onInit(void)
+{
+  ros::NodeHandle n(getPrivateNodeHandle());
+
+  std::vector<std::string> devices, names;
+  n.getParam("devices", devices);
+  n.getParam("names", names);
+  if(devices.empty())
+  {
+    NODELET_ERROR("No serial devices given in the devices param");
+    return;
+  }
+  if(!names.empty() && names.size() != devices.size())
+  {
+    NODELET_ERROR("The names param needs a name for each of the %zu devices", devices.size());
+    return;
+  }
+
+  int baud_rate;
+  n.param("baud_rate", baud_rate, 57600);
+
+  int read_buffer_size;
+  n.param("read_buffer_size", read_buffer_size, DEFAULT_READ_BUFFER_SIZE);
+
+  double max_write_latency;
+  n.param("max_write_latency", max_write_latency, DEFAULT_MAX_WRITE_LATENCY);
+
+  // One thread is enough for a few serial links, the handlers only parse and publish
+  int io_threads;
+  n.param("io_threads", io_threads, 1);
+  io_service_ = std::make_shared<SerialIOService>(std::max(io_threads, 1));
+
+  updater_.reset(new diagnostic_updater::Updater(getNodeHandle(), n, getName()));
+  updater_->setHardwareID(getName());
+
+  for(size_t i = 0; i < devices.size(); i++)
+  {
+    std::unique_ptr<Link> link(new Link);
+    Link *l = link.get();
+    l->name = names.empty() ? "link" + std::to_string(i) : names[i];
+
+    l->sd.reset(new ASIOSerialDevice(io_service_));
+    try
+    {
+      l->sd->Open(devices[i], baud_rate);
+    }
+    catch(const std::exception &e)
+    {
+      NODELET_ERROR("Could not open %s for the link %s, skipping it: %s", devices[i].c_str(), l->name.c_str(),
+                    e.what());
+      continue;
+    }
+    l->sd->SetReadBufferSize(read_buffer_size);
+    l->sd->SetMaxWriteLatency(max_write_latency);
+    l->stats.reset(new SerialLinkStats(baud_rate));
+    l->capture.open(n, l->name);
+
+    ros::NodeHandle link_nh(n, l->name);
+    l->output_data_pub = link_nh.advertise<kr_mav_msgs::Serial>("from_robot", 10);
+    l->serial_sub = link_nh.subscribe<kr_mav_msgs::Serial>(
+        "to_robot", 10, boost::bind(&QuadSerialMultiComm::serial_callback, this, _1, l), ros::VoidConstPtr(),
+        ros::TransportHints().tcpNoDelay());
+    updater_->add("Serial link " + l->name + " (" + devices[i] + ")",
+                  boost::bind(&QuadSerialMultiComm::link_diagnostics, this, l, _1));
+
+    l->parser.setCallback(boost::bind(&QuadSerialMultiComm::packet_callback, this, l, _1, _2, _3));
+    l->sd->SetReadCallback(boost::bind(&QuadSerialMultiComm::serial_read_callback, this, l, _1, _2));
+    l->sd->Start();
+    links_.push_back(std::move(link));
+  }
+
+  if(links_.empty())
+  {
+    NODELET_ERROR("None of the %zu serial devices could be opened", devices.size());
+    return;
+  }
+
+  diagnostics_timer_ = n.createTimer(ros::Duration(1.0), &QuadSerialMultiComm::diagnostics_timer_callback, this);
+  NODELET_INFO("%zu of %zu serial devices on %d I/O threads", links_.size(), devices.size(), std::max(io_threads, 1));
+}
+
+QuadSerialMultiComm::~QuadSerialMultiComm()
+{
+  for(auto &link : links_)
+  {
+    link->sd->Close();
+    link->sd->Stop();
+  }
+}
+
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(QuadSerialMultiComm, nodelet::Nodelet);
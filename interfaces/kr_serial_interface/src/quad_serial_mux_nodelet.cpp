@@ -0,0 +1,172 @@
+#include <kr_mav_msgs/Serial.h>
+#include <kr_serial_interface/comm_types.h>
+#include <kr_serial_interface/encode_msgs.h>
+#include <kr_serial_interface/serial_interface.h>
+#include <nodelet/nodelet.h>
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+// Several vehicles sharing one radio: the SO3 commands of all the vehicles, told apart by their channel, arrive on
+// to_robot_in. Only the latest command of each channel is kept, and once per time slot the kept commands are packed
+// into SO3_MULTI_CMD packets, earliest deadline first, as much as the link can carry in a slot. Commands which could
+// not be sent before they got older than max_command_age are dropped rather than sent late. Other messages are
+// passed through as they come, the bytes they take on the link are taken from the next slots. The packets go to
+// to_robot_out, for QuadSerialComm to send.
+class QuadSerialMux : public nodelet::Nodelet
+{
+ public:
+  void onInit(void);
+
+ private:
+  struct PendingCommand
+  {
+    bool valid;
+    ros::Time deadline;
+    uint8_t data[sizeof(SO3_CMD_INPUT)];
+  };
+
+  void serial_callback(const kr_mav_msgs::Serial::ConstPtr &msg);
+  void slot_callback(const ros::TimerEvent &e);
+
+  ros::Publisher serial_pub_;
+  ros::Subscriber serial_sub_;
+  ros::Timer slot_timer_;
+
+  std::array<PendingCommand, 256> pending_;
+  std::vector<uint8_t> schedule_;
+  std::vector<std::pair<uint8_t, const uint8_t *>> entries_;
+  ros::Duration max_command_age_;
+  size_t slot_bytes_;
+  // Bytes of the messages passed through not yet taken from a slot
+  size_t passthrough_bytes_;
+  uint8_t slot_;
+  unsigned int replaced_, stale_;
+};
+
+static const size_t kMultiEntrySize = 1 + sizeof(SO3_CMD_INPUT);
+static const size_t kMultiMaxEntries = (kPacketDataMaxSize - sizeof(SO3_MULTI_CMD_HEADER)) / kMultiEntrySize;
+
+static_assert(kMultiMaxEntries > 0, "An SO3 command has to fit in a multi command packet");
+static_assert(kMultiMaxEntries <= 255, "The count of a multi command packet is a byte");
+
+void QuadSerialMux::serial_callback(const kr_mav_msgs::Serial::ConstPtr &msg)
+{
+  if(msg->type != kr_mav_msgs::Serial::SO3_CMD || msg->data.size() != sizeof(SO3_CMD_INPUT))
+  {
+    passthrough_bytes_ += kPacketOverhead + msg->data.size();
+    serial_pub_.publish(msg);
+    return;
+  }
+
+  PendingCommand &cmd = pending_[msg->channel];
+  if(cmd.valid)
+    replaced_++;
+  const ros::Time stamp = msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp;
+  cmd.valid = true;
+  cmd.deadline = stamp + max_command_age_;
+  memcpy(cmd.data, msg->data.data(), sizeof(cmd.data));
+}
+
+void QuadSerialMux::slot_callback(const ros::TimerEvent &e)
+{
+  const ros::Time now = ros::Time::now();
+
+  // The link time the passed through messages took is not available to the commands, what exceeds a slot is taken
+  // from the following ones
+  size_t budget = slot_bytes_;
+  const size_t charged = std::min(budget, passthrough_bytes_);
+  budget -= charged;
+  passthrough_bytes_ -= charged;
+
+  schedule_.clear();
+  for(size_t channel = 0; channel < pending_.size(); channel++)
+  {
+    PendingCommand &cmd = pending_[channel];
+    if(!cmd.valid)
+      continue;
+    if(cmd.deadline < now)
+    {
+      cmd.valid = false;
+      stale_++;
+      continue;
+    }
+    schedule_.push_back(channel);
+  }
+  if(schedule_.empty())
+    return;
+
+  std::stable_sort(schedule_.begin(), schedule_.end(),
+                   [this](uint8_t a, uint8_t b) { return pending_[a].deadline < pending_[b].deadline; });
+
+  // What does not fit in this slot waits for the next one, unless a newer command replaces it or it gets stale
+  size_t next = 0;
+  while(next < schedule_.size())
+  {
+    const size_t fit = budget > kPacketOverhead + sizeof(SO3_MULTI_CMD_HEADER) ?
+                           (budget - kPacketOverhead - sizeof(SO3_MULTI_CMD_HEADER)) / kMultiEntrySize :
+                           0;
+    const size_t count = std::min({schedule_.size() - next, kMultiMaxEntries, fit});
+    if(count == 0)
+      break;
+
+    entries_.clear();
+    for(size_t i = 0; i < count; i++, next++)
+    {
+      PendingCommand &cmd = pending_[schedule_[next]];
+      entries_.push_back(std::make_pair(schedule_[next], cmd.data));
+      cmd.valid = false;
+    }
+
+    kr_mav_msgs::Serial::Ptr msg(new kr_mav_msgs::Serial);
+    msg->header.stamp = now;
+    msg->type = kr_mav_msgs::Serial::SO3_MULTI_CMD;
+    msg->data.resize(kr_mav_msgs::so3MultiCommandSize(count));
+    kr_mav_msgs::encodeSO3MultiCommand(slot_, entries_, msg->data.data());
+
+    serial_pub_.publish(msg);
+    budget -= kPacketOverhead + msg->data.size();
+  }
+  slot_++;
+
+  if(stale_ > 0)
+    NODELET_WARN_THROTTLE(1, "%u commands dropped as stale, %u replaced before being sent", stale_, replaced_);
+}
+
+void QuadSerialMux::onInit(void)
+{
+  ros::NodeHandle n(getPrivateNodeHandle());
+
+  int baud_rate;
+  n.param("baud_rate", baud_rate, 57600);
+
+  double slot_period;
+  n.param("slot_period", slot_period, 0.02);
+
+  double max_command_age;
+  n.param("max_command_age", max_command_age, 0.05);
+  max_command_age_ = ros::Duration(max_command_age);
+
+  // 10 bits per byte on the wire
+  slot_bytes_ = baud_rate / 10 * slot_period;
+  if(slot_bytes_ < kPacketOverhead + sizeof(SO3_MULTI_CMD_HEADER) + kMultiEntrySize)
+    NODELET_WARN("A slot of %g s at %d baud is too short for a single command", slot_period, baud_rate);
+
+  for(auto &cmd : pending_)
+    cmd.valid = false;
+  entries_.reserve(kMultiMaxEntries);
+  slot_ = 0;
+  passthrough_bytes_ = 0;
+  replaced_ = 0;
+  stale_ = 0;
+
+  serial_pub_ = n.advertise<kr_mav_msgs::Serial>("to_robot_out", 10);
+  serial_sub_ =
+      n.subscribe("to_robot_in", 100, &QuadSerialMux::serial_callback, this, ros::TransportHints().tcpNoDelay());
+  slot_timer_ = n.createTimer(ros::Duration(slot_period), &QuadSerialMux::slot_callback, this);
+}
+
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(QuadSerialMux, nodelet::Nodelet);
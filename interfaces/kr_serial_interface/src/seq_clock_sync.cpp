@@ -0,0 +1,100 @@
+#include <kr_serial_interface/seq_clock_sync.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Packets before the fit is used
+static const unsigned int kMinSamples = 20;
+// An arrival further than this from the fit, in s, means the robot or the clock was restarted
+static const double kMaxResidual = 0.5;
+// How fast the lowest arrival is forgotten, in periods per packet, so the fit can follow a drift of the delays
+static const double kRelax = 0.002;
+// Packets after which the sums are moved to the latest packet
+static const int64_t kRebaseSamples = 10000;
+
+SeqClockSync::SeqClockSync(double window, unsigned int seq_modulus)
+    : forgetting_(1 - 1 / std::max(window, 1.0)), seq_modulus_(seq_modulus)
+{
+  reset();
+}
+
+void SeqClockSync::reset()
+{
+  last_seq_ = -1;
+  num_samples_ = 0;
+  n_ = 0;
+  n_ref_ = 0;
+  s_ = s_n_ = s_t_ = s_nn_ = s_nt_ = 0;
+  min_offset_ = std::numeric_limits<double>::infinity();
+}
+
+double SeqClockSync::period() const
+{
+  if(num_samples_ < kMinSamples)
+    return 0;
+  const double mean_n = s_n_ / s_, mean_t = s_t_ / s_;
+  const double var_n = s_nn_ / s_ - mean_n * mean_n;
+  return var_n > 0 ? (s_nt_ / s_ - mean_n * mean_t) / var_n : 0;
+}
+
+ros::Time SeqClockSync::update(unsigned int seq, const ros::Time &arrival)
+{
+  if(last_seq_ >= 0)
+  {
+    const unsigned int diff = (seq + seq_modulus_ - last_seq_) % seq_modulus_;
+    // With the period known, a dropout longer than half the seq range would otherwise be taken for a short gap
+    const double p = period();
+    if(arrival < last_arrival_ || diff == 0 || diff > seq_modulus_ / 2 ||
+       (p > 0 && (arrival - last_arrival_).toSec() > p * seq_modulus_ / 2))
+      reset();
+    else
+      n_ += diff;
+  }
+  if(last_seq_ < 0)
+    t_ref_ = arrival;
+  last_seq_ = seq;
+  last_arrival_ = arrival;
+
+  const double n = n_ - n_ref_;
+  const double t = (arrival - t_ref_).toSec();
+  s_ = forgetting_ * s_ + 1;
+  s_n_ = forgetting_ * s_n_ + n;
+  s_t_ = forgetting_ * s_t_ + t;
+  s_nn_ = forgetting_ * s_nn_ + n * n;
+  s_nt_ = forgetting_ * s_nt_ + n * t;
+  num_samples_++;
+
+  const double slope = period();
+  if(slope <= 0)
+    return arrival;
+
+  const double fit = s_t_ / s_ + slope * (n - s_n_ / s_);
+  const double residual = t - fit;
+  if(std::abs(residual) > kMaxResidual)
+  {
+    reset();
+    return update(seq, arrival);
+  }
+  min_offset_ = std::min(residual, min_offset_ + kRelax * slope);
+
+  // Never later than the arrival
+  const ros::Time stamp = std::min(t_ref_ + ros::Duration(fit + min_offset_), arrival);
+
+  if(n_ - n_ref_ > kRebaseSamples)
+    rebase();
+  return stamp;
+}
+
+void SeqClockSync::rebase()
+{
+  // Moves the origin of n and t to the latest packet, the sums of the shifted samples follow from the old ones
+  const double a = n_ - n_ref_;
+  const double b = (last_arrival_ - t_ref_).toSec();
+  s_nt_ = s_nt_ - a * s_t_ - b * s_n_ + a * b * s_;
+  s_nn_ = s_nn_ - 2 * a * s_n_ + a * a * s_;
+  s_n_ -= a * s_;
+  s_t_ -= b * s_;
+  n_ref_ = n_;
+  t_ref_ = last_arrival_;
+}
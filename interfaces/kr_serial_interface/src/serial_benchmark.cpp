@@ -0,0 +1,115 @@
+// Measures how fast ASIOSerialDevice and SerialPacketParser take in packets, over a pseudo terminal so no hardware is
+// needed. A writer thread sends the packets to the master side as fast as the pty takes them, the device reads the
+// slave side.
+//
+// Usage: serial_benchmark [num_packets] [payload_size] [read_buffer_size]
+
+#include <fcntl.h>
+#include <kr_serial_interface/ASIOSerialDevice.h>
+#include <kr_serial_interface/serial_interface.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+int main(int argc, char **argv)
+{
+  const int num_packets = argc > 1 ? std::atoi(argv[1]) : 200000;
+  const int payload_size = argc > 2 ? std::atoi(argv[2]) : 40;
+  const int read_buffer_size = argc > 3 ? std::atoi(argv[3]) : DEFAULT_READ_BUFFER_SIZE;
+  if(num_packets <= 0 || payload_size < 0 || payload_size > static_cast<int>(kPacketDataMaxSize) ||
+     read_buffer_size < 2)
+  {
+    fprintf(stderr, "Usage: %s [num_packets] [payload_size (0-%u)] [read_buffer_size]\n", argv[0], kPacketDataMaxSize);
+    return 1;
+  }
+
+  int master, slave;
+  char slave_name[256];
+  if(openpty(&master, &slave, slave_name, NULL, NULL) != 0)
+  {
+    perror("openpty");
+    return 1;
+  }
+  // The master side stays raw as well, so the bytes go through unchanged
+  termios tio;
+  tcgetattr(master, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(master, TCSANOW, &tio);
+
+  std::atomic<int> received(0);
+  std::atomic<size_t> num_reads(0);
+  SerialPacketParser parser([&received](uint8_t, const uint8_t *, size_t) { received++; });
+
+  ASIOSerialDevice sd;
+  sd.Open(slave_name, 921600);
+  sd.SetReadBufferSize(read_buffer_size);
+  sd.SetReadCallback([&parser, &num_reads](const unsigned char *data, size_t count) {
+    num_reads++;
+    parser.process(data, count);
+  });
+  sd.Start();
+
+  kr_mav_msgs::Serial msg;
+  msg.type = kr_mav_msgs::Serial::OUTPUT_DATA;
+  msg.data.resize(payload_size);
+  for(int i = 0; i < payload_size; i++)
+    msg.data[i] = i;
+  std::vector<uint8_t> packet;
+  encode_serial_msg(msg, packet);
+
+  // Packets are batched into larger writes, as a radio delivers them
+  const int packets_per_write = std::max<int>(1, 4096 / packet.size());
+  std::vector<uint8_t> batch;
+  for(int i = 0; i < packets_per_write; i++)
+    batch.insert(batch.end(), packet.begin(), packet.end());
+
+  const auto start = std::chrono::steady_clock::now();
+  std::thread writer([&]() {
+    for(int sent = 0; sent < num_packets; sent += packets_per_write)
+    {
+      const size_t size = std::min(packets_per_write, num_packets - sent) * packet.size();
+      size_t written = 0;
+      while(written < size)
+      {
+        const ssize_t n = write(master, &batch[written], size - written);
+        if(n < 0)
+          return;
+        written += n;
+      }
+    }
+  });
+
+  // Stop when all the packets arrived or nothing arrived for a while
+  int last_received = -1;
+  auto last_progress = std::chrono::steady_clock::now();
+  while(received < num_packets &&
+        std::chrono::steady_clock::now() - last_progress < std::chrono::milliseconds(500))
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if(received != last_received)
+    {
+      last_received = received;
+      last_progress = std::chrono::steady_clock::now();
+    }
+  }
+  const double elapsed = std::chrono::duration<double>(last_progress - start).count();
+
+  writer.join();
+  sd.Close();
+  sd.Stop();
+  close(master);
+  close(slave);
+
+  const double bytes = static_cast<double>(received) * packet.size();
+  printf("read buffer %d B, %d byte packets: %d/%d packets in %.3f s, %.1f MB/s, %.0f packets/s, %zu reads of %.1f B"
+         " on average, %u CRC errors\n",
+         read_buffer_size, payload_size, received.load(), num_packets, elapsed, bytes / elapsed / 1e6,
+         received / elapsed, num_reads.load(), num_reads > 0 ? bytes / num_reads : 0.0, parser.crcErrors());
+  return received == num_packets ? 0 : 1;
+}
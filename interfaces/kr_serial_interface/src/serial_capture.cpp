@@ -0,0 +1,58 @@
+#include <kr_flight_recorder/records.h>
+#include <kr_serial_interface/serial_capture.h>
+#include <kr_serial_interface/serial_interface.h>
+
+#include <cstring>
+
+static_assert(sizeof(kr_flight_recorder::SerialFrameRecord::data) >= kPacketDataMaxSize,
+              "The capture has to hold the largest packet");
+
+void SerialCapture::open(const ros::NodeHandle &n, const std::string &link)
+{
+  close();
+
+  std::string filename;
+  n.param("capture_file", filename, std::string());
+  if(filename.empty())
+    return;
+
+  if(!link.empty())
+  {
+    // capture.log becomes capture_<link>.log
+    size_t pos = filename.rfind('.');
+    if(pos == std::string::npos || (filename.rfind('/') != std::string::npos && pos < filename.rfind('/')))
+      pos = filename.size();
+    filename.insert(pos, "_" + link);
+  }
+
+  int buffer_size, size_mb;
+  n.param("capture_buffer", buffer_size, 4096);
+  n.param("capture_size_mb", size_mb, 64);
+  recorder_.reset(new kr_flight_recorder::FlightRecorder(kr_flight_recorder::SerialFrameRecord::TYPE,
+                                                         sizeof(kr_flight_recorder::SerialFrameRecord), buffer_size));
+  if(!recorder_->open(filename, static_cast<size_t>(size_mb) << 20))
+    recorder_.reset();
+}
+
+void SerialCapture::close()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  recorder_.reset();
+}
+
+void SerialCapture::record(const ros::Time &stamp, uint8_t direction, uint8_t type, uint8_t channel,
+                           const uint8_t *data, size_t length)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(!recorder_)
+    return;
+
+  kr_flight_recorder::SerialFrameRecord r = {};
+  r.stamp = stamp.toNSec();
+  r.direction = direction;
+  r.type = type;
+  r.length = length;
+  r.channel = channel;
+  memcpy(r.data, data, length);
+  recorder_->record(r);
+}
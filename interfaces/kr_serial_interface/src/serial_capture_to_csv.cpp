@@ -0,0 +1,272 @@
+// Decodes a capture written by QuadSerialComm, QuadEncodeSerialComm or QuadSerialMultiComm (capture_file param) into
+// CSV files, one per decoded message type: <prefix>_output_data.csv and <prefix>_status.csv. The output data gets both
+// the arrival stamp and the sample stamp reconstructed from its seq, as QuadDecodeMsg does. The capture is read a chunk
+// at a time, so it does not have to fit in memory.
+//
+// Usage: serial_capture_to_csv <capture_file> <output_prefix>
+
+#include <kr_flight_recorder/flight_recorder.h>
+#include <kr_flight_recorder/records.h>
+#include <kr_mav_msgs/Serial.h>
+#include <kr_serial_interface/decode_msgs.h>
+#include <kr_serial_interface/seq_clock_sync.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using kr_flight_recorder::SerialFrameRecord;
+
+// Records read from the capture at a time
+static const size_t kChunkRecords = 4096;
+
+// Formats the CSV lines itself, printf would take most of the time
+class CsvWriter
+{
+ public:
+  CsvWriter() : out_(NULL) { buffer_.reserve(kFlushSize + 1024); }
+  ~CsvWriter() { close(); }
+
+  bool open(const std::string &filename, const char *header)
+  {
+    out_ = fopen(filename.c_str(), "w");
+    if(out_ == NULL)
+    {
+      fprintf(stderr, "Could not create %s\n", filename.c_str());
+      return false;
+    }
+    buffer_ = header;
+    return true;
+  }
+
+  void close()
+  {
+    if(out_ == NULL)
+      return;
+    flush();
+    fclose(out_);
+    out_ = NULL;
+  }
+
+  // The fields but the first of the line are written with the comma before them
+  void stamp(int64_t ns, bool separator = false)
+  {
+    if(separator)
+      buffer_ += ',';
+    integer(ns / 1000000000);
+    char fraction[10];
+    digits(ns % 1000000000, fraction, 9);
+    buffer_ += '.';
+    buffer_.append(fraction, 9);
+  }
+
+  void integer(int64_t value)
+  {
+    if(value < 0)
+    {
+      buffer_ += '-';
+      value = -value;
+    }
+    char text[20];
+    int n = 0;
+    do
+    {
+      text[sizeof(text) - ++n] = '0' + value % 10;
+      value /= 10;
+    } while(value > 0);
+    buffer_.append(&text[sizeof(text) - n], n);
+  }
+
+  // Six decimals, without the trailing zeros
+  void fixed(double value)
+  {
+    buffer_ += ',';
+    const double scaled = std::round(std::abs(value) * 1e6);
+    if(!(scaled < 9e15))
+    {
+      char text[32];
+      buffer_.append(text, snprintf(text, sizeof(text), "%g", value));
+      return;
+    }
+    const int64_t units = static_cast<int64_t>(scaled);
+    if(value < 0 && units > 0)
+      buffer_ += '-';
+    integer(units / 1000000);
+    int64_t fraction = units % 1000000;
+    if(fraction == 0)
+      return;
+    int n = 6;
+    while(fraction % 10 == 0)
+    {
+      fraction /= 10;
+      n--;
+    }
+    char text[6];
+    digits(fraction, text, n);
+    buffer_ += '.';
+    buffer_.append(text, n);
+  }
+
+  void field(int64_t value)
+  {
+    buffer_ += ',';
+    integer(value);
+  }
+
+  void endLine()
+  {
+    buffer_ += '\n';
+    if(buffer_.size() >= kFlushSize)
+      flush();
+  }
+
+ private:
+  static const size_t kFlushSize = 1 << 20;
+
+  static void digits(int64_t value, char *text, int n)
+  {
+    for(int i = n - 1; i >= 0; i--, value /= 10)
+      text[i] = '0' + value % 10;
+  }
+
+  void flush()
+  {
+    fwrite(buffer_.data(), 1, buffer_.size(), out_);
+    buffer_.clear();
+  }
+
+  FILE *out_;
+  std::string buffer_;
+};
+
+static void write_output_data(CsvWriter &out, int64_t stamp, int64_t sample_stamp, const kr_mav_msgs::OutputData &o)
+{
+  out.stamp(stamp);
+  out.stamp(sample_stamp, true);
+  out.field(o.seq);
+  out.field(o.loop_rate);
+  out.fixed(o.voltage);
+  out.fixed(o.orientation.x);
+  out.fixed(o.orientation.y);
+  out.fixed(o.orientation.z);
+  out.fixed(o.orientation.w);
+  out.fixed(o.angular_velocity.x);
+  out.fixed(o.angular_velocity.y);
+  out.fixed(o.angular_velocity.z);
+  out.fixed(o.linear_acceleration.x);
+  out.fixed(o.linear_acceleration.y);
+  out.fixed(o.linear_acceleration.z);
+  out.fixed(o.pressure_dheight);
+  out.fixed(o.pressure_height);
+  out.fixed(o.magnetic_field.x);
+  out.fixed(o.magnetic_field.y);
+  out.fixed(o.magnetic_field.z);
+  for(int i = 0; i < 8; i++)
+    out.field(o.radio_channel[i]);
+  for(int i = 0; i < 4; i++)
+    out.field(o.motor_rpm[i]);
+  out.endLine();
+}
+
+int main(int argc, char **argv)
+{
+  if(argc != 3)
+  {
+    fprintf(stderr, "Usage: %s <capture_file> <output_prefix>\n", argv[0]);
+    return 1;
+  }
+
+  kr_flight_recorder::FlightLogReader reader;
+  std::string error;
+  if(!reader.open(argv[1], error))
+  {
+    fprintf(stderr, "Could not read %s: %s\n", argv[1], error.c_str());
+    return 1;
+  }
+  const kr_flight_recorder::FlightLogHeader &header = reader.header();
+  if(header.record_type != SerialFrameRecord::TYPE || header.record_size != sizeof(SerialFrameRecord))
+  {
+    fprintf(stderr, "%s is not a serial capture\n", argv[1]);
+    return 1;
+  }
+
+  const std::string prefix(argv[2]);
+  CsvWriter output_out, status_out;
+  if(!output_out.open(prefix + "_output_data.csv",
+                      "stamp,sample_stamp,seq,loop_rate,voltage,qx,qy,qz,qw,wx,wy,wz,ax,ay,az,dheight,height,mx,my,mz,"
+                      "radio0,radio1,radio2,radio3,radio4,radio5,radio6,radio7,rpm0,rpm1,rpm2,rpm3\n") ||
+     !status_out.open(prefix + "_status.csv", "stamp,seq,loop_rate,voltage\n"))
+    return 1;
+
+  SeqClockSync output_data_clock;
+  SerialFrameRecord r;
+  std::vector<uint8_t> records, data;
+  kr_mav_msgs::OutputData output_data;
+  kr_mav_msgs::StatusData status;
+  uint64_t num_output_data = 0, num_status = 0, num_sent = 0, num_other = 0, num_invalid = 0;
+
+  size_t count;
+  while((count = reader.read(records, kChunkRecords)) > 0)
+  {
+    for(size_t i = 0; i < count; i++)
+    {
+      memcpy(&r, &records[i * sizeof(r)], sizeof(r));
+      if(r.direction == kr_flight_recorder::FRAME_SENT)
+      {
+        num_sent++;
+        continue;
+      }
+
+      ros::Time stamp;
+      stamp.fromNSec(r.stamp);
+      data.assign(r.data, r.data + std::min<size_t>(r.length, sizeof(r.data)));
+
+      if(r.type == kr_mav_msgs::Serial::OUTPUT_DATA)
+      {
+        if(!kr_mav_msgs::decodeOutputData(data, output_data))
+        {
+          num_invalid++;
+          continue;
+        }
+        write_output_data(output_out, r.stamp, output_data_clock.update(output_data.seq, stamp).toNSec(), output_data);
+        num_output_data++;
+      }
+      else if(r.type == kr_mav_msgs::Serial::STATUS_DATA)
+      {
+        if(!kr_mav_msgs::decodeStatusData(data, status))
+        {
+          num_invalid++;
+          continue;
+        }
+        status_out.stamp(r.stamp);
+        status_out.field(status.seq);
+        status_out.field(status.loop_rate);
+        status_out.fixed(status.voltage);
+        status_out.endLine();
+        num_status++;
+      }
+      else
+        num_other++;
+    }
+  }
+
+  output_out.close();
+  status_out.close();
+
+  fprintf(stderr,
+          "%lu output data, %lu status, %lu received of other types, %lu with a wrong size, %lu sent\n",
+          static_cast<unsigned long>(num_output_data), static_cast<unsigned long>(num_status),
+          static_cast<unsigned long>(num_other), static_cast<unsigned long>(num_invalid),
+          static_cast<unsigned long>(num_sent));
+  if(header.dropped > 0)
+    fprintf(stderr, "%lu packets were dropped while capturing\n", static_cast<unsigned long>(header.dropped));
+  if(reader.truncated())
+  {
+    fprintf(stderr, "%s is truncated, it has fewer packets than its header says\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
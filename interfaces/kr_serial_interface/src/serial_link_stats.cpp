@@ -0,0 +1,132 @@
+#include <kr_mav_msgs/Serial.h>
+#include <kr_serial_interface/comm_types.h>
+#include <kr_serial_interface/serial_link_stats.h>
+
+#include <cstddef>
+
+// Share of the link bandwidth above which it is reported as saturated
+static const double kSaturatedUtilization = 0.9;
+
+void SerialLinkStats::SeqTracker::update(unsigned int seq)
+{
+  // A jump backwards, more than half the range, is taken as a restart of the sender rather than a gap
+  if(last >= 0)
+  {
+    const unsigned int gap = (seq + 2 * modulus - last - 1) % modulus;
+    if(gap < modulus / 2)
+      gaps += gap;
+  }
+  last = seq;
+}
+
+SerialLinkStats::SerialLinkStats(unsigned int baud_rate)
+    : baud_rate_(baud_rate),
+      read_bytes_(0),
+      packets_(0),
+      crc_errors_(0),
+      resyncs_(0),
+      output_seq_(256),
+      status_seq_(256),
+      command_seq_(255),  // encodeSO3Command sends seq % 255
+      last_time_(std::chrono::steady_clock::now()),
+      last_read_bytes_(0),
+      last_write_bytes_(0),
+      last_write_frames_(0),
+      last_dropped_(0),
+      last_packets_(0),
+      last_crc_errors_(0),
+      last_resyncs_(0),
+      last_gaps_(0),
+      last_latency_sum_(0)
+{
+}
+
+void SerialLinkStats::read(size_t count, const SerialPacketParser &parser)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  read_bytes_ += count;
+  packets_ = parser.packets();
+  crc_errors_ = parser.crcErrors();
+  resyncs_ = parser.resyncs();
+}
+
+void SerialLinkStats::received(uint8_t type, const uint8_t *data, size_t length)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(type == kr_mav_msgs::Serial::OUTPUT_DATA && length == sizeof(OUTPUT_DATA))
+    output_seq_.update(data[offsetof(OUTPUT_DATA, seq)]);
+  else if(type == kr_mav_msgs::Serial::STATUS_DATA && length == sizeof(STATUS_DATA))
+    status_seq_.update(data[offsetof(STATUS_DATA, seq)]);
+}
+
+void SerialLinkStats::sent(uint8_t type, const uint8_t *data, size_t length)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(type == kr_mav_msgs::Serial::SO3_CMD && length == sizeof(SO3_CMD_INPUT))
+    command_seq_.update(data[offsetof(SO3_CMD_INPUT, seq)]);
+  else if(type == kr_mav_msgs::Serial::SO3_COMPACT_CMD && length == sizeof(SO3_COMPACT_CMD))
+    command_seq_.update(data[offsetof(SO3_COMPACT_CMD, seq)]);
+}
+
+void SerialLinkStats::diagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat,
+                                  const ASIOSerialDevice::WriteStats &write_stats)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const auto now = std::chrono::steady_clock::now();
+  const double dt = std::chrono::duration<double>(now - last_time_).count();
+  if(dt <= 0)
+    return;
+
+  const size_t read_bytes = read_bytes_ - last_read_bytes_;
+  const size_t write_bytes = write_stats.bytes - last_write_bytes_;
+  const size_t write_frames = write_stats.frames - last_write_frames_;
+  const size_t dropped = write_stats.dropped - last_dropped_;
+  const unsigned int packets = packets_ - last_packets_;
+  const unsigned int crc_errors = crc_errors_ - last_crc_errors_;
+  const unsigned int resyncs = resyncs_ - last_resyncs_;
+  const unsigned int total_gaps = output_seq_.gaps + status_seq_.gaps + command_seq_.gaps;
+  const unsigned int gaps = total_gaps - last_gaps_;
+
+  // 10 bits per byte on the wire
+  const double bytes_per_second = baud_rate_ / 10.0;
+  const double read_utilization = read_bytes / dt / bytes_per_second;
+  const double write_utilization = write_bytes / dt / bytes_per_second;
+  const double latency = write_frames > 0 ? (write_stats.latency_sum - last_latency_sum_) / write_frames : 0;
+  const double round_trip = latency + (kPacketOverhead + sizeof(OUTPUT_DATA)) / bytes_per_second;
+
+  stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Link OK");
+  if(read_utilization > kSaturatedUtilization || write_utilization > kSaturatedUtilization)
+    stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::WARN, "Link saturated");
+  if(crc_errors > 0 || resyncs > 0 || gaps > 0 || dropped > 0)
+    stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::WARN, "Packets lost");
+  if(packets == 0)
+    stat.mergeSummary(diagnostic_msgs::DiagnosticStatus::WARN, "No packets from the robot");
+
+  stat.add("Received packets/s", packets / dt);
+  stat.add("Received bytes/s", read_bytes / dt);
+  stat.add("Received utilization", read_utilization);
+  stat.add("Sent packets/s", write_frames / dt);
+  stat.add("Sent bytes/s", write_bytes / dt);
+  stat.add("Sent utilization", write_utilization);
+  stat.add("CRC errors", crc_errors);
+  stat.add("Resynchronizations", resyncs);
+  stat.add("Sequence gaps", gaps);
+  stat.add("Dropped writes", dropped);
+  stat.add("Write latency mean (s)", latency);
+  stat.add("Write latency max (s)", write_stats.latency_max);
+  stat.add("Estimated round trip (s)", round_trip);
+  stat.add("Total CRC errors", crc_errors_);
+  stat.add("Total sequence gaps", total_gaps);
+
+  last_time_ = now;
+  last_read_bytes_ = read_bytes_;
+  last_write_bytes_ = write_stats.bytes;
+  last_write_frames_ = write_stats.frames;
+  last_dropped_ = write_stats.dropped;
+  last_packets_ = packets_;
+  last_crc_errors_ = crc_errors_;
+  last_resyncs_ = resyncs_;
+  last_gaps_ = total_gaps;
+  last_latency_sum_ = write_stats.latency_sum;
+}
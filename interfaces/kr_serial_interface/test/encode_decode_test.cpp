@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include <kr_serial_interface/decode_msgs.h>
+#include <kr_serial_interface/encode_msgs.h>
+
+#include <cmath>
+
+static kr_mav_msgs::SO3Command makeCommand(double qx, double qy, double qz, double qw)
+{
+  kr_mav_msgs::SO3Command cmd;
+  cmd.header.seq = 42;
+  cmd.force.x = 0.5;
+  cmd.force.y = -1.25;
+  cmd.force.z = 9.3;
+  const double norm = std::sqrt(qx * qx + qy * qy + qz * qz + qw * qw);
+  cmd.orientation.x = qx / norm;
+  cmd.orientation.y = qy / norm;
+  cmd.orientation.z = qz / norm;
+  cmd.orientation.w = qw / norm;
+  cmd.angular_velocity.x = 0.1;
+  cmd.angular_velocity.y = -0.2;
+  cmd.angular_velocity.z = 1.5;
+  cmd.kR = {1.5, 1.5, 1.0};
+  cmd.kOm = {0.13, 0.13, 0.1};
+  cmd.aux.current_yaw = 0.7;
+  cmd.aux.kf_correction = 1.2e-8;
+  cmd.aux.angle_corrections = {0.01, -0.02};
+  cmd.aux.enable_motors = true;
+  cmd.aux.use_external_yaw = false;
+  return cmd;
+}
+
+// Same rotation, up to the sign of the quaternion
+static double quaternionError(const geometry_msgs::Quaternion &a, const geometry_msgs::Quaternion &b)
+{
+  const double dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+  return 1 - std::abs(dot);
+}
+
+static void expectSameCommand(const kr_mav_msgs::SO3Command &expected, const kr_mav_msgs::SO3Command &decoded)
+{
+  EXPECT_NEAR(decoded.force.x, expected.force.x, 1 / 500.0);
+  EXPECT_NEAR(decoded.force.y, expected.force.y, 1 / 500.0);
+  EXPECT_NEAR(decoded.force.z, expected.force.z, 1 / 500.0);
+  EXPECT_NEAR(decoded.angular_velocity.x, expected.angular_velocity.x, 1 / 1000.0);
+  EXPECT_NEAR(decoded.angular_velocity.y, expected.angular_velocity.y, 1 / 1000.0);
+  EXPECT_NEAR(decoded.angular_velocity.z, expected.angular_velocity.z, 1 / 1000.0);
+  for(int i = 0; i < 3; i++)
+  {
+    EXPECT_NEAR(decoded.kR[i], expected.kR[i], 1 / 50.0);
+    EXPECT_NEAR(decoded.kOm[i], expected.kOm[i], 1 / 100.0);
+  }
+  EXPECT_NEAR(decoded.aux.current_yaw, expected.aux.current_yaw, 1e-4);
+  EXPECT_NEAR(decoded.aux.kf_correction, expected.aux.kf_correction, 1e-11);
+  EXPECT_NEAR(decoded.aux.angle_corrections[0], expected.aux.angle_corrections[0], 1 / 2500.0);
+  EXPECT_NEAR(decoded.aux.angle_corrections[1], expected.aux.angle_corrections[1], 1 / 2500.0);
+  EXPECT_EQ(decoded.aux.enable_motors, expected.aux.enable_motors);
+  EXPECT_EQ(decoded.aux.use_external_yaw, expected.aux.use_external_yaw);
+  EXPECT_EQ(decoded.header.seq, expected.header.seq);
+}
+
+TEST(EncodeDecodeTest, SO3Command)
+{
+  const kr_mav_msgs::SO3Command cmd = makeCommand(0.1, -0.2, 0.3, 0.9);
+  std::vector<uint8_t> data;
+  kr_mav_msgs::encodeSO3Command(cmd, data);
+
+  kr_mav_msgs::SO3Command decoded;
+  ASSERT_TRUE(kr_mav_msgs::decodeSO3Command(data, decoded));
+  expectSameCommand(cmd, decoded);
+  // Components truncated to 1/125, and not normalized
+  EXPECT_LT(quaternionError(cmd.orientation, decoded.orientation), 1e-2);
+}
+
+TEST(EncodeDecodeTest, SO3CompactCommand)
+{
+  kr_mav_msgs::SO3CompactEncoder encoder;
+  kr_mav_msgs::SO3CompactDecoder decoder;
+  std::vector<uint8_t> gains(sizeof(SO3_GAINS)), data(sizeof(SO3_COMPACT_CMD));
+
+  // Each component in turn the largest one, with either sign
+  const double quaternions[][4] = {{0.9, 0.1, -0.3, 0.2}, {0.1, -0.8, 0.3, 0.2}, {0.1, 0.2, 0.95, -0.1},
+                                   {0.1, 0.2, -0.3, 0.9}, {0.1, 0.2, -0.3, -0.9}, {0.5, 0.5, 0.5, 0.5},
+                                   {0, 0, 0, 1}};
+  for(const auto &q : quaternions)
+  {
+    const kr_mav_msgs::SO3Command cmd = makeCommand(q[0], q[1], q[2], q[3]);
+    if(encoder.encodeGains(cmd, gains.data()) > 0)
+    {
+      ASSERT_TRUE(decoder.decodeGains(gains));
+    }
+    encoder.encodeCommand(cmd, data.data());
+
+    kr_mav_msgs::SO3Command decoded;
+    ASSERT_TRUE(decoder.decodeCommand(data, decoded));
+    expectSameCommand(cmd, decoded);
+    EXPECT_LT(quaternionError(cmd.orientation, decoded.orientation), 1e-5);
+  }
+  EXPECT_EQ(decoder.staleGains(), 0u);
+}
+
+TEST(EncodeDecodeTest, SO3GainsOnlyWhenChanged)
+{
+  kr_mav_msgs::SO3CompactEncoder encoder(10);
+  kr_mav_msgs::SO3CompactDecoder decoder;
+  std::vector<uint8_t> gains(sizeof(SO3_GAINS)), data(sizeof(SO3_COMPACT_CMD));
+  kr_mav_msgs::SO3Command cmd = makeCommand(0, 0, 0, 1), decoded;
+
+  // No command without gains
+  encoder.encodeCommand(cmd, data.data());
+  EXPECT_FALSE(decoder.decodeCommand(data, decoded));
+
+  EXPECT_GT(encoder.encodeGains(cmd, gains.data()), 0u);
+  ASSERT_TRUE(decoder.decodeGains(gains));
+  encoder.encodeCommand(cmd, data.data());
+
+  // Unchanged, or changed below the resolution
+  cmd.kR[0] += 1e-3;
+  EXPECT_EQ(encoder.encodeGains(cmd, gains.data()), 0u);
+  encoder.encodeCommand(cmd, data.data());
+
+  // The gains packet is lost, the command is decoded with the old gains
+  cmd.kR[0] = 2.0;
+  EXPECT_GT(encoder.encodeGains(cmd, gains.data()), 0u);
+  encoder.encodeCommand(cmd, data.data());
+  ASSERT_TRUE(decoder.decodeCommand(data, decoded));
+  EXPECT_NEAR(decoded.kR[0], 1.5, 1 / 50.0);
+  EXPECT_EQ(decoder.staleGains(), 1u);
+
+  // Until they are sent again
+  size_t resent = 0;
+  for(int i = 0; i < 10 && resent == 0; i++)
+  {
+    resent = encoder.encodeGains(cmd, gains.data());
+    encoder.encodeCommand(cmd, data.data());
+  }
+  ASSERT_GT(resent, 0u);
+  ASSERT_TRUE(decoder.decodeGains(gains));
+  ASSERT_TRUE(decoder.decodeCommand(data, decoded));
+  EXPECT_NEAR(decoded.kR[0], 2.0, 1 / 50.0);
+  EXPECT_EQ(decoder.staleGains(), 1u);
+}
+
+TEST(EncodeDecodeTest, SO3MultiCommand)
+{
+  const kr_mav_msgs::SO3Command cmds[] = {makeCommand(0.1, -0.2, 0.3, 0.9), makeCommand(0, 0, 0, 1),
+                                          makeCommand(0.5, 0.5, 0.5, 0.5)};
+  const uint8_t channels[] = {7, 0, 255};
+  std::vector<std::vector<uint8_t>> encoded(3);
+  std::vector<std::pair<uint8_t, const uint8_t *>> entries;
+  for(int i = 0; i < 3; i++)
+  {
+    kr_mav_msgs::encodeSO3Command(cmds[i], encoded[i]);
+    entries.push_back(std::make_pair(channels[i], encoded[i].data()));
+  }
+
+  std::vector<uint8_t> data(kr_mav_msgs::so3MultiCommandSize(entries.size()));
+  ASSERT_EQ(kr_mav_msgs::encodeSO3MultiCommand(42, entries, data.data()), data.size());
+
+  uint8_t slot;
+  std::vector<std::pair<uint8_t, kr_mav_msgs::SO3Command>> decoded;
+  ASSERT_TRUE(kr_mav_msgs::decodeSO3MultiCommand(data, slot, decoded));
+  EXPECT_EQ(slot, 42);
+  ASSERT_EQ(decoded.size(), 3u);
+  for(int i = 0; i < 3; i++)
+  {
+    EXPECT_EQ(decoded[i].first, channels[i]);
+    expectSameCommand(cmds[i], decoded[i].second);
+    EXPECT_LT(quaternionError(cmds[i].orientation, decoded[i].second.orientation), 1e-2);
+  }
+
+  // The count has to match the size
+  data.pop_back();
+  EXPECT_FALSE(kr_mav_msgs::decodeSO3MultiCommand(data, slot, decoded));
+  data.resize(kr_mav_msgs::so3MultiCommandSize(0));
+  EXPECT_FALSE(kr_mav_msgs::decodeSO3MultiCommand(data, slot, decoded));
+}
+
+TEST(EncodeDecodeTest, SO3CompactIsSmaller)
+{
+  EXPECT_LT(sizeof(SO3_COMPACT_CMD), sizeof(SO3_CMD_INPUT));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
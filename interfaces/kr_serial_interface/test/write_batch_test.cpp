@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+#include <kr_serial_interface/ASIOSerialDevice.h>
+
+// Frame sizes on the link, with the 6 bytes of packet overhead
+static const size_t kSO3FrameSize = 36;
+static const size_t kCompactFrameSize = 28;
+
+static size_t batchFrames(const std::vector<size_t> &sizes, size_t max_bytes)
+{
+  return WriteBatchFrames(sizes.size(), max_bytes, [&sizes](size_t i) { return sizes[i]; });
+}
+
+TEST(WriteBatch, MaxWriteBytes)
+{
+  EXPECT_EQ(MaxWriteBytes(DEFAULT_MAX_WRITE_LATENCY, 57600), 28u);
+  EXPECT_EQ(MaxWriteBytes(DEFAULT_MAX_WRITE_LATENCY, 921600), 460u);
+  EXPECT_EQ(MaxWriteBytes(DEFAULT_MAX_WRITE_LATENCY, 0), 0u);
+}
+
+// At 57600 baud an SO3 frame takes longer than the latency limit, so each write carries one frame and the frames
+// queued behind it wait at most one frame time
+TEST(WriteBatch, LowBaud)
+{
+  const size_t max_bytes = MaxWriteBytes(DEFAULT_MAX_WRITE_LATENCY, 57600);
+  EXPECT_EQ(batchFrames(std::vector<size_t>(5, kSO3FrameSize), max_bytes), 1u);
+  EXPECT_EQ(batchFrames(std::vector<size_t>(5, kCompactFrameSize), max_bytes), 1u);
+  EXPECT_EQ(batchFrames(std::vector<size_t>(5, 10), max_bytes), 2u);
+}
+
+TEST(WriteBatch, HighBaud)
+{
+  const size_t max_bytes = MaxWriteBytes(DEFAULT_MAX_WRITE_LATENCY, 921600);
+  EXPECT_EQ(batchFrames(std::vector<size_t>(20, kSO3FrameSize), max_bytes), 12u);
+  EXPECT_EQ(batchFrames(std::vector<size_t>(3, kSO3FrameSize), max_bytes), 3u);
+  // A frame larger than the limit still goes out alone
+  EXPECT_EQ(batchFrames({600, kSO3FrameSize}, max_bytes), 1u);
+}
+
+TEST(WriteBatch, UnknownBaud)
+{
+  EXPECT_EQ(batchFrames(std::vector<size_t>(4, kSO3FrameSize), 0), 1u);
+  EXPECT_EQ(batchFrames(std::vector<size_t>(), 0), 0u);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
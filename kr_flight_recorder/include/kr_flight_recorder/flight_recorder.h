@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace kr_flight_recorder
+{
+/**
+ * Flight log file layout, in host byte order:
+ *   FlightLogHeader
+ *   records[num_records]  (record_size bytes each, in the order they were recorded)
+ *
+ * num_records and dropped are updated on each flush, so a log cut short by a crash stays readable up to the last flush.
+ * The file is allocated to its maximum size when it is opened and trimmed to the records written when it is closed.
+ */
+struct FlightLogHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_type;
+  uint32_t record_size;
+  uint32_t reserved;
+  uint64_t num_records;
+  uint64_t dropped;  // Records lost because the ring or the file was full
+};
+
+// Default maximum size of a flight log file, in bytes
+const size_t default_max_log_size = size_t(64) << 20;
+
+/**
+ * Records fixed-size binary records from a control loop without blocking it.
+ *
+ * record() copies the record into a single-producer single-consumer ring, so it must not be called from two threads
+ * at the same time. A background thread moves the records from the ring to a memory-mapped file every flush period.
+ * When the ring is full the record is dropped and counted instead of waiting for the flush. The file is allocated up
+ * front, so a flush never grows it, and once it is full the recorder stops and the following records are dropped.
+ *
+ * close() may run while the producer is in record(): it stops accepting records and waits for the record() in flight
+ * to return before the final flush, so every record() which returned true is in the file.
+ */
+class FlightRecorder
+{
+ public:
+  /**
+   * @param capacity Number of records in the ring, rounded up to a power of two
+   */
+  FlightRecorder(uint32_t record_type, size_t record_size, size_t capacity = 4096);
+  ~FlightRecorder();
+
+  FlightRecorder(const FlightRecorder &) = delete;
+  FlightRecorder &operator=(const FlightRecorder &) = delete;
+
+  /**
+   * @brief Create the log file, replacing an existing one, allocate it and start the flush thread
+   *
+   * @param max_size Size of the file in bytes, including the header
+   * @return false if the file could not be created or allocated
+   */
+  bool open(const std::string &filename, size_t max_size = default_max_log_size, double flush_period = 0.1);
+
+  /**
+   * @brief Flush the remaining records, stop the flush thread and trim the file to the records written
+   */
+  void close();
+
+  /**
+   * @brief Move the records in the ring to the file now instead of at the next flush period
+   *
+   * @return false if the file is full, the recorder then drops all the following records
+   */
+  bool flush();
+
+  bool isOpen() const { return fd_ >= 0; }
+
+  /**
+   * @return false if the record was dropped, because the ring is full or the recorder is not open
+   */
+  bool record(const void *data);
+
+  template <typename T>
+  bool record(const T &r)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Records are copied as raw bytes");
+    return sizeof(T) == record_size_ && record(static_cast<const void *>(&r));
+  }
+
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  void flush_loop(double flush_period);
+  bool flush_locked();
+
+  const uint32_t record_type_;
+  const size_t record_size_;
+  size_t mask_;
+  std::vector<uint8_t> ring_;
+
+  // head_ is only written by record(), tail_ only by flush()
+  std::atomic<uint64_t> head_, tail_;
+  std::atomic<uint64_t> dropped_;
+
+  int fd_;
+  uint8_t *map_;
+  size_t map_size_;
+  uint64_t max_records_, num_records_;
+
+  // record() only writes to the ring while recording_ is set, and counts itself in writers_ while it checks and
+  // writes, so close() can wait for it
+  std::atomic<bool> recording_;
+  std::atomic<unsigned int> writers_;
+
+  // Held by the consumer, i.e. the flush thread, flush() and close()
+  std::mutex flush_mutex_;
+  std::condition_variable flush_cv_;
+  bool running_;
+  std::thread flush_thread_;
+};
+
+/**
+ * Reads a flight log a chunk of records at a time, so a long log does not have to fit in memory
+ */
+class FlightLogReader
+{
+ public:
+  FlightLogReader();
+
+  /**
+   * @brief Open the log and read its header
+   *
+   * @return false if the file cannot be read or is not a flight log, error then has the reason
+   */
+  bool open(const std::string &filename, std::string &error);
+
+  const FlightLogHeader &header() const { return header_; }
+
+  /**
+   * @brief Read the next records, up to max_records, records is resized to the records read
+   *
+   * @return Number of records read, 0 at the end of the log
+   */
+  size_t read(std::vector<uint8_t> &records, size_t max_records);
+
+  /**
+   * @return true if the file ended before the number of records in the header
+   */
+  bool truncated() const { return truncated_; }
+
+ private:
+  std::ifstream file_;
+  FlightLogHeader header_;
+  uint64_t remaining_;
+  bool truncated_;
+};
+
+/**
+ * @brief Read the header and all the records of a flight log
+ *
+ * @return false if the file cannot be read or is not a flight log, error then has the reason
+ */
+bool readFlightLog(const std::string &filename, FlightLogHeader &header, std::vector<uint8_t> &records,
+                   std::string &error);
+
+}  // namespace kr_flight_recorder
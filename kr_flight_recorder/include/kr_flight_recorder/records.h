@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+namespace kr_flight_recorder
+{
+enum RecordType : uint32_t
+{
+  CONTROL_RECORD = 1,
+  TRACKER_RECORD = 2,
+  SERIAL_FRAME_RECORD = 3
+};
+
+// The stamps are in ns, the orientations are (x, y, z, w) and the times are in s
+
+// One command of the SO3 controller
+struct ControlRecord
+{
+  static constexpr uint32_t TYPE = CONTROL_RECORD;
+
+  int64_t stamp;       // When the command was computed
+  int64_t odom_stamp;  // Stamp of the odometry it was computed from
+  float pos[3], vel[3], orientation[4];
+  float des_pos[3], des_vel[3], des_acc[3], des_jrk[3], des_yaw, des_yaw_dot;
+  float force[3], cmd_orientation[4], ang_vel[3];
+  float pos_int[3], pos_int_b[3];
+  float compute_time;  // Spent in calculateControl
+  uint8_t enable_motors;
+  uint8_t padding[3];
+};
+
+// One update of the active tracker
+struct TrackerRecord
+{
+  static constexpr uint32_t TYPE = TRACKER_RECORD;
+
+  int64_t stamp;       // When the tracker was updated
+  int64_t odom_stamp;  // Stamp of the odometry it was updated with
+  float pos[3], vel[3];
+  float cmd_pos[3], cmd_vel[3], cmd_acc[3], cmd_jrk[3], cmd_yaw, cmd_yaw_dot;
+  float update_time;  // Spent in the update of the tracker
+  uint8_t status;
+  uint8_t has_cmd;  // The tracker returned a command, otherwise the cmd fields are zero
+  uint8_t padding[2];
+  char tracker[40];  // Name of the active tracker, truncated
+};
+
+enum SerialFrameDirection : uint8_t
+{
+  FRAME_RECEIVED = 0,
+  FRAME_SENT = 1
+};
+
+// One packet on the serial link to the robot, without the start bytes and the CRC
+struct SerialFrameRecord
+{
+  static constexpr uint32_t TYPE = SERIAL_FRAME_RECORD;
+
+  int64_t stamp;  // When the packet was received, or queued to be sent
+  uint8_t direction;
+  uint8_t type;
+  uint8_t length;  // Of data
+  uint8_t channel;
+  uint8_t data[100];
+};
+
+}  // namespace kr_flight_recorder
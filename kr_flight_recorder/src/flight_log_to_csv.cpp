@@ -0,0 +1,161 @@
+// Converts a flight log written by the flight recorder to CSV, one line per record with a header line naming the
+// columns. Writes to stdout unless an output file is given.
+
+#include <kr_flight_recorder/flight_recorder.h>
+#include <kr_flight_recorder/records.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace kr_flight_recorder;
+
+static void print_array(FILE *out, const float *values, int n)
+{
+  for(int i = 0; i < n; i++)
+    fprintf(out, ",%g", values[i]);
+}
+
+static void print_control_header(FILE *out)
+{
+  fprintf(out,
+          "stamp,odom_stamp,x,y,z,vx,vy,vz,qx,qy,qz,qw,des_x,des_y,des_z,des_vx,des_vy,des_vz,des_ax,des_ay,des_az,"
+          "des_jx,des_jy,des_jz,des_yaw,des_yaw_dot,fx,fy,fz,cmd_qx,cmd_qy,cmd_qz,cmd_qw,wx,wy,wz,int_x,int_y,int_z,"
+          "int_b_x,int_b_y,int_b_z,compute_time,enable_motors\n");
+}
+
+static void print_control(FILE *out, const ControlRecord &r)
+{
+  fprintf(out, "%.9f,%.9f", r.stamp * 1e-9, r.odom_stamp * 1e-9);
+  print_array(out, r.pos, 3);
+  print_array(out, r.vel, 3);
+  print_array(out, r.orientation, 4);
+  print_array(out, r.des_pos, 3);
+  print_array(out, r.des_vel, 3);
+  print_array(out, r.des_acc, 3);
+  print_array(out, r.des_jrk, 3);
+  fprintf(out, ",%g,%g", r.des_yaw, r.des_yaw_dot);
+  print_array(out, r.force, 3);
+  print_array(out, r.cmd_orientation, 4);
+  print_array(out, r.ang_vel, 3);
+  print_array(out, r.pos_int, 3);
+  print_array(out, r.pos_int_b, 3);
+  fprintf(out, ",%g,%u\n", r.compute_time, r.enable_motors);
+}
+
+static void print_tracker_header(FILE *out)
+{
+  fprintf(out,
+          "stamp,odom_stamp,x,y,z,vx,vy,vz,cmd_x,cmd_y,cmd_z,cmd_vx,cmd_vy,cmd_vz,cmd_ax,cmd_ay,cmd_az,cmd_jx,cmd_jy,"
+          "cmd_jz,cmd_yaw,cmd_yaw_dot,update_time,status,has_cmd,tracker\n");
+}
+
+static void print_tracker(FILE *out, const TrackerRecord &r)
+{
+  fprintf(out, "%.9f,%.9f", r.stamp * 1e-9, r.odom_stamp * 1e-9);
+  print_array(out, r.pos, 3);
+  print_array(out, r.vel, 3);
+  print_array(out, r.cmd_pos, 3);
+  print_array(out, r.cmd_vel, 3);
+  print_array(out, r.cmd_acc, 3);
+  print_array(out, r.cmd_jrk, 3);
+  fprintf(out, ",%g,%g,%g,%u,%u,%.*s\n", r.cmd_yaw, r.cmd_yaw_dot, r.update_time, r.status, r.has_cmd,
+          static_cast<int>(strnlen(r.tracker, sizeof(r.tracker))), r.tracker);
+}
+
+static void print_serial_frame_header(FILE *out)
+{
+  fprintf(out, "stamp,direction,type,channel,length,data\n");
+}
+
+// The data in hex, serial_capture_to_csv in kr_serial_interface decodes it
+static void print_serial_frame(FILE *out, const SerialFrameRecord &r)
+{
+  fprintf(out, "%.9f,%s,%u,%u,%u,", r.stamp * 1e-9, r.direction == FRAME_SENT ? "sent" : "received", r.type, r.channel,
+          r.length);
+  for(int i = 0; i < r.length && i < static_cast<int>(sizeof(r.data)); i++)
+    fprintf(out, "%02x", r.data[i]);
+  fprintf(out, "\n");
+}
+
+// Records read from the log at a time
+static const size_t chunk_records = 4096;
+
+template <typename T>
+static bool print_records(FILE *out, FlightLogReader &reader, void (*print_header)(FILE *),
+                          void (*print)(FILE *, const T &))
+{
+  if(reader.header().record_size != sizeof(T))
+  {
+    fprintf(stderr, "Records of %u bytes, expected %zu\n", reader.header().record_size, sizeof(T));
+    return false;
+  }
+
+  print_header(out);
+  std::vector<uint8_t> records;
+  T record;
+  size_t count;
+  while((count = reader.read(records, chunk_records)) > 0)
+  {
+    for(size_t i = 0; i < count; i++)
+    {
+      memcpy(&record, &records[i * sizeof(T)], sizeof(T));
+      print(out, record);
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 2 || argc > 3)
+  {
+    fprintf(stderr, "Usage: %s <flight_log> [csv_file]\n", argv[0]);
+    return 1;
+  }
+
+  FlightLogReader reader;
+  std::string error;
+  if(!reader.open(argv[1], error))
+  {
+    fprintf(stderr, "Could not read %s: %s\n", argv[1], error.c_str());
+    return 1;
+  }
+
+  FILE *out = stdout;
+  if(argc > 2 && (out = fopen(argv[2], "w")) == NULL)
+  {
+    fprintf(stderr, "Could not create %s\n", argv[2]);
+    return 1;
+  }
+
+  const FlightLogHeader &header = reader.header();
+  bool ok = false;
+  switch(header.record_type)
+  {
+    case CONTROL_RECORD:
+      ok = print_records<ControlRecord>(out, reader, print_control_header, print_control);
+      break;
+    case TRACKER_RECORD:
+      ok = print_records<TrackerRecord>(out, reader, print_tracker_header, print_tracker);
+      break;
+    case SERIAL_FRAME_RECORD:
+      ok = print_records<SerialFrameRecord>(out, reader, print_serial_frame_header, print_serial_frame);
+      break;
+    default:
+      fprintf(stderr, "Unknown record type %u\n", header.record_type);
+      break;
+  }
+
+  if(out != stdout)
+    fclose(out);
+
+  if(reader.truncated())
+  {
+    fprintf(stderr, "%s is truncated, it has fewer records than its header says\n", argv[1]);
+    ok = false;
+  }
+  if(header.dropped > 0)
+    fprintf(stderr, "%lu records were dropped while recording\n", static_cast<unsigned long>(header.dropped));
+  return ok ? 0 : 1;
+}
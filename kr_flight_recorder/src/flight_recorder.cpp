@@ -0,0 +1,288 @@
+#include <fcntl.h>
+#include <kr_flight_recorder/flight_recorder.h>
+#include <ros/console.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+namespace kr_flight_recorder
+{
+static const char flight_log_magic[8] = {'K', 'R', 'F', 'L', 'I', 'G', 'H', 'T'};
+static const uint32_t flight_log_version = 1;
+
+FlightRecorder::FlightRecorder(uint32_t record_type, size_t record_size, size_t capacity)
+    : record_type_(record_type),
+      record_size_(record_size),
+      head_(0),
+      tail_(0),
+      dropped_(0),
+      fd_(-1),
+      map_(NULL),
+      map_size_(0),
+      max_records_(0),
+      num_records_(0),
+      recording_(false),
+      writers_(0),
+      running_(false)
+{
+  size_t size = 1;
+  while(size < capacity)
+    size <<= 1;
+  mask_ = size - 1;
+  ring_.resize(size * record_size_);
+}
+
+FlightRecorder::~FlightRecorder()
+{
+  close();
+}
+
+bool FlightRecorder::open(const std::string &filename, size_t max_size, double flush_period)
+{
+  close();
+
+  const size_t max_records =
+      max_size > sizeof(FlightLogHeader) ? (max_size - sizeof(FlightLogHeader)) / record_size_ : 0;
+  if(max_records == 0)
+  {
+    ROS_ERROR("A flight log of %zu bytes cannot hold any record", max_size);
+    return false;
+  }
+
+  fd_ = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd_ < 0)
+  {
+    ROS_ERROR("Could not create the flight log %s: %s", filename.c_str(), strerror(errno));
+    return false;
+  }
+
+  // Allocated now, so running out of space does not fault a write to the mapping during the flight
+  const size_t size = sizeof(FlightLogHeader) + max_records * record_size_;
+  const int err = posix_fallocate(fd_, 0, size);
+  void *map = (err == 0) ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0) : MAP_FAILED;
+  if(map == MAP_FAILED)
+  {
+    ROS_ERROR("Could not allocate %zu bytes for the flight log %s: %s", size, filename.c_str(),
+              strerror(err != 0 ? err : errno));
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  map_ = static_cast<uint8_t *>(map);
+  map_size_ = size;
+  max_records_ = max_records;
+
+  FlightLogHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, flight_log_magic, sizeof(header.magic));
+  header.version = flight_log_version;
+  header.record_type = record_type_;
+  header.record_size = record_size_;
+  memcpy(map_, &header, sizeof(header));
+
+  head_ = 0;
+  tail_ = 0;
+  dropped_ = 0;
+  num_records_ = 0;
+
+  running_ = true;
+  recording_ = true;
+  flush_thread_ = std::thread(&FlightRecorder::flush_loop, this, flush_period);
+  return true;
+}
+
+void FlightRecorder::close()
+{
+  if(fd_ < 0)
+    return;
+
+  // Sequentially consistent with the check in record(): either record() sees recording_ cleared, or it is counted in
+  // writers_ here and its record is in the ring before the final flush
+  recording_ = false;
+  while(writers_ != 0)
+    std::this_thread::yield();
+
+  {
+    std::lock_guard<std::mutex> lock(flush_mutex_);
+    running_ = false;
+  }
+  flush_cv_.notify_all();
+  if(flush_thread_.joinable())
+    flush_thread_.join();
+  flush();
+
+  const size_t size = sizeof(FlightLogHeader) + num_records_ * record_size_;
+  msync(map_, size, MS_SYNC);
+  munmap(map_, map_size_);
+  if(ftruncate(fd_, size) != 0)
+    ROS_WARN("Could not trim the flight log: %s", strerror(errno));
+  ::close(fd_);
+
+  if(dropped_ > 0)
+    ROS_WARN("Flight recorder dropped %lu of %lu records, the ring or the log was full", static_cast<unsigned long>(dropped_),
+             static_cast<unsigned long>(dropped_ + num_records_));
+
+  fd_ = -1;
+  map_ = NULL;
+  map_size_ = 0;
+  max_records_ = 0;
+}
+
+bool FlightRecorder::record(const void *data)
+{
+  writers_++;
+  if(!recording_)
+  {
+    writers_.fetch_sub(1, std::memory_order_release);
+    return false;
+  }
+
+  bool recorded = false;
+  const uint64_t head = head_.load(std::memory_order_relaxed);
+  if(head - tail_.load(std::memory_order_acquire) > mask_)
+  {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+  else
+  {
+    memcpy(&ring_[(head & mask_) * record_size_], data, record_size_);
+    head_.store(head + 1, std::memory_order_release);
+    recorded = true;
+  }
+  writers_.fetch_sub(1, std::memory_order_release);
+  return recorded;
+}
+
+void FlightRecorder::flush_loop(double flush_period)
+{
+  const auto period = std::chrono::duration<double>(flush_period);
+  std::unique_lock<std::mutex> lock(flush_mutex_);
+  while(running_)
+  {
+    // close() wakes the thread up and does the last flush itself
+    if(flush_cv_.wait_for(lock, period, [this]() { return !running_; }))
+      break;
+    if(!flush_locked())
+      break;
+  }
+}
+
+bool FlightRecorder::flush()
+{
+  std::lock_guard<std::mutex> lock(flush_mutex_);
+  return flush_locked();
+}
+
+bool FlightRecorder::flush_locked()
+{
+  const uint64_t tail = tail_.load(std::memory_order_relaxed);
+  const uint64_t head = head_.load(std::memory_order_acquire);
+  if(head == tail)
+    return true;
+
+  // The ring wraps at most once between tail and head, the records which do not fit in the file any more are dropped
+  uint8_t *dst = map_ + sizeof(FlightLogHeader) + num_records_ * record_size_;
+  const size_t first = tail & mask_;
+  const size_t count = std::min<uint64_t>(head - tail, max_records_ - num_records_);
+  const size_t before_wrap = std::min(count, mask_ + 1 - first);
+  memcpy(dst, &ring_[first * record_size_], before_wrap * record_size_);
+  memcpy(dst + before_wrap * record_size_, &ring_[0], (count - before_wrap) * record_size_);
+
+  const bool full = count < head - tail;
+  if(full)
+  {
+    dropped_.fetch_add(head - tail - count, std::memory_order_relaxed);
+    // Stop instead of filling the ring again, close() reports the records dropped after this
+    if(recording_.exchange(false))
+      ROS_WARN("The flight log is full after %lu records, stopped recording",
+               static_cast<unsigned long>(max_records_));
+  }
+  tail_.store(head, std::memory_order_release);
+
+  num_records_ += count;
+  FlightLogHeader *header = reinterpret_cast<FlightLogHeader *>(map_);
+  header->num_records = num_records_;
+  header->dropped = dropped_.load(std::memory_order_relaxed);
+  return !full;
+}
+
+FlightLogReader::FlightLogReader() : remaining_(0), truncated_(false)
+{
+  memset(&header_, 0, sizeof(header_));
+}
+
+bool FlightLogReader::open(const std::string &filename, std::string &error)
+{
+  file_.close();
+  file_.clear();
+  remaining_ = 0;
+  truncated_ = false;
+
+  file_.open(filename, std::ios::binary);
+  if(!file_)
+  {
+    error = "cannot open the file";
+    return false;
+  }
+
+  if(!file_.read(reinterpret_cast<char *>(&header_), sizeof(header_)) ||
+     memcmp(header_.magic, flight_log_magic, sizeof(header_.magic)) != 0 || header_.record_size == 0)
+  {
+    error = "not a flight log";
+    return false;
+  }
+  if(header_.version != flight_log_version)
+  {
+    error = "unsupported version " + std::to_string(header_.version);
+    return false;
+  }
+
+  remaining_ = header_.num_records;
+  return true;
+}
+
+size_t FlightLogReader::read(std::vector<uint8_t> &records, size_t max_records)
+{
+  const size_t count = std::min<uint64_t>(max_records, remaining_);
+  records.resize(count * header_.record_size);
+  if(count == 0)
+    return 0;
+
+  file_.read(reinterpret_cast<char *>(records.data()), records.size());
+  const size_t num_read = file_.gcount() / header_.record_size;
+  records.resize(num_read * header_.record_size);
+  if(num_read < count)
+  {
+    truncated_ = true;
+    remaining_ = 0;
+  }
+  else
+  {
+    remaining_ -= num_read;
+  }
+  return num_read;
+}
+
+bool readFlightLog(const std::string &filename, FlightLogHeader &header, std::vector<uint8_t> &records,
+                   std::string &error)
+{
+  FlightLogReader reader;
+  if(!reader.open(filename, error))
+    return false;
+
+  header = reader.header();
+  reader.read(records, header.num_records);
+  if(reader.truncated())
+  {
+    error = "truncated log";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace kr_flight_recorder
@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+#include <kr_flight_recorder/flight_recorder.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+using kr_flight_recorder::FlightLogHeader;
+using kr_flight_recorder::FlightLogReader;
+using kr_flight_recorder::FlightRecorder;
+
+static const uint32_t kTestRecordType = 1000;
+// Long enough that the flush thread never runs while a test records, close() wakes it up
+static const double kNoFlush = 3600;
+static const size_t kLogSize = 1 << 20;
+
+struct TestRecord
+{
+  uint64_t seq;
+  float value;
+  uint32_t padding;
+};
+
+static std::vector<TestRecord> readRecords(const std::string &filename, FlightLogHeader &header)
+{
+  std::vector<uint8_t> data;
+  std::string error;
+  EXPECT_TRUE(kr_flight_recorder::readFlightLog(filename, header, data, error)) << error;
+  EXPECT_EQ(header.record_size, sizeof(TestRecord));
+  std::vector<TestRecord> records(data.size() / sizeof(TestRecord));
+  if(!records.empty())
+    memcpy(records.data(), data.data(), records.size() * sizeof(TestRecord));
+  return records;
+}
+
+class FlightRecorderTest : public ::testing::Test
+{
+ protected:
+  void SetUp() { filename_ = testing::TempDir() + "flight_recorder_test.log"; }
+
+  void TearDown() { std::remove(filename_.c_str()); }
+
+  std::string filename_;
+};
+
+TEST_F(FlightRecorderTest, RoundTrip)
+{
+  FlightRecorder recorder(kTestRecordType, sizeof(TestRecord), 16);
+  ASSERT_TRUE(recorder.open(filename_, kLogSize, kNoFlush));
+  for(uint64_t i = 0; i < 10; i++)
+    EXPECT_TRUE(recorder.record(TestRecord{i, 0.5f * i, 0}));
+  recorder.close();
+  EXPECT_FALSE(recorder.isOpen());
+
+  FlightLogHeader header;
+  const std::vector<TestRecord> records = readRecords(filename_, header);
+  EXPECT_EQ(header.record_type, kTestRecordType);
+  EXPECT_EQ(header.num_records, 10u);
+  EXPECT_EQ(header.dropped, 0u);
+  ASSERT_EQ(records.size(), 10u);
+  for(uint64_t i = 0; i < records.size(); i++)
+  {
+    EXPECT_EQ(records[i].seq, i);
+    EXPECT_EQ(records[i].value, 0.5f * i);
+  }
+}
+
+TEST_F(FlightRecorderTest, RejectsOtherRecordSizes)
+{
+  FlightRecorder recorder(kTestRecordType, sizeof(TestRecord), 16);
+  ASSERT_TRUE(recorder.open(filename_, kLogSize, kNoFlush));
+  EXPECT_FALSE(recorder.record(uint64_t(1)));
+}
+
+TEST_F(FlightRecorderTest, DropsWhenFull)
+{
+  // Rounded up to 4
+  FlightRecorder recorder(kTestRecordType, sizeof(TestRecord), 3);
+  ASSERT_TRUE(recorder.open(filename_, kLogSize, kNoFlush));
+  for(uint64_t i = 0; i < 6; i++)
+    EXPECT_EQ(recorder.record(TestRecord{i, 0, 0}), i < 4);
+  EXPECT_EQ(recorder.dropped(), 2u);
+  recorder.close();
+
+  FlightLogHeader header;
+  const std::vector<TestRecord> records = readRecords(filename_, header);
+  EXPECT_EQ(header.dropped, 2u);
+  ASSERT_EQ(records.size(), 4u);
+  for(uint64_t i = 0; i < records.size(); i++)
+    EXPECT_EQ(records[i].seq, i);
+}
+
+TEST_F(FlightRecorderTest, WrapsAroundTheRing)
+{
+  FlightRecorder recorder(kTestRecordType, sizeof(TestRecord), 4);
+  ASSERT_TRUE(recorder.open(filename_, kLogSize, kNoFlush));
+  uint64_t seq = 0;
+  for(int i = 0; i < 3; i++)
+    EXPECT_TRUE(recorder.record(TestRecord{seq++, 0, 0}));
+  ASSERT_TRUE(recorder.flush());
+
+  // Slots 3, 0, 1 and 2, then the ring is full again
+  for(int i = 0; i < 4; i++)
+    EXPECT_TRUE(recorder.record(TestRecord{seq++, 0, 0}));
+  EXPECT_FALSE(recorder.record(TestRecord{seq, 0, 0}));
+  ASSERT_TRUE(recorder.flush());
+  EXPECT_TRUE(recorder.record(TestRecord{seq++, 0, 0}));
+  recorder.close();
+
+  FlightLogHeader header;
+  const std::vector<TestRecord> records = readRecords(filename_, header);
+  EXPECT_EQ(header.dropped, 1u);
+  ASSERT_EQ(records.size(), seq);
+  for(uint64_t i = 0; i < records.size(); i++)
+    EXPECT_EQ(records[i].seq, i);
+}
+
+TEST_F(FlightRecorderTest, RecordAfterClose)
+{
+  FlightRecorder recorder(kTestRecordType, sizeof(TestRecord), 4);
+  EXPECT_FALSE(recorder.record(TestRecord{0, 0, 0}));
+  ASSERT_TRUE(recorder.open(filename_, kLogSize, kNoFlush));
+  recorder.close();
+  EXPECT_FALSE(recorder.record(TestRecord{0, 0, 0}));
+  EXPECT_EQ(recorder.dropped(), 0u);
+}
+
+// Every record() which returned true is in the file, also when close() runs while the producer is recording
+TEST_F(FlightRecorderTest, CloseWhileRecording)
+{
+  for(int run = 0; run < 20; run++)
+  {
+    FlightRecorder recorder(kTestRecordType, sizeof(TestRecord), 1 << 16);
+    ASSERT_TRUE(recorder.open(filename_, kLogSize, 0.001));
+    std::atomic<bool> started(false), closed(false);
+    uint64_t recorded = 0;
+    std::thread producer([&]() {
+      // Stops before the log can be full
+      for(uint64_t seq = 0; !closed && seq < kLogSize / sizeof(TestRecord) / 2; seq++)
+      {
+        if(recorder.record(TestRecord{seq, 0, 0}))
+          recorded++;
+        started = true;
+      }
+    });
+    while(!started)
+      std::this_thread::yield();
+    recorder.close();
+    closed = true;
+    producer.join();
+
+    FlightLogHeader header;
+    const std::vector<TestRecord> records = readRecords(filename_, header);
+    EXPECT_EQ(records.size(), recorded);
+  }
+}
+
+TEST_F(FlightRecorderTest, StopsWhenTheLogIsFull)
+{
+  FlightRecorder recorder(kTestRecordType, sizeof(TestRecord), 16);
+  ASSERT_TRUE(recorder.open(filename_, sizeof(FlightLogHeader) + 5 * sizeof(TestRecord), kNoFlush));
+  for(uint64_t i = 0; i < 8; i++)
+    EXPECT_TRUE(recorder.record(TestRecord{i, 0, 0}));
+  EXPECT_FALSE(recorder.flush());
+  EXPECT_FALSE(recorder.record(TestRecord{8, 0, 0}));
+  EXPECT_EQ(recorder.dropped(), 3u);
+  recorder.close();
+
+  FlightLogHeader header;
+  const std::vector<TestRecord> records = readRecords(filename_, header);
+  EXPECT_EQ(header.dropped, 3u);
+  ASSERT_EQ(records.size(), 5u);
+  for(uint64_t i = 0; i < records.size(); i++)
+    EXPECT_EQ(records[i].seq, i);
+}
+
+TEST_F(FlightRecorderTest, RejectsTooSmallLogs)
+{
+  FlightRecorder recorder(kTestRecordType, sizeof(TestRecord), 16);
+  EXPECT_FALSE(recorder.open(filename_, sizeof(FlightLogHeader) + sizeof(TestRecord) - 1, kNoFlush));
+  EXPECT_FALSE(recorder.isOpen());
+}
+
+TEST_F(FlightRecorderTest, ReadsInChunks)
+{
+  FlightRecorder recorder(kTestRecordType, sizeof(TestRecord), 16);
+  ASSERT_TRUE(recorder.open(filename_, kLogSize, kNoFlush));
+  for(uint64_t i = 0; i < 10; i++)
+    EXPECT_TRUE(recorder.record(TestRecord{i, 0, 0}));
+  recorder.close();
+
+  FlightLogReader reader;
+  std::string error;
+  ASSERT_TRUE(reader.open(filename_, error)) << error;
+  EXPECT_EQ(reader.header().num_records, 10u);
+  std::vector<uint8_t> chunk;
+  uint64_t seq = 0;
+  for(size_t expected : {4, 4, 2, 0})
+  {
+    ASSERT_EQ(reader.read(chunk, 4), expected);
+    ASSERT_EQ(chunk.size(), expected * sizeof(TestRecord));
+    for(size_t i = 0; i < expected; i++, seq++)
+    {
+      TestRecord record;
+      memcpy(&record, &chunk[i * sizeof(TestRecord)], sizeof(record));
+      EXPECT_EQ(record.seq, seq);
+    }
+  }
+  EXPECT_FALSE(reader.truncated());
+}
+
+TEST_F(FlightRecorderTest, ReadsTruncatedLogs)
+{
+  FlightRecorder recorder(kTestRecordType, sizeof(TestRecord), 16);
+  ASSERT_TRUE(recorder.open(filename_, kLogSize, kNoFlush));
+  for(uint64_t i = 0; i < 10; i++)
+    EXPECT_TRUE(recorder.record(TestRecord{i, 0, 0}));
+  recorder.close();
+  // As if cut short in the middle of a record
+  ASSERT_EQ(truncate(filename_.c_str(), sizeof(FlightLogHeader) + 7 * sizeof(TestRecord) / 2), 0);
+
+  FlightLogReader reader;
+  std::string error;
+  ASSERT_TRUE(reader.open(filename_, error)) << error;
+  std::vector<uint8_t> chunk;
+  EXPECT_EQ(reader.read(chunk, 100), 3u);
+  EXPECT_TRUE(reader.truncated());
+  EXPECT_EQ(reader.read(chunk, 100), 0u);
+
+  FlightLogHeader header;
+  EXPECT_FALSE(kr_flight_recorder::readFlightLog(filename_, header, chunk, error));
+  EXPECT_EQ(error, "truncated log");
+}
+
+TEST_F(FlightRecorderTest, ReadRejectsOtherFiles)
+{
+  FlightLogHeader header;
+  std::vector<uint8_t> records;
+  std::string error;
+  EXPECT_FALSE(kr_flight_recorder::readFlightLog(filename_, header, records, error));
+
+  std::ofstream(filename_) << "not a flight log, but long enough for a header";
+  EXPECT_FALSE(kr_flight_recorder::readFlightLog(filename_, header, records, error));
+  EXPECT_EQ(error, "not a flight log");
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,125 @@
+#ifndef SO3_COMMAND_GENERATOR_H
+#define SO3_COMMAND_GENERATOR_H
+
+#include <kr_flight_recorder/records.h>
+#include <kr_mav_controllers/SO3Config.h>
+#include <kr_mav_controllers/SO3Control.h>
+#include <kr_mav_msgs/Corrections.h>
+#include <kr_mav_msgs/PositionCommand.h>
+#include <kr_mav_msgs/SO3Command.h>
+#include <nav_msgs/Odometry.h>
+
+#include <Eigen/Geometry>
+#include <cmath>
+#include <string>
+
+/**
+ * @brief The SO3Command computation of the SO3ControlNodelet without its topics, so the controller can also be run
+ * without a ROS master, e.g. when replaying a bag. Not thread safe.
+ */
+class SO3CommandGenerator
+{
+ public:
+  SO3CommandGenerator();
+
+  /**
+   * @brief Read the params of the SO3ControlNodelet, from a ros::NodeHandle or any class with its param interface.
+   *
+   * @return The gains and limits read, for the dynamic_reconfigure server.
+   */
+  template <typename NodeHandle>
+  kr_mav_controllers::SO3Config loadParams(const NodeHandle &priv_nh);
+
+  // Set the parts of the config selected by level, the bits are the levels in SO3.cfg
+  void configure(const kr_mav_controllers::SO3Config &config, uint32_t level);
+
+  /**
+   * @return True if a command is due, i.e. no PositionCommand was given since the previous odometry.
+   */
+  bool setOdometry(const nav_msgs::Odometry &odom);
+  void setPositionCommand(const kr_mav_msgs::PositionCommand &cmd);
+  // Also resets the integrals
+  void setMotors(bool enable);
+  void setCorrections(const kr_mav_msgs::Corrections &msg);
+
+  /**
+   * @brief Compute a command from the last odometry and PositionCommand, stamped with ros::Time::now().
+   *
+   * @param compute_time Set to the time spent in SO3Control::calculateControl, in s.
+   *
+   * @return False if no odometry was given yet.
+   */
+  bool calculate(kr_mav_msgs::SO3Command &cmd, float &compute_time);
+
+  // The inputs and outputs of the last calculate(), for the flight recorder
+  void fillRecord(kr_flight_recorder::ControlRecord &r);
+
+  const Eigen::Vector3f &getDesiredPosition() const { return des_pos_; }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;  // Need this since we have SO3Control which needs aligned pointer
+
+ private:
+  SO3Control controller_;
+
+  bool position_cmd_updated_, position_cmd_init_;
+  std::string frame_id_;
+
+  Eigen::Vector3f des_pos_, des_vel_, des_acc_, des_jrk_, config_kx_, config_kv_, config_ki_, config_kib_, kx_, kv_;
+  float des_yaw_, des_yaw_dot_;
+  float current_yaw_;
+  bool enable_motors_, use_external_yaw_, have_odom_;
+  float kR_[3], kOm_[3], corrections_[3];
+  float mass_;
+  const float g_;
+  Eigen::Quaternionf current_orientation_;
+  Eigen::Vector3f odom_pos_, odom_vel_;
+  ros::Time odom_stamp_;
+};
+
+template <typename NodeHandle>
+kr_mav_controllers::SO3Config SO3CommandGenerator::loadParams(const NodeHandle &priv_nh)
+{
+  std::string quadrotor_name;
+  priv_nh.param("quadrotor_name", quadrotor_name, std::string("quadrotor"));
+  frame_id_ = "/" + quadrotor_name;
+
+  priv_nh.param("mass", mass_, 0.5f);
+  controller_.setMass(mass_);
+  controller_.setGravity(g_);
+
+  priv_nh.param("use_external_yaw", use_external_yaw_, true);
+
+  // Dynamic reconfigure struct
+  kr_mav_controllers::SO3Config config;
+  config.kp_x = priv_nh.param("gains/pos/x", 7.4f);
+  config.kp_y = priv_nh.param("gains/pos/y", 7.4f);
+  config.kp_z = priv_nh.param("gains/pos/z", 10.4f);
+  config.kd_x = priv_nh.param("gains/vel/x", 4.8f);
+  config.kd_y = priv_nh.param("gains/vel/y", 4.8f);
+  config.kd_z = priv_nh.param("gains/vel/z", 6.0f);
+  config.ki_x = priv_nh.param("gains/ki/x", 0.0f);
+  config.ki_y = priv_nh.param("gains/ki/y", 0.0f);
+  config.ki_z = priv_nh.param("gains/ki/z", 0.0f);
+  config.kib_x = priv_nh.param("gains/kib/x", 0.0f);
+  config.kib_y = priv_nh.param("gains/kib/y", 0.0f);
+  config.kib_z = priv_nh.param("gains/kib/z", 0.0f);
+  config.rot_x = priv_nh.param("gains/rot/x", 1.5f);
+  config.rot_y = priv_nh.param("gains/rot/y", 1.5f);
+  config.rot_z = priv_nh.param("gains/rot/z", 1.0f);
+  config.ang_x = priv_nh.param("gains/ang/x", 0.13f);
+  config.ang_y = priv_nh.param("gains/ang/y", 0.13f);
+  config.ang_z = priv_nh.param("gains/ang/z", 0.1f);
+  config.kf_correction = priv_nh.param("corrections/kf", 0.0f);
+  config.roll_correction = priv_nh.param("corrections/r", 0.0f);
+  config.pitch_correction = priv_nh.param("corrections/p", 0.0f);
+  config.max_pos_int = priv_nh.param("max_pos_int", 0.5f);
+  config.max_pos_int_b = priv_nh.param("mas_pos_int_b", 0.5f);
+  config.max_tilt_angle = priv_nh.param("max_tilt_angle", static_cast<float>(M_PI));
+
+  configure(config, ~0u);
+  kx_ = config_kx_;
+  kv_ = config_kv_;
+  return config;
+}
+
+#endif
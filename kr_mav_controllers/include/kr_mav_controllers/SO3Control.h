@@ -26,6 +26,8 @@ class SO3Control
   const Eigen::Vector3f &getComputedForce();
   const Eigen::Quaternionf &getComputedOrientation();
   const Eigen::Vector3f &getComputedAngularVelocity();
+  const Eigen::Vector3f &getPositionIntegral();
+  const Eigen::Vector3f &getPositionIntegralBody();
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
 
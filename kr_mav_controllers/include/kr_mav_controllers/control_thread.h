@@ -0,0 +1,41 @@
+#ifndef KR_MAV_CONTROLLERS_CONTROL_THREAD_H
+#define KR_MAV_CONTROLLERS_CONTROL_THREAD_H
+
+#include <ros/callback_queue.h>
+
+#include <atomic>
+#include <thread>
+
+/**
+ * @brief A thread of its own for the callbacks computing the commands, e.g. on odometry, so they neither share the
+ * nodelet manager threads with other nodelets nor wait behind the reconfigure service.
+ */
+class ControlThread
+{
+ public:
+  ControlThread();
+  ~ControlThread();
+
+  // Subscribe with a NodeHandle using this queue for the callbacks to run on the thread
+  ros::CallbackQueue *queue() { return &queue_; }
+
+  /**
+   * @brief Start spinning the queue.
+   *
+   * @param priority SCHED_FIFO priority of the thread, 0 keeps the default scheduling. Raising it needs the rtprio
+   * limit or CAP_SYS_NICE, without it a warning is logged and the thread runs at the default priority.
+   */
+  void start(int priority);
+
+  // Wait for the callback running, if any, and stop. The subscribers of the queue have to be shut down after this.
+  void stop();
+
+ private:
+  void spin();
+
+  ros::CallbackQueue queue_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+};
+
+#endif
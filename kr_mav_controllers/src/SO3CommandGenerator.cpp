@@ -0,0 +1,259 @@
+#include "kr_mav_controllers/SO3CommandGenerator.h"
+
+#include <ros/console.h>
+#include <tf/transform_datatypes.h>
+
+#include <chrono>
+#include <limits>
+
+SO3CommandGenerator::SO3CommandGenerator()
+    : position_cmd_updated_(false),
+      position_cmd_init_(false),
+      des_pos_(Eigen::Vector3f::Zero()),
+      des_vel_(Eigen::Vector3f::Zero()),
+      des_acc_(Eigen::Vector3f::Zero()),
+      des_jrk_(Eigen::Vector3f::Zero()),
+      des_yaw_(0),
+      des_yaw_dot_(0),
+      current_yaw_(0),
+      enable_motors_(false),
+      use_external_yaw_(false),
+      have_odom_(false),
+      mass_(0.5),
+      g_(9.81),
+      current_orientation_(Eigen::Quaternionf::Identity()),
+      odom_pos_(Eigen::Vector3f::Zero()),
+      odom_vel_(Eigen::Vector3f::Zero())
+{
+  controller_.resetIntegrals();
+}
+
+void SO3CommandGenerator::configure(const kr_mav_controllers::SO3Config &config, uint32_t level)
+{
+  if(level == 0)
+  {
+    ROS_DEBUG_STREAM("Nothing changed. level: " << level);
+    return;
+  }
+
+  if(level & (1 << 0))
+  {
+    config_kx_[0] = config.kp_x;
+    config_kx_[1] = config.kp_y;
+    config_kx_[2] = config.kp_z;
+
+    config_kv_[0] = config.kd_x;
+    config_kv_[1] = config.kd_y;
+    config_kv_[2] = config.kd_z;
+
+    ROS_INFO("Position Gains set to kp: {%2.3g, %2.3g, %2.3g}, kd: {%2.3g, %2.3g, %2.3g}", config_kx_[0],
+             config_kx_[1], config_kx_[2], config_kv_[0], config_kv_[1], config_kv_[2]);
+  }
+
+  if(level & (1 << 1))
+  {
+    config_ki_[0] = config.ki_x;
+    config_ki_[1] = config.ki_y;
+    config_ki_[2] = config.ki_z;
+
+    config_kib_[0] = config.kib_x;
+    config_kib_[1] = config.kib_y;
+    config_kib_[2] = config.kib_z;
+
+    ROS_INFO("Integral Gains set to ki: {%2.2g, %2.2g, %2.2g}, kib: {%2.2g, %2.2g, %2.2g}", config_ki_[0],
+             config_ki_[1], config_ki_[2], config_kib_[0], config_kib_[1], config_kib_[2]);
+  }
+
+  if(level & (1 << 2))
+  {
+    kR_[0] = config.rot_x;
+    kR_[1] = config.rot_y;
+    kR_[2] = config.rot_z;
+
+    kOm_[0] = config.ang_x;
+    kOm_[1] = config.ang_y;
+    kOm_[2] = config.ang_z;
+
+    ROS_INFO("Attitude Gains set to kp: {%2.2g, %2.2g, %2.2g}, kd: {%2.2g, %2.2g, %2.2g}", kR_[0], kR_[1], kR_[2],
+             kOm_[0], kOm_[1], kOm_[2]);
+  }
+
+  if(level & (1 << 3))
+  {
+    corrections_[0] = config.kf_correction;
+    corrections_[1] = config.roll_correction;
+    corrections_[2] = config.pitch_correction;
+    ROS_INFO("Corrections set to kf: %2.2g, roll: %2.2g, pitch: %2.2g", corrections_[0], corrections_[1],
+             corrections_[2]);
+  }
+
+  if(level & (1 << 4))
+  {
+    controller_.setMaxIntegral(config.max_pos_int);
+    controller_.setMaxIntegralBody(config.max_pos_int_b);
+    controller_.setMaxTiltAngle(config.max_tilt_angle);
+
+    ROS_INFO("Maxes set to Integral: %2.2g, Integral Body: %2.2g, Tilt Angle (rad): %2.2g", config.max_pos_int,
+             config.max_pos_int_b, config.max_tilt_angle);
+  }
+
+  ROS_WARN_STREAM_COND(level != std::numeric_limits<uint32_t>::max() && (level >= (1 << 5)),
+                       "kr_mav_controllers dynamic reconfigure called, but with unknown level: " << level);
+}
+
+bool SO3CommandGenerator::setOdometry(const nav_msgs::Odometry &odom)
+{
+  have_odom_ = true;
+
+  frame_id_ = odom.header.frame_id;
+
+  const Eigen::Vector3f position(odom.pose.pose.position.x, odom.pose.pose.position.y, odom.pose.pose.position.z);
+  const Eigen::Vector3f velocity(odom.twist.twist.linear.x, odom.twist.twist.linear.y, odom.twist.twist.linear.z);
+
+  current_yaw_ = tf::getYaw(odom.pose.pose.orientation);
+
+  current_orientation_ = Eigen::Quaternionf(odom.pose.pose.orientation.w, odom.pose.pose.orientation.x,
+                                            odom.pose.pose.orientation.y, odom.pose.pose.orientation.z);
+
+  odom_pos_ = position;
+  odom_vel_ = velocity;
+  odom_stamp_ = odom.header.stamp;
+
+  controller_.setPosition(position);
+  controller_.setVelocity(velocity);
+  controller_.setCurrentOrientation(current_orientation_);
+
+  bool command_due = false;
+  if(position_cmd_init_)
+  {
+    // We set position_cmd_updated_ = false and expect that setPositionCommand would set it to true since typically a
+    // position_cmd message would follow an odom message. If not, the caller has to compute the so3 command itself
+    // TODO: Fallback to hover if position_cmd hasn't been received for some time
+    command_due = !position_cmd_updated_;
+    position_cmd_updated_ = false;
+  }
+  return command_due;
+}
+
+void SO3CommandGenerator::setPositionCommand(const kr_mav_msgs::PositionCommand &cmd)
+{
+  des_pos_ = Eigen::Vector3f(cmd.position.x, cmd.position.y, cmd.position.z);
+  des_vel_ = Eigen::Vector3f(cmd.velocity.x, cmd.velocity.y, cmd.velocity.z);
+  des_acc_ = Eigen::Vector3f(cmd.acceleration.x, cmd.acceleration.y, cmd.acceleration.z);
+  des_jrk_ = Eigen::Vector3f(cmd.jerk.x, cmd.jerk.y, cmd.jerk.z);
+
+  // Check use_msg_gains_flag to decide whether to use gains from the msg or config
+  kx_[0] = (cmd.use_msg_gains_flags & cmd.USE_MSG_GAINS_POSITION_X) ? cmd.kx[0] : config_kx_[0];
+  kx_[1] = (cmd.use_msg_gains_flags & cmd.USE_MSG_GAINS_POSITION_Y) ? cmd.kx[1] : config_kx_[1];
+  kx_[2] = (cmd.use_msg_gains_flags & cmd.USE_MSG_GAINS_POSITION_Z) ? cmd.kx[2] : config_kx_[2];
+  kv_[0] = (cmd.use_msg_gains_flags & cmd.USE_MSG_GAINS_VELOCITY_X) ? cmd.kv[0] : config_kv_[0];
+  kv_[1] = (cmd.use_msg_gains_flags & cmd.USE_MSG_GAINS_VELOCITY_Y) ? cmd.kv[1] : config_kv_[1];
+  kv_[2] = (cmd.use_msg_gains_flags & cmd.USE_MSG_GAINS_VELOCITY_Z) ? cmd.kv[2] : config_kv_[2];
+
+  des_yaw_ = cmd.yaw;
+  des_yaw_dot_ = cmd.yaw_dot;
+  position_cmd_updated_ = true;
+  // position_cmd_init_ = true;
+}
+
+void SO3CommandGenerator::setMotors(bool enable)
+{
+  if(enable)
+    ROS_INFO("Enabling motors");
+  else
+    ROS_INFO("Disabling motors");
+
+  enable_motors_ = enable;
+  // Reset integral when toggling motor state
+  controller_.resetIntegrals();
+}
+
+void SO3CommandGenerator::setCorrections(const kr_mav_msgs::Corrections &msg)
+{
+  corrections_[0] = msg.kf_correction;
+  corrections_[1] = msg.angle_corrections[0];
+  corrections_[2] = msg.angle_corrections[1];
+}
+
+bool SO3CommandGenerator::calculate(kr_mav_msgs::SO3Command &cmd, float &compute_time)
+{
+  if(!have_odom_)
+  {
+    ROS_WARN("No odometry! Not publishing SO3Command.");
+    return false;
+  }
+
+  Eigen::Vector3f ki = Eigen::Vector3f::Zero();
+  Eigen::Vector3f kib = Eigen::Vector3f::Zero();
+  if(enable_motors_)
+  {
+    ki = config_ki_;
+    kib = config_kib_;
+  }
+
+  const auto compute_start = std::chrono::steady_clock::now();
+  controller_.calculateControl(des_pos_, des_vel_, des_acc_, des_jrk_, des_yaw_, des_yaw_dot_, kx_, kv_, ki, kib);
+  compute_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - compute_start).count();
+
+  const Eigen::Vector3f &force = controller_.getComputedForce();
+  const Eigen::Quaternionf &orientation = controller_.getComputedOrientation();
+  const Eigen::Vector3f &ang_vel = controller_.getComputedAngularVelocity();
+
+  cmd.header.stamp = ros::Time::now();
+  cmd.header.frame_id = frame_id_;
+  cmd.force.x = force(0);
+  cmd.force.y = force(1);
+  cmd.force.z = force(2);
+  cmd.orientation.x = orientation.x();
+  cmd.orientation.y = orientation.y();
+  cmd.orientation.z = orientation.z();
+  cmd.orientation.w = orientation.w();
+  cmd.angular_velocity.x = ang_vel(0);
+  cmd.angular_velocity.y = ang_vel(1);
+  cmd.angular_velocity.z = ang_vel(2);
+  for(int i = 0; i < 3; i++)
+  {
+    cmd.kR[i] = kR_[i];
+    cmd.kOm[i] = kOm_[i];
+  }
+  cmd.aux.current_yaw = current_yaw_;
+  cmd.aux.kf_correction = corrections_[0];
+  cmd.aux.angle_corrections[0] = corrections_[1];
+  cmd.aux.angle_corrections[1] = corrections_[2];
+  cmd.aux.enable_motors = enable_motors_;
+  cmd.aux.use_external_yaw = use_external_yaw_;
+  return true;
+}
+
+void SO3CommandGenerator::fillRecord(kr_flight_recorder::ControlRecord &r)
+{
+  const Eigen::Vector3f &force = controller_.getComputedForce();
+  const Eigen::Quaternionf &orientation = controller_.getComputedOrientation();
+  const Eigen::Vector3f &ang_vel = controller_.getComputedAngularVelocity();
+  const Eigen::Vector3f &pos_int = controller_.getPositionIntegral();
+  const Eigen::Vector3f &pos_int_b = controller_.getPositionIntegralBody();
+
+  r.odom_stamp = odom_stamp_.toNSec();
+  for(int i = 0; i < 3; i++)
+  {
+    r.pos[i] = odom_pos_(i);
+    r.vel[i] = odom_vel_(i);
+    r.des_pos[i] = des_pos_(i);
+    r.des_vel[i] = des_vel_(i);
+    r.des_acc[i] = des_acc_(i);
+    r.des_jrk[i] = des_jrk_(i);
+    r.force[i] = force(i);
+    r.ang_vel[i] = ang_vel(i);
+    r.pos_int[i] = pos_int(i);
+    r.pos_int_b[i] = pos_int_b(i);
+  }
+  // Eigen stores the coefficients as (x, y, z, w)
+  for(int i = 0; i < 4; i++)
+  {
+    r.orientation[i] = current_orientation_.coeffs()(i);
+    r.cmd_orientation[i] = orientation.coeffs()(i);
+  }
+  r.des_yaw = des_yaw_;
+  r.des_yaw_dot = des_yaw_dot_;
+  r.enable_motors = enable_motors_;
+}
@@ -156,6 +156,16 @@ const Eigen::Vector3f &SO3Control::getComputedAngularVelocity()
   return angular_velocity_;
 }
 
+const Eigen::Vector3f &SO3Control::getPositionIntegral()
+{
+  return pos_int_;
+}
+
+const Eigen::Vector3f &SO3Control::getPositionIntegralBody()
+{
+  return pos_int_b_;
+}
+
 void SO3Control::resetIntegrals()
 {
   pos_int_ = Eigen::Vector3f::Zero();
@@ -0,0 +1,45 @@
+#include "kr_mav_controllers/control_thread.h"
+
+#include <pthread.h>
+#include <ros/console.h>
+
+#include <cstring>
+
+ControlThread::ControlThread() : running_(false) {}
+
+ControlThread::~ControlThread()
+{
+  stop();
+}
+
+void ControlThread::start(int priority)
+{
+  if(thread_.joinable())
+    return;
+
+  running_ = true;
+  thread_ = std::thread(&ControlThread::spin, this);
+
+  if(priority > 0)
+  {
+    sched_param param = {};
+    param.sched_priority = priority;
+    const int err = pthread_setschedparam(thread_.native_handle(), SCHED_FIFO, &param);
+    if(err != 0)
+      ROS_WARN("Could not raise the control thread to SCHED_FIFO priority %d: %s", priority, strerror(err));
+  }
+}
+
+void ControlThread::stop()
+{
+  running_ = false;
+  if(thread_.joinable())
+    thread_.join();
+}
+
+void ControlThread::spin()
+{
+  // The timeout only bounds how long stop() waits when no messages come
+  while(running_)
+    queue_.callAvailable(ros::WallDuration(0.1));
+}
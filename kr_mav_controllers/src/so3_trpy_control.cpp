@@ -1,6 +1,7 @@
 #include <dynamic_reconfigure/server.h>
 #include <kr_mav_controllers/SO3Config.h>
 #include <kr_mav_controllers/SO3Control.h>
+#include <kr_mav_controllers/control_thread.h>
 #include <kr_mav_msgs/Corrections.h>
 #include <kr_mav_msgs/PositionCommand.h>
 #include <kr_mav_msgs/TRPYCommand.h>
@@ -10,6 +11,7 @@
 #include <std_msgs/Bool.h>
 
 #include <Eigen/Geometry>
+#include <mutex>
 
 #define CLAMP(x, min, max) ((x) < (min)) ? (min) : ((x) > (max)) ? (max) : (x)
 
@@ -25,10 +27,12 @@ class SO3TRPYControlNodelet : public nodelet::Nodelet
         yaw_int_(0),
         enable_motors_(false),
         use_external_yaw_(false),
-        g_(9.81)
+        g_(9.81),
+        pending_level_(0)
   {
     controller_.resetIntegrals();
   }
+  ~SO3TRPYControlNodelet();
 
   void onInit();
 
@@ -41,6 +45,8 @@ class SO3TRPYControlNodelet : public nodelet::Nodelet
   void enable_motors_callback(const std_msgs::Bool::ConstPtr &msg);
   void corrections_callback(const kr_mav_msgs::Corrections::ConstPtr &msg);
   void cfg_callback(kr_mav_controllers::SO3Config &config, uint32_t level);
+  void apply_pending_config();
+  void configure(const kr_mav_controllers::SO3Config &config, uint32_t level);
 
   SO3Control controller_;
   ros::Publisher trpy_command_pub_;
@@ -58,11 +64,25 @@ class SO3TRPYControlNodelet : public nodelet::Nodelet
   const float g_;
   Eigen::Quaternionf current_orientation_;
 
-  boost::recursive_mutex config_mutex_;
+  // Runs the subscriber callbacks, the only ones using the controller state
+  ControlThread control_thread_;
+
+  // Set by the reconfigure server, applied on the control thread before its next callback
+  std::mutex gains_mutex_;
+  kr_mav_controllers::SO3Config pending_config_;
+  uint32_t pending_level_;
+
+  boost::recursive_mutex reconfigure_mutex_;
   typedef dynamic_reconfigure::Server<kr_mav_controllers::SO3Config> ReconfigureServer;
   boost::shared_ptr<ReconfigureServer> reconfigure_server_;
 };
 
+SO3TRPYControlNodelet::~SO3TRPYControlNodelet()
+{
+  // The callbacks use the members, stop them before anything is destroyed
+  control_thread_.stop();
+}
+
 void SO3TRPYControlNodelet::publishCommand()
 {
   if(!odom_set_)
@@ -152,6 +172,7 @@ void SO3TRPYControlNodelet::publishCommand()
 
 void SO3TRPYControlNodelet::position_cmd_callback(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
 {
+  apply_pending_config();
   des_pos_ = Eigen::Vector3f(cmd->position.x, cmd->position.y, cmd->position.z);
   des_vel_ = Eigen::Vector3f(cmd->velocity.x, cmd->velocity.y, cmd->velocity.z);
   des_acc_ = Eigen::Vector3f(cmd->acceleration.x, cmd->acceleration.y, cmd->acceleration.z);
@@ -175,6 +196,7 @@ void SO3TRPYControlNodelet::position_cmd_callback(const kr_mav_msgs::PositionCom
 
 void SO3TRPYControlNodelet::odom_callback(const nav_msgs::Odometry::ConstPtr &odom)
 {
+  apply_pending_config();
   if(!odom_set_)
     odom_set_ = true;
 
@@ -203,6 +225,7 @@ void SO3TRPYControlNodelet::odom_callback(const nav_msgs::Odometry::ConstPtr &od
 
 void SO3TRPYControlNodelet::enable_motors_callback(const std_msgs::Bool::ConstPtr &msg)
 {
+  apply_pending_config();
   if(msg->data)
     ROS_INFO("Enabling motors");
   else
@@ -217,12 +240,36 @@ void SO3TRPYControlNodelet::enable_motors_callback(const std_msgs::Bool::ConstPt
 
 void SO3TRPYControlNodelet::corrections_callback(const kr_mav_msgs::Corrections::ConstPtr &msg)
 {
+  apply_pending_config();
   corrections_[0] = msg->kf_correction;
   corrections_[1] = msg->angle_corrections[0];
   corrections_[2] = msg->angle_corrections[1];
 }
 
 void SO3TRPYControlNodelet::cfg_callback(kr_mav_controllers::SO3Config &config, uint32_t level)
+{
+  // The config holds all the values, only the levels of the changes since the last one applied add up
+  std::lock_guard<std::mutex> lock(gains_mutex_);
+  pending_config_ = config;
+  pending_level_ |= level;
+}
+
+void SO3TRPYControlNodelet::apply_pending_config()
+{
+  kr_mav_controllers::SO3Config config;
+  uint32_t level;
+  {
+    std::lock_guard<std::mutex> lock(gains_mutex_);
+    if(pending_level_ == 0)
+      return;
+    config = pending_config_;
+    level = pending_level_;
+    pending_level_ = 0;
+  }
+  configure(config, level);
+}
+
+void SO3TRPYControlNodelet::configure(const kr_mav_controllers::SO3Config &config, uint32_t level)
 {
   if(level == 0)
   {
@@ -383,20 +430,29 @@ void SO3TRPYControlNodelet::onInit()
   controller_.setMaxTiltAngle(max_tilt_angle);
   config.max_tilt_angle = max_tilt_angle;
 
-  // Initialize dynamic reconfigure
-  reconfigure_server_ = boost::make_shared<ReconfigureServer>(config_mutex_, n);
+  // Initialize dynamic reconfigure. Its callback only hands the config to the control thread, so a reconfigure call
+  // never blocks the control callbacks for longer than the copy of the config.
+  reconfigure_server_ = boost::make_shared<ReconfigureServer>(reconfigure_mutex_, n);
   reconfigure_server_->updateConfig(config);
   reconfigure_server_->setCallback(boost::bind(&SO3TRPYControlNodelet::cfg_callback, this, _1, _2));
 
   trpy_command_pub_ = n.advertise<kr_mav_msgs::TRPYCommand>("trpy_cmd", 10);
 
-  odom_sub_ = n.subscribe("odom", 10, &SO3TRPYControlNodelet::odom_callback, this, ros::TransportHints().tcpNoDelay());
-  position_cmd_sub_ = n.subscribe("position_cmd", 10, &SO3TRPYControlNodelet::position_cmd_callback, this,
-                                  ros::TransportHints().tcpNoDelay());
-  enable_motors_sub_ = n.subscribe("motors", 2, &SO3TRPYControlNodelet::enable_motors_callback, this,
+  // The odometry and commands are handled on the control thread, at a raised priority if allowed
+  int control_priority;
+  n.param("control_thread_priority", control_priority, 50);
+  ros::NodeHandle control_nh(n);
+  control_nh.setCallbackQueue(control_thread_.queue());
+
+  odom_sub_ = control_nh.subscribe("odom", 10, &SO3TRPYControlNodelet::odom_callback, this,
                                    ros::TransportHints().tcpNoDelay());
-  corrections_sub_ = n.subscribe("corrections", 10, &SO3TRPYControlNodelet::corrections_callback, this,
-                                 ros::TransportHints().tcpNoDelay());
+  position_cmd_sub_ = control_nh.subscribe("position_cmd", 10, &SO3TRPYControlNodelet::position_cmd_callback, this,
+                                           ros::TransportHints().tcpNoDelay());
+  enable_motors_sub_ = control_nh.subscribe("motors", 2, &SO3TRPYControlNodelet::enable_motors_callback, this,
+                                            ros::TransportHints().tcpNoDelay());
+  corrections_sub_ = control_nh.subscribe("corrections", 10, &SO3TRPYControlNodelet::corrections_callback, this,
+                                          ros::TransportHints().tcpNoDelay());
+  control_thread_.start(control_priority);
 }
 
 #include <pluginlib/class_list_macros.h>
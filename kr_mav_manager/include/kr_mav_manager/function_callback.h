@@ -0,0 +1,27 @@
+#ifndef FUNCTION_CALLBACK_H
+#define FUNCTION_CALLBACK_H
+
+#include <ros/callback_queue_interface.h>
+
+#include <functional>
+
+namespace kr_mav_manager
+{
+// Posts a function to a callback queue, to run it in the thread spinning the queue
+class FunctionCallback : public ros::CallbackInterface
+{
+ public:
+  explicit FunctionCallback(const std::function<void(void)> &function) : function_(function) {}
+
+  CallResult call()
+  {
+    function_();
+    return Success;
+  }
+
+ private:
+  std::function<void(void)> function_;
+};
+
+}  // namespace kr_mav_manager
+#endif /* FUNCTION_CALLBACK_H */
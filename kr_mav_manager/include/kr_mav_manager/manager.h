@@ -4,16 +4,24 @@
 // Standard C++
 #include <Eigen/Geometry>
 #include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 // ROS related
 #include <actionlib/client/simple_action_client.h>
 #include <nav_msgs/Odometry.h>
+#include <ros/callback_queue.h>
 #include <ros/ros.h>
 #include <sensor_msgs/Imu.h>
 #include <std_msgs/Empty.h>
 
 // kr_mav_control
+#include <kr_mav_manager/MissionGoal.h>
 #include <kr_mav_msgs/OutputData.h>
 #include <kr_mav_msgs/PositionCommand.h>
 #include <kr_mav_msgs/SO3Command.h>
@@ -26,6 +34,13 @@
 
 namespace kr_mav_manager
 {
+enum class ServerState
+{
+  WAITING,
+  MISSING,  // Not found within the server_wait_timeout, still checked
+  CONNECTED
+};
+
 class MAVManager
 {
  public:
@@ -45,19 +60,32 @@ class MAVManager
     FLYING
   };
 
-  MAVManager(std::string ns = "");
-
-  // Accessors
-  Vec3 pos() { return pos_; }
-  Vec3 vel() { return vel_; }
-  Vec3 home() { return home_; }
-  float yaw() { return yaw_; }
-  float home_yaw() { return home_yaw_; }
+  /**
+   * @param ns Namespace of the vehicle
+   * @param priv_ns Namespace of the params and of the topics of the manager
+   * @param queue Callback queue for all the callbacks of the manager, including its action clients. If not given, the
+   * global queue is used and the action clients spin their own threads.
+   * @param sensor_queue Callback queue for the odometry, imu, output data, heartbeat and tracker status callbacks and
+   * the safety checks they run. It has to be spun apart from queue, so the safety checks keep going and the tracker
+   * status still arrives while a command waits on a service or an action. It may be shared with other managers and
+   * spun by several threads. If not given, the manager spins its own thread for them.
+   */
+  MAVManager(std::string ns = "", std::string priv_ns = "~", ros::CallbackQueueInterface *queue = NULL,
+             ros::CallbackQueueInterface *sensor_queue = NULL);
+  ~MAVManager();
+
+  // Accessors, all the methods can be called from any thread
+  Vec3 pos();
+  Vec3 vel();
+  Vec3 home();
+  float yaw();
+  float home_yaw();
   float mass() { return mass_; }
-  std::string active_tracker() { return active_tracker_; }
+  std::string active_tracker();
   bool need_imu() { return need_imu_; }
   bool need_odom() { return need_odom_; }
   Status status() { return status_; }
+  bool ready() { return ready_; }  // The required trackers and the transition service have been found
 
   // Mutators
   bool set_mass(float m);
@@ -98,6 +126,14 @@ class MAVManager
                           float y_num_periods[2], float z_num_periods[2], float yaw_num_periods[2], float period[2],
                           float num_cycles[2], float ramp_time[2]);
 
+  // Mission, each goal starts when the previous one ends. Consecutive line goals are queued in the LineTrackerMinJerk,
+  // and the goal for another tracker is sent ahead with a switch armed in the trackers manager for when the previous
+  // goal succeeds, which only happens if the command stays continuous. Any other motion command stops the mission and
+  // cancels its goals, as does a goal which does not succeed.
+  bool mission(const std::vector<kr_mav_manager::MissionGoal> &goals, bool append = false);
+  void stopMission();
+  size_t mission_size();
+
   // Direct low-level control
   bool setPositionCommand(const kr_mav_msgs::PositionCommand &cmd);
   bool setSO3Command(const kr_mav_msgs::SO3Command &cmd);
@@ -106,11 +142,11 @@ class MAVManager
 
   // Monitoring
   bool have_recent_odom(), have_recent_imu(), have_recent_output_data();
-  float voltage() { return voltage_; }
-  float pressure_height() { return pressure_height_; }
-  float pressure_dheight() { return pressure_dheight_; }
-  std::array<float, 3> magnetic_field() { return magnetic_field_; }
-  std::array<uint8_t, 8> radio() { return radio_; }
+  float voltage();
+  float pressure_height();
+  float pressure_dheight();
+  std::array<float, 3> magnetic_field();
+  std::array<uint8_t, 8> radio();
 
   // Safety
   bool hover();
@@ -130,6 +166,9 @@ class MAVManager
   typedef actionlib::SimpleActionClient<kr_tracker_msgs::LissajousTrackerAction> LissajousClientType;
   typedef actionlib::SimpleActionClient<kr_tracker_msgs::LissajousAdderAction> CompoundLissajousClientType;
 
+  // Used when no sensor queue is given, outlives the subscriptions and clients using it
+  std::unique_ptr<ros::CallbackQueue> own_sensor_queue_;
+
   ros::NodeHandle nh_;
   ros::NodeHandle priv_nh_;
 
@@ -147,13 +186,92 @@ class MAVManager
   void output_data_cb(const kr_mav_msgs::OutputData::ConstPtr &msg);
   void heartbeat_cb(const std_msgs::Empty::ConstPtr &msg);
   void tracker_status_cb(const kr_tracker_msgs::TrackerStatus::ConstPtr &msg);
+  // Runs in the thread of the action client, posts missionGoalDone to the command queue
+  void mission_done_callback(const actionlib::SimpleClientGoalState &state, unsigned int goal_id);
+  void missionGoalDone(const actionlib::SimpleClientGoalState &state, unsigned int goal_id);
   void heartbeat();
 
-  std::string active_tracker_;
+  // Safety actions requested by the sensor callbacks, in increasing priority
+  enum class SafetyAction
+  {
+    NONE,
+    EHOVER,
+    ELAND
+  };
+  // Posts the action to the command queue, where it runs once the command in progress returns, which takes at most
+  // service_timeout_ per transition and activation_timeout_ per goal. A pending action is only replaced by one of
+  // higher priority.
+  void requestSafetyAction(SafetyAction action);
+  void runSafetyAction();
+  void server_check_cb(const ros::WallTimerEvent &e);
+
+  // Sends the goal and activates the tracker, within the goal if transition_with_goal_ is set
+  bool sendLineTrackerGoal(ClientType &client, kr_tracker_msgs::LineTrackerGoal &goal, const std::string &tracker_str,
+                           const ClientType::SimpleDoneCallback &done_cb = ClientType::SimpleDoneCallback());
+  // Set by the done callback of a goal activating its tracker, guarded by state_mutex_
+  struct GoalOutcome
+  {
+    bool done = false;
+    bool succeeded = false;
+  };
+  // Waits for the tracker status to echo the send_time of the goal and returns whether its tracker was activated, false
+  // if the goal fails first or after activation_timeout_. The status arrives on the sensor queue, so this must not run
+  // in one of its callbacks.
+  bool waitForActivation(const ros::Time &send_time, const GoalOutcome &outcome);
+  // The checks the commands do for the tracker of the goal
+  bool checkMissionGoal(const kr_mav_manager::MissionGoal &goal);
+  // Sends the goals which can start from the end of the goals before them
+  bool sendMissionGoals();
+  // Sends the goal and activates its tracker
+  bool startMissionGoal(const kr_mav_manager::MissionGoal &goal, unsigned int goal_id);
+  // Only sends the goal, queue is for line goals
+  bool sendMissionTrackerGoal(const kr_mav_manager::MissionGoal &goal, unsigned int goal_id, bool queue);
+  // Arms the tracker to take over when the active one succeeds, an empty tracker disarms
+  bool transitionWhenDone(const std::string &tracker_str);
+  // Calls a transition service, waiting at most service_timeout_ so the commands, and the safety actions queued behind
+  // them, are not held up by a trackers manager which does not answer. A call which times out is left to finish on
+  // its own thread and the client is reconnected, so the next call does not queue behind it on the same connection.
+  bool callTransition(ros::ServiceClient &client, const std::string &service, const std::string &tracker_str,
+                      std::string &message);
+
+  // Held by the commands and the callbacks sending goals, so only one of them runs at a time. The sensor callbacks
+  // never take it, they post their safety actions to the command queue instead.
+  std::recursive_mutex command_mutex_;
+  std::atomic<SafetyAction> pending_safety_action_;
+
+  // Guards the state written by the sensor callbacks: the odometry, imu and output data, the times they were received
+  // and the active tracker
+  std::mutex state_mutex_;
 
-  Status status_;
+  std::string active_tracker_;
+  // The last activation request echoed in the tracker status
+  ros::Time activation_request_;
+  bool activation_succeeded_;
+  std::condition_variable tracker_status_cv_;
+  bool transition_with_goal_;
+  float activation_timeout_, service_timeout_;
+
+  // The goals of the mission which have not finished, the first one is being tracked. The first mission_sent_ goals
+  // were sent, the last of them is armed if mission_armed_ is set. The goals are numbered from mission_front_id_, so
+  // that a late result from an earlier goal cannot advance or stop the current mission.
+  std::deque<kr_mav_manager::MissionGoal> mission_;
+  size_t mission_sent_;
+  bool mission_armed_;
+  bool sending_mission_goal_;
+  unsigned int mission_front_id_;
+
+  std::atomic<Status> status_;
+
+  // Line trackers, optional trackers and the transition service, in the order they are checked by server_check_cb
+  std::array<ServerState, 6> server_states_;
+  ros::WallTimer server_check_timer_;
+  ros::WallTime server_check_start_;
+  float server_wait_timeout_;
+  std::atomic<bool> ready_;
 
   ros::Time last_odom_t_, last_imu_t_, last_output_data_t_, last_heartbeat_t_;
+  // Held by the sensor callback running the heartbeat, the others skip it
+  std::mutex heartbeat_mutex_;
 
   Vec3 pos_, vel_;
   float mass_;
@@ -161,13 +279,17 @@ class MAVManager
   float yaw_, yaw_dot_;
   float takeoff_height_;
   float max_attitude_angle_;
+  float attitude_limit_timer_;  // Time the attitude has been over max_attitude_angle_
   float odom_timeout_;
 
   Vec3 home_, goal_;
   float home_yaw_;
 
-  bool need_imu_, need_output_data_, need_odom_, use_attitude_safety_catch_;
-  bool home_set_, motors_;
+  // Read by the heartbeat on the sensor queue, set by the commands
+  std::atomic<bool> need_imu_, need_odom_, use_attitude_safety_catch_;
+  bool need_output_data_;
+  bool home_set_;
+  std::atomic<bool> motors_;
   float voltage_, pressure_height_, pressure_dheight_;
   std::array<float, 3> magnetic_field_;
   std::array<uint8_t, 8> radio_;
@@ -181,13 +303,16 @@ class MAVManager
 
   // Publishers
   ros::Publisher pub_motors_, pub_estop_, pub_goal_yaw_, pub_goal_velocity_, pub_so3_command_, pub_trpy_command_,
-      pub_position_command_, pub_status_, pub_pwm_command_;
+      pub_position_command_, pub_status_, pub_pwm_command_, pub_ready_;
 
   // Subscribers
   ros::Subscriber odom_sub_, imu_sub_, output_data_sub_, heartbeat_sub_, tracker_status_sub_;
 
   // Services
-  ros::ServiceClient srv_transition_;
+  ros::ServiceClient srv_transition_, srv_transition_when_done_;
+
+  // Spins own_sensor_queue_, stopped first
+  std::unique_ptr<ros::AsyncSpinner> sensor_spinner_;
 };
 
 }  // namespace kr_mav_manager
@@ -5,6 +5,7 @@
 #include <kr_mav_manager/CompoundLissajous.h>
 #include <kr_mav_manager/GoalTimed.h>
 #include <kr_mav_manager/Lissajous.h>
+#include <kr_mav_manager/Mission.h>
 #include <kr_mav_manager/Vec4.h>
 #include <kr_mav_manager/manager.h>
 #include <std_srvs/SetBool.h>
@@ -121,6 +122,14 @@ class MAVManagerServices
       last_cb_ = "compound_lissajous";
     return true;
   }
+  bool mission_cb(kr_mav_manager::Mission::Request &req, kr_mav_manager::Mission::Response &res)
+  {
+    res.success = mav->mission(req.goals, req.append);
+    res.message = "Mission with " + std::to_string(mav->mission_size()) + " goals";
+    if(res.success)
+      last_cb_ = "mission";
+    return true;
+  }
   bool hover_cb(std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res)
   {
     res.success = mav->hover();
@@ -162,8 +171,9 @@ class MAVManagerServices
     return true;
   }
 
-  // Constructor
-  MAVManagerServices(std::shared_ptr<MAVManager> m) : nh_("~"), mav(m), last_cb_("")
+  // Constructor, the services are advertised in the namespace and with the callback queue of nh
+  MAVManagerServices(std::shared_ptr<MAVManager> m, const ros::NodeHandle &nh = ros::NodeHandle("~"))
+      : nh_(nh), mav(m), last_cb_("")
   {
     srvs_.push_back(nh_.advertiseService("motors", &MAVManagerServices::motors_cb, this));
     srvs_.push_back(nh_.advertiseService("takeoff", &MAVManagerServices::takeoff_cb, this));
@@ -176,6 +186,7 @@ class MAVManagerServices
     srvs_.push_back(nh_.advertiseService("circle", &MAVManagerServices::circle_cb, this));
     srvs_.push_back(nh_.advertiseService("lissajous", &MAVManagerServices::lissajous_cb, this));
     srvs_.push_back(nh_.advertiseService("compound_lissajous", &MAVManagerServices::compound_lissajous_cb, this));
+    srvs_.push_back(nh_.advertiseService("mission", &MAVManagerServices::mission_cb, this));
     srvs_.push_back(nh_.advertiseService("hover", &MAVManagerServices::hover_cb, this));
     srvs_.push_back(nh_.advertiseService("ehover", &MAVManagerServices::ehover_cb, this));
     srvs_.push_back(nh_.advertiseService("land", &MAVManagerServices::land_cb, this));
@@ -1,13 +1,18 @@
 // kr_mav_manager
+#include <kr_mav_manager/function_callback.h>
 #include <kr_mav_manager/manager.h>
 
 // Standard C++
 #include <math.h>
 
+#include <algorithm>
+#include <chrono>
 #include <string>
+#include <thread>
 
 // ROS Related
 #include <actionlib/client/simple_action_client.h>
+#include <boost/make_shared.hpp>
 #include <ros/ros.h>
 #include <std_msgs/Bool.h>
 #include <std_msgs/Empty.h>
@@ -29,11 +34,30 @@ static const std::string circle_tracker_str("kr_trackers/CircleTracker");
 static const std::string lissajous_tracker_str("kr_trackers/LissajousTracker");
 static const std::string lissajous_adder_str("kr_trackers/LissajousAdder");
 
-MAVManager::MAVManager(std::string ns)
-    : nh_(ns),
-      priv_nh_("~"),
+static ros::NodeHandle make_node_handle(const std::string &ns, ros::CallbackQueueInterface *queue)
+{
+  ros::NodeHandle nh(ns);
+  if(queue != NULL)
+    nh.setCallbackQueue(queue);
+  return nh;
+}
+
+MAVManager::MAVManager(std::string ns, std::string priv_ns, ros::CallbackQueueInterface *queue,
+                       ros::CallbackQueueInterface *sensor_queue)
+    : nh_(make_node_handle(ns, queue)),
+      priv_nh_(make_node_handle(priv_ns, queue)),
+      pending_safety_action_(SafetyAction::NONE),
       active_tracker_(""),
+      activation_succeeded_(false),
+      transition_with_goal_(true),
+      activation_timeout_(0.5),
+      service_timeout_(0.5),
+      mission_sent_(0),
+      mission_armed_(false),
+      sending_mission_goal_(false),
+      mission_front_id_(0),
       status_(INIT),
+      ready_(false),
       last_odom_t_(0.0),
       last_imu_t_(0.0),
       last_output_data_t_(0.0),
@@ -42,45 +66,23 @@ MAVManager::MAVManager(std::string ns)
       odom_q_(1.0, 0.0, 0.0, 0.0),
       imu_q_(1.0, 0.0, 0.0, 0.0),
       max_attitude_angle_(45.0 / 180.0 * M_PI),
+      attitude_limit_timer_(0),
       need_imu_(false),
-      need_output_data_(true),
       need_odom_(true),
       use_attitude_safety_catch_(true),
-      line_tracker_distance_client_(nh_, "trackers_manager/line_tracker_distance/LineTracker", true),
-      line_tracker_min_jerk_client_(nh_, "trackers_manager/line_tracker_min_jerk/LineTracker", true),
-      circle_tracker_client_(nh_, "trackers_manager/circle_tracker/CircleTracker", true),
-      lissajous_tracker_client_(nh_, "trackers_manager/lissajous_tracker/LissajousTracker", true),
-      lissajous_adder_client_(nh_, "trackers_manager/lissajous_adder/LissajousAdder", true)
+      need_output_data_(true),
+      home_set_(false),
+      motors_(false),
+      line_tracker_distance_client_(nh_, "trackers_manager/line_tracker_distance/LineTracker", queue == NULL),
+      line_tracker_min_jerk_client_(nh_, "trackers_manager/line_tracker_min_jerk/LineTracker", queue == NULL),
+      circle_tracker_client_(nh_, "trackers_manager/circle_tracker/CircleTracker", queue == NULL),
+      lissajous_tracker_client_(nh_, "trackers_manager/lissajous_tracker/LissajousTracker", queue == NULL),
+      lissajous_adder_client_(nh_, "trackers_manager/lissajous_adder/LissajousAdder", queue == NULL)
 {
-  // Action servers.
-  float server_wait_timeout;
-  priv_nh_.param("server_wait_timeout", server_wait_timeout, 0.5f);
-
-  if(!line_tracker_distance_client_.waitForServer(ros::Duration(server_wait_timeout)))
-  {
-    ROS_ERROR("LineTrackerDistance server not found.");
-  }
-
-  if(!line_tracker_min_jerk_client_.waitForServer(ros::Duration(server_wait_timeout)))
-  {
-    ROS_ERROR("LineTrackerMinJerk server not found.");
-  }
-
-  // Optional trackers.
-  if(!circle_tracker_client_.waitForServer(ros::Duration(server_wait_timeout)))
-  {
-    ROS_WARN("CircleTracker server not found.");
-  }
-
-  if(!lissajous_tracker_client_.waitForServer(ros::Duration(server_wait_timeout)))
-  {
-    ROS_WARN("LissajousTracker server not found.");
-  }
-
-  if(!lissajous_adder_client_.waitForServer(ros::Duration(server_wait_timeout)))
-  {
-    ROS_WARN("LissajousAdder server not found.");
-  }
+  // The servers are found in the background by server_check_cb, so the manager can be reached right away and the
+  // clients connect concurrently. The required ones are reported after server_wait_timeout.
+  priv_nh_.param("server_wait_timeout", server_wait_timeout_, 0.5f);
+  server_states_.fill(ServerState::WAITING);
 
   pub_motors_ = nh_.advertise<std_msgs::Bool>("motors", 10);
   pub_estop_ = nh_.advertise<std_msgs::Empty>("estop", 10);
@@ -88,35 +90,46 @@ MAVManager::MAVManager(std::string ns)
   pub_trpy_command_ = nh_.advertise<kr_mav_msgs::TRPYCommand>("trpy_cmd", 10);
   pub_position_command_ = nh_.advertise<kr_mav_msgs::PositionCommand>("position_cmd", 10);
   pub_status_ = priv_nh_.advertise<std_msgs::UInt8>("status", 10);
+  pub_ready_ = priv_nh_.advertise<std_msgs::Bool>("ready", 1, true);
   pub_goal_velocity_ = nh_.advertise<kr_tracker_msgs::VelocityGoal>("trackers_manager/velocity_tracker/goal", 10);
 
   // pwm_command_pub_ = nh_ ...
 
-  // Subscribers
-  odom_sub_ = nh_.subscribe("odom", 10, &MAVManager::odometry_cb, this, ros::TransportHints().tcpNoDelay());
-  heartbeat_sub_ = nh_.subscribe("heartbeat", 10, &MAVManager::heartbeat_cb, this, ros::TransportHints().tcpNoDelay());
-  tracker_status_sub_ = nh_.subscribe("trackers_manager/status", 10, &MAVManager::tracker_status_cb, this,
-                                      ros::TransportHints().tcpNoDelay());
-
-  // Services
-  srv_transition_ = nh_.serviceClient<kr_tracker_msgs::Transition>("trackers_manager/transition");
-
-  srv_transition_.waitForExistence();
-  if(!this->transition(null_tracker_str))
-    ROS_FATAL("Activation of NullTracker failed.");
-
-  // Load params after we are sure that we have stuff loaded
-  if(!priv_nh_.getParam("need_imu", need_imu_))
+  // Subscribers, on the sensor queue so they are not held up by the services and actions
+  if(sensor_queue == NULL)
+  {
+    own_sensor_queue_.reset(new ros::CallbackQueue);
+    sensor_queue = own_sensor_queue_.get();
+  }
+  ros::NodeHandle sensor_nh(nh_);
+  sensor_nh.setCallbackQueue(sensor_queue);
+  odom_sub_ = sensor_nh.subscribe("odom", 10, &MAVManager::odometry_cb, this, ros::TransportHints().tcpNoDelay());
+  heartbeat_sub_ =
+      sensor_nh.subscribe("heartbeat", 10, &MAVManager::heartbeat_cb, this, ros::TransportHints().tcpNoDelay());
+  tracker_status_sub_ = sensor_nh.subscribe("trackers_manager/status", 10, &MAVManager::tracker_status_cb, this,
+                                            ros::TransportHints().tcpNoDelay());
+
+  // Services, the connection is kept to avoid setting it up on each transition
+  srv_transition_ = nh_.serviceClient<kr_tracker_msgs::Transition>("trackers_manager/transition", true);
+  srv_transition_when_done_ =
+      nh_.serviceClient<kr_tracker_msgs::Transition>("trackers_manager/transition_when_done", true);
+
+  bool flag;
+  if(priv_nh_.getParam("need_imu", flag))
+    need_imu_ = flag;
+  else
     ROS_WARN("Couldn't find need_imu param");
   if(need_imu_)
-    imu_sub_ = nh_.subscribe("quad_decode_msg/imu", 10, &MAVManager::imu_cb, this);
+    imu_sub_ = sensor_nh.subscribe("quad_decode_msg/imu", 10, &MAVManager::imu_cb, this);
 
   if(!priv_nh_.getParam("need_output_data", need_output_data_))
     ROS_WARN("Couldn't find need_output_data param");
   if(need_output_data_)
-    output_data_sub_ = nh_.subscribe("quad_decode_msg/output_data", 10, &MAVManager::output_data_cb, this);
+    output_data_sub_ = sensor_nh.subscribe("quad_decode_msg/output_data", 10, &MAVManager::output_data_cb, this);
 
-  if(!priv_nh_.getParam("use_attitude_safety_catch", use_attitude_safety_catch_))
+  if(priv_nh_.getParam("use_attitude_safety_catch", flag))
+    use_attitude_safety_catch_ = flag;
+  else
     ROS_WARN("Couldn't find use_attitude_safety_catch param");
 
   if(!priv_nh_.getParam("max_attitude_angle", max_attitude_angle_))
@@ -131,10 +144,152 @@ MAVManager::MAVManager(std::string ns)
     ROS_ERROR("Mass failed to set. Perhaps mass <= 0?");
 
   priv_nh_.param("odom_timeout", odom_timeout_, 0.1f);
+  priv_nh_.param("transition_with_goal", transition_with_goal_, true);
+  priv_nh_.param("activation_timeout", activation_timeout_, 0.5f);
+  priv_nh_.param("service_timeout", service_timeout_, 0.5f);
+
+  std_msgs::Bool ready_msg;
+  ready_msg.data = false;
+  pub_ready_.publish(ready_msg);
+
+  server_check_start_ = ros::WallTime::now();
+  server_check_timer_ = nh_.createWallTimer(ros::WallDuration(0.05), &MAVManager::server_check_cb, this);
+
+  if(own_sensor_queue_)
+  {
+    sensor_spinner_.reset(new ros::AsyncSpinner(1, own_sensor_queue_.get()));
+    sensor_spinner_->start();
+  }
+}
+
+MAVManager::Vec3 MAVManager::pos()
+{
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  return pos_;
+}
+
+MAVManager::Vec3 MAVManager::vel()
+{
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  return vel_;
+}
+
+MAVManager::Vec3 MAVManager::home()
+{
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
+  return home_;
+}
+
+float MAVManager::yaw()
+{
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  return yaw_;
+}
+
+float MAVManager::home_yaw()
+{
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
+  return home_yaw_;
+}
+
+std::string MAVManager::active_tracker()
+{
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  return active_tracker_;
+}
+
+size_t MAVManager::mission_size()
+{
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
+  return mission_.size();
+}
+
+float MAVManager::voltage()
+{
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  return voltage_;
+}
+
+float MAVManager::pressure_height()
+{
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  return pressure_height_;
+}
+
+float MAVManager::pressure_dheight()
+{
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  return pressure_dheight_;
+}
+
+std::array<float, 3> MAVManager::magnetic_field()
+{
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  return magnetic_field_;
+}
 
-  // Disable motors
-  if(!this->set_motors(false))
-    ROS_ERROR("Could not disable motors");
+std::array<uint8_t, 8> MAVManager::radio()
+{
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  return radio_;
+}
+
+static void check_server(bool connected, const char *name, bool required, bool timed_out, ServerState &state)
+{
+  if(connected && state != ServerState::CONNECTED)
+  {
+    // Only worth a message when it was reported missing before
+    if(state == ServerState::MISSING)
+      ROS_INFO("%s server connected.", name);
+    state = ServerState::CONNECTED;
+  }
+  else if(!connected && timed_out && state == ServerState::WAITING)
+  {
+    if(required)
+      ROS_ERROR("%s server not found.", name);
+    else
+      ROS_WARN("%s server not found, it will be used once it appears.", name);
+    state = ServerState::MISSING;
+  }
+}
+
+void MAVManager::server_check_cb(const ros::WallTimerEvent &e)
+{
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
+  const bool timed_out = (ros::WallTime::now() - server_check_start_).toSec() > server_wait_timeout_;
+
+  check_server(line_tracker_distance_client_.isServerConnected(), "LineTrackerDistance", true, timed_out,
+               server_states_[0]);
+  check_server(line_tracker_min_jerk_client_.isServerConnected(), "LineTrackerMinJerk", true, timed_out,
+               server_states_[1]);
+  check_server(circle_tracker_client_.isServerConnected(), "CircleTracker", false, timed_out, server_states_[2]);
+  check_server(lissajous_tracker_client_.isServerConnected(), "LissajousTracker", false, timed_out,
+               server_states_[3]);
+  check_server(lissajous_adder_client_.isServerConnected(), "LissajousAdder", false, timed_out, server_states_[4]);
+  if(server_states_[5] != ServerState::CONNECTED)
+    check_server(srv_transition_.exists(), "Transition", true, timed_out, server_states_[5]);
+
+  if(!ready_ && server_states_[0] == ServerState::CONNECTED && server_states_[1] == ServerState::CONNECTED &&
+     server_states_[5] == ServerState::CONNECTED)
+  {
+    if(!this->transition(null_tracker_str))
+      ROS_FATAL("Activation of NullTracker failed.");
+
+    // Disable motors
+    if(!this->set_motors(false))
+      ROS_ERROR("Could not disable motors");
+
+    ready_ = true;
+    std_msgs::Bool ready_msg;
+    ready_msg.data = true;
+    pub_ready_.publish(ready_msg);
+    ROS_INFO("MAVManager ready after %2.2f s.", (ros::WallTime::now() - server_check_start_).toSec());
+  }
+
+  // The optional trackers attach whenever their servers appear, so the check only stops once everything is connected
+  if(ready_ && std::all_of(server_states_.begin(), server_states_.end(),
+                           [](ServerState state) { return state == ServerState::CONNECTED; }))
+    server_check_timer_.stop();
 }
 
 void MAVManager::tracker_done_callback(const actionlib::SimpleClientGoalState &state,
@@ -168,6 +323,7 @@ void MAVManager::lissajous_adder_done_callback(const actionlib::SimpleClientGoal
 
 void MAVManager::odometry_cb(const nav_msgs::Odometry::ConstPtr &msg)
 {
+  std::unique_lock<std::mutex> lock(state_mutex_);
   pos_(0) = msg->pose.pose.position.x;
   pos_(1) = msg->pose.pose.position.y;
   pos_(2) = msg->pose.pose.position.z;
@@ -183,12 +339,14 @@ void MAVManager::odometry_cb(const nav_msgs::Odometry::ConstPtr &msg)
   yaw_dot_ = msg->twist.twist.angular.z;
 
   last_odom_t_ = ros::Time::now();
+  lock.unlock();
 
   this->heartbeat();
 }
 
 bool MAVManager::takeoff()
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   if(!this->have_recent_odom())
   {
     ROS_WARN("Cannot takeoff without odometry.");
@@ -205,7 +363,7 @@ bool MAVManager::takeoff()
   }
 
   // Only takeoff if currently under NULL_TRACKER
-  if(active_tracker_.compare(null_tracker_str) != 0)
+  if(this->active_tracker().compare(null_tracker_str) != 0)
   {
     ROS_WARN("The Null Tracker must be active before taking off");
     return false;
@@ -227,10 +385,7 @@ bool MAVManager::takeoff()
   kr_tracker_msgs::LineTrackerGoal goal;
   goal.z = takeoff_height_;
   goal.relative = true;
-  line_tracker_distance_client_.sendGoal(goal, boost::bind(&MAVManager::tracker_done_callback, this, _1, _2),
-                                         ClientType::SimpleActiveCallback(), ClientType::SimpleFeedbackCallback());
-
-  if(this->transition(line_tracker_distance))
+  if(this->sendLineTrackerGoal(line_tracker_distance_client_, goal, line_tracker_distance))
   {
     status_ = FLYING;
     return true;
@@ -241,6 +396,7 @@ bool MAVManager::takeoff()
 
 bool MAVManager::set_mass(float m)
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   if(m > 0)
   {
     // TODO: This should update the mass in the controller and everywhere else that is necessary.
@@ -256,10 +412,11 @@ bool MAVManager::set_mass(float m)
 
 bool MAVManager::setHome()
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   if(this->have_recent_odom())
   {
-    home_ = pos_;
-    home_yaw_ = yaw_;
+    home_ = this->pos();
+    home_yaw_ = this->yaw();
     home_set_ = true;
 
     return true;
@@ -272,6 +429,7 @@ bool MAVManager::setHome()
 
 bool MAVManager::goHome()
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   if(home_set_)
     return this->goTo(home_ + Vec3(0, 0, 0.15), home_yaw_);
   else
@@ -283,25 +441,25 @@ bool MAVManager::goHome()
 
 bool MAVManager::land()
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   if(!this->motors() || status_ != FLYING)
   {
     ROS_WARN("Not landing since the robot is not already flying.");
     return false;
   }
 
+  const Vec3 pos = this->pos();
   kr_tracker_msgs::LineTrackerGoal goal;
-  goal.x = pos_(0);
-  goal.y = pos_(1);
+  goal.x = pos(0);
+  goal.y = pos(1);
   goal.z = home_(2);
   std::cout << " landing at " << goal.x << " " << goal.y << " " << goal.z << "\n";
-  line_tracker_distance_client_.sendGoal(goal, boost::bind(&MAVManager::tracker_done_callback, this, _1, _2),
-                                         ClientType::SimpleActiveCallback(), ClientType::SimpleFeedbackCallback());
-
-  return this->transition(line_tracker_distance);
+  return this->sendLineTrackerGoal(line_tracker_distance_client_, goal, line_tracker_distance);
 }
 
 bool MAVManager::goTo(float x, float y, float z, float yaw, float v_des, float a_des, bool relative)
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   if(!this->motors() || status_ != FLYING)
   {
     ROS_WARN("The robot must be flying before using the goTo method.");
@@ -316,8 +474,9 @@ bool MAVManager::goTo(float x, float y, float z, float yaw, float v_des, float a
   // Convert relative translation in body frame to global frame
   if(relative)
   {
-    goal.x = x * std::cos(yaw_) - y * std::sin(yaw_);
-    goal.y = x * std::sin(yaw_) + y * std::cos(yaw_);
+    const float cur_yaw = this->yaw();
+    goal.x = x * std::cos(cur_yaw) - y * std::sin(cur_yaw);
+    goal.y = x * std::sin(cur_yaw) + y * std::cos(cur_yaw);
   }
 
   goal.z = z;
@@ -325,15 +484,13 @@ bool MAVManager::goTo(float x, float y, float z, float yaw, float v_des, float a
   goal.v_des = v_des;
   goal.a_des = a_des;
 
-  line_tracker_min_jerk_client_.sendGoal(goal, boost::bind(&MAVManager::tracker_done_callback, this, _1, _2),
-                                         ClientType::SimpleActiveCallback(), ClientType::SimpleFeedbackCallback());
-
-  return this->transition(line_tracker_min_jerk);
+  return this->sendLineTrackerGoal(line_tracker_min_jerk_client_, goal, line_tracker_min_jerk);
 }
 
 bool MAVManager::goToTimed(float x, float y, float z, float yaw, float v_des, float a_des, bool relative,
                            ros::Duration duration, ros::Time t_start)
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   kr_tracker_msgs::LineTrackerGoal goal;
   goal.x = x;
   goal.y = y;
@@ -342,8 +499,9 @@ bool MAVManager::goToTimed(float x, float y, float z, float yaw, float v_des, fl
   // Convert relative translation in body frame to global frame
   if(relative)
   {
-    goal.x = x * std::cos(yaw_) - y * std::sin(yaw_);
-    goal.y = x * std::sin(yaw_) + y * std::cos(yaw_);
+    const float cur_yaw = this->yaw();
+    goal.x = x * std::cos(cur_yaw) - y * std::sin(cur_yaw);
+    goal.y = x * std::sin(cur_yaw) + y * std::cos(cur_yaw);
   }
 
   goal.z = z;
@@ -353,12 +511,10 @@ bool MAVManager::goToTimed(float x, float y, float z, float yaw, float v_des, fl
   goal.v_des = v_des;
   goal.a_des = a_des;
 
-  line_tracker_min_jerk_client_.sendGoal(goal, boost::bind(&MAVManager::tracker_done_callback, this, _1, _2),
-                                         ClientType::SimpleActiveCallback(), ClientType::SimpleFeedbackCallback());
   ROS_INFO("Going to {%2.2f, %2.2f, %2.2f, %2.2f}%s with duration %2.2f", x, y, z, yaw,
            (relative ? " relative to the current position." : ""), duration.toSec());
 
-  return this->transition(line_tracker_min_jerk);
+  return this->sendLineTrackerGoal(line_tracker_min_jerk_client_, goal, line_tracker_min_jerk);
 }
 
 bool MAVManager::goTo(Vec4 xyz_yaw, Vec2 v_and_a_des)
@@ -371,21 +527,31 @@ bool MAVManager::goTo(Vec3 xyz, float yaw, Vec2 v_and_a_des)
 }
 bool MAVManager::goTo(Vec3 xyz, Vec2 v_and_a_des)
 {
-  return this->goTo(xyz(0), xyz(1), xyz(2), yaw_, v_and_a_des(0), v_and_a_des(1));
+  return this->goTo(xyz(0), xyz(1), xyz(2), this->yaw(), v_and_a_des(0), v_and_a_des(1));
 }
 bool MAVManager::goToYaw(float yaw)
 {
-  return this->goTo(pos_(0), pos_(1), pos_(2), yaw);
+  const Vec3 pos = this->pos();
+  return this->goTo(pos(0), pos(1), pos(2), yaw);
 }
 
 bool MAVManager::circle(float Ax, float Ay, float T, float duration)
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   if(!this->motors() || status_ != FLYING)
   {
     ROS_WARN("The robot must be flying before using the circle method.");
     return false;
   }
 
+  if(!circle_tracker_client_.isServerConnected())
+  {
+    ROS_WARN("CircleTracker server not connected.");
+    return false;
+  }
+
+  this->stopMission();
+
   kr_tracker_msgs::CircleTrackerGoal goal;
   goal.Ax = Ax;
   goal.Ay = Ay;
@@ -402,12 +568,21 @@ bool MAVManager::lissajous(float x_amp, float y_amp, float z_amp, float yaw_amp,
                            float y_num_periods, float z_num_periods, float yaw_num_periods, float period,
                            float num_cycles, float ramp_time)
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   if(!this->motors() || status_ != FLYING)
   {
     ROS_WARN("The robot must be flying to execute a Lissajous.");
     return false;
   }
 
+  if(!lissajous_tracker_client_.isServerConnected())
+  {
+    ROS_WARN("LissajousTracker server not connected.");
+    return false;
+  }
+
+  this->stopMission();
+
   kr_tracker_msgs::LissajousTrackerGoal goal;
   goal.x_amp = x_amp;
   goal.y_amp = y_amp;
@@ -432,12 +607,21 @@ bool MAVManager::compound_lissajous(float x_amp[2], float y_amp[2], float z_amp[
                                     float x_num_periods[2], float y_num_periods[2], float z_num_periods[2],
                                     float yaw_num_periods[2], float period[2], float num_cycles[2], float ramp_time[2])
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   if(!this->motors() || status_ != FLYING)
   {
     ROS_WARN("The robot must be flying to execute a Lissajous.");
     return false;
   }
 
+  if(!lissajous_adder_client_.isServerConnected())
+  {
+    ROS_WARN("LissajousAdder server not connected.");
+    return false;
+  }
+
+  this->stopMission();
+
   kr_tracker_msgs::LissajousAdderGoal goal;
   goal.x_amp[0] = x_amp[0];
   goal.x_amp[1] = x_amp[1];
@@ -472,6 +656,7 @@ bool MAVManager::compound_lissajous(float x_amp[2], float y_amp[2], float z_amp[
 // World Velocity commands
 bool MAVManager::setDesVelInWorldFrame(float x, float y, float z, float yaw, bool use_position_feedback)
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   if(!this->motors() || status_ != FLYING)
   {
     ROS_WARN("The robot must be flying with motors on before setting a desired velocity.");
@@ -492,7 +677,7 @@ bool MAVManager::setDesVelInWorldFrame(float x, float y, float z, float yaw, boo
 
   // Since this could be called quite often,
   // only try to transition if it is not the active tracker.
-  if(active_tracker_.compare(velocity_tracker_str) != 0)
+  if(this->active_tracker().compare(velocity_tracker_str) != 0)
   {
     return this->transition(velocity_tracker_str);
   }
@@ -504,12 +689,16 @@ bool MAVManager::setDesVelInWorldFrame(float x, float y, float z, float yaw, boo
 bool MAVManager::setDesVelInBodyFrame(float x, float y, float z, float yaw, bool use_position_feedback)
 {
   Vec3 vel(x, y, z);
-  vel = odom_q_ * vel;
+  {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    vel = odom_q_ * vel;
+  }
   return this->setDesVelInWorldFrame(vel(0), vel(1), vel(2), yaw, use_position_feedback);
 }
 
 bool MAVManager::setPositionCommand(const kr_mav_msgs::PositionCommand &msg)
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   // TODO: Need to keep publishing a position command if there is no update.
   // Otherwise, no so3_command will be published.
 
@@ -519,7 +708,7 @@ bool MAVManager::setPositionCommand(const kr_mav_msgs::PositionCommand &msg)
 
     // Since this could be called quite often,
     // only try to transition if it is not the active tracker.
-    if(active_tracker_.compare(null_tracker_str) != 0)
+    if(this->active_tracker().compare(null_tracker_str) != 0)
       flag = this->transition(null_tracker_str);
 
     if(flag)
@@ -536,6 +725,7 @@ bool MAVManager::setPositionCommand(const kr_mav_msgs::PositionCommand &msg)
 
 bool MAVManager::setSO3Command(const kr_mav_msgs::SO3Command &msg)
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   // Note: To enable motors, the motors method must be used
   if(!this->motors())
   {
@@ -546,7 +736,7 @@ bool MAVManager::setSO3Command(const kr_mav_msgs::SO3Command &msg)
   // Since this could be called quite often,
   // only try to transition if it is not the active tracker.
   bool flag(true);
-  if(active_tracker_.compare(null_tracker_str) != 0)
+  if(this->active_tracker().compare(null_tracker_str) != 0)
     flag = this->transition(null_tracker_str);
 
   if(flag)
@@ -557,6 +747,7 @@ bool MAVManager::setSO3Command(const kr_mav_msgs::SO3Command &msg)
 
 bool MAVManager::setTRPYCommand(const kr_mav_msgs::TRPYCommand &msg)
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   // Note: To enable motors, the motors method must be used
   if(!this->motors())
   {
@@ -567,7 +758,7 @@ bool MAVManager::setTRPYCommand(const kr_mav_msgs::TRPYCommand &msg)
   // Since this could be called quite often,
   // only try to transition if it is not the active tracker.
   bool flag(true);
-  if(active_tracker_.compare(null_tracker_str) != 0)
+  if(this->active_tracker().compare(null_tracker_str) != 0)
     flag = this->transition(null_tracker_str);
 
   if(flag)
@@ -578,7 +769,8 @@ bool MAVManager::setTRPYCommand(const kr_mav_msgs::TRPYCommand &msg)
 
 bool MAVManager::useNullTracker()
 {
-  if(active_tracker_.compare(null_tracker_str) != 0)
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
+  if(this->active_tracker().compare(null_tracker_str) != 0)
     return this->transition(null_tracker_str);
 
   return true;
@@ -586,10 +778,17 @@ bool MAVManager::useNullTracker()
 
 bool MAVManager::set_motors(bool motors)
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   // Do nothing if we ask for motors to be turned on when they already are on
   if(motors && this->motors())
     return true;
 
+  if(motors && !ready_)
+  {
+    ROS_WARN("Cannot start the motors before the trackers are ready.");
+    return false;
+  }
+
   bool null_tkr = this->transition(null_tracker_str);
 
   // Make sure null_tracker is active before starting motors. If turning motors
@@ -638,15 +837,19 @@ bool MAVManager::set_motors(bool motors)
 
 void MAVManager::imu_cb(const sensor_msgs::Imu::ConstPtr &msg)
 {
-  last_imu_t_ = ros::Time::now();
+  {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    last_imu_t_ = ros::Time::now();
 
-  imu_q_ = Quat(msg->orientation.w, msg->orientation.x, msg->orientation.y, msg->orientation.z);
+    imu_q_ = Quat(msg->orientation.w, msg->orientation.x, msg->orientation.y, msg->orientation.z);
+  }
 
   this->heartbeat();
 }
 
 void MAVManager::output_data_cb(const kr_mav_msgs::OutputData::ConstPtr &msg)
 {
+  std::unique_lock<std::mutex> lock(state_mutex_);
   last_output_data_t_ = ros::Time::now();
   last_imu_t_ = ros::Time::now();
 
@@ -660,13 +863,28 @@ void MAVManager::output_data_cb(const kr_mav_msgs::OutputData::ConstPtr &msg)
   magnetic_field_[2] = msg->magnetic_field.z;
   for(uint8_t i = 0; i < radio_.size(); i++)
     radio_[i] = msg->radio_channel[i];
+  lock.unlock();
 
   this->heartbeat();
 }
 
 void MAVManager::tracker_status_cb(const kr_tracker_msgs::TrackerStatus::ConstPtr &msg)
 {
-  active_tracker_ = msg->tracker;
+  {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    active_tracker_ = msg->tracker;
+    activation_request_ = msg->activation_request;
+    activation_succeeded_ = msg->activation_succeeded;
+  }
+  tracker_status_cv_.notify_all();
+}
+
+MAVManager::~MAVManager()
+{
+  // No more safety actions are posted once the sensor callbacks stopped
+  if(sensor_spinner_)
+    sensor_spinner_->stop();
+  nh_.getCallbackQueue()->removeByID(reinterpret_cast<uint64_t>(this));
 }
 
 void MAVManager::heartbeat_cb(const std_msgs::Empty::ConstPtr &msg)
@@ -674,11 +892,17 @@ void MAVManager::heartbeat_cb(const std_msgs::Empty::ConstPtr &msg)
   this->heartbeat();
 }
 
-// TODO: This should be done in a separate thread
+// Runs in the thread of the sensor callbacks and never waits for a command, the safety actions are posted to the
+// command queue
 void MAVManager::heartbeat()
 {
   const float freq = 10;  // Hz
 
+  // The sensor callbacks may run in several threads
+  std::unique_lock<std::mutex> heartbeat_lock(heartbeat_mutex_, std::try_to_lock);
+  if(!heartbeat_lock.owns_lock())
+    return;
+
   // Only need to do monitoring at the specified frequency
   ros::Time t = ros::Time::now();
   float dt = (t - last_heartbeat_t_).toSec();
@@ -696,14 +920,23 @@ void MAVManager::heartbeat()
   if(this->motors() && need_odom_ && !this->have_recent_odom())
   {
     ROS_WARN("No recent odometry!");
-    this->eland();
+    this->requestSafetyAction(SafetyAction::ELAND);
   }
 
   // Checking for imu
   if(this->motors() && need_imu_ && !this->have_recent_imu())
   {
     ROS_WARN("No recent imu!");
-    this->eland();
+    this->requestSafetyAction(SafetyAction::ELAND);
+  }
+
+  Quat imu_q_copy, odom_q_copy;
+  float voltage;
+  {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    imu_q_copy = imu_q_;
+    odom_q_copy = odom_q_;
+    voltage = voltage_;
   }
 
   if(use_attitude_safety_catch_)
@@ -713,8 +946,8 @@ void MAVManager::heartbeat()
     // require a call to hover before exiting a safety catch mode?
 
     // Convert quaterions to tf so we can compute Euler angles, etc.
-    tf::Quaternion imu_q(imu_q_.x(), imu_q_.y(), imu_q_.z(), imu_q_.w());
-    tf::Quaternion odom_q(odom_q_.x(), odom_q_.y(), odom_q_.z(), odom_q_.w());
+    tf::Quaternion imu_q(imu_q_copy.x(), imu_q_copy.y(), imu_q_copy.z(), imu_q_copy.w());
+    tf::Quaternion odom_q(odom_q_copy.x(), odom_q_copy.y(), odom_q_copy.z(), odom_q_copy.w());
 
     // Determine a geodesic angle from hover at the same yaw
     double yaw, pitch, roll;
@@ -733,26 +966,25 @@ void MAVManager::heartbeat()
 
     float geodesic = std::max(imu_geodesic, odom_geodesic);
 
-    static float attitude_limit_timer = 0;
     if(geodesic > max_attitude_angle_)
-      attitude_limit_timer += dt;
+      attitude_limit_timer_ += dt;
     else
-      attitude_limit_timer = 0;
+      attitude_limit_timer_ = 0;
 
-    if(attitude_limit_timer > 0.5f)
+    if(attitude_limit_timer_ > 0.5f)
     {
       // Reset the timer so we don't keep calling ehover
-      attitude_limit_timer = 0;
+      attitude_limit_timer_ = 0;
       ROS_WARN("Attitude exceeded threshold of %2.2f deg! Geodesic = %2.2f deg. Entering emergency hover.",
                max_attitude_angle_ * 180.0f / M_PI, geodesic * 180.0f / M_PI);
-      this->ehover();
+      this->requestSafetyAction(SafetyAction::EHOVER);
     }
   }
 
   if(this->have_recent_output_data())
   {
-    if(voltage_ < 10.0f)  // Note: Asctec firmware uses 9V
-      ROS_WARN_THROTTLE(10, "Battery voltage = %2.2f V", voltage_);
+    if(voltage < 10.0f)  // Note: Asctec firmware uses 9V
+      ROS_WARN_THROTTLE(10, "Battery voltage = %2.2f V", voltage);
   }
 
   // TODO: Incorporate bounding box constraints. Something along the lines of the following.
@@ -776,8 +1008,39 @@ void MAVManager::heartbeat()
   // br.sendTransform(tf::StampedTransform(transform, ros::Time::now(), "/simulator", "/quadrotor"));
 }
 
+void MAVManager::requestSafetyAction(SafetyAction action)
+{
+  SafetyAction pending = pending_safety_action_.load();
+  do
+  {
+    if(pending >= action)
+      return;
+  } while(!pending_safety_action_.compare_exchange_weak(pending, action));
+
+  // Otherwise the callback already posted runs the new action
+  if(pending == SafetyAction::NONE)
+    nh_.getCallbackQueue()->addCallback(boost::make_shared<FunctionCallback>([this]() { this->runSafetyAction(); }),
+                                        reinterpret_cast<uint64_t>(this));
+}
+
+void MAVManager::runSafetyAction()
+{
+  switch(pending_safety_action_.exchange(SafetyAction::NONE))
+  {
+    case SafetyAction::ELAND:
+      this->eland();
+      break;
+    case SafetyAction::EHOVER:
+      this->ehover();
+      break;
+    case SafetyAction::NONE:
+      break;
+  }
+}
+
 bool MAVManager::eland()
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   // TODO: This should also check a height threshold or something along those
   // lines. For example, if the rotors are idle and the robot hasn't even
   // left the ground, we don't want them to spin up faster.
@@ -787,7 +1050,7 @@ bool MAVManager::eland()
 
     kr_mav_msgs::PositionCommand goal;
     goal.acceleration.z = -0.45f;
-    goal.yaw = yaw_;
+    goal.yaw = this->yaw();
 
     if(this->setPositionCommand(goal))
     {
@@ -803,6 +1066,7 @@ bool MAVManager::eland()
 
 bool MAVManager::estop()
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   ROS_WARN("E-STOP");
   std_msgs::Empty estop_cmd;
   pub_estop_.publish(estop_cmd);
@@ -819,13 +1083,23 @@ bool MAVManager::estop()
 
 bool MAVManager::hover()
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   const float a_des(0.8);  //, yaw_a_des(0.1);
 
-  const float v_norm = vel_.norm();
+  Vec3 pos, vel;
+  float yaw;
+  {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    pos = pos_;
+    vel = vel_;
+    yaw = yaw_;
+  }
+
+  const float v_norm = vel.norm();
 
   if(v_norm > 1e-2)
   {
-    Vec3 dir = vel_ / v_norm;
+    Vec3 dir = vel / v_norm;
 
     // Acceleration should be opposite the velocity component
     const Vec3 acc = -dir * a_des;
@@ -837,47 +1111,359 @@ bool MAVManager::hover()
     // float t_yaw = - yaw_dot_ / yaw_a_des;
 
     // xf = xo + vo * t + 1/2 * a * t^2
-    Vec4 goal(pos_(0) + vel_(0) * t + 0.5f * acc(0) * t * t, pos_(1) + vel_(1) * t + 0.5f * acc(1) * t * t,
-              pos_(2) + vel_(2) * t + 0.5f * acc(2) * t * t,
-              yaw_);  //    + yaw_dot_ * t_yaw + 0.5 * yaw_a_des * t_yaw * t_yaw);
+    Vec4 goal(pos(0) + vel(0) * t + 0.5f * acc(0) * t * t, pos(1) + vel(1) * t + 0.5f * acc(1) * t * t,
+              pos(2) + vel(2) * t + 0.5f * acc(2) * t * t,
+              yaw);  //    + yaw_dot_ * t_yaw + 0.5 * yaw_a_des * t_yaw * t_yaw);
 
-    Vec2 v_and_a_des(std::sqrt(vel_.dot(vel_)), a_des);
+    Vec2 v_and_a_des(std::sqrt(vel.dot(vel)), a_des);
 
     ROS_DEBUG("Coasting to hover...");
     return this->goTo(goal, v_and_a_des);
   }
 
   ROS_DEBUG("Hovering in place...");
-  return this->goTo(pos_(0), pos_(1), pos_(2), yaw_);
+  return this->goTo(pos(0), pos(1), pos(2), yaw);
 }
 
 bool MAVManager::ehover()
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   if(!this->motors() || status_ != FLYING)
   {
     ROS_WARN("Will not call emergency hover unless the robot is already flying.");
     return false;
   }
 
+  const Vec3 pos = this->pos();
   kr_tracker_msgs::LineTrackerGoal goal;
-  goal.x = pos_(0);
-  goal.y = pos_(1);
-  goal.z = pos_(2);
-  line_tracker_distance_client_.sendGoal(goal, boost::bind(&MAVManager::tracker_done_callback, this, _1, _2),
-                                         ClientType::SimpleActiveCallback(), ClientType::SimpleFeedbackCallback());
+  goal.x = pos(0);
+  goal.y = pos(1);
+  goal.z = pos(2);
+  return this->sendLineTrackerGoal(line_tracker_distance_client_, goal, line_tracker_distance);
+}
+
+bool MAVManager::mission(const std::vector<kr_mav_manager::MissionGoal> &goals, bool append)
+{
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
+  if(!append)
+    this->stopMission();
+  if(goals.empty())
+    return true;
+
+  if(!this->motors() || status_ != FLYING)
+  {
+    ROS_WARN("The robot must be flying to start a mission.");
+    return false;
+  }
+
+  for(size_t i = 0; i < goals.size(); i++)
+  {
+    const kr_mav_manager::MissionGoal &goal = goals[i];
+    if(!this->checkMissionGoal(goal))
+    {
+      ROS_WARN("Not queuing the mission goals.");
+      return false;
+    }
 
-  return this->transition(line_tracker_distance);
+    // A line goal after another one is queued in the tracker and starts where the previous one ends
+    const kr_mav_manager::MissionGoal *previous =
+        (i > 0) ? &goals[i - 1] : (mission_.empty() ? NULL : &mission_.back());
+    if(goal.type == kr_mav_manager::MissionGoal::LINE_TRACKER && previous != NULL &&
+       previous->type == kr_mav_manager::MissionGoal::LINE_TRACKER && !goal.line_tracker.t_start.isZero())
+    {
+      ROS_WARN("Mission goal %zu follows a line goal and cannot have a start time, not queuing the mission goals.", i);
+      return false;
+    }
+  }
+
+  mission_.insert(mission_.end(), goals.begin(), goals.end());
+  ROS_INFO("Mission with %zu goals queued.", mission_.size());
+  return this->sendMissionGoals();
+}
+
+void MAVManager::stopMission()
+{
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
+  if(mission_.empty())
+    return;
+
+  ROS_INFO("Stopping the mission with %zu goals left.", mission_.size());
+  if(mission_armed_)
+    this->transitionWhenDone("");
+
+  // Cancelling the last goal sent to a tracker also drops the goals queued before it
+  std::array<bool, kr_mav_manager::MissionGoal::LISSAJOUS_ADDER + 1> sent = {};
+  for(size_t i = 0; i < mission_sent_; i++)
+    sent[mission_[i].type] = true;
+  if(sent[kr_mav_manager::MissionGoal::LINE_TRACKER])
+    line_tracker_min_jerk_client_.cancelGoal();
+  if(sent[kr_mav_manager::MissionGoal::CIRCLE_TRACKER])
+    circle_tracker_client_.cancelGoal();
+  if(sent[kr_mav_manager::MissionGoal::LISSAJOUS_TRACKER])
+    lissajous_tracker_client_.cancelGoal();
+  if(sent[kr_mav_manager::MissionGoal::LISSAJOUS_ADDER])
+    lissajous_adder_client_.cancelGoal();
+
+  mission_front_id_ += mission_.size();
+  mission_.clear();
+  mission_sent_ = 0;
+  mission_armed_ = false;
+}
+
+bool MAVManager::checkMissionGoal(const kr_mav_manager::MissionGoal &goal)
+{
+  switch(goal.type)
+  {
+    case kr_mav_manager::MissionGoal::LINE_TRACKER:
+      if(!line_tracker_min_jerk_client_.isServerConnected())
+      {
+        ROS_WARN("LineTrackerMinJerk server not connected.");
+        return false;
+      }
+      return true;
+    case kr_mav_manager::MissionGoal::CIRCLE_TRACKER:
+      if(!circle_tracker_client_.isServerConnected())
+      {
+        ROS_WARN("CircleTracker server not connected.");
+        return false;
+      }
+      return true;
+    case kr_mav_manager::MissionGoal::LISSAJOUS_TRACKER:
+      if(!lissajous_tracker_client_.isServerConnected())
+      {
+        ROS_WARN("LissajousTracker server not connected.");
+        return false;
+      }
+      return true;
+    case kr_mav_manager::MissionGoal::LISSAJOUS_ADDER:
+      if(!lissajous_adder_client_.isServerConnected())
+      {
+        ROS_WARN("LissajousAdder server not connected.");
+        return false;
+      }
+      return true;
+  }
+
+  ROS_WARN("Unknown mission goal type %u.", goal.type);
+  return false;
+}
+
+static const std::string &mission_tracker_str(uint8_t type)
+{
+  switch(type)
+  {
+    case kr_mav_manager::MissionGoal::CIRCLE_TRACKER:
+      return circle_tracker_str;
+    case kr_mav_manager::MissionGoal::LISSAJOUS_TRACKER:
+      return lissajous_tracker_str;
+    case kr_mav_manager::MissionGoal::LISSAJOUS_ADDER:
+      return lissajous_adder_str;
+    default:
+      return line_tracker_min_jerk;
+  }
+}
+
+bool MAVManager::sendMissionGoals()
+{
+  // The goals after an armed one wait until it is active
+  while(mission_sent_ < mission_.size() && !mission_armed_)
+  {
+    const kr_mav_manager::MissionGoal &goal = mission_[mission_sent_];
+    const unsigned int goal_id = mission_front_id_ + mission_sent_;
+    bool sent;
+    if(mission_sent_ == 0)
+      sent = this->startMissionGoal(goal, goal_id);
+    else
+    {
+      const uint8_t previous_type = mission_[mission_sent_ - 1].type;
+      const bool line = (goal.type == kr_mav_manager::MissionGoal::LINE_TRACKER);
+      if(line && previous_type == kr_mav_manager::MissionGoal::LINE_TRACKER)
+        sent = this->sendMissionTrackerGoal(goal, goal_id, true);
+      else if(goal.type == previous_type || (line && goal.line_tracker.relative))
+        break;  // The tracker is busy with the previous goal, or the goal is relative to where the previous one ends
+      else
+      {
+        sent = this->sendMissionTrackerGoal(goal, goal_id, false) &&
+               this->transitionWhenDone(mission_tracker_str(goal.type));
+        mission_armed_ = sent;
+      }
+    }
+
+    // Counted even if it failed, so that stopping the mission cancels it
+    mission_sent_++;
+    if(!sent)
+    {
+      ROS_WARN("Could not send the next mission goal.");
+      this->stopMission();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MAVManager::startMissionGoal(const kr_mav_manager::MissionGoal &goal, unsigned int goal_id)
+{
+  sending_mission_goal_ = true;
+  bool started;
+  if(goal.type == kr_mav_manager::MissionGoal::LINE_TRACKER)
+  {
+    kr_tracker_msgs::LineTrackerGoal line_goal = goal.line_tracker;
+    line_goal.queue = false;
+    started = this->sendLineTrackerGoal(line_tracker_min_jerk_client_, line_goal, line_tracker_min_jerk,
+                                        boost::bind(&MAVManager::mission_done_callback, this, _1, goal_id));
+  }
+  else
+    started = this->sendMissionTrackerGoal(goal, goal_id, false) && this->transition(mission_tracker_str(goal.type));
+  sending_mission_goal_ = false;
+  return started;
+}
+
+bool MAVManager::sendMissionTrackerGoal(const kr_mav_manager::MissionGoal &goal, unsigned int goal_id, bool queue)
+{
+  const auto done_cb = boost::bind(&MAVManager::mission_done_callback, this, _1, goal_id);
+  switch(goal.type)
+  {
+    case kr_mav_manager::MissionGoal::LINE_TRACKER:
+    {
+      kr_tracker_msgs::LineTrackerGoal line_goal = goal.line_tracker;
+      line_goal.queue = queue;
+      line_goal.activate = false;
+      line_tracker_min_jerk_client_.sendGoal(line_goal, done_cb, ClientType::SimpleActiveCallback(),
+                                             ClientType::SimpleFeedbackCallback());
+      return true;
+    }
+    case kr_mav_manager::MissionGoal::CIRCLE_TRACKER:
+      circle_tracker_client_.sendGoal(goal.circle_tracker, done_cb, CircleClientType::SimpleActiveCallback(),
+                                      CircleClientType::SimpleFeedbackCallback());
+      return true;
+    case kr_mav_manager::MissionGoal::LISSAJOUS_TRACKER:
+      lissajous_tracker_client_.sendGoal(goal.lissajous_tracker, done_cb, LissajousClientType::SimpleActiveCallback(),
+                                         LissajousClientType::SimpleFeedbackCallback());
+      return true;
+    case kr_mav_manager::MissionGoal::LISSAJOUS_ADDER:
+      lissajous_adder_client_.sendGoal(goal.lissajous_adder, done_cb,
+                                       CompoundLissajousClientType::SimpleActiveCallback(),
+                                       CompoundLissajousClientType::SimpleFeedbackCallback());
+      return true;
+  }
+  return false;
+}
+
+void MAVManager::mission_done_callback(const actionlib::SimpleClientGoalState &state, unsigned int goal_id)
+{
+  // The action client holds its lock while calling this, and the command in progress may need it to cancel a goal
+  nh_.getCallbackQueue()->addCallback(
+      boost::make_shared<FunctionCallback>([this, state, goal_id]() { this->missionGoalDone(state, goal_id); }),
+      reinterpret_cast<uint64_t>(this));
+}
+
+void MAVManager::missionGoalDone(const actionlib::SimpleClientGoalState &state, unsigned int goal_id)
+{
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
+  if(goal_id < mission_front_id_ || goal_id >= mission_front_id_ + mission_sent_)
+    return;
+
+  if(state != actionlib::SimpleClientGoalState::SUCCEEDED)
+  {
+    ROS_WARN("Mission goal finished with state %s.", state.toString().c_str());
+    this->stopMission();
+    return;
+  }
+
+  // Only the last of the line goals queued in the tracker reports, the ones before it are done too
+  const size_t done = goal_id - mission_front_id_ + 1;
+  mission_.erase(mission_.begin(), mission_.begin() + done);
+  mission_sent_ -= done;
+  mission_front_id_ += done;
+  // The armed goal took over, or was the one done
+  if(mission_sent_ <= 1)
+    mission_armed_ = false;
+
+  if(mission_.empty())
+  {
+    ROS_INFO("Mission completed.");
+    return;
+  }
+  ROS_INFO("Mission goal completed, %zu goals left.", mission_.size());
+  this->sendMissionGoals();
+}
+
+bool MAVManager::sendLineTrackerGoal(ClientType &client, kr_tracker_msgs::LineTrackerGoal &goal,
+                                     const std::string &tracker_str, const ClientType::SimpleDoneCallback &done_cb)
+{
+  if(!sending_mission_goal_)
+    this->stopMission();
+
+  const ClientType::SimpleDoneCallback cb =
+      done_cb ? done_cb : ClientType::SimpleDoneCallback(boost::bind(&MAVManager::tracker_done_callback, this, _1, _2));
+  if(!transition_with_goal_)
+  {
+    client.sendGoal(goal, cb, ClientType::SimpleActiveCallback(), ClientType::SimpleFeedbackCallback());
+    return this->transition(tracker_str);
+  }
+
+  // The tracker is activated when it receives the goal, without waiting for a service call. The trackers manager
+  // echoes the send_time of the goal in its status as soon as the goal is handled, also if the activation failed and
+  // the goal was aborted.
+  // The outcome is recorded before cb runs, which may wait for the command in progress
+  const auto outcome = std::make_shared<GoalOutcome>();
+  const ClientType::SimpleDoneCallback activation_cb = [this, outcome, cb](
+                                                           const actionlib::SimpleClientGoalState &state,
+                                                           const kr_tracker_msgs::LineTrackerResultConstPtr &result) {
+    {
+      std::lock_guard<std::mutex> lock(state_mutex_);
+      outcome->done = true;
+      outcome->succeeded = (state == actionlib::SimpleClientGoalState::SUCCEEDED);
+    }
+    tracker_status_cv_.notify_all();
+    cb(state, result);
+  };
+
+  goal.activate = true;
+  goal.send_time = ros::Time::now();
+  client.sendGoal(goal, activation_cb, ClientType::SimpleActiveCallback(), ClientType::SimpleFeedbackCallback());
+  if(!this->waitForActivation(goal.send_time, *outcome))
+  {
+    ROS_WARN("%s was not activated by its goal.", tracker_str.c_str());
+    return false;
+  }
+  ROS_INFO("Current tracker: %s", tracker_str.c_str());
+  return true;
+}
+
+bool MAVManager::waitForActivation(const ros::Time &send_time, const GoalOutcome &outcome)
+{
+  // The goal outcome only arrives while waiting when the action clients spin their own threads, the status always does
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                             std::chrono::duration<float>(activation_timeout_));
+  std::unique_lock<std::mutex> lock(state_mutex_);
+  while(activation_request_ != send_time)
+  {
+    // A goal which succeeded was activated, one which was rejected or preempted before that never will be
+    if(outcome.done)
+      return outcome.succeeded;
+
+    if(tracker_status_cv_.wait_until(lock, deadline) == std::cv_status::timeout)
+      return false;
+  }
+  return activation_succeeded_;
 }
 
 bool MAVManager::transition(const std::string &tracker_str)
 {
+  std::lock_guard<std::recursive_mutex> lock(command_mutex_);
   // usleep(100000);
-  kr_tracker_msgs::Transition transition_cmd;
-  transition_cmd.request.tracker = tracker_str;
+  if(!sending_mission_goal_)
+    this->stopMission();
 
-  if(srv_transition_.call(transition_cmd) && transition_cmd.response.success)
+  std::string message;
+  if(this->callTransition(srv_transition_, "trackers_manager/transition", tracker_str, message))
   {
-    active_tracker_ = tracker_str;
+    {
+      std::lock_guard<std::mutex> lock(state_mutex_);
+      active_tracker_ = tracker_str;
+    }
     ROS_INFO("Current tracker: %s", tracker_str.c_str());
     return true;
   }
@@ -885,18 +1471,73 @@ bool MAVManager::transition(const std::string &tracker_str)
   return false;
 }
 
+bool MAVManager::transitionWhenDone(const std::string &tracker_str)
+{
+  std::string message;
+  if(this->callTransition(srv_transition_when_done_, "trackers_manager/transition_when_done", tracker_str, message))
+    return true;
+
+  ROS_WARN("Could not arm %s: %s", tracker_str.c_str(), message.c_str());
+  return false;
+}
+
+bool MAVManager::callTransition(ros::ServiceClient &client, const std::string &service, const std::string &tracker_str,
+                                std::string &message)
+{
+  // Reconnect if the persistent connection was dropped, e.g. when the trackers_manager restarted
+  if(!client.isValid())
+    client = nh_.serviceClient<kr_tracker_msgs::Transition>(service, true);
+
+  // Shared with the calling thread, which may outlive this call
+  struct PendingCall
+  {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    bool called = false;
+    kr_tracker_msgs::Transition srv;
+  };
+  const auto call = std::make_shared<PendingCall>();
+  call->srv.request.tracker = tracker_str;
+
+  ros::ServiceClient thread_client = client;
+  std::thread([call, thread_client]() mutable {
+    const bool called = thread_client.call(call->srv);
+    {
+      std::lock_guard<std::mutex> lock(call->mutex);
+      call->done = true;
+      call->called = called;
+    }
+    call->cv.notify_all();
+  }).detach();
+
+  std::unique_lock<std::mutex> lock(call->mutex);
+  if(!call->cv.wait_for(lock, std::chrono::duration<float>(service_timeout_), [&call]() { return call->done; }))
+  {
+    ROS_WARN("%s did not answer within %.2f s", service.c_str(), service_timeout_);
+    client = nh_.serviceClient<kr_tracker_msgs::Transition>(service, true);
+    message = "timed out";
+    return false;
+  }
+  message = call->srv.response.message;
+  return call->called && call->srv.response.success;
+}
+
 bool MAVManager::have_recent_odom()
 {
+  std::lock_guard<std::mutex> lock(state_mutex_);
   return (ros::Time::now() - last_odom_t_).toSec() < odom_timeout_;
 }
 
 bool MAVManager::have_recent_imu()
 {
+  std::lock_guard<std::mutex> lock(state_mutex_);
   return (ros::Time::now() - last_imu_t_).toSec() < 0.1;
 }
 
 bool MAVManager::have_recent_output_data()
 {
+  std::lock_guard<std::mutex> lock(state_mutex_);
   return (ros::Time::now() - last_output_data_t_).toSec() < 0.1;
 }
 }  // namespace kr_mav_manager
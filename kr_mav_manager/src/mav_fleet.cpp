@@ -0,0 +1,319 @@
+// Runs the MAVManager and its services for several vehicles in one process, instead of one mav_services process per
+// vehicle. The commands of all the vehicles run on a pool of num_threads worker threads. Each vehicle has its own
+// command queue, from which the workers take one callback at a time, so the commands of a vehicle run one at a time
+// and in order as in mav_services, while a command waiting on a service or an action only holds up its own vehicle
+// and one worker. The sensor callbacks of all the vehicles run on one queue shared by the managers, spun by
+// num_sensor_threads threads.
+//
+// Params, in the private namespace:
+//   vehicles            List of the namespaces of the vehicles, required. The services and params of each vehicle are
+//                       in <vehicle>/mav_services, as for a mav_services node in the namespace of the vehicle.
+//   num_threads         Number of worker threads for the commands, at most one per vehicle. Once all of them wait on
+//                       commands, the commands of the other vehicles wait for one to return.
+//   num_sensor_threads  Number of threads for the sensor callbacks
+//
+// The fleet services, in the private namespace, call the same method on all the vehicles at once and report the
+// vehicles for which it failed.
+
+#include <kr_mav_manager/FleetGoTo.h>
+#include <kr_mav_manager/function_callback.h>
+#include <kr_mav_manager/mav_manager_services.h>
+#include <ros/callback_queue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <boost/make_shared.hpp>
+
+namespace kr_mav_manager
+{
+// The command queue of a vehicle, which tells the fleet about each callback added to it so that a worker calls it
+class VehicleQueue : public ros::CallbackQueueInterface
+{
+ public:
+  explicit VehicleQueue(const std::function<void(void)> &notify) : notify_(notify) {}
+
+  void addCallback(const ros::CallbackInterfacePtr &callback, uint64_t owner_id = 0)
+  {
+    queue_.addCallback(callback, owner_id);
+    notify_();
+  }
+
+  void removeByID(uint64_t owner_id) { queue_.removeByID(owner_id); }
+
+  void callOne(void) { queue_.callOne(ros::WallDuration(0)); }
+  bool isEmpty(void) { return queue_.isEmpty(); }
+
+ private:
+  ros::CallbackQueue queue_;
+  std::function<void(void)> notify_;
+};
+
+class MAVFleet
+{
+ public:
+  MAVFleet(void);
+  ~MAVFleet(void);
+
+  // Sets up the vehicles and starts the threads, false if the params are missing
+  bool init(void);
+
+ private:
+  struct Vehicle
+  {
+    std::string name;
+    // Outlives mav, which removes its callbacks from it
+    std::unique_ptr<VehicleQueue> queue;
+    // In ready_ or being called by a worker, guarded by ready_mutex_
+    bool scheduled = false;
+    std::shared_ptr<MAVManager> mav;
+    std::unique_ptr<MAVManagerServices> services;
+  };
+
+  typedef std::function<bool(MAVManager &)> Command;
+
+  // Runs each command on the queue of its vehicle and waits for all of them
+  bool run(const std::vector<std::pair<Vehicle *, Command>> &commands, std::string &message);
+  bool run_all(const Command &command, std::string &message);
+
+  ros::ServiceServer advertise_trigger(const std::string &name, bool (MAVManager::*method)());
+
+  bool motors_cb(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res);
+  bool goTo_cb(kr_mav_manager::FleetGoTo::Request &req, kr_mav_manager::FleetGoTo::Response &res);
+
+  // Queues the vehicle for a worker, unless it is already queued or being served
+  void schedule(Vehicle *vehicle);
+  // Run by the workers: calls one callback of the first ready vehicle at a time
+  void work(void);
+
+  ros::NodeHandle priv_nh_;
+
+  // Shared by the managers of all the vehicles, outlives them
+  ros::CallbackQueue sensor_queue_;
+  std::unique_ptr<ros::AsyncSpinner> sensor_spinner_;
+
+  // The vehicles with callbacks to call, in the order they are served
+  std::mutex ready_mutex_;
+  std::condition_variable ready_cv_;
+  std::deque<Vehicle *> ready_;
+  std::atomic<bool> running_;
+  std::vector<std::thread> workers_;
+
+  std::vector<Vehicle> vehicles_;
+  std::vector<ros::ServiceServer> srvs_;
+};
+
+MAVFleet::MAVFleet(void) : priv_nh_("~"), running_(true) {}
+
+bool MAVFleet::init(void)
+{
+  std::vector<std::string> names;
+  if(!priv_nh_.getParam("vehicles", names) || names.empty())
+  {
+    ROS_ERROR("MAVFleet requires a list of vehicles in %s/vehicles.", priv_nh_.getNamespace().c_str());
+    return false;
+  }
+
+  int num_threads, num_sensor_threads;
+  priv_nh_.param("num_threads", num_threads, static_cast<int>(std::thread::hardware_concurrency()));
+  num_threads = std::max(1, std::min(num_threads, static_cast<int>(names.size())));
+  priv_nh_.param("num_sensor_threads", num_sensor_threads, 2);
+  num_sensor_threads = std::max(1, num_sensor_threads);
+
+  // Callbacks added while setting up are called once the workers start
+  vehicles_.resize(names.size());
+  for(size_t i = 0; i < names.size(); i++)
+  {
+    Vehicle &vehicle = vehicles_[i];
+    vehicle.name = names[i];
+    vehicle.queue.reset(new VehicleQueue([this, &vehicle]() { this->schedule(&vehicle); }));
+
+    const std::string priv_ns = ros::names::append(vehicle.name, "mav_services");
+    vehicle.mav = std::make_shared<MAVManager>(vehicle.name, priv_ns, vehicle.queue.get(), &sensor_queue_);
+
+    ros::NodeHandle services_nh(priv_ns);
+    services_nh.setCallbackQueue(vehicle.queue.get());
+    vehicle.services.reset(new MAVManagerServices(vehicle.mav, services_nh));
+  }
+
+  sensor_spinner_.reset(new ros::AsyncSpinner(num_sensor_threads, &sensor_queue_));
+  sensor_spinner_->start();
+  for(int i = 0; i < num_threads; i++)
+    workers_.emplace_back(&MAVFleet::work, this);
+
+  srvs_.push_back(priv_nh_.advertiseService("motors", &MAVFleet::motors_cb, this));
+  srvs_.push_back(advertise_trigger("takeoff", &MAVManager::takeoff));
+  srvs_.push_back(advertise_trigger("goHome", &MAVManager::goHome));
+  srvs_.push_back(priv_nh_.advertiseService("goTo", &MAVFleet::goTo_cb, this));
+  srvs_.push_back(advertise_trigger("hover", &MAVManager::hover));
+  srvs_.push_back(advertise_trigger("ehover", &MAVManager::ehover));
+  srvs_.push_back(advertise_trigger("land", &MAVManager::land));
+  srvs_.push_back(advertise_trigger("eland", &MAVManager::eland));
+  srvs_.push_back(advertise_trigger("estop", &MAVManager::estop));
+
+  ROS_INFO("MAVFleet running %zu vehicles over %d command and %d sensor threads.", vehicles_.size(), num_threads,
+           num_sensor_threads);
+  return true;
+}
+
+MAVFleet::~MAVFleet(void)
+{
+  srvs_.clear();
+
+  // No more safety actions are posted once the sensor callbacks stopped
+  if(sensor_spinner_)
+    sensor_spinner_->stop();
+
+  {
+    std::lock_guard<std::mutex> lock(ready_mutex_);
+    running_ = false;
+  }
+  ready_cv_.notify_all();
+  for(auto &worker : workers_)
+    worker.join();
+
+  // Nothing is left to call the callbacks of the vehicles
+  vehicles_.clear();
+}
+
+void MAVFleet::schedule(Vehicle *vehicle)
+{
+  {
+    std::lock_guard<std::mutex> lock(ready_mutex_);
+    if(vehicle->scheduled)
+      return;
+    vehicle->scheduled = true;
+    ready_.push_back(vehicle);
+  }
+  ready_cv_.notify_one();
+}
+
+void MAVFleet::work(void)
+{
+  std::unique_lock<std::mutex> lock(ready_mutex_);
+  while(running_)
+  {
+    if(ready_.empty())
+    {
+      ready_cv_.wait(lock);
+      continue;
+    }
+
+    Vehicle *vehicle = ready_.front();
+    ready_.pop_front();
+    lock.unlock();
+    vehicle->queue->callOne();
+    lock.lock();
+
+    // A callback added while it was called finds the vehicle still scheduled, so it is checked here
+    if(vehicle->queue->isEmpty())
+      vehicle->scheduled = false;
+    else
+      ready_.push_back(vehicle);
+  }
+}
+
+bool MAVFleet::run(const std::vector<std::pair<Vehicle *, Command>> &commands, std::string &message)
+{
+  std::vector<std::future<bool>> results;
+  for(const auto &command : commands)
+  {
+    auto task = std::make_shared<std::packaged_task<bool(void)>>(
+        std::bind(command.second, std::ref(*command.first->mav)));
+    results.push_back(task->get_future());
+    command.first->queue->addCallback(boost::make_shared<FunctionCallback>([task]() { (*task)(); }));
+  }
+
+  // Stop waiting on shutdown, when the workers may not run the commands anymore
+  std::string failed;
+  for(size_t i = 0; i < results.size(); i++)
+  {
+    while(results[i].wait_for(std::chrono::milliseconds(100)) != std::future_status::ready && running_ && ros::ok())
+      continue;
+    const bool done = results[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    if(!done || !results[i].get())
+      failed += (failed.empty() ? "" : ", ") + commands[i].first->name;
+  }
+
+  if(!failed.empty())
+  {
+    message = "Failed for " + failed;
+    return false;
+  }
+  message = "Done for " + std::to_string(commands.size()) + " vehicles";
+  return true;
+}
+
+bool MAVFleet::run_all(const Command &command, std::string &message)
+{
+  std::vector<std::pair<Vehicle *, Command>> commands;
+  for(auto &vehicle : vehicles_)
+    commands.emplace_back(&vehicle, command);
+  return run(commands, message);
+}
+
+ros::ServiceServer MAVFleet::advertise_trigger(const std::string &name, bool (MAVManager::*method)())
+{
+  return priv_nh_.advertiseService<std_srvs::Trigger::Request, std_srvs::Trigger::Response>(
+      name, [this, method](std_srvs::Trigger::Request &req, std_srvs::Trigger::Response &res) {
+        res.success = run_all([method](MAVManager &mav) { return (mav.*method)(); }, res.message);
+        return true;
+      });
+}
+
+bool MAVFleet::motors_cb(std_srvs::SetBool::Request &req, std_srvs::SetBool::Response &res)
+{
+  const bool motors = req.data;
+  res.success = run_all([motors](MAVManager &mav) { return mav.set_motors(motors); }, res.message);
+  return true;
+}
+
+bool MAVFleet::goTo_cb(kr_mav_manager::FleetGoTo::Request &req, kr_mav_manager::FleetGoTo::Response &res)
+{
+  std::vector<std::pair<Vehicle *, Command>> commands;
+  for(const auto &goal : req.goals)
+  {
+    auto it = std::find_if(vehicles_.begin(), vehicles_.end(),
+                           [&goal](const Vehicle &vehicle) { return vehicle.name == goal.vehicle; });
+    if(it == vehicles_.end())
+    {
+      res.success = false;
+      res.message = "Unknown vehicle " + goal.vehicle;
+      return true;
+    }
+
+    const kr_mav_manager::VehicleGoal::_goal_type g = goal.goal;
+    const bool relative = req.relative;
+    commands.emplace_back(&*it, [g, relative](MAVManager &mav) {
+      return mav.goTo(g[0], g[1], g[2], g[3], 0.0f, 0.0f, relative);
+    });
+  }
+
+  res.success = run(commands, res.message);
+  return true;
+}
+}  // namespace kr_mav_manager
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "mav_fleet");
+  ros::NodeHandle nh;
+
+  // The fleet services are called from the global queue, the vehicles from the workers of the fleet
+  kr_mav_manager::MAVFleet fleet;
+  if(!fleet.init())
+    return 1;
+
+  ros::spin();
+
+  return 0;
+}
@@ -1,14 +1,21 @@
 #include <kr_mav_manager/mav_manager_services.h>
+#include <ros/callback_queue.h>
 
 int main(int argc, char **argv)
 {
   ros::init(argc, argv, "manager");
   ros::NodeHandle nh;
 
-  auto mav = std::make_shared<kr_mav_manager::MAVManager>();
+  // The odometry, imu and heartbeat callbacks and the safety checks get their own thread, the services and actions are
+  // called from the global queue
+  ros::CallbackQueue sensor_queue;
+  auto mav = std::make_shared<kr_mav_manager::MAVManager>("", "~", nullptr, &sensor_queue);
 
   kr_mav_manager::MAVManagerServices mm_srvs(mav);
 
+  ros::AsyncSpinner sensor_spinner(1, &sensor_queue);
+  sensor_spinner.start();
+
   ros::spin();
 
   return 0;
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <kr_mav_controllers/SO3CommandGenerator.h>
+#include <kr_mav_msgs/PositionCommand.h>
+#include <kr_mav_replay/replay_log.h>
+#include <kr_trackers_manager/Tracker.h>
+#include <nav_msgs/Odometry.h>
+#include <pluginlib/class_loader.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Replays the odometry, tracker goals and tracker transitions recorded in a bag through the tracker plugins and the SO3
+ * controller, all run in this process without a ROS master, as fast as possible. The resulting PositionCommand and
+ * SO3Command messages are written to a replay log.
+ *
+ * The ROS time is simulated with ros::Time::setNow() and follows the bag, so the output only depends on the bag and
+ * the params. ros::Time::init() has to be called before, but not ros::init(). The params are:
+ *   trackers_manager/*   The params of the TrackersManager, i.e. the trackers list and the tracker params
+ *   so3_control/*        The params of the SO3ControlNodelet
+ *   trackers_manager_ns  Namespace of the TrackersManager in the bag, the goals sent to the trackers are replayed and
+ *                        the trackers are switched when its status reports a different tracker
+ *   odom_topic, motors_topic  Topics in the bag
+ *
+ * Trackers which do not implement Tracker::InitializeOffline() are skipped, the replay fails if the bag switches to
+ * one of them.
+ */
+class BagReplay
+{
+ public:
+  explicit BagReplay(const kr_trackers_manager::OfflineParams &params);
+  ~BagReplay();
+
+  bool run(const std::string &bag_file, ReplayLogWriter &log);
+
+ private:
+  bool loadTrackers();
+  bool transition(const std::string &tracker_name);
+  void odomCallback(const nav_msgs::Odometry::ConstPtr &msg);
+  // Give a message on a topic below trackers_manager_ns to the tracker it is for
+  bool replayTrackerMessage(const std::string &topic, const std::vector<uint8_t> &data);
+  void calculateControl();
+  void write(const ReplayRecord &record);
+
+  kr_trackers_manager::OfflineParams params_;
+
+  pluginlib::ClassLoader<kr_trackers_manager::Tracker> tracker_loader_;
+  kr_trackers_manager::Tracker *active_tracker_;
+  std::string active_tracker_name_;
+  std::map<std::string, kr_trackers_manager::Tracker *> tracker_map_;
+  std::vector<kr_trackers_manager::Tracker *> inactive_trackers_;
+  // Listed trackers which cannot run without a ROS master
+  std::set<std::string> offline_unsupported_;
+  kr_mav_msgs::PositionCommand::ConstPtr cmd_;
+  ros::Time tracker_time_;
+
+  // Behind a pointer for its alignment
+  std::unique_ptr<SO3CommandGenerator> controller_;
+
+  ReplayLogWriter *log_;
+  bool failed_;
+  uint32_t odom_index_;
+  unsigned int num_position_cmds_, num_so3_cmds_;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <kr_mav_msgs/PositionCommand.h>
+#include <kr_mav_msgs/SO3Command.h>
+
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Binary log of the commands produced when replaying a bag through the trackers and the SO3 controller.
+ *
+ * Layout, in host byte order:
+ *   ReplayLogHeader
+ *   ReplayRecord records[]  (in the order the commands were produced)
+ */
+struct ReplayLogHeader
+{
+  char magic[4];
+  uint32_t version;
+};
+
+struct ReplayRecord
+{
+  enum Type : uint32_t
+  {
+    POSITION_COMMAND = 1,
+    SO3_COMMAND = 2
+  };
+
+  uint32_t type;
+  uint32_t odom_index;  // Index of the odometry message which led to this command
+  double stamp;
+  // PositionCommand: position, velocity, acceleration, jerk, yaw, yaw_dot
+  // SO3Command: force, orientation (x, y, z, w), angular_velocity
+  float data[16];
+};
+
+ReplayRecord makeReplayRecord(const kr_mav_msgs::PositionCommand &cmd, uint32_t odom_index);
+ReplayRecord makeReplayRecord(const kr_mav_msgs::SO3Command &cmd, uint32_t odom_index);
+
+/**
+ * @brief Number of the data values used by a record type, and their names for reporting differences
+ */
+unsigned int replayRecordSize(uint32_t type);
+const char *replayRecordField(uint32_t type, unsigned int i);
+
+class ReplayLogWriter
+{
+ public:
+  /**
+   * @brief Create the log file, replacing an existing one
+   *
+   * @return false if the file could not be created
+   */
+  bool open(const std::string &filename);
+  bool write(const ReplayRecord &record);
+  bool close();
+
+ private:
+  std::ofstream file_;
+};
+
+/**
+ * @brief Read all the records of a log file
+ *
+ * @return false if the file cannot be read or is not a replay log, error then has the reason
+ */
+bool readReplayLog(const std::string &filename, std::vector<ReplayRecord> &records, std::string &error);
+
+/**
+ * @brief Compare a log against a golden one. The values of the records are compared with an absolute tolerance, the
+ * types and stamps have to match exactly since the replay is deterministic.
+ *
+ * @param report Gets the first difference and the maximum error of each field.
+ *
+ * @return true if the logs match
+ */
+bool compareReplayLogs(const std::vector<ReplayRecord> &log, const std::vector<ReplayRecord> &golden, float tolerance,
+                       std::ostream &report);
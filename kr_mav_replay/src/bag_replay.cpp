@@ -0,0 +1,277 @@
+#include <kr_mav_replay/bag_replay.h>
+#include <kr_tracker_msgs/TrackerStatus.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <std_msgs/Bool.h>
+
+static bool ends_with(const std::string &str, const std::string &suffix)
+{
+  return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+BagReplay::BagReplay(const kr_trackers_manager::OfflineParams &params)
+    : params_(params),
+      tracker_loader_("kr_trackers_manager", "kr_trackers_manager::Tracker"),
+      active_tracker_(NULL),
+      controller_(new SO3CommandGenerator),
+      log_(NULL),
+      failed_(false),
+      odom_index_(0),
+      num_position_cmds_(0),
+      num_so3_cmds_(0)
+{
+}
+
+BagReplay::~BagReplay()
+{
+  for(const auto &tracker : tracker_map_)
+  {
+    delete tracker.second;
+    try
+    {
+      tracker_loader_.unloadLibraryForClass(tracker.first);
+    }
+    catch(pluginlib::LibraryUnloadException &e)
+    {
+      ROS_ERROR_STREAM("Could not unload library for the tracker " << tracker.first << ": " << e.what());
+    }
+  }
+}
+
+bool BagReplay::run(const std::string &bag_file, ReplayLogWriter &log)
+{
+  rosbag::Bag bag;
+  try
+  {
+    bag.open(bag_file, rosbag::bagmode::Read);
+  }
+  catch(rosbag::BagException &e)
+  {
+    ROS_ERROR("Could not open %s: %s", bag_file.c_str(), e.what());
+    return false;
+  }
+
+  const std::string trackers_manager_ns =
+      params_.param("trackers_manager_ns", std::string("/quadrotor/trackers_manager"));
+  const std::string odom_topic = params_.param("odom_topic", std::string("/quadrotor/odom"));
+  const std::string motors_topic = params_.param("motors_topic", std::string("/quadrotor/motors"));
+  const std::string status_topic = trackers_manager_ns + "/status";
+
+  rosbag::View view(bag);
+  if(view.size() == 0)
+  {
+    ROS_ERROR("%s has no messages", bag_file.c_str());
+    return false;
+  }
+
+  // Everything created from here on, e.g. the trackers, has to use the time of the bag
+  ros::Time::setNow(view.getBeginTime());
+
+  if(!loadTrackers())
+    return false;
+  controller_->loadParams(kr_trackers_manager::OfflineParams(params_, "so3_control"));
+
+  log_ = &log;
+  std::vector<uint8_t> buffer;
+  const ros::WallTime start = ros::WallTime::now();
+  for(const rosbag::MessageInstance &m : view)
+  {
+    ros::Time::setNow(m.getTime());
+
+    const std::string &topic = m.getTopic();
+    if(topic == odom_topic)
+    {
+      const nav_msgs::Odometry::ConstPtr odom = m.instantiate<nav_msgs::Odometry>();
+      if(odom != NULL)
+        odomCallback(odom);
+    }
+    else if(topic == status_topic)
+    {
+      // The calls to the transition service are not recorded, but the status names the active tracker
+      const kr_tracker_msgs::TrackerStatus::ConstPtr status = m.instantiate<kr_tracker_msgs::TrackerStatus>();
+      if(status != NULL && !status->tracker.empty() && status->tracker != active_tracker_name_)
+      {
+        if(offline_unsupported_.count(status->tracker))
+        {
+          ROS_ERROR_STREAM("The bag switches to " << status->tracker << ", which cannot be replayed");
+          return false;
+        }
+        transition(status->tracker);
+      }
+    }
+    else if(topic == motors_topic)
+    {
+      const std_msgs::Bool::ConstPtr motors = m.instantiate<std_msgs::Bool>();
+      if(motors != NULL)
+        controller_->setMotors(motors->data);
+    }
+    else if(topic.compare(0, trackers_manager_ns.size() + 1, trackers_manager_ns + "/") == 0)
+    {
+      // The trackers get the serialized messages, as they would from their subscribers
+      buffer.resize(m.size());
+      ros::serialization::OStream stream(buffer.data(), buffer.size());
+      m.write(stream);
+      if(!replayTrackerMessage(topic.substr(trackers_manager_ns.size() + 1), buffer))
+        return false;
+    }
+
+    if(failed_)
+    {
+      ROS_ERROR("Could not write the replay log");
+      return false;
+    }
+  }
+
+  const double duration = (ros::WallTime::now() - start).toSec();
+  ROS_INFO("Replayed %u odometry messages, %.1f s of data in %.2f s: %u PositionCommand and %u SO3Command messages",
+           odom_index_, (view.getEndTime() - view.getBeginTime()).toSec(), duration, num_position_cmds_,
+           num_so3_cmds_);
+  return true;
+}
+
+bool BagReplay::loadTrackers()
+{
+  const kr_trackers_manager::OfflineParams params(params_, "trackers_manager");
+
+  bool use_odom_clock;
+  params.param("use_odom_clock", use_odom_clock, true);
+
+  XmlRpc::XmlRpcValue tracker_list;
+  if(!params.getParam("trackers", tracker_list) || tracker_list.getType() != XmlRpc::XmlRpcValue::TypeArray)
+  {
+    ROS_ERROR("No trackers list in %s/trackers", params.getNamespace().c_str());
+    return false;
+  }
+
+  for(int i = 0; i < tracker_list.size(); i++)
+  {
+    const std::string tracker_name = static_cast<const std::string>(tracker_list[i]);
+    kr_trackers_manager::Tracker *c;
+    try
+    {
+      c = tracker_loader_.createUnmanagedInstance(tracker_name);
+    }
+    catch(pluginlib::PluginlibException &e)
+    {
+      ROS_ERROR_STREAM("Could not load the tracker " << tracker_name << ": " << e.what());
+      return false;
+    }
+
+    if(use_odom_clock)
+      c->setClock([this]() { return tracker_time_; });
+    // Goals which activate their tracker do so here too, the status recorded afterwards then names it already
+    c->setActivationCallback([this](kr_trackers_manager::Tracker *tracker, const ros::Time &) {
+      for(const auto &t : tracker_map_)
+      {
+        if(t.second == tracker)
+          return t.second == active_tracker_ || transition(t.first);
+      }
+      return false;
+    });
+    if(!c->InitializeOffline(params))
+    {
+      ROS_WARN_STREAM("The tracker " << tracker_name << " cannot run without a ROS master, skipping it");
+      offline_unsupported_.insert(tracker_name);
+      delete c;
+      continue;
+    }
+    tracker_map_.insert(std::make_pair(tracker_name, c));
+    inactive_trackers_.push_back(c);
+  }
+  return true;
+}
+
+bool BagReplay::transition(const std::string &tracker_name)
+{
+  const auto it = tracker_map_.find(tracker_name);
+  if(it == tracker_map_.end())
+  {
+    ROS_WARN_STREAM("Cannot find tracker " << tracker_name << ", cannot transition");
+    return false;
+  }
+
+  if(!it->second->Activate(cmd_))
+  {
+    ROS_WARN_STREAM("Failed to activate tracker " << tracker_name << ", cannot transition");
+    return false;
+  }
+
+  if(active_tracker_ != NULL)
+    active_tracker_->Deactivate();
+
+  active_tracker_ = it->second;
+  active_tracker_name_ = it->first;
+  inactive_trackers_.clear();
+  for(const auto &tracker : tracker_map_)
+  {
+    if(tracker.second != active_tracker_)
+      inactive_trackers_.push_back(tracker.second);
+  }
+  return true;
+}
+
+void BagReplay::odomCallback(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  tracker_time_ = msg->header.stamp;
+
+  // As in SO3ControlNodelet, a command is computed from the odometry if no PositionCommand followed the previous one
+  if(controller_->setOdometry(*msg))
+    calculateControl();
+
+  for(kr_trackers_manager::Tracker *tracker : inactive_trackers_)
+    tracker->observe(msg);
+
+  if(active_tracker_ != NULL)
+  {
+    cmd_ = active_tracker_->update(msg);
+    if(cmd_ != NULL)
+    {
+      write(makeReplayRecord(*cmd_, odom_index_));
+      num_position_cmds_++;
+
+      controller_->setPositionCommand(*cmd_);
+      calculateControl();
+    }
+  }
+
+  odom_index_++;
+}
+
+bool BagReplay::replayTrackerMessage(const std::string &topic, const std::vector<uint8_t> &data)
+{
+  try
+  {
+    for(const auto &tracker : tracker_map_)
+    {
+      if(tracker.second->replay(topic, data.data(), data.size()))
+        return true;
+    }
+  }
+  catch(ros::Exception &e)
+  {
+    ROS_ERROR_STREAM("Could not replay the message on " << topic << ": " << e.what());
+    return false;
+  }
+
+  // The results, feedback and status of the trackers are outputs, but the goals of a skipped tracker are lost
+  if(ends_with(topic, "/goal") || ends_with(topic, "/cancel"))
+    ROS_WARN_STREAM_ONCE("No tracker takes the messages on " << topic << ", they are not replayed");
+  return true;
+}
+
+void BagReplay::calculateControl()
+{
+  kr_mav_msgs::SO3Command so3_cmd;
+  float compute_time;
+  if(!controller_->calculate(so3_cmd, compute_time))
+    return;
+
+  write(makeReplayRecord(so3_cmd, odom_index_));
+  num_so3_cmds_++;
+}
+
+void BagReplay::write(const ReplayRecord &record)
+{
+  if(!log_->write(record))
+    failed_ = true;
+}
@@ -0,0 +1,214 @@
+// Replays a bag through the trackers and the SO3 controller without a ROS master, see bag_replay.h, and compares the
+// resulting log against a golden log if one is given.
+//
+// The params are read from YAML files, loaded into a namespace as rosparam would, and from single values. Without any
+// -p option, the configs of kr_mav_launch are loaded into trackers_manager and so3_control as the launch files do.
+
+#include <kr_mav_replay/bag_replay.h>
+#include <ros/package.h>
+#include <unistd.h>
+#include <yaml-cpp/yaml.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s [-p ns=params.yaml]... [-s name=value]... [-t tolerance] <bag_file> <log_file> [golden_file]\n"
+          "  -p  Load a YAML file into the namespace ns of the params, e.g. trackers_manager=tracker_params.yaml\n"
+          "  -s  Set one param, e.g. so3_control/mass=0.5, the value is parsed as YAML\n"
+          "  -t  Absolute tolerance for the comparison against the golden log, default 1e-4\n",
+          name);
+}
+
+// Convert a YAML node as rosparam does: the scalars are ints, doubles, bools or strings in that order
+static XmlRpc::XmlRpcValue toXmlRpc(const YAML::Node &node)
+{
+  XmlRpc::XmlRpcValue value;
+  if(node.IsMap())
+  {
+    for(const auto &member : node)
+      value[member.first.as<std::string>()] = toXmlRpc(member.second);
+  }
+  else if(node.IsSequence())
+  {
+    value.setSize(node.size());
+    for(int i = 0; i < value.size(); i++)
+      value[i] = toXmlRpc(node[i]);
+  }
+  else if(node.IsScalar())
+  {
+    int i;
+    double d;
+    bool b;
+    if(YAML::convert<int>::decode(node, i))
+      value = i;
+    else if(YAML::convert<double>::decode(node, d))
+      value = d;
+    else if(YAML::convert<bool>::decode(node, b))
+      value = b;
+    else
+      value = node.as<std::string>();
+  }
+  return value;
+}
+
+// Merge the members of a struct into another, as loading several files into one namespace does
+static void merge(XmlRpc::XmlRpcValue &dest, XmlRpc::XmlRpcValue src)
+{
+  if(dest.getType() != XmlRpc::XmlRpcValue::TypeStruct || src.getType() != XmlRpc::XmlRpcValue::TypeStruct)
+  {
+    dest = src;
+    return;
+  }
+  for(auto &member : src)
+    merge(dest[member.first], member.second);
+}
+
+// The value at a '/' separated name below params, created as structs where needed
+static XmlRpc::XmlRpcValue &lookup(XmlRpc::XmlRpcValue &params, const std::string &name)
+{
+  XmlRpc::XmlRpcValue *value = &params;
+  std::istringstream path(name);
+  std::string part;
+  while(std::getline(path, part, '/'))
+  {
+    if(part.empty())
+      continue;
+    if(value->getType() != XmlRpc::XmlRpcValue::TypeStruct)
+      *value = XmlRpc::XmlRpcValue();
+    value = &(*value)[part];
+  }
+  return *value;
+}
+
+static bool loadFile(XmlRpc::XmlRpcValue &params, const std::string &ns, const std::string &filename)
+{
+  try
+  {
+    merge(lookup(params, ns), toXmlRpc(YAML::LoadFile(filename)));
+  }
+  catch(YAML::Exception &e)
+  {
+    fprintf(stderr, "Could not load %s: %s\n", filename.c_str(), e.what());
+    return false;
+  }
+  return true;
+}
+
+// Split name=value at the first '='
+static bool split(const char *arg, std::string &name, std::string &value)
+{
+  const std::string s(arg);
+  const size_t pos = s.find('=');
+  if(pos == std::string::npos)
+    return false;
+  name = s.substr(0, pos);
+  value = s.substr(pos + 1);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  // The time is simulated, but no ros::init() since there is no ROS master
+  ros::Time::init();
+
+  XmlRpc::XmlRpcValue params;
+  bool loaded_params = false;
+  std::vector<std::pair<std::string, std::string>> values;
+  float tolerance = 1e-4f;
+
+  int opt;
+  std::string name, value;
+  while((opt = getopt(argc, argv, "p:s:t:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'p':
+        if(!split(optarg, name, value))
+        {
+          usage(argv[0]);
+          return 1;
+        }
+        if(!loadFile(params, name, value))
+          return 1;
+        loaded_params = true;
+        break;
+      case 's':
+        if(!split(optarg, name, value))
+        {
+          usage(argv[0]);
+          return 1;
+        }
+        values.push_back(std::make_pair(name, value));
+        break;
+      case 't':
+        tolerance = std::atof(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(argc - optind < 2 || argc - optind > 3)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  const char *bag_file = argv[optind], *log_file = argv[optind + 1];
+  const char *golden_file = argc - optind > 2 ? argv[optind + 2] : NULL;
+
+  if(!loaded_params)
+  {
+    const std::string config = ros::package::getPath("kr_mav_launch") + "/config/";
+    if(!loadFile(params, "trackers_manager", config + "trackers.yaml") ||
+       !loadFile(params, "trackers_manager", config + "tracker_params.yaml") ||
+       !loadFile(params, "so3_control", config + "gains.yaml"))
+      return 1;
+  }
+  // The single values are set last, so they override the files
+  try
+  {
+    for(const auto &v : values)
+      lookup(params, v.first) = toXmlRpc(YAML::Load(v.second));
+  }
+  catch(YAML::Exception &e)
+  {
+    fprintf(stderr, "Could not parse a param value: %s\n", e.what());
+    return 1;
+  }
+
+  ReplayLogWriter log;
+  if(!log.open(log_file))
+  {
+    fprintf(stderr, "Could not create %s\n", log_file);
+    return 1;
+  }
+
+  bool replayed;
+  {
+    BagReplay replay((kr_trackers_manager::OfflineParams(params)));
+    replayed = replay.run(bag_file, log);
+  }
+  if(!log.close() || !replayed)
+    return 1;
+
+  if(golden_file == NULL)
+    return 0;
+
+  std::vector<ReplayRecord> records, golden;
+  std::string error;
+  if(!readReplayLog(log_file, records, error) || !readReplayLog(golden_file, golden, error))
+  {
+    fprintf(stderr, "Could not read the replay logs: %s\n", error.c_str());
+    return 1;
+  }
+
+  const bool match = compareReplayLogs(records, golden, tolerance, std::cout);
+  printf("%s\n", match ? "Logs match" : "Logs differ");
+  return match ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+// Compares a replay log written by bag_replay against a golden one. Exits with 0 if they match within the tolerance.
+
+#include <kr_mav_replay/replay_log.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char **argv)
+{
+  if(argc < 3 || argc > 4)
+  {
+    fprintf(stderr, "Usage: %s <log_file> <golden_file> [tolerance]\n", argv[0]);
+    return 1;
+  }
+
+  const float tolerance = argc > 3 ? std::atof(argv[3]) : 1e-4f;
+
+  std::vector<ReplayRecord> log, golden;
+  std::string error;
+  if(!readReplayLog(argv[1], log, error))
+  {
+    fprintf(stderr, "Could not read %s: %s\n", argv[1], error.c_str());
+    return 1;
+  }
+  if(!readReplayLog(argv[2], golden, error))
+  {
+    fprintf(stderr, "Could not read %s: %s\n", argv[2], error.c_str());
+    return 1;
+  }
+
+  const bool match = compareReplayLogs(log, golden, tolerance, std::cout);
+  printf("%s\n", match ? "Logs match" : "Logs differ");
+  return match ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+#include <kr_mav_replay/replay_log.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+static const char kReplayLogMagic[4] = {'K', 'R', 'R', 'P'};
+static const uint32_t kReplayLogVersion = 1;
+
+static const char *const kPositionCommandFields[] = {
+    "position.x",     "position.y",     "position.z",     "velocity.x", "velocity.y", "velocity.z", "acceleration.x",
+    "acceleration.y", "acceleration.z", "jerk.x",         "jerk.y",     "jerk.z",     "yaw",        "yaw_dot"};
+static const char *const kSO3CommandFields[] = {
+    "force.x",       "force.y",       "force.z",            "orientation.x",      "orientation.y",
+    "orientation.z", "orientation.w", "angular_velocity.x", "angular_velocity.y", "angular_velocity.z"};
+
+ReplayRecord makeReplayRecord(const kr_mav_msgs::PositionCommand &cmd, uint32_t odom_index)
+{
+  ReplayRecord record = {};
+  record.type = ReplayRecord::POSITION_COMMAND;
+  record.odom_index = odom_index;
+  record.stamp = cmd.header.stamp.toSec();
+  const double data[] = {cmd.position.x,     cmd.position.y,     cmd.position.z,     cmd.velocity.x,
+                         cmd.velocity.y,     cmd.velocity.z,     cmd.acceleration.x, cmd.acceleration.y,
+                         cmd.acceleration.z, cmd.jerk.x,         cmd.jerk.y,         cmd.jerk.z,
+                         cmd.yaw,            cmd.yaw_dot};
+  std::copy(std::begin(data), std::end(data), record.data);
+  return record;
+}
+
+ReplayRecord makeReplayRecord(const kr_mav_msgs::SO3Command &cmd, uint32_t odom_index)
+{
+  ReplayRecord record = {};
+  record.type = ReplayRecord::SO3_COMMAND;
+  record.odom_index = odom_index;
+  record.stamp = cmd.header.stamp.toSec();
+  const double data[] = {cmd.force.x,
+                         cmd.force.y,
+                         cmd.force.z,
+                         cmd.orientation.x,
+                         cmd.orientation.y,
+                         cmd.orientation.z,
+                         cmd.orientation.w,
+                         cmd.angular_velocity.x,
+                         cmd.angular_velocity.y,
+                         cmd.angular_velocity.z};
+  std::copy(std::begin(data), std::end(data), record.data);
+  return record;
+}
+
+unsigned int replayRecordSize(uint32_t type)
+{
+  switch(type)
+  {
+    case ReplayRecord::POSITION_COMMAND:
+      return sizeof(kPositionCommandFields) / sizeof(kPositionCommandFields[0]);
+    case ReplayRecord::SO3_COMMAND:
+      return sizeof(kSO3CommandFields) / sizeof(kSO3CommandFields[0]);
+    default:
+      return 0;
+  }
+}
+
+const char *replayRecordField(uint32_t type, unsigned int i)
+{
+  if(i >= replayRecordSize(type))
+    return "";
+  return type == ReplayRecord::POSITION_COMMAND ? kPositionCommandFields[i] : kSO3CommandFields[i];
+}
+
+static const char *replayRecordName(uint32_t type)
+{
+  switch(type)
+  {
+    case ReplayRecord::POSITION_COMMAND:
+      return "PositionCommand";
+    case ReplayRecord::SO3_COMMAND:
+      return "SO3Command";
+    default:
+      return "unknown";
+  }
+}
+
+bool ReplayLogWriter::open(const std::string &filename)
+{
+  file_.open(filename, std::ios::binary | std::ios::trunc);
+  if(!file_)
+    return false;
+
+  ReplayLogHeader header;
+  std::memcpy(header.magic, kReplayLogMagic, sizeof(header.magic));
+  header.version = kReplayLogVersion;
+  file_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  return static_cast<bool>(file_);
+}
+
+bool ReplayLogWriter::write(const ReplayRecord &record)
+{
+  file_.write(reinterpret_cast<const char *>(&record), sizeof(record));
+  return static_cast<bool>(file_);
+}
+
+bool ReplayLogWriter::close()
+{
+  file_.close();
+  return static_cast<bool>(file_);
+}
+
+bool readReplayLog(const std::string &filename, std::vector<ReplayRecord> &records, std::string &error)
+{
+  records.clear();
+
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if(!file)
+  {
+    error = std::strerror(errno);
+    return false;
+  }
+
+  const std::streamoff size = file.tellg();
+  file.seekg(0);
+  ReplayLogHeader header;
+  if(size < static_cast<std::streamoff>(sizeof(header)) ||
+     !file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+     std::memcmp(header.magic, kReplayLogMagic, sizeof(header.magic)) != 0 || header.version != kReplayLogVersion)
+  {
+    error = "not a replay log or unsupported version";
+    return false;
+  }
+  if((size - sizeof(header)) % sizeof(ReplayRecord) != 0)
+  {
+    error = "truncated record";
+    return false;
+  }
+
+  records.resize((size - sizeof(header)) / sizeof(ReplayRecord));
+  if(!file.read(reinterpret_cast<char *>(records.data()), records.size() * sizeof(ReplayRecord)))
+  {
+    error = "read failed";
+    return false;
+  }
+  return true;
+}
+
+bool compareReplayLogs(const std::vector<ReplayRecord> &log, const std::vector<ReplayRecord> &golden, float tolerance,
+                       std::ostream &report)
+{
+  bool match = true;
+  if(log.size() != golden.size())
+  {
+    report << "Log has " << log.size() << " records, golden log has " << golden.size() << "\n";
+    match = false;
+  }
+
+  // Maximum error of each field, indexed by the record type
+  float max_error[3][16] = {};
+  bool reported = false;
+  const size_t n = std::min(log.size(), golden.size());
+  for(size_t i = 0; i < n; i++)
+  {
+    const ReplayRecord &a = log[i], &b = golden[i];
+    if(a.type != b.type || a.odom_index != b.odom_index || a.stamp != b.stamp || replayRecordSize(a.type) == 0)
+    {
+      report.precision(std::numeric_limits<double>::max_digits10);
+      report << "Record " << i << " diverges: " << replayRecordName(a.type) << " for odometry " << a.odom_index
+             << " at " << a.stamp << ", golden has " << replayRecordName(b.type) << " for odometry " << b.odom_index
+             << " at " << b.stamp << "\n";
+      match = false;
+      break;
+    }
+
+    for(unsigned int k = 0; k < replayRecordSize(a.type); k++)
+    {
+      float error = std::abs(a.data[k] - b.data[k]);
+      if(std::isnan(a.data[k]) || std::isnan(b.data[k]))
+        error = (std::isnan(a.data[k]) && std::isnan(b.data[k])) ? 0 : std::numeric_limits<float>::infinity();
+      max_error[a.type][k] = std::max(max_error[a.type][k], error);
+
+      if(error > tolerance && !reported)
+      {
+        report << "Record " << i << " (" << replayRecordName(a.type) << " for odometry " << a.odom_index << ") "
+               << replayRecordField(a.type, k) << " is " << a.data[k] << ", golden is " << b.data[k] << "\n";
+        match = false;
+        reported = true;
+      }
+    }
+  }
+
+  for(uint32_t type : {ReplayRecord::POSITION_COMMAND, ReplayRecord::SO3_COMMAND})
+  {
+    report << "Maximum error of " << replayRecordName(type) << ":";
+    for(unsigned int k = 0; k < replayRecordSize(type); k++)
+      report << " " << replayRecordField(type, k) << " " << max_error[type][k];
+    report << "\n";
+  }
+  return match;
+}
@@ -0,0 +1,263 @@
+#include <gtest/gtest.h>
+#include <kr_mav_controllers/SO3Control.h>
+#include <kr_mav_replay/bag_replay.h>
+#include <kr_tracker_msgs/LineTrackerAction.h>
+#include <kr_tracker_msgs/TrackerStatus.h>
+#include <rosbag/bag.h>
+#include <std_msgs/Bool.h>
+
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+static const std::string kTrackersManagerNs = "/quadrotor/trackers_manager";
+static const ros::Time kStart(1000);
+static const unsigned int kNumOdom = 401;
+static const double kOdomPeriod = 0.01;
+static const double kGoalTime = 0.505;
+static const double kGoalDuration = 2.0;
+static const Eigen::Vector3d kStartPosition(0, 0, 1), kGoalPosition(1, 0, 1);
+// Sent while flying to kGoalPosition, queued behind that goal
+static const double kSecondGoalTime = 1.005;
+static const double kSecondGoalDuration = 1.0;
+static const Eigen::Vector3d kSecondGoalPosition(1, 1, 1);
+
+enum SecondGoal
+{
+  NO_SECOND_GOAL,
+  QUEUED_GOAL,
+  QUEUED_GOAL_WITH_START_TIME
+};
+
+static ros::Time odomTime(unsigned int i)
+{
+  return kStart + ros::Duration(i * kOdomPeriod);
+}
+
+static void writeStatus(rosbag::Bag &bag, const ros::Time &t, const std::string &tracker)
+{
+  kr_tracker_msgs::TrackerStatus status;
+  status.header.stamp = t;
+  status.tracker = tracker;
+  status.status = kr_tracker_msgs::TrackerStatus::SUCCEEDED;
+  bag.write(kTrackersManagerNs + "/status", t, status);
+}
+
+// Hovering at kStartPosition with the NullTracker active, then a LineTrackerMinJerk goal to kGoalPosition which
+// activates its tracker, as sent by the MAVManager. The second goal is queued as the MAVManager does for the next line
+// goal of a mission.
+static void writeFixtureBag(const std::string &filename, SecondGoal second_goal)
+{
+  rosbag::Bag bag(filename, rosbag::bagmode::Write);
+  for(unsigned int i = 0; i < kNumOdom; i++)
+  {
+    nav_msgs::Odometry odom;
+    odom.header.stamp = odomTime(i);
+    odom.header.frame_id = "world";
+    odom.pose.pose.position.x = kStartPosition(0);
+    odom.pose.pose.position.y = kStartPosition(1);
+    odom.pose.pose.position.z = kStartPosition(2);
+    odom.pose.pose.orientation.w = 1;
+    bag.write("/quadrotor/odom", odom.header.stamp, odom);
+  }
+
+  std_msgs::Bool motors;
+  motors.data = true;
+  bag.write("/quadrotor/motors", kStart + ros::Duration(0.002), motors);
+  writeStatus(bag, kStart + ros::Duration(0.005), "kr_trackers/NullTracker");
+
+  const ros::Time goal_time = kStart + ros::Duration(kGoalTime);
+  kr_tracker_msgs::LineTrackerActionGoal goal;
+  goal.header.stamp = goal_time;
+  goal.goal_id.stamp = goal_time;
+  goal.goal_id.id = "goal";
+  goal.goal.x = kGoalPosition(0);
+  goal.goal.y = kGoalPosition(1);
+  goal.goal.z = kGoalPosition(2);
+  goal.goal.duration = ros::Duration(kGoalDuration);
+  goal.goal.activate = true;
+  goal.goal.send_time = goal_time;
+  bag.write(kTrackersManagerNs + "/line_tracker_min_jerk/LineTracker/goal", goal_time, goal);
+
+  writeStatus(bag, goal_time + ros::Duration(0.01), "kr_trackers/LineTrackerMinJerk");
+
+  if(second_goal != NO_SECOND_GOAL)
+  {
+    const ros::Time second_goal_time = kStart + ros::Duration(kSecondGoalTime);
+    kr_tracker_msgs::LineTrackerActionGoal queued;
+    queued.header.stamp = second_goal_time;
+    queued.goal_id.stamp = second_goal_time;
+    queued.goal_id.id = "queued_goal";
+    queued.goal.x = kSecondGoalPosition(0);
+    queued.goal.y = kSecondGoalPosition(1);
+    queued.goal.z = kSecondGoalPosition(2);
+    queued.goal.duration = ros::Duration(kSecondGoalDuration);
+    queued.goal.queue = true;
+    if(second_goal == QUEUED_GOAL_WITH_START_TIME)
+      queued.goal.t_start = second_goal_time + ros::Duration(1.0);
+    bag.write(kTrackersManagerNs + "/line_tracker_min_jerk/LineTracker/goal", second_goal_time, queued);
+  }
+  bag.close();
+}
+
+static kr_trackers_manager::OfflineParams makeParams()
+{
+  XmlRpc::XmlRpcValue params;
+  params["trackers_manager_ns"] = kTrackersManagerNs;
+  params["odom_topic"] = std::string("/quadrotor/odom");
+  params["motors_topic"] = std::string("/quadrotor/motors");
+  params["trackers_manager"]["trackers"][0] = std::string("kr_trackers/LineTrackerMinJerk");
+  params["trackers_manager"]["trackers"][1] = std::string("kr_trackers/NullTracker");
+  params["trackers_manager"]["use_odom_clock"] = true;
+  params["so3_control"]["mass"] = 0.5;
+  return kr_trackers_manager::OfflineParams(params);
+}
+
+// A min jerk trajectory between two points at rest
+struct Segment
+{
+  double start, duration;
+  Eigen::Vector3d from, to;
+};
+
+// The commands expected for the fixture bag: the min jerk trajectories of the goals, the first from the first odometry
+// after its goal and each following one from the end of the one before, held at the last goal once they are over, and
+// the SO3Control output for them with the default gains of the SO3ControlNodelet
+static std::vector<ReplayRecord> expectedRecords(bool second_segment)
+{
+  SO3Control controller;
+  controller.resetIntegrals();
+  controller.setMass(0.5);
+  controller.setGravity(9.81);
+  controller.setMaxIntegral(0.5);
+  controller.setMaxIntegralBody(0.5);
+  controller.setMaxTiltAngle(M_PI);
+  controller.setPosition(kStartPosition.cast<float>());
+  controller.setVelocity(Eigen::Vector3f::Zero());
+  controller.setCurrentOrientation(Eigen::Quaternionf::Identity());
+  const Eigen::Vector3f kx(7.4, 7.4, 10.4), kv(4.8, 4.8, 6.0);
+
+  std::vector<Segment> segments(1, Segment{0, kGoalDuration, kStartPosition, kGoalPosition});
+  if(second_segment)
+    segments.push_back(Segment{kGoalDuration, kSecondGoalDuration, kGoalPosition, kSecondGoalPosition});
+
+  const unsigned int first = static_cast<unsigned int>(std::ceil(kGoalTime / kOdomPeriod));
+  std::vector<ReplayRecord> records;
+  for(unsigned int i = first; i < kNumOdom; i++)
+  {
+    const double t_first = (odomTime(i) - odomTime(first)).toSec();
+    auto segment = segments.begin();
+    while(segment + 1 != segments.end() && t_first >= (segment + 1)->start)
+      segment++;
+    const Eigen::Vector3d d = segment->to - segment->from;
+    const double T = segment->duration, t = t_first - segment->start, s = std::min(t / T, 1.0);
+    Eigen::Vector3d x = segment->to, v = Eigen::Vector3d::Zero(), a = Eigen::Vector3d::Zero(),
+                    j = Eigen::Vector3d::Zero();
+    if(t < T)
+    {
+      x = segment->from + d * (10 * std::pow(s, 3) - 15 * std::pow(s, 4) + 6 * std::pow(s, 5));
+      v = d * (30 * s * s - 60 * std::pow(s, 3) + 30 * std::pow(s, 4)) / T;
+      a = d * (60 * s - 180 * s * s + 120 * std::pow(s, 3)) / (T * T);
+      j = d * (60 - 360 * s + 360 * s * s) / (T * T * T);
+    }
+
+    kr_mav_msgs::PositionCommand cmd;
+    cmd.header.stamp = odomTime(i);
+    cmd.position.x = x(0), cmd.position.y = x(1), cmd.position.z = x(2);
+    cmd.velocity.x = v(0), cmd.velocity.y = v(1), cmd.velocity.z = v(2);
+    cmd.acceleration.x = a(0), cmd.acceleration.y = a(1), cmd.acceleration.z = a(2);
+    cmd.jerk.x = j(0), cmd.jerk.y = j(1), cmd.jerk.z = j(2);
+    records.push_back(makeReplayRecord(cmd, i));
+
+    controller.calculateControl(x.cast<float>(), v.cast<float>(), a.cast<float>(), j.cast<float>(), 0, 0, kx, kv,
+                                Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero());
+    const Eigen::Vector3f &force = controller.getComputedForce();
+    const Eigen::Quaternionf &orientation = controller.getComputedOrientation();
+    const Eigen::Vector3f &ang_vel = controller.getComputedAngularVelocity();
+    kr_mav_msgs::SO3Command so3_cmd;
+    so3_cmd.header.stamp = odomTime(i);
+    so3_cmd.force.x = force(0), so3_cmd.force.y = force(1), so3_cmd.force.z = force(2);
+    so3_cmd.orientation.x = orientation.x(), so3_cmd.orientation.y = orientation.y();
+    so3_cmd.orientation.z = orientation.z(), so3_cmd.orientation.w = orientation.w();
+    so3_cmd.angular_velocity.x = ang_vel(0), so3_cmd.angular_velocity.y = ang_vel(1);
+    so3_cmd.angular_velocity.z = ang_vel(2);
+    records.push_back(makeReplayRecord(so3_cmd, i));
+  }
+  return records;
+}
+
+class BagReplayTest : public ::testing::Test
+{
+ protected:
+  void SetUp() { bag_file_ = testing::TempDir() + "bag_replay_test.bag"; }
+
+  void TearDown() { std::remove(bag_file_.c_str()); }
+
+  bool replay(const std::string &log_file, std::vector<ReplayRecord> &records)
+  {
+    ReplayLogWriter log;
+    if(!log.open(log_file))
+      return false;
+    bool replayed;
+    {
+      BagReplay replay(makeParams());
+      replayed = replay.run(bag_file_, log);
+    }
+    std::string error;
+    const bool read = log.close() && replayed && readReplayLog(log_file, records, error);
+    std::remove(log_file.c_str());
+    return read;
+  }
+
+  std::string bag_file_;
+};
+
+TEST_F(BagReplayTest, MatchesGolden)
+{
+  writeFixtureBag(bag_file_, NO_SECOND_GOAL);
+  std::vector<ReplayRecord> records;
+  ASSERT_TRUE(replay(testing::TempDir() + "bag_replay_test.log", records));
+
+  std::ostringstream report;
+  EXPECT_TRUE(compareReplayLogs(records, expectedRecords(false), 1e-4f, report)) << report.str();
+}
+
+// A mission of two line goals, the second starts exactly where the first ends
+TEST_F(BagReplayTest, QueuedGoal)
+{
+  writeFixtureBag(bag_file_, QUEUED_GOAL);
+  std::vector<ReplayRecord> records;
+  ASSERT_TRUE(replay(testing::TempDir() + "bag_replay_test.log", records));
+
+  std::ostringstream report;
+  EXPECT_TRUE(compareReplayLogs(records, expectedRecords(true), 1e-4f, report)) << report.str();
+}
+
+// A queued goal cannot have its own start time, it is aborted and the first goal is held
+TEST_F(BagReplayTest, QueuedGoalWithStartTime)
+{
+  writeFixtureBag(bag_file_, QUEUED_GOAL_WITH_START_TIME);
+  std::vector<ReplayRecord> records;
+  ASSERT_TRUE(replay(testing::TempDir() + "bag_replay_test.log", records));
+
+  std::ostringstream report;
+  EXPECT_TRUE(compareReplayLogs(records, expectedRecords(false), 1e-4f, report)) << report.str();
+}
+
+TEST_F(BagReplayTest, Deterministic)
+{
+  writeFixtureBag(bag_file_, QUEUED_GOAL);
+  std::vector<ReplayRecord> a, b;
+  ASSERT_TRUE(replay(testing::TempDir() + "bag_replay_test_a.log", a));
+  ASSERT_TRUE(replay(testing::TempDir() + "bag_replay_test_b.log", b));
+
+  std::ostringstream report;
+  EXPECT_TRUE(compareReplayLogs(a, b, 0, report)) << report.str();
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::Time::init();
+  return RUN_ALL_TESTS();
+}
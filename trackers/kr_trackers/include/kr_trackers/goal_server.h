@@ -0,0 +1,206 @@
+#ifndef KR_TRACKERS_GOAL_SERVER_H
+#define KR_TRACKERS_GOAL_SERVER_H
+
+#include <actionlib/server/simple_action_server.h>
+#include <actionlib_msgs/GoalID.h>
+#include <kr_trackers_manager/offline_params.h>
+
+#include <memory>
+#include <string>
+
+/**
+ * @brief The action server of a tracker. Created with a ros::NodeHandle it is an actionlib::SimpleActionServer, created
+ * with kr_trackers_manager::OfflineParams it works without a ROS master: the goal and cancel messages are then given to
+ * replay() instead of coming from the topics, and the results and feedback are dropped. The goals are handled as the
+ * SimpleActionServer would, so the tracker sees the same calls of its callbacks either way.
+ */
+template <class ActionSpec>
+class GoalServer
+{
+ public:
+  ACTION_DEFINITION(ActionSpec);
+
+  typedef boost::function<void()> Callback;
+
+  GoalServer(const ros::NodeHandle &nh, const std::string &name, bool auto_start)
+      : server_(new actionlib::SimpleActionServer<ActionSpec>(nh, name, auto_start)),
+        started_(auto_start),
+        new_goal_(false),
+        current_active_(false),
+        current_canceled_(false),
+        preempt_request_(false),
+        new_goal_preempt_request_(false)
+  {
+  }
+
+  GoalServer(const kr_trackers_manager::OfflineParams &params, const std::string &name, bool auto_start)
+      : topic_(params.getNamespace().empty() ? name : params.getNamespace() + "/" + name),
+        started_(auto_start),
+        new_goal_(false),
+        current_active_(false),
+        current_canceled_(false),
+        preempt_request_(false),
+        new_goal_preempt_request_(false)
+  {
+  }
+
+  void registerGoalCallback(const Callback &cb)
+  {
+    if(server_)
+      server_->registerGoalCallback(cb);
+    else
+      goal_callback_ = cb;
+  }
+
+  void registerPreemptCallback(const Callback &cb)
+  {
+    if(server_)
+      server_->registerPreemptCallback(cb);
+    else
+      preempt_callback_ = cb;
+  }
+
+  void start()
+  {
+    if(server_)
+      server_->start();
+    else
+      started_ = true;
+  }
+
+  bool isActive() const { return server_ ? server_->isActive() : current_active_; }
+  bool isNewGoalAvailable() const { return server_ ? server_->isNewGoalAvailable() : new_goal_; }
+  bool isPreemptRequested() const { return server_ ? server_->isPreemptRequested() : preempt_request_; }
+
+  GoalConstPtr acceptNewGoal()
+  {
+    if(server_)
+      return server_->acceptNewGoal();
+
+    if(!new_goal_ || !next_goal_)
+    {
+      ROS_ERROR("Attempting to accept the next goal when a new goal is not available");
+      return GoalConstPtr();
+    }
+    current_goal_ = next_goal_;
+    current_active_ = true;
+    current_canceled_ = false;
+    new_goal_ = false;
+    preempt_request_ = new_goal_preempt_request_;
+    new_goal_preempt_request_ = false;
+    return GoalConstPtr(current_goal_, &current_goal_->goal);
+  }
+
+  void setSucceeded(const Result &result = Result(), const std::string &text = std::string())
+  {
+    if(server_)
+      server_->setSucceeded(result, text);
+    else
+      current_active_ = false;
+  }
+
+  void setAborted(const Result &result = Result(), const std::string &text = std::string())
+  {
+    if(server_)
+      server_->setAborted(result, text);
+    else
+      current_active_ = false;
+  }
+
+  void setPreempted(const Result &result = Result(), const std::string &text = std::string())
+  {
+    if(server_)
+      server_->setPreempted(result, text);
+    else
+      current_active_ = false;
+  }
+
+  void publishFeedback(const Feedback &feedback)
+  {
+    if(server_)
+      server_->publishFeedback(feedback);
+  }
+
+  /**
+   * @brief Give a message recorded on the goal or cancel topic of the server, when created without a ROS master.
+   *
+   * @param topic The topic relative to the kr_trackers_manager's namespace, see kr_trackers_manager::Tracker::replay.
+   *
+   * @return True if the topic is one of the server's.
+   */
+  bool replay(const std::string &topic, const uint8_t *data, uint32_t size)
+  {
+    if(server_ || topic.compare(0, topic_.size() + 1, topic_ + "/") != 0)
+      return false;
+
+    const std::string name = topic.substr(topic_.size() + 1);
+    if(name == "goal")
+    {
+      if(started_)
+        goalReceived(kr_trackers_manager::deserializeReplayMessage<ActionGoal>(data, size));
+      return true;
+    }
+    if(name == "cancel")
+    {
+      if(started_)
+        cancelReceived(*kr_trackers_manager::deserializeReplayMessage<actionlib_msgs::GoalID>(data, size));
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  // As SimpleActionServer::goalCallback, goals older than the current or the next one are dropped
+  void goalReceived(const boost::shared_ptr<ActionGoal> &goal)
+  {
+    if(goal->goal_id.stamp == ros::Time())
+      goal->goal_id.stamp = ros::Time::now();
+
+    if((current_goal_ && goal->goal_id.stamp < current_goal_->goal_id.stamp) ||
+       (next_goal_ && goal->goal_id.stamp < next_goal_->goal_id.stamp))
+      return;
+
+    next_goal_ = goal;
+    new_goal_ = true;
+    new_goal_preempt_request_ = false;
+    if(isActive())
+    {
+      preempt_request_ = true;
+      if(preempt_callback_)
+        preempt_callback_();
+    }
+    if(goal_callback_)
+      goal_callback_();
+  }
+
+  // As ActionServer::cancelCallback followed by SimpleActionServer::preemptCallback
+  void cancelReceived(const actionlib_msgs::GoalID &id)
+  {
+    const auto matches = [&id](const ActionGoalConstPtr &goal) {
+      return (id.id.empty() && id.stamp == ros::Time()) || id.id == goal->goal_id.id ||
+             (id.stamp != ros::Time() && goal->goal_id.stamp <= id.stamp);
+    };
+
+    if(new_goal_ && next_goal_ && next_goal_ != current_goal_ && matches(next_goal_))
+      new_goal_preempt_request_ = true;
+
+    if(current_active_ && !current_canceled_ && matches(current_goal_))
+    {
+      current_canceled_ = true;
+      preempt_request_ = true;
+      if(preempt_callback_)
+        preempt_callback_();
+    }
+  }
+
+  std::unique_ptr<actionlib::SimpleActionServer<ActionSpec>> server_;
+
+  // State of the server without a ROS master
+  std::string topic_;
+  bool started_;
+  Callback goal_callback_, preempt_callback_;
+  ActionGoalConstPtr current_goal_, next_goal_;
+  bool new_goal_, current_active_, current_canceled_, preempt_request_, new_goal_preempt_request_;
+};
+
+#endif  // KR_TRACKERS_GOAL_SERVER_H
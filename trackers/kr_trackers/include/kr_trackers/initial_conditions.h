@@ -13,17 +13,51 @@ class InitialConditions
 
   void set_from_cmd(const kr_mav_msgs::PositionCommand::ConstPtr &msg);
   void set_from_odom(const nav_msgs::Odometry::ConstPtr &msg);
-  Eigen::Vector3f pos() const { return pos_; }
-  Eigen::Vector3f vel() const { return vel_; }
-  Eigen::Vector3f acc() const { return acc_; }
-  Eigen::Vector3f jrk() const { return jrk_; }
-  float yaw() const { return yaw_; }
-  float yaw_dot() const { return yaw_dot_; }
+  Eigen::Vector3f pos() const
+  {
+    convert_odom();
+    return pos_;
+  }
+  Eigen::Vector3f vel() const
+  {
+    convert_odom();
+    return vel_;
+  }
+  Eigen::Vector3f acc() const
+  {
+    convert_odom();
+    return acc_;
+  }
+  Eigen::Vector3f jrk() const
+  {
+    convert_odom();
+    return jrk_;
+  }
+  float yaw() const
+  {
+    convert_odom();
+    return yaw_;
+  }
+  float yaw_dot() const
+  {
+    convert_odom();
+    return yaw_dot_;
+  }
   void reset();
 
  private:
-  Eigen::Vector3f pos_, vel_, acc_, jrk_;
-  float yaw_, yaw_dot_;
+  // The odometry is only converted when the initial conditions are used, since set_from_odom is called for every
+  // odometry message
+  void convert_odom() const
+  {
+    if(odom_)
+      convert_odom_msg();
+  }
+  void convert_odom_msg() const;
+
+  mutable nav_msgs::Odometry::ConstPtr odom_;
+  mutable Eigen::Vector3f pos_, vel_, acc_, jrk_;
+  mutable float yaw_, yaw_dot_;
   bool cmd_valid_;
 };
 
@@ -8,6 +8,8 @@
 #include <nav_msgs/Path.h>
 #include <ros/ros.h>
 
+#include <Eigen/Core>
+
 class LissajousGenerator
 {
  public:
@@ -15,14 +17,18 @@ class LissajousGenerator
   void setParams(const kr_tracker_msgs::LissajousTrackerGoal::ConstPtr &msg);
   void setParams(const kr_tracker_msgs::LissajousAdderGoal::ConstPtr &msg, int num);
   void generatePath(nav_msgs::Path &path, geometry_msgs::Point &initial_pt, double dt);
-  const kr_mav_msgs::PositionCommand::Ptr getPositionCmd(void);
-  bool activate(void);
+  // The times are given by the tracker, see kr_trackers_manager::Tracker::now
+  const kr_mav_msgs::PositionCommand::Ptr getPositionCmd(const ros::Time &t);
+  // Evaluate the trajectory at t seconds from its start, relative to the start position and yaw
+  void evaluate(double t, Eigen::Vector3f &pos, Eigen::Vector3f &vel, Eigen::Vector3f &acc, Eigen::Vector3f &jrk,
+                double &yaw, double &yaw_dot) const;
+  bool activate(const ros::Time &t);
   void deactivate(void);
-  bool isActive(void);
+  bool isActive(void) const;
   bool goalIsSet(void);
   bool status(void) const;
-  float timeRemaining(void);
-  float timeElapsed(void);
+  float timeRemaining(const ros::Time &t) const;
+  float timeElapsed(const ros::Time &t) const;
 
  private:
   double lissajous_period_, ramp_time_, total_time_, ramp_s_, total_s_, const_time_, period_;
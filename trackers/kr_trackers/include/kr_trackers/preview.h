@@ -0,0 +1,24 @@
+#ifndef KR_TRACKERS_PREVIEW_H
+#define KR_TRACKERS_PREVIEW_H
+
+#include <kr_tracker_msgs/TrackerPreview.h>
+
+#include <Eigen/Core>
+
+/**
+ * @brief Store sample i of a tracker preview, see kr_trackers_manager::Tracker::preview
+ */
+inline void setPreviewSample(kr_tracker_msgs::TrackerPreview &preview, unsigned int i, const Eigen::Vector3f &pos,
+                             const Eigen::Vector3f &vel, const Eigen::Vector3f &acc, float yaw, float yaw_dot)
+{
+  for(unsigned int k = 0; k < 3; k++)
+  {
+    preview.position[3 * i + k] = pos(k);
+    preview.velocity[3 * i + k] = vel(k);
+    preview.acceleration[3 * i + k] = acc(k);
+  }
+  preview.yaw[i] = yaw;
+  preview.yaw_dot[i] = yaw_dot;
+}
+
+#endif  // KR_TRACKERS_PREVIEW_H
@@ -17,28 +17,108 @@ class TrajectoryGenerator
    * @param minimize_derivative The derivative to minimize
    */
   TrajectoryGenerator(unsigned int continuous_derivative_order, unsigned int minimize_derivative);
+  virtual ~TrajectoryGenerator() = default;
 
   void setInitialConditions(const Vec3f &position, const vec_Vec3f &derivatives);
   void addWaypoint(const Vec3f &position);  // Waypoint is X, Y, Z
   void clearWaypoints(void);
   std::vector<float> computeTimesTrapezoidSpeed(float vel_des, float acc_des) const;
   std::vector<float> computeTimesConstantSpeed(float avg_speed) const;
-  bool calculate(const std::vector<float> &waypoint_times_);
-  bool getCommand(const float time, Vec3f &pos, Vec3f &vel, Vec3f &acc, Vec3f &jrk) const;
+  virtual bool calculate(const std::vector<float> &waypoint_times_);
 
-  void calcMaxPerSegment(std::vector<float> &max_vel, std::vector<float> &max_acc, std::vector<float> &max_jrk) const;
+  /**
+   * @brief Incrementally update the calculated trajectory after waypoints were appended, removed or modified.
+   *
+   * Only the segments within `window` waypoints of the change are solved again, the rest of the trajectory is kept.
+   * The state of the current trajectory at the splice points is used as the boundary condition of the re-solved
+   * segments, so the commands stay continuous up to continuous_derivative_order. The re-solved segments are stretched
+   * in time where needed to respect the limits last given to optimizeWaypointTimes().
+   *
+   * @param time The current time along the trajectory, the trajectory before this time is never modified
+   * @param waypoints The complete new list of waypoints, indexed the same as in the previous calculate()/replan()
+   * @param waypoint_times The times for the new waypoints, in the same time frame as the times given to the previous
+   * calculate()/replan(). They are compared with those to find the change, the unchanged segments keep the timing
+   * they are flown with and the changed ones take their duration from here.
+   * @param window The number of unchanged segments to also re-solve on each side of the change
+   *
+   * @return false if the change cannot be applied incrementally, e.g. if it modifies the part of the trajectory that
+   * was already flown. The trajectory is left untouched in that case and calculate() should be used instead.
+   */
+  virtual bool replan(float time, const vec_Vec3f &waypoints, const std::vector<float> &waypoint_times,
+                      unsigned int window);
 
+  virtual bool getCommand(const float time, Vec3f &pos, Vec3f &vel, Vec3f &acc, Vec3f &jrk) const;
+
+  virtual void calcMaxPerSegment(std::vector<float> &max_vel, std::vector<float> &max_acc,
+                                 std::vector<float> &max_jrk) const;
+
+  /**
+   * @brief Retime the segments of the calculated trajectory to respect the limits, replan() also respects them after
+   */
   void optimizeWaypointTimes(const float max_vel, const float max_acc, const float max_jrk);
 
   const std::vector<float> &getWaypointTimes() const;
+
+  /**
+   * @brief Get the polynomial coefficients of a segment of the calculated trajectory
+   *
+   * @param segment The index of the segment
+   *
+   * @return N x 3 matrix where row i holds the coefficient of t^i, with t the time from the start of the segment
+   */
+  virtual Eigen::MatrixX3f getCoefficients(unsigned int segment) const;
   float getTotalTime() const;
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
- private:
+ protected:
+  /**
+   * @brief Find the segment of the calculated trajectory to evaluate at a time
+   *
+   * @return false if the time is outside of the trajectory
+   */
+  bool commandSegment(float time, unsigned int &segment) const;
+
   const unsigned int N_;
   const unsigned int R_;
   vec_Vec3f waypoints_, initial_derivatives_;
-  std::vector<Eigen::MatrixX3f, Eigen::aligned_allocator<Eigen::MatrixX3f>> coefficients_;
   std::vector<float> waypoint_times_;
+
+ private:
+  using vec_MatrixX3f = std::vector<Eigen::MatrixX3f, Eigen::aligned_allocator<Eigen::MatrixX3f>>;
+
+  bool solve(const vec_Vec3f &waypoints, const std::vector<float> &waypoint_times,
+             const vec_Vec3f &initial_derivatives, const vec_Vec3f &final_derivatives,
+             vec_MatrixX3f &coefficients) const;
+
+  /**
+   * @brief Fill the constraint and cost blocks of a single segment
+   *
+   * @param seg_time The duration of the segment
+   * @param A The N x N block of the linear constraints, mapping the coefficients to the derivatives at both ends
+   * @param Q The N x N block of the quadratic cost matrix, expected to be zero on input
+   */
+  void segmentMatrices(float seg_time, Eigen::Ref<Eigen::MatrixXf> A, Eigen::Ref<Eigen::MatrixXf> Q) const;
+
+  /**
+   * @brief Evaluate a segment of the calculated trajectory
+   *
+   * @param segment The index of the segment
+   * @param t The time from the start of the segment
+   */
+  void evaluate(unsigned int segment, float t, Vec3f &pos, Vec3f &vel, Vec3f &acc, Vec3f &jrk) const;
+
+  unsigned int findSegment(float time) const;
+  void getDerivatives(unsigned int segment, float t, vec_Vec3f &derivatives) const;
+  static void calcMax(const Eigen::MatrixX3f &coefficients, float seg_duration, float &max_vel, float &max_acc,
+                      float &max_jrk);
+
+  vec_MatrixX3f coefficients_;
+  float max_vel_, max_acc_, max_jrk_;
+
+  // The waypoints and times as last given by the caller to calculate()/replan(). replan() can insert knots in
+  // waypoints_, so knot_index_ maps each of these to its index in waypoints_.
+  vec_Vec3f input_waypoints_;
+  std::vector<float> input_times_;
+  std::vector<unsigned int> knot_index_;
 };
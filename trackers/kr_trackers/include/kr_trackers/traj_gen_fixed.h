@@ -0,0 +1,267 @@
+#pragma once
+
+#include <kr_trackers/traj_gen.h>
+
+#include <Eigen/LU>
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <memory>
+
+namespace traj_gen_detail
+{
+constexpr float factorial(unsigned int n)
+{
+  return n == 0 ? 1.0f : n * factorial(n - 1);
+}
+
+// values[r][i] = i! / (i - r)!, the factor of t^(i - r) in the r-th derivative of t^i
+template <unsigned int N>
+struct DerivativeTable
+{
+  constexpr DerivativeTable() : values{}
+  {
+    for(unsigned int r = 0; r < N; r++)
+      for(unsigned int i = r; i < N; i++)
+        values[r][i] = factorial(i) / factorial(i - r);
+  }
+  float values[N][N];
+};
+
+// values[r][n] is the factor of T^(r + n - 2R + 1) in the integral over [0, T] of the squared R-th derivative
+template <unsigned int N, unsigned int R>
+struct CostTable
+{
+  constexpr CostTable() : values{}
+  {
+    for(unsigned int r = R; r < N; r++)
+      for(unsigned int n = R; n < N; n++)
+        values[r][n] = 2 * (factorial(r) / factorial(r - R)) * (factorial(n) / factorial(n - R)) / (r + n - 2 * R + 1);
+  }
+  float values[N][N];
+};
+}  // namespace traj_gen_detail
+
+/**
+ * @brief TrajectoryGenerator with the polynomial order fixed at compile time
+ *
+ * The per-segment blocks of the solve are fixed-size matrices, the segment coefficients are stored as fixed-size
+ * matrices in one contiguous buffer and the derivative factors come from tables computed at compile time, so
+ * getCommand() does not allocate nor recompute factorials. Incremental replanning is not supported, replan() always
+ * returns false.
+ *
+ * @tparam ContinuousDerivativeOrder The highest derivative that is continous
+ * @tparam MinimizeDerivative The derivative to minimize
+ */
+template <unsigned int ContinuousDerivativeOrder, unsigned int MinimizeDerivative>
+class FixedTrajectoryGenerator : public TrajectoryGenerator
+{
+ public:
+  static constexpr unsigned int kN = 2 * (ContinuousDerivativeOrder + 1);
+  static_assert(MinimizeDerivative > 0 && MinimizeDerivative < kN, "Invalid derivative order to minimize");
+
+  using Coefficients = Eigen::Matrix<float, kN, 3>;
+
+  FixedTrajectoryGenerator() : TrajectoryGenerator(ContinuousDerivativeOrder, MinimizeDerivative) {}
+
+  bool calculate(const std::vector<float> &waypoint_times) override
+  {
+    if(waypoints_.size() < 2)
+      return false;
+
+    if(waypoint_times.size() != waypoints_.size())
+    {
+      printf("waypoint_times.size() != waypoints_.size()\n");
+      return false;
+    }
+
+    solve(waypoint_times);
+    waypoint_times_ = waypoint_times;
+    return true;
+  }
+
+  bool replan(float, const vec_Vec3f &, const std::vector<float> &, unsigned int) override { return false; }
+
+  bool getCommand(const float time, Vec3f &pos, Vec3f &vel, Vec3f &acc, Vec3f &jrk) const override
+  {
+    unsigned int segment;
+    if(!commandSegment(time, segment))
+      return false;
+
+    evaluate(coefficients_[segment], time - waypoint_times_[segment], pos, vel, acc, jrk);
+    return true;
+  }
+
+  void calcMaxPerSegment(std::vector<float> &max_vel, std::vector<float> &max_acc,
+                         std::vector<float> &max_jrk) const override
+  {
+    const unsigned int num_samples_per_seg = 10;
+    for(unsigned int seg_idx = 0; seg_idx < coefficients_.size(); ++seg_idx)
+    {
+      const float dt = (waypoint_times_[seg_idx + 1] - waypoint_times_[seg_idx]) / num_samples_per_seg;
+      float seg_max_vel = 0, seg_max_acc = 0, seg_max_jrk = 0;
+      for(unsigned int sample_idx = 0; sample_idx < num_samples_per_seg; ++sample_idx)
+      {
+        Vec3f pos, vel, acc, jrk;
+        evaluate(coefficients_[seg_idx], sample_idx * dt, pos, vel, acc, jrk);
+        seg_max_vel = std::max(seg_max_vel, vel.norm());
+        seg_max_acc = std::max(seg_max_acc, acc.norm());
+        seg_max_jrk = std::max(seg_max_jrk, jrk.norm());
+      }
+      max_vel.push_back(seg_max_vel);
+      max_acc.push_back(seg_max_acc);
+      max_jrk.push_back(seg_max_jrk);
+    }
+  }
+
+  Eigen::MatrixX3f getCoefficients(unsigned int segment) const override { return coefficients_[segment]; }
+
+ private:
+  using MatrixN = Eigen::Matrix<float, kN, kN>;
+
+  // The index of a derivative of a waypoint in the vector of all derivatives, the fixed ones first. They are the
+  // position and given derivatives of the first waypoint, the middle positions, then the last position and derivatives.
+  static unsigned int derivativeIndex(unsigned int num_waypoints, unsigned int waypoint, unsigned int derivative)
+  {
+    if(waypoint == 0)
+      return derivative;
+    if(waypoint == num_waypoints - 1)
+      return kN / 2 + num_waypoints - 2 + derivative;
+    if(derivative == 0)
+      return kN / 2 + waypoint - 1;
+    return (num_waypoints - 2 + kN) + (waypoint - 1) * (kN / 2 - 1) + derivative - 1;
+  }
+
+  // Same as TrajectoryGenerator::solve(), ending at rest. The constraints are block diagonal, so each segment is
+  // inverted on its own and its cost added to the rows and columns of the derivatives at its ends.
+  void solve(const std::vector<float> &waypoint_times)
+  {
+    const unsigned int num_waypoints = waypoints_.size();
+    const unsigned int num_segments = num_waypoints - 1;
+    const unsigned int num_derivatives = num_waypoints * kN / 2;
+    const unsigned int num_fixed_derivatives = num_waypoints - 2 + kN;
+    const unsigned int num_free_derivatives = num_derivatives - num_fixed_derivatives;
+
+    std::vector<MatrixN, Eigen::aligned_allocator<MatrixN>> A_inv(num_segments);
+    std::vector<std::array<unsigned int, kN>> index(num_segments);
+    Eigen::MatrixXf R = Eigen::MatrixXf::Zero(num_derivatives, num_derivatives);
+    for(unsigned int i = 0; i < num_segments; i++)
+    {
+      MatrixN A = MatrixN::Zero(), Q = MatrixN::Zero();
+      segmentMatrices(waypoint_times[i + 1] - waypoint_times[i], A, Q);
+      A_inv[i] = A.partialPivLu().inverse();
+      const MatrixN H = A_inv[i].transpose() * Q * A_inv[i];
+
+      for(unsigned int j = 0; j < kN / 2; j++)
+      {
+        index[i][j] = derivativeIndex(num_waypoints, i, j);
+        index[i][kN / 2 + j] = derivativeIndex(num_waypoints, i + 1, j);
+      }
+      for(unsigned int r = 0; r < kN; r++)
+        for(unsigned int c = 0; c < kN; c++)
+          R(index[i][r], index[i][c]) += H(r, c);
+    }
+
+    Eigen::MatrixX3f D = Eigen::MatrixX3f::Zero(num_derivatives, 3);
+    D.row(0) = waypoints_[0].transpose();
+    for(unsigned int j = 1; j < kN / 2; j++)
+      D.row(j) = initial_derivatives_[j - 1].transpose();
+    for(unsigned int i = 1; i < num_waypoints; i++)
+      D.row(derivativeIndex(num_waypoints, i, 0)) = waypoints_[i].transpose();
+    if(num_free_derivatives > 0)
+    {
+      D.bottomRows(num_free_derivatives) =
+          -R.bottomRightCorner(num_free_derivatives, num_free_derivatives)
+               .partialPivLu()
+               .solve(R.block(num_fixed_derivatives, 0, num_free_derivatives, num_fixed_derivatives) *
+                      D.topRows(num_fixed_derivatives));
+    }
+
+    coefficients_.resize(num_segments);
+    for(unsigned int i = 0; i < num_segments; i++)
+    {
+      Coefficients d;
+      for(unsigned int r = 0; r < kN; r++)
+        d.row(r) = D.row(index[i][r]);
+      coefficients_[i] = A_inv[i] * d;
+    }
+  }
+
+  static void segmentMatrices(float seg_time, MatrixN &A, MatrixN &Q)
+  {
+    float t_pow[2 * kN];
+    t_pow[0] = 1;
+    for(unsigned int i = 1; i < 2 * kN; i++)
+      t_pow[i] = t_pow[i - 1] * seg_time;
+
+    for(unsigned int n = 0; n < kN; n++)
+    {
+      // A_0
+      if(n < kN / 2)
+        A(n, n) = kDerivatives.values[n][n];
+      // A_T
+      for(unsigned int r = 0; r < kN / 2 && r <= n; r++)
+        A(kN / 2 + r, n) = kDerivatives.values[r][n] * t_pow[n - r];
+    }
+    // Q
+    for(unsigned int r = MinimizeDerivative; r < kN; r++)
+      for(unsigned int n = MinimizeDerivative; n < kN; n++)
+        Q(r, n) = kCost.values[r][n] * t_pow[r + n - 2 * MinimizeDerivative + 1];
+  }
+
+  static void evaluate(const Coefficients &p, float t, Vec3f &pos, Vec3f &vel, Vec3f &acc, Vec3f &jrk)
+  {
+    float t_pow[kN];
+    t_pow[0] = 1;
+    for(unsigned int i = 1; i < kN; i++)
+      t_pow[i] = t_pow[i - 1] * t;
+
+    pos = p.row(0).transpose();
+    vel = Vec3f::Zero();
+    acc = Vec3f::Zero();
+    jrk = Vec3f::Zero();
+    for(unsigned int i = 1; i < kN; i++)
+    {
+      pos += p.row(i).transpose() * t_pow[i];
+      vel += p.row(i).transpose() * (kDerivatives.values[1][i] * t_pow[i - 1]);
+      if(i >= 2)
+        acc += p.row(i).transpose() * (kDerivatives.values[2][i] * t_pow[i - 2]);
+      if(i >= 3)
+        jrk += p.row(i).transpose() * (kDerivatives.values[3][i] * t_pow[i - 3]);
+    }
+  }
+
+  static constexpr traj_gen_detail::DerivativeTable<kN> kDerivatives{};
+  static constexpr traj_gen_detail::CostTable<kN, MinimizeDerivative> kCost{};
+
+  std::vector<Coefficients, Eigen::aligned_allocator<Coefficients>> coefficients_;
+};
+
+template <unsigned int C, unsigned int R>
+constexpr traj_gen_detail::DerivativeTable<FixedTrajectoryGenerator<C, R>::kN>
+    FixedTrajectoryGenerator<C, R>::kDerivatives;
+
+template <unsigned int C, unsigned int R>
+constexpr traj_gen_detail::CostTable<FixedTrajectoryGenerator<C, R>::kN, R> FixedTrajectoryGenerator<C, R>::kCost;
+
+using MinJerkTrajectoryGenerator = FixedTrajectoryGenerator<2, 3>;
+using MinSnapTrajectoryGenerator = FixedTrajectoryGenerator<3, 4>;
+
+/**
+ * @brief Create a trajectory generator, using a fixed-order specialization if one exists for the given orders
+ *
+ * @param continuous_derivative_order The highest derivative that is continous
+ * @param minimize_derivative The derivative to minimize
+ * @param incremental Whether replan() is needed, only the runtime-order generator supports it
+ */
+inline std::unique_ptr<TrajectoryGenerator> makeTrajectoryGenerator(unsigned int continuous_derivative_order,
+                                                                    unsigned int minimize_derivative,
+                                                                    bool incremental = false)
+{
+  if(!incremental && continuous_derivative_order == 2 && minimize_derivative == 3)
+    return std::unique_ptr<TrajectoryGenerator>(new MinJerkTrajectoryGenerator());
+  if(!incremental && continuous_derivative_order == 3 && minimize_derivative == 4)
+    return std::unique_ptr<TrajectoryGenerator>(new MinSnapTrajectoryGenerator());
+  return std::unique_ptr<TrajectoryGenerator>(
+      new TrajectoryGenerator(continuous_derivative_order, minimize_derivative));
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <kr_trackers/traj_gen.h>
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Binary file holding a precomputed piecewise polynomial trajectory, as written by writeTrajectoryFile().
+ *
+ * Layout, in host byte order:
+ *   TrajectoryFileHeader
+ *   float waypoint_times[num_segments + 1]
+ *   float coefficients[num_segments][3][num_coefficients]  (N x 3 column-major per segment, row i multiplies t^i)
+ */
+struct TrajectoryFileHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t num_coefficients;
+  uint32_t num_segments;
+};
+
+/**
+ * @brief Write the trajectory calculated by a TrajectoryGenerator to a trajectory file
+ *
+ * @return false if the trajectory is empty or the file could not be written
+ */
+bool writeTrajectoryFile(const std::string &filename, const TrajectoryGenerator &traj_gen);
+
+/**
+ * @brief Read-only, memory-mapped view of a trajectory file
+ *
+ * Opening a file only maps it and checks the header, the segment data is read in place when the trajectory is
+ * evaluated so playback can start immediately at any point of the trajectory.
+ */
+class TrajectoryFile
+{
+ public:
+  using Vec3f = Eigen::Vector3f;
+
+  TrajectoryFile();
+  ~TrajectoryFile();
+  TrajectoryFile(const TrajectoryFile &) = delete;
+  TrajectoryFile &operator=(const TrajectoryFile &) = delete;
+
+  /**
+   * @brief Map a trajectory file, closing any previously opened one
+   *
+   * @return false if the file cannot be mapped or is not a valid trajectory file, error() then has the reason
+   */
+  bool open(const std::string &filename);
+  void close();
+
+  bool isOpen() const { return data_ != nullptr; }
+  const std::string &filename() const { return filename_; }
+  const std::string &error() const { return error_; }
+
+  unsigned int numSegments() const { return num_segments_; }
+  float getTotalTime() const { return num_segments_ > 0 ? times_[num_segments_] : 0; }
+
+  /**
+   * @brief Evaluate the trajectory
+   *
+   * @param time The time from the start of the trajectory, values outside the trajectory are clamped to its ends
+   */
+  void getCommand(float time, Vec3f &pos, Vec3f &vel, Vec3f &acc, Vec3f &jrk) const;
+
+ private:
+  std::string filename_, error_;
+  void *data_;
+  size_t size_;
+
+  unsigned int num_coefficients_, num_segments_;
+  const float *times_, *coefficients_;
+};
@@ -3,10 +3,11 @@
  * x(t) = [Ax*cos(2*pi*t/T); Ay*sin(2*pi*t/T); 0] + init_pos.
  * Yaw is constant. */
 
-#include <actionlib/server/simple_action_server.h>
 #include <kr_mav_msgs/PositionCommand.h>
 #include <kr_tracker_msgs/CircleTrackerAction.h>
 #include <kr_tracker_msgs/TrackerStatus.h>
+#include <kr_trackers/goal_server.h>
+#include <kr_trackers/preview.h>
 #include <kr_trackers_manager/Tracker.h>
 #include <ros/ros.h>
 #include <std_msgs/Empty.h>
@@ -21,18 +22,31 @@ class CircleTracker : public kr_trackers_manager::Tracker
   CircleTracker(void);
 
   void Initialize(const ros::NodeHandle &nh);
+  bool InitializeOffline(const kr_trackers_manager::OfflineParams &params);
+  bool replay(const std::string &topic, const uint8_t *data, uint32_t size);
   bool Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd);
   void Deactivate();
 
   kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &msg);
+  void observe(const nav_msgs::Odometry::ConstPtr &msg);
 
   uint8_t status() const;
 
+  bool preview(const ros::Time &t0, float dt, unsigned int n, kr_tracker_msgs::TrackerPreview &preview) const;
+
  private:
+  // Read the params and set up the action server, from a ros::NodeHandle or OfflineParams
+  template <typename NodeHandle>
+  void init(const NodeHandle &priv_nh);
+
   void goal_callback();
   void preempt_callback();
 
-  typedef actionlib::SimpleActionServer<kr_tracker_msgs::CircleTrackerAction> ServerType;
+  // Evaluate the ellipse at traj_time from the start of the trajectory, without the offset.
+  void evaluate(float traj_time, Eigen::Vector3f &pos, Eigen::Vector3f &vel, Eigen::Vector3f &acc,
+                Eigen::Vector3f &jrk) const;
+
+  typedef GoalServer<kr_tracker_msgs::CircleTrackerAction> ServerType;
   // Action server that takes a trajectory.
   // Must be a pointer, because plugin does not support a constructor
   // with inputs, but an action server must be initialized with a Nodehandle.
@@ -81,7 +95,7 @@ class CircleTracker : public kr_trackers_manager::Tracker
 
   // Record the current state.
   Eigen::Vector3f current_pos_;
-  float current_yaw_;
+  nav_msgs::Odometry::ConstPtr odom_;
   float constant_yaw_;
 
   // Pubish trigger for start and goal.
@@ -104,10 +118,9 @@ CircleTracker::CircleTracker(void)
 {
 }
 
-void CircleTracker::Initialize(const ros::NodeHandle &nh)
+template <typename NodeHandle>
+void CircleTracker::init(const NodeHandle &priv_nh)
 {
-  ros::NodeHandle priv_nh(nh, "circle_tracker");
-
   priv_nh.param("alpha_des", alpha_des_, static_cast<float>(M_PI / 20.0));
 
   // Set up the action server.
@@ -116,11 +129,27 @@ void CircleTracker::Initialize(const ros::NodeHandle &nh)
   tracker_server_->registerPreemptCallback(boost::bind(&CircleTracker::preempt_callback, this));
 
   tracker_server_->start();
+}
 
+void CircleTracker::Initialize(const ros::NodeHandle &nh)
+{
+  ros::NodeHandle priv_nh(nh, "circle_tracker");
+  init(priv_nh);
   pub_start_ = priv_nh.advertise<std_msgs::Empty>("traj_start", 10);
   pub_end_ = priv_nh.advertise<std_msgs::Empty>("traj_end", 10);
 }
 
+bool CircleTracker::InitializeOffline(const kr_trackers_manager::OfflineParams &params)
+{
+  init(kr_trackers_manager::OfflineParams(params, "circle_tracker"));
+  return true;
+}
+
+bool CircleTracker::replay(const std::string &topic, const uint8_t *data, uint32_t size)
+{
+  return tracker_server_->replay(topic, data, size);
+}
+
 bool CircleTracker::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
 {
   if(!have_odom_)
@@ -153,7 +182,7 @@ bool CircleTracker::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
   // x(0) + offset = current_pos_.
   // Here, x(0) is [Ax 0 0].
   offset_pos_ = current_pos_ - Eigen::Vector3f(Ax_, 0.0, 0.0);
-  constant_yaw_ = current_yaw_;
+  constant_yaw_ = tf::getYaw(odom_->pose.pose.orientation);
   //   std::cout << " RELATIVE ACTIVATE CALCULATED AS " << offset_pos_(0) << " " << offset_pos_(1) << " " <<
   //   offset_pos_(2) << " " << offset_yaw_ << "\n";
 
@@ -167,7 +196,7 @@ void CircleTracker::Deactivate(void)
     ROS_WARN("CircleTracker::Deactivate: deactivated tracker while still tracking position trajectory.");
 
     kr_tracker_msgs::CircleTrackerResult result;
-    result.duration = std::max(0.0f, static_cast<float>((ros::Time::now() - traj_start_time_).toSec()));
+    result.duration = std::max(0.0f, static_cast<float>((now() - traj_start_time_).toSec()));
     result.length = current_traj_length_;
     tracker_server_->setAborted(result);
   }
@@ -190,7 +219,7 @@ kr_mav_msgs::PositionCommand::ConstPtr CircleTracker::update(const nav_msgs::Odo
   current_pos_(0) = msg->pose.pose.position.x;
   current_pos_(1) = msg->pose.pose.position.y;
   current_pos_(2) = msg->pose.pose.position.z;
-  current_yaw_ = tf::getYaw(msg->pose.pose.orientation);
+  odom_ = msg;
 
   have_odom_ = true;
 
@@ -201,7 +230,7 @@ kr_mav_msgs::PositionCommand::ConstPtr CircleTracker::update(const nav_msgs::Odo
 
   current_traj_length_ += dx;
 
-  const ros::Time t_now = ros::Time::now();
+  const ros::Time t_now = now();
   kr_mav_msgs::PositionCommand::Ptr cmd(new kr_mav_msgs::PositionCommand);
   cmd->header.stamp = t_now;
   cmd->header.frame_id = msg->header.frame_id;
@@ -209,14 +238,14 @@ kr_mav_msgs::PositionCommand::ConstPtr CircleTracker::update(const nav_msgs::Odo
   if(!traj_started_)
   {
     // Start the trajectory.
-    traj_start_time_ = ros::Time::now();
+    traj_start_time_ = now();
     traj_started_ = true;
     traj_completed_ = false;
 
     current_traj_length_ = 0.0;
   }
 
-  const float traj_time = std::max(0.0f, static_cast<float>((ros::Time::now() - traj_start_time_).toSec()));
+  const float traj_time = std::max(0.0f, static_cast<float>((now() - traj_start_time_).toSec()));
   constexpr float kEps = 1e-6;
 
   // Process position trajectory.
@@ -242,146 +271,47 @@ kr_mav_msgs::PositionCommand::ConstPtr CircleTracker::update(const nav_msgs::Odo
   }
   else
   {
-    float theta, theta_dot, theta_ddot, theta_dddot;
-
-    // theta = omega_des_ * traj_time;
-    // theta_dot = omega_des_;
-    // theta_ddot = 0.0;
-    // theta_dddot = 0.0;
-    // theta_d4dot = 0.0;
-    // theta_d5dot = 0.0;
-    // theta_d6dot = 0.0;
-
-    // Ramping up the angular velocity.
-    if(traj_time < ramp_time_)
-    {
-      // ROS_INFO("Circle Tracker: Accelerating...");
-
-      /*      theta = 0.5 * alpha_des_ * traj_time_ * traj_time_;
-            theta_dot = alpha_des_ * traj_time_;
-            theta_ddot = alpha_des_;
-            theta_dddot = 0.0;*/
-      const float dT = traj_time / ramp_time_;
-      // std::cout << " ramp time i s" << ramp_time_ << " and dt is " << dT << "\n";
-      const float dT2 = dT * dT, dT3 = dT2 * dT, dT4 = dT3 * dT, dT5 = dT4 * dT, dT6 = dT5 * dT;
-      theta = omega_coeffs_.at(0) * dT + 0.5 * omega_coeffs_.at(1) * dT2 + 1.0 / 3.0 * omega_coeffs_.at(2) * dT3 +
-              0.25 * omega_coeffs_.at(3) * dT4 + 1.0 / 5.0 * omega_coeffs_.at(4) * dT5 +
-              1.0 / 6.0 * omega_coeffs_.at(5) * dT6;
-      theta_dot = omega_coeffs_.at(0) + omega_coeffs_.at(1) * dT + omega_coeffs_.at(2) * dT2 +
-                  omega_coeffs_.at(3) * dT3 + omega_coeffs_.at(4) * dT4 + omega_coeffs_.at(5) * dT5;
-      theta_dot /= ramp_time_;
-      theta_ddot = omega_coeffs_.at(1) + 2.0 * omega_coeffs_.at(2) * dT + 3.0 * omega_coeffs_.at(3) * dT2 +
-                   4.0 * omega_coeffs_.at(4) * dT3 + 5.0 * omega_coeffs_.at(5) * dT4;
-      const float ramp_time_2 = ramp_time_ * ramp_time_;
-      theta_ddot /= ramp_time_2;
-      theta_dddot = 2.0 * omega_coeffs_.at(2) + 6.0 * omega_coeffs_.at(3) * dT + 12.0 * omega_coeffs_.at(4) * dT2 +
-                    20.0 * omega_coeffs_.at(5) * dT3;
-      const float ramp_time_3 = ramp_time_2 * ramp_time_;
-      theta_dddot /= (ramp_time_3);
-    }
-    // Constant segment.
-    else if(traj_time < circle_time_)
+    if(traj_time >= circle_time_)
     {
-      // ROS_INFO("Circle Tracker: Coasting...");
+      // Publish message indicating trajectory end.
       std_msgs::Empty empty_msg;
-      pub_start_.publish(empty_msg);
-
-      // Calculate time in this phase.
-      const float dT = traj_time - ramp_time_;
-
-      theta = omega_des_ * dT + ramp_dist_;
-      theta_dot = omega_des_;
-      theta_ddot = 0.0;
-      theta_dddot = 0.0;
+      if(pub_end_)
+        pub_end_.publish(empty_msg);
     }
-    // Ramping down the angular velocity.
-    else
+    else if(traj_time >= ramp_time_)
     {
-      // const float dT = traj_time - circle_time_;
-      //       theta = omega_des_ * dT + circle_dist_;
-      // theta_dot = omega_des_;
-      // theta_ddot = 0.0;
-      // theta_dddot = 0.0;
-      // theta_d4dot = 0.0;
-      // theta_d5dot = 0.0;
-      // theta_d6dot = 0.0;
-
-      // ROS_INFO("Circle Tracker: Decelerating...");
-
-      // Publish message indicating trajectory end.
       std_msgs::Empty empty_msg;
-      pub_end_.publish(empty_msg);
-
-      // const float dT = traj_time - circle_time_;
-      // theta = -0.5 * alpha_des_ * dT * dT + omega_des_ * dT + circle_dist_;
-      // theta_dot = -alpha_des_ * dT + omega_des_;
-      // theta_ddot = -alpha_des_;
-      // theta_dddot = 0.0;
-
-      const float dT = 1.0 - (traj_time - circle_time_) / ramp_time_;
-      const float dT2 = dT * dT, dT3 = dT2 * dT, dT4 = dT3 * dT, dT5 = dT4 * dT, dT6 = dT5 * dT;
-      theta = omega_coeffs_.at(0) * dT + 0.5 * omega_coeffs_.at(1) * dT2 + 1.0 / 3.0 * omega_coeffs_.at(2) * dT3 +
-              0.25 * omega_coeffs_.at(3) * dT4 + 1.0 / 5.0 * omega_coeffs_.at(4) * dT5 +
-              1.0 / 6.0 * omega_coeffs_.at(5) * dT6;
-      theta = circle_dist_ + ramp_dist_ - theta;
-      theta_dot = omega_coeffs_.at(0) + omega_coeffs_.at(1) * dT + omega_coeffs_.at(2) * dT2 +
-                  omega_coeffs_.at(3) * dT3 + omega_coeffs_.at(4) * dT4 + omega_coeffs_.at(5) * dT5;
-      theta_dot /= ramp_time_;
-      theta_ddot = omega_coeffs_.at(1) + 2.0 * omega_coeffs_.at(2) * dT + 3.0 * omega_coeffs_.at(3) * dT2 +
-                   4.0 * omega_coeffs_.at(4) * dT3 + 5.0 * omega_coeffs_.at(5) * dT4;
-      const float ramp_time_2 = ramp_time_ * ramp_time_;
-      theta_ddot /= ramp_time_2;
-      theta_dddot = 2.0 * omega_coeffs_.at(2) + 6.0 * omega_coeffs_.at(3) * dT + 12.0 * omega_coeffs_.at(4) * dT2 +
-                    20.0 * omega_coeffs_.at(5) * dT3;
-      const float ramp_time_3 = ramp_time_2 * ramp_time_;
-      theta_dddot /= (ramp_time_3);
+      if(pub_start_)
+        pub_start_.publish(empty_msg);
     }
 
-    const float sin_t = sin(theta);
-    const float cos_t = cos(theta);
-
-    const float pos_x = Ax_ * cos_t;
-    const float pos_y = Ay_ * sin_t;
-    const float pos_z = 0.0;
-
-    const float vel_x = Ax_ * (-sin_t * theta_dot);
-    const float vel_y = Ay_ * (cos_t * theta_dot);
-    const float vel_z = 0.0;
-
-    const float theta_dot_2 = theta_dot * theta_dot;
-    const float acc_x = Ax_ * (-cos_t * theta_dot_2 - sin_t * theta_ddot);
-    const float acc_y = Ay_ * (-sin_t * theta_dot_2 + cos_t * theta_ddot);
-    const float acc_z = 0.0;
-
-    const float theta_dot_3 = theta_dot_2 * theta_dot;
-    const float jerk_x = Ax_ * (sin_t * theta_dot_3 - 3.0 * cos_t * theta_dot * theta_ddot - sin_t * theta_dddot);
-    const float jerk_y = Ay_ * (-cos_t * theta_dot_3 - 3.0 * sin_t * theta_dot * theta_ddot + cos_t * theta_dddot);
-    const float jerk_z = 0.0;
+    Eigen::Vector3f pos, vel, acc, jrk;
+    evaluate(traj_time, pos, vel, acc, jrk);
 
     // Note, these values do NOT yet include the offset.
-    cmd->position.x = pos_x;
-    cmd->position.y = pos_y;
-    cmd->position.z = pos_z;
+    cmd->position.x = pos(0);
+    cmd->position.y = pos(1);
+    cmd->position.z = pos(2);
     cmd->yaw = constant_yaw_;
 
-    cmd->velocity.x = vel_x;
-    cmd->velocity.y = vel_y;
-    cmd->velocity.z = vel_z;
+    cmd->velocity.x = vel(0);
+    cmd->velocity.y = vel(1);
+    cmd->velocity.z = vel(2);
     cmd->yaw_dot = 0.0;
 
-    cmd->acceleration.x = acc_x;
-    cmd->acceleration.y = acc_y;
-    cmd->acceleration.z = acc_z;
+    cmd->acceleration.x = acc(0);
+    cmd->acceleration.y = acc(1);
+    cmd->acceleration.z = acc(2);
 
-    cmd->jerk.x = jerk_x;
-    cmd->jerk.y = jerk_y;
-    cmd->jerk.z = jerk_z;
+    cmd->jerk.x = jrk(0);
+    cmd->jerk.y = jrk(1);
+    cmd->jerk.z = jrk(2);
 
     // Check if we completed the trajectory.
     if(traj_time >= traj_duration_ - kEps)
     {
       traj_completed_ = true;
-      final_pos_ = Eigen::Vector3f(pos_x, pos_y, pos_z);
+      final_pos_ = pos;
     }
   }
 
@@ -409,6 +339,152 @@ kr_mav_msgs::PositionCommand::ConstPtr CircleTracker::update(const nav_msgs::Odo
   return cmd;
 }
 
+void CircleTracker::observe(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  current_pos_(0) = msg->pose.pose.position.x;
+  current_pos_(1) = msg->pose.pose.position.y;
+  current_pos_(2) = msg->pose.pose.position.z;
+  odom_ = msg;
+
+  have_odom_ = true;
+}
+
+void CircleTracker::evaluate(float traj_time, Eigen::Vector3f &pos, Eigen::Vector3f &vel, Eigen::Vector3f &acc,
+                             Eigen::Vector3f &jrk) const
+{
+  float theta, theta_dot, theta_ddot, theta_dddot;
+
+  // theta = omega_des_ * traj_time;
+  // theta_dot = omega_des_;
+  // theta_ddot = 0.0;
+  // theta_dddot = 0.0;
+  // theta_d4dot = 0.0;
+  // theta_d5dot = 0.0;
+  // theta_d6dot = 0.0;
+
+  // Ramping up the angular velocity.
+  if(traj_time < ramp_time_)
+  {
+    // ROS_INFO("Circle Tracker: Accelerating...");
+
+    /*      theta = 0.5 * alpha_des_ * traj_time_ * traj_time_;
+          theta_dot = alpha_des_ * traj_time_;
+          theta_ddot = alpha_des_;
+          theta_dddot = 0.0;*/
+    const float dT = traj_time / ramp_time_;
+    // std::cout << " ramp time i s" << ramp_time_ << " and dt is " << dT << "\n";
+    const float dT2 = dT * dT, dT3 = dT2 * dT, dT4 = dT3 * dT, dT5 = dT4 * dT, dT6 = dT5 * dT;
+    theta = omega_coeffs_.at(0) * dT + 0.5 * omega_coeffs_.at(1) * dT2 + 1.0 / 3.0 * omega_coeffs_.at(2) * dT3 +
+            0.25 * omega_coeffs_.at(3) * dT4 + 1.0 / 5.0 * omega_coeffs_.at(4) * dT5 +
+            1.0 / 6.0 * omega_coeffs_.at(5) * dT6;
+    theta_dot = omega_coeffs_.at(0) + omega_coeffs_.at(1) * dT + omega_coeffs_.at(2) * dT2 +
+                omega_coeffs_.at(3) * dT3 + omega_coeffs_.at(4) * dT4 + omega_coeffs_.at(5) * dT5;
+    theta_dot /= ramp_time_;
+    theta_ddot = omega_coeffs_.at(1) + 2.0 * omega_coeffs_.at(2) * dT + 3.0 * omega_coeffs_.at(3) * dT2 +
+                 4.0 * omega_coeffs_.at(4) * dT3 + 5.0 * omega_coeffs_.at(5) * dT4;
+    const float ramp_time_2 = ramp_time_ * ramp_time_;
+    theta_ddot /= ramp_time_2;
+    theta_dddot = 2.0 * omega_coeffs_.at(2) + 6.0 * omega_coeffs_.at(3) * dT + 12.0 * omega_coeffs_.at(4) * dT2 +
+                  20.0 * omega_coeffs_.at(5) * dT3;
+    const float ramp_time_3 = ramp_time_2 * ramp_time_;
+    theta_dddot /= (ramp_time_3);
+  }
+  // Constant segment.
+  else if(traj_time < circle_time_)
+  {
+    // ROS_INFO("Circle Tracker: Coasting...");
+
+    // Calculate time in this phase.
+    const float dT = traj_time - ramp_time_;
+
+    theta = omega_des_ * dT + ramp_dist_;
+    theta_dot = omega_des_;
+    theta_ddot = 0.0;
+    theta_dddot = 0.0;
+  }
+  // Ramping down the angular velocity.
+  else
+  {
+    // const float dT = traj_time - circle_time_;
+    //       theta = omega_des_ * dT + circle_dist_;
+    // theta_dot = omega_des_;
+    // theta_ddot = 0.0;
+    // theta_dddot = 0.0;
+    // theta_d4dot = 0.0;
+    // theta_d5dot = 0.0;
+    // theta_d6dot = 0.0;
+
+    // ROS_INFO("Circle Tracker: Decelerating...");
+
+    // const float dT = traj_time - circle_time_;
+    // theta = -0.5 * alpha_des_ * dT * dT + omega_des_ * dT + circle_dist_;
+    // theta_dot = -alpha_des_ * dT + omega_des_;
+    // theta_ddot = -alpha_des_;
+    // theta_dddot = 0.0;
+
+    const float dT = 1.0 - (traj_time - circle_time_) / ramp_time_;
+    const float dT2 = dT * dT, dT3 = dT2 * dT, dT4 = dT3 * dT, dT5 = dT4 * dT, dT6 = dT5 * dT;
+    theta = omega_coeffs_.at(0) * dT + 0.5 * omega_coeffs_.at(1) * dT2 + 1.0 / 3.0 * omega_coeffs_.at(2) * dT3 +
+            0.25 * omega_coeffs_.at(3) * dT4 + 1.0 / 5.0 * omega_coeffs_.at(4) * dT5 +
+            1.0 / 6.0 * omega_coeffs_.at(5) * dT6;
+    theta = circle_dist_ + ramp_dist_ - theta;
+    theta_dot = omega_coeffs_.at(0) + omega_coeffs_.at(1) * dT + omega_coeffs_.at(2) * dT2 +
+                omega_coeffs_.at(3) * dT3 + omega_coeffs_.at(4) * dT4 + omega_coeffs_.at(5) * dT5;
+    theta_dot /= ramp_time_;
+    theta_ddot = omega_coeffs_.at(1) + 2.0 * omega_coeffs_.at(2) * dT + 3.0 * omega_coeffs_.at(3) * dT2 +
+                 4.0 * omega_coeffs_.at(4) * dT3 + 5.0 * omega_coeffs_.at(5) * dT4;
+    const float ramp_time_2 = ramp_time_ * ramp_time_;
+    theta_ddot /= ramp_time_2;
+    theta_dddot = 2.0 * omega_coeffs_.at(2) + 6.0 * omega_coeffs_.at(3) * dT + 12.0 * omega_coeffs_.at(4) * dT2 +
+                  20.0 * omega_coeffs_.at(5) * dT3;
+    const float ramp_time_3 = ramp_time_2 * ramp_time_;
+    theta_dddot /= (ramp_time_3);
+  }
+
+  const float sin_t = sin(theta);
+  const float cos_t = cos(theta);
+
+  pos = Eigen::Vector3f(Ax_ * cos_t, Ay_ * sin_t, 0.0);
+  vel = Eigen::Vector3f(Ax_ * (-sin_t * theta_dot), Ay_ * (cos_t * theta_dot), 0.0);
+
+  const float theta_dot_2 = theta_dot * theta_dot;
+  acc = Eigen::Vector3f(Ax_ * (-cos_t * theta_dot_2 - sin_t * theta_ddot),
+                        Ay_ * (-sin_t * theta_dot_2 + cos_t * theta_ddot), 0.0);
+
+  const float theta_dot_3 = theta_dot_2 * theta_dot;
+  jrk = Eigen::Vector3f(Ax_ * (sin_t * theta_dot_3 - 3.0 * cos_t * theta_dot * theta_ddot - sin_t * theta_dddot),
+                        Ay_ * (-cos_t * theta_dot_3 - 3.0 * sin_t * theta_dot * theta_ddot + cos_t * theta_dddot),
+                        0.0);
+}
+
+bool CircleTracker::preview(const ros::Time &t0, float dt, unsigned int n,
+                            kr_tracker_msgs::TrackerPreview &preview) const
+{
+  // The start time is only set in the next update
+  if(!active_ || !traj_started_)
+    return false;
+
+  const float traj_time = (t0 - traj_start_time_).toSec();
+  Eigen::Vector3f pos, vel, acc, jrk;
+  for(unsigned int i = 0; i < n; i++)
+  {
+    const float t = std::max(0.0f, traj_time + i * dt);
+    if(traj_completed_ || t >= traj_duration_)
+    {
+      if(traj_completed_)
+        pos = final_pos_;
+      else
+        evaluate(traj_duration_, pos, vel, acc, jrk);
+      vel = acc = Eigen::Vector3f::Zero();
+    }
+    else
+      evaluate(t, pos, vel, acc, jrk);
+    setPreviewSample(preview, i, pos + offset_pos_, vel, acc, constant_yaw_, 0);
+  }
+  preview.num_samples = n;
+  return true;
+}
+
 void CircleTracker::goal_callback()
 {
   // If another goal is already active, cancel that goal
@@ -417,7 +493,7 @@ void CircleTracker::goal_callback()
   {
     ROS_INFO("CircleTracker trajectory aborted because new goal recieved.");
     kr_tracker_msgs::CircleTrackerResult result;
-    result.duration = std::max(0.0f, static_cast<float>((ros::Time::now() - traj_start_time_).toSec()));
+    result.duration = std::max(0.0f, static_cast<float>((now() - traj_start_time_).toSec()));
     result.length = current_traj_length_;
 
     tracker_server_->setAborted(result);
@@ -494,7 +570,7 @@ void CircleTracker::preempt_callback()
 {
   // Send a message reporting about the trajectory that was executed.
   kr_tracker_msgs::CircleTrackerResult result;
-  result.duration = std::max(0.0f, static_cast<float>((ros::Time::now() - traj_start_time_).toSec()));
+  result.duration = std::max(0.0f, static_cast<float>((now() - traj_start_time_).toSec()));
   result.length = current_traj_length_;
 
   if(tracker_server_->isActive())
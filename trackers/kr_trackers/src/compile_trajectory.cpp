@@ -0,0 +1,126 @@
+// Compiles a waypoint file into a trajectory file which can be played back by TrajectoryFileTracker without solving
+// for the trajectory in flight.
+//
+// The waypoint file has one waypoint per line, "x y z" or "x y z t" with t the time of the waypoint from the start.
+// Empty lines and lines starting with '#' are ignored. The first waypoint is the start of the trajectory, which starts
+// and ends at rest. The trajectory is computed the same way as TrajectoryTracker does it.
+
+#include <kr_trackers/traj_gen_fixed.h>
+#include <kr_trackers/trajectory_file.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s <waypoint_file> <trajectory_file> [max_vel_des] [max_acc_des] [continuous_derivative_order] "
+          "[derivative_order_to_minimize]\n",
+          name);
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 3 || argc > 7)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  const float max_v_des = argc > 3 ? std::atof(argv[3]) : 1.0f;
+  const float max_a_des = argc > 4 ? std::atof(argv[4]) : 1.0f;
+  const int continuous_derivative_order = argc > 5 ? std::max(0, std::atoi(argv[5])) : 2;
+  const int derivative_order_to_minimize = argc > 6 ? std::max(1, std::atoi(argv[6])) : 3;
+  if(max_v_des <= 0 || max_a_des <= 0)
+  {
+    fprintf(stderr, "max_vel_des and max_acc_des must be positive\n");
+    return 1;
+  }
+
+  std::ifstream input(argv[1]);
+  if(!input)
+  {
+    fprintf(stderr, "Could not open %s\n", argv[1]);
+    return 1;
+  }
+
+  TrajectoryGenerator::vec_Vec3f waypoints;
+  std::vector<float> waypoint_times;
+  std::string line;
+  unsigned int line_num = 0;
+  while(std::getline(input, line))
+  {
+    line_num++;
+    std::istringstream ss(line);
+    std::string first;
+    if(!(ss >> first) || first[0] == '#')
+      continue;
+
+    ss.clear();
+    ss.str(line);
+    Eigen::Vector3f p;
+    float t;
+    if(!(ss >> p(0) >> p(1) >> p(2)))
+    {
+      fprintf(stderr, "%s:%u: expected \"x y z [t]\"\n", argv[1], line_num);
+      return 1;
+    }
+    waypoints.push_back(p);
+    if(ss >> t)
+      waypoint_times.push_back(t);
+  }
+
+  if(waypoints.size() < 2)
+  {
+    fprintf(stderr, "Need at least two waypoints\n");
+    return 1;
+  }
+  if(!waypoint_times.empty() && waypoint_times.size() != waypoints.size())
+  {
+    fprintf(stderr, "Either all or none of the waypoints should have a time\n");
+    return 1;
+  }
+
+  auto traj_gen = makeTrajectoryGenerator(continuous_derivative_order, derivative_order_to_minimize);
+  traj_gen->setInitialConditions(waypoints.front(), TrajectoryGenerator::vec_Vec3f());
+  for(unsigned int i = 1; i < waypoints.size(); i++)
+    traj_gen->addWaypoint(waypoints[i]);
+
+  if(waypoint_times.empty())
+    waypoint_times = traj_gen->computeTimesTrapezoidSpeed(max_v_des / 2, max_a_des / 2);
+  else
+  {
+    // Times are relative to the first waypoint
+    const float t0 = waypoint_times.front();
+    for(auto &t : waypoint_times)
+      t -= t0;
+    for(unsigned int i = 1; i < waypoint_times.size(); i++)
+    {
+      if(waypoint_times[i] <= waypoint_times[i - 1])
+      {
+        fprintf(stderr, "Waypoint times should be increasing\n");
+        return 1;
+      }
+    }
+  }
+
+  if(!traj_gen->calculate(waypoint_times))
+  {
+    fprintf(stderr, "Failed to calculate the trajectory\n");
+    return 1;
+  }
+  const float max_jerk_des = 100;
+  traj_gen->optimizeWaypointTimes(max_v_des, max_a_des, max_jerk_des);
+
+  if(!writeTrajectoryFile(argv[2], *traj_gen))
+  {
+    fprintf(stderr, "Could not write %s\n", argv[2]);
+    return 1;
+  }
+
+  printf("Wrote %s: %zu segments, %.3f s\n", argv[2], waypoints.size() - 1, traj_gen->getTotalTime());
+  return 0;
+}
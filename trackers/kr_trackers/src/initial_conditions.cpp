@@ -41,21 +41,26 @@ void InitialConditions::set_from_cmd(const kr_mav_msgs::PositionCommand::ConstPt
   yaw_ = msg->yaw;
   yaw_dot_ = msg->yaw_dot;
 
+  odom_.reset();
   cmd_valid_ = true;
 }
 
 void InitialConditions::set_from_odom(const nav_msgs::Odometry::ConstPtr &msg)
 {
   if(!cmd_valid_)
-  {
-    pos_ = Eigen::Vector3f(msg->pose.pose.position.x, msg->pose.pose.position.y, msg->pose.pose.position.z);
-    vel_ = Eigen::Vector3f(msg->twist.twist.linear.x, msg->twist.twist.linear.y, msg->twist.twist.linear.z);
-    acc_ = Eigen::Vector3f(0, 0, 0);
-    jrk_ = Eigen::Vector3f(0, 0, 0);
-    yaw_ = tf::getYaw(msg->pose.pose.orientation);
-    yaw_dot_ = msg->twist.twist.angular.z;  // TODO: Should double check which
+    odom_ = msg;
+}
+
+void InitialConditions::convert_odom_msg() const
+{
+  pos_ = Eigen::Vector3f(odom_->pose.pose.position.x, odom_->pose.pose.position.y, odom_->pose.pose.position.z);
+  vel_ = Eigen::Vector3f(odom_->twist.twist.linear.x, odom_->twist.twist.linear.y, odom_->twist.twist.linear.z);
+  acc_ = Eigen::Vector3f(0, 0, 0);
+  jrk_ = Eigen::Vector3f(0, 0, 0);
+  yaw_ = tf::getYaw(odom_->pose.pose.orientation);
+  yaw_dot_ = odom_->twist.twist.angular.z;  // TODO: Should double check which
                                             // frame (body or world) this is in
-  }
+  odom_.reset();
 }
 
 void InitialConditions::reset()
@@ -1,7 +1,7 @@
-#include <actionlib/server/simple_action_server.h>
 #include <kr_mav_msgs/PositionCommand.h>
 #include <kr_tracker_msgs/LineTrackerAction.h>
 #include <kr_tracker_msgs/TrackerStatus.h>
+#include <kr_trackers/goal_server.h>
 #include <kr_trackers/initial_conditions.h>
 #include <kr_trackers_manager/Tracker.h>
 #include <ros/ros.h>
@@ -16,19 +16,26 @@ class LineTrackerDistance : public kr_trackers_manager::Tracker
   LineTrackerDistance(void);
 
   void Initialize(const ros::NodeHandle &nh);
+  bool InitializeOffline(const kr_trackers_manager::OfflineParams &params);
+  bool replay(const std::string &topic, const uint8_t *data, uint32_t size);
   bool Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd);
   void Deactivate(void);
 
   kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &msg);
+  void observe(const nav_msgs::Odometry::ConstPtr &msg);
 
   uint8_t status() const;
 
  private:
+  // Read the params and set up the action server, from a ros::NodeHandle or OfflineParams
+  template <typename NodeHandle>
+  void init(const NodeHandle &priv_nh);
+
   void goal_callback();
 
   void preempt_callback();
 
-  typedef actionlib::SimpleActionServer<kr_tracker_msgs::LineTrackerAction> ServerType;
+  typedef GoalServer<kr_tracker_msgs::LineTrackerAction> ServerType;
 
   // Action server that takes a goal.
   // Must be a pointer, because plugin does not support a constructor
@@ -42,7 +49,10 @@ class LineTrackerDistance : public kr_trackers_manager::Tracker
 
   InitialConditions ICs_;
   Eigen::Vector3f start_, goal_, pos_;
-  float yaw_, start_yaw_;
+  float start_yaw_;
+  // Latest odometry, its yaw is only converted when a trajectory starts
+  nav_msgs::Odometry::ConstPtr odom_;
+  ros::Time t_prev_;
 
   // Time taken to get to the goal.
   float current_traj_duration_;
@@ -54,10 +64,9 @@ LineTrackerDistance::LineTrackerDistance(void) : pos_set_(false), goal_set_(fals
 {
 }
 
-void LineTrackerDistance::Initialize(const ros::NodeHandle &nh)
+template <typename NodeHandle>
+void LineTrackerDistance::init(const NodeHandle &priv_nh)
 {
-  ros::NodeHandle priv_nh(nh, "line_tracker_distance");
-
   priv_nh.param("default_v_des", default_v_des_, 0.5);
   priv_nh.param("default_a_des", default_a_des_, 0.5);
   priv_nh.param("epsilon", epsilon_, 0.1);
@@ -73,6 +82,23 @@ void LineTrackerDistance::Initialize(const ros::NodeHandle &nh)
   tracker_server_->start();
 }
 
+void LineTrackerDistance::Initialize(const ros::NodeHandle &nh)
+{
+  ros::NodeHandle priv_nh(nh, "line_tracker_distance");
+  init(priv_nh);
+}
+
+bool LineTrackerDistance::InitializeOffline(const kr_trackers_manager::OfflineParams &params)
+{
+  init(kr_trackers_manager::OfflineParams(params, "line_tracker_distance"));
+  return true;
+}
+
+bool LineTrackerDistance::replay(const std::string &topic, const uint8_t *data, uint32_t size)
+{
+  return tracker_server_->replay(topic, data, size);
+}
+
 bool LineTrackerDistance::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
 {
   // Only allow activation if a goal has been set
@@ -90,7 +116,7 @@ bool LineTrackerDistance::Activate(const kr_mav_msgs::PositionCommand::ConstPtr
     // Set start and start_yaw here so that even if the goal was sent at a
     // different position, we still use the current position as start
     start_ = pos_;
-    start_yaw_ = yaw_;
+    start_yaw_ = tf::getYaw(odom_->pose.pose.orientation);
 
     current_traj_duration_ = 0.0;
     current_traj_length_ = 0.0;
@@ -123,13 +149,14 @@ kr_mav_msgs::PositionCommand::ConstPtr LineTrackerDistance::update(const nav_msg
   pos_(0) = msg->pose.pose.position.x;
   pos_(1) = msg->pose.pose.position.y;
   pos_(2) = msg->pose.pose.position.z;
-  yaw_ = tf::getYaw(msg->pose.pose.orientation);
+  odom_ = msg;
   pos_set_ = true;
   ICs_.set_from_odom(msg);
 
-  static ros::Time t_prev = msg->header.stamp;
-  const double dT = (msg->header.stamp - t_prev).toSec();
-  t_prev = msg->header.stamp;
+  if(t_prev_.isZero())
+    t_prev_ = msg->header.stamp;
+  const double dT = (msg->header.stamp - t_prev_).toSec();
+  t_prev_ = msg->header.stamp;
 
   if(!active_)
   {
@@ -141,7 +168,7 @@ kr_mav_msgs::PositionCommand::ConstPtr LineTrackerDistance::update(const nav_msg
   current_traj_length_ += dx;
 
   kr_mav_msgs::PositionCommand::Ptr cmd(new kr_mav_msgs::PositionCommand);
-  cmd->header.stamp = ros::Time::now();
+  cmd->header.stamp = now();
   cmd->header.frame_id = msg->header.frame_id;
   cmd->yaw = start_yaw_;
 
@@ -241,6 +268,18 @@ kr_mav_msgs::PositionCommand::ConstPtr LineTrackerDistance::update(const nav_msg
   return cmd;
 }
 
+void LineTrackerDistance::observe(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  pos_(0) = msg->pose.pose.position.x;
+  pos_(1) = msg->pose.pose.position.y;
+  pos_(2) = msg->pose.pose.position.z;
+  odom_ = msg;
+  pos_set_ = true;
+  ICs_.set_from_odom(msg);
+
+  t_prev_ = msg->header.stamp;
+}
+
 void LineTrackerDistance::goal_callback()
 {
   // If another goal is already active, cancel that goal
@@ -284,13 +323,22 @@ void LineTrackerDistance::goal_callback()
     a_des_ = default_a_des_;
 
   start_ = pos_;
-  start_yaw_ = yaw_;
+  start_yaw_ = odom_ ? tf::getYaw(odom_->pose.pose.orientation) : 0;
 
   current_traj_length_ = 0.0;
   current_traj_duration_ = 0.0;
 
   goal_set_ = true;
   goal_reached_ = false;
+
+  if(msg->activate && !requestActivation(msg->send_time))
+  {
+    ROS_WARN("LineTrackerDistance goal (%2.2f, %2.2f, %2.2f) aborted, could not activate the tracker.", goal_(0), goal_(1),
+             goal_(2));
+    tracker_server_->setAborted();
+    goal_set_ = false;
+    goal_reached_ = true;
+  }
 }
 
 void LineTrackerDistance::preempt_callback()
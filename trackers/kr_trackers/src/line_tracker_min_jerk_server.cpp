@@ -1,13 +1,16 @@
-#include <actionlib/server/simple_action_server.h>
 #include <kr_mav_msgs/PositionCommand.h>
 #include <kr_tracker_msgs/LineTrackerAction.h>
 #include <kr_tracker_msgs/TrackerStatus.h>
+#include <kr_trackers/goal_server.h>
 #include <kr_trackers/initial_conditions.h>
+#include <kr_trackers/preview.h>
 #include <kr_trackers_manager/Tracker.h>
 #include <ros/ros.h>
 #include <tf/transform_datatypes.h>
 
 #include <Eigen/Core>
+#include <algorithm>
+#include <deque>
 #include <memory>
 
 class LineTrackerMinJerk : public kr_trackers_manager::Tracker
@@ -16,24 +19,57 @@ class LineTrackerMinJerk : public kr_trackers_manager::Tracker
   LineTrackerMinJerk(void);
 
   void Initialize(const ros::NodeHandle &nh);
+  bool InitializeOffline(const kr_trackers_manager::OfflineParams &params);
+  bool replay(const std::string &topic, const uint8_t *data, uint32_t size);
   bool Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd);
   void Deactivate(void);
 
   kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &msg);
+  void observe(const nav_msgs::Odometry::ConstPtr &msg);
 
   uint8_t status() const;
 
+  bool preview(const ros::Time &t0, float dt, unsigned int n, kr_tracker_msgs::TrackerPreview &preview) const;
+
  private:
+  // Read the params and set up the action server, from a ros::NodeHandle or OfflineParams
+  template <typename NodeHandle>
+  void init(const NodeHandle &priv_nh);
+
   void goal_callback();
 
   void preempt_callback();
 
+  // Stop the trajectory in progress and hold the current position
+  void hold_position();
+
+  // Plan the trajectories of the queued goals which are not planned yet, each from the end of the one before it
+  void plan_queued_goals();
+
+  // Switch to the trajectory of the first queued goal, starting right where the one in progress ends
+  void start_queued_goal();
+
+  // Plan a trajectory from the initial state to rest at the goal. The duration is from the goal if long enough,
+  // otherwise from the desired velocity and acceleration. goal_yaw is changed to the closest equivalent angle.
+  void plan(const Eigen::Vector3f &xi, const Eigen::Vector3f &vi, const Eigen::Vector3f &ai, float yawi,
+            float yaw_dot_i, const Eigen::Vector3f &goal, float &goal_yaw, float v_des, float a_des,
+            const ros::Duration &goal_duration, float &duration, Eigen::Vector3f coeffs[6], float yaw_coeffs[4]) const;
+
   void gen_trajectory(const Eigen::Vector3f &xi, const Eigen::Vector3f &xf, const Eigen::Vector3f &vi,
                       const Eigen::Vector3f &vf, const Eigen::Vector3f &ai, const Eigen::Vector3f &af,
                       const float &yawi, const float &yawf, const float &yaw_dot_i, const float &yaw_dot_f, float dt,
-                      Eigen::Vector3f coeffs[6], float yaw_coeffs[4]);
+                      Eigen::Vector3f coeffs[6], float yaw_coeffs[4]) const;
+
+  // Evaluate the current trajectory at traj_time from its start, holding its ends outside of it
+  void evaluate(float traj_time, Eigen::Vector3f &x, Eigen::Vector3f &v, Eigen::Vector3f &a, Eigen::Vector3f &j,
+                float &yaw, float &yaw_dot) const;
+
+  // Evaluate a trajectory at its end
+  static void evaluate_end(const Eigen::Vector3f coeffs[6], const float yaw_coeffs[4], float duration,
+                           Eigen::Vector3f &x, Eigen::Vector3f &v, Eigen::Vector3f &a, Eigen::Vector3f &j, float &yaw,
+                           float &yaw_dot);
 
-  typedef actionlib::SimpleActionServer<kr_tracker_msgs::LineTrackerAction> ServerType;
+  typedef GoalServer<kr_tracker_msgs::LineTrackerAction> ServerType;
 
   // Action server that takes a goal.
   // Must be a pointer, because plugin does not support a constructor
@@ -57,6 +93,22 @@ class LineTrackerMinJerk : public kr_trackers_manager::Tracker
   bool traj_start_set_;
 
   float current_traj_length_;
+
+  // Goals received with queue set while a trajectory is in progress, started one after the other as it ends. Their
+  // trajectories are planned as soon as the one before them is, so that the next one is ready at the end of each.
+  struct QueuedGoal
+  {
+    Eigen::Vector3f goal;
+    float yaw, v_des, a_des;
+    ros::Duration duration;
+    bool relative;
+
+    bool planned;
+    float traj_duration;
+    Eigen::Vector3f coeffs[6];
+    float yaw_coeffs[4];
+  };
+  std::deque<QueuedGoal> queued_goals_;
 };
 
 LineTrackerMinJerk::LineTrackerMinJerk(void)
@@ -69,10 +121,9 @@ LineTrackerMinJerk::LineTrackerMinJerk(void)
 {
 }
 
-void LineTrackerMinJerk::Initialize(const ros::NodeHandle &nh)
+template <typename NodeHandle>
+void LineTrackerMinJerk::init(const NodeHandle &priv_nh)
 {
-  ros::NodeHandle priv_nh(nh, "line_tracker_min_jerk");
-
   priv_nh.param("default_v_des", default_v_des_, 0.5);
   priv_nh.param("default_a_des", default_a_des_, 0.3);
   priv_nh.param("default_yaw_v_des", default_yaw_v_des_, 0.8);
@@ -91,6 +142,23 @@ void LineTrackerMinJerk::Initialize(const ros::NodeHandle &nh)
   tracker_server_->start();
 }
 
+void LineTrackerMinJerk::Initialize(const ros::NodeHandle &nh)
+{
+  ros::NodeHandle priv_nh(nh, "line_tracker_min_jerk");
+  init(priv_nh);
+}
+
+bool LineTrackerMinJerk::InitializeOffline(const kr_trackers_manager::OfflineParams &params)
+{
+  init(kr_trackers_manager::OfflineParams(params, "line_tracker_min_jerk"));
+  return true;
+}
+
+bool LineTrackerMinJerk::replay(const std::string &topic, const uint8_t *data, uint32_t size)
+{
+  return tracker_server_->replay(topic, data, size);
+}
+
 bool LineTrackerMinJerk::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
 {
   // Only allow activation if a goal has been set
@@ -119,6 +187,7 @@ void LineTrackerMinJerk::Deactivate(void)
   }
 
   ICs_.reset();
+  queued_goals_.clear();
   goal_set_ = false;
   active_ = false;
 }
@@ -138,7 +207,7 @@ kr_mav_msgs::PositionCommand::ConstPtr LineTrackerMinJerk::update(const nav_msgs
   pos_set_ = true;
   ICs_.set_from_odom(msg);
 
-  const ros::Time t_now = ros::Time::now();
+  const ros::Time t_now = now();
 
   if(!active_)
   {
@@ -147,6 +216,9 @@ kr_mav_msgs::PositionCommand::ConstPtr LineTrackerMinJerk::update(const nav_msgs
 
   current_traj_length_ += dx;
 
+  while(!goal_set_ && !goal_reached_ && !queued_goals_.empty() && (t_now - traj_start_).toSec() >= traj_duration_)
+    start_queued_goal();
+
   kr_mav_msgs::PositionCommand::Ptr cmd(new kr_mav_msgs::PositionCommand);
   cmd->header.stamp = t_now;
   cmd->header.frame_id = msg->header.frame_id;
@@ -156,95 +228,9 @@ kr_mav_msgs::PositionCommand::ConstPtr LineTrackerMinJerk::update(const nav_msgs
     if(!traj_start_set_)
       traj_start_ = t_now;
 
-    bool duration_set = false;
-    traj_duration_ = 0.5f;
-
-    // TODO: This should probably be after traj_duration_ is determined
-    if(goal_duration_.toSec() > traj_duration_)
-    {
-      traj_duration_ = goal_duration_.toSec();
-      duration_set = true;
-    }
-
-    // Min-Jerk trajectory
-    const float total_dist = (goal_ - ICs_.pos()).norm();
-    const Eigen::Vector3f dir = (goal_ - ICs_.pos()) / total_dist;
-    const float vel_proj = (ICs_.vel()).dot(dir);
-
-    const float t_ramp = (v_des_ - vel_proj) / a_des_;
-
-    const float distance_to_v_des = vel_proj * t_ramp + 0.5f * a_des_ * t_ramp * t_ramp;
-    const float distance_v_des_to_stop = 0.5f * v_des_ * v_des_ / a_des_;
-
-    const float ramping_distance = distance_to_v_des + distance_v_des_to_stop;
-
-    if(!duration_set)  // If duration is not set by the goal callback
-    {
-      if(total_dist > ramping_distance)
-      {
-        float t = (v_des_ - vel_proj) / a_des_                // Ramp up
-                  + (total_dist - ramping_distance) / v_des_  // Constant velocity
-                  + v_des_ / a_des_;                          // Ramp down
-
-        traj_duration_ = std::max(traj_duration_, t);
-      }
-      else
-      {
-        // In this case, v_des_ is not reached. Assume bang bang acceleration.
-
-        float vo = vel_proj;
-        float distance_to_stop = 0.5f * vo * vo / a_des_;
-
-        float t_dir;  // The time required for the component along dir
-        if(vo > 0.0f && total_dist < distance_to_stop)
-        {
-          // Currently traveling towards the goal and need to overshoot
-
-          t_dir = vo / a_des_ + std::sqrt(2.0f) * std::sqrt(vo * vo - 2.0f * a_des_ * total_dist) / a_des_;
-        }
-        else
-        {
-          // Ramp up to a velocity towards the goal before ramping down
-
-          t_dir = -vo / a_des_ + std::sqrt(2.0f) * std::sqrt(vo * vo + 2.0f * a_des_ * total_dist) / a_des_;
-        }
-        traj_duration_ = std::max(traj_duration_, t_dir);
-
-        // The velocity component orthogonal to dir
-        float v_ortho = (ICs_.vel() - dir * vo).norm();
-        float t_non_dir = v_ortho / a_des_                       // Ramp to zero velocity
-                          + std::sqrt(2.0f) * v_ortho / a_des_;  // Get back to the dir line
-
-        traj_duration_ = std::max(traj_duration_, t_non_dir);
-      }
-    }
-
-    // Find shortest angle and direction to go from yaw_ to goal_yaw_
-    float yaw_dist, yaw_dir;
-    yaw_dist = goal_yaw_ - ICs_.yaw();
-    const float pi(M_PI);  // Defined so as to force float type
-    yaw_dist = std::fmod(yaw_dist, 2 * pi);
-    if(yaw_dist > pi)
-      yaw_dist -= 2 * pi;
-    else if(yaw_dist < -pi)
-      yaw_dist += 2 * pi;
-    yaw_dir = (yaw_dist >= 0) ? 1 : -1;
-    yaw_dist = std::abs(yaw_dist);
-    goal_yaw_ = ICs_.yaw() + yaw_dir * yaw_dist;
-
-    // Consider yaw in the trajectory duration
-    if(!duration_set)  // Only if duration is not set from goal
-    {
-      if(yaw_dist > yaw_v_des_ * yaw_v_des_ / yaw_a_des_)
-        traj_duration_ = std::max(traj_duration_, yaw_dist / yaw_v_des_ + yaw_v_des_ / yaw_a_des_);
-      else
-        traj_duration_ = std::max(traj_duration_, 2 * std::sqrt(yaw_dist / yaw_a_des_));
-    }
-
-    // TODO: Should consider yaw_dot_. See hover() in MAVManager
-
-    gen_trajectory(ICs_.pos(), goal_, ICs_.vel(), Eigen::Vector3f::Zero(), ICs_.acc(), Eigen::Vector3f::Zero(),
-                   ICs_.yaw(), goal_yaw_, ICs_.yaw_dot(), 0, traj_duration_, coeffs_, yaw_coeffs_);
+    plan(ICs_.pos(), ICs_.vel(), ICs_.acc(), ICs_.yaw(), ICs_.yaw_dot(), goal_, goal_yaw_, v_des_, a_des_,
+         goal_duration_, traj_duration_, coeffs_, yaw_coeffs_);
+    plan_queued_goals();
 
     goal_set_ = false;
   }
@@ -281,7 +267,9 @@ kr_mav_msgs::PositionCommand::ConstPtr LineTrackerMinJerk::update(const nav_msgs
     result.z = goal_(2);
     result.yaw = goal_yaw_;
 
-    tracker_server_->setSucceeded(result);
+    // Not active if a queued goal was rejected
+    if(tracker_server_->isActive())
+      tracker_server_->setSucceeded(result);
 
     current_traj_length_ = 0.0;
 
@@ -295,23 +283,7 @@ kr_mav_msgs::PositionCommand::ConstPtr LineTrackerMinJerk::update(const nav_msgs
     goal_reached_ = true;
   }
   else if(traj_time >= 0)
-  {
-    float t = traj_time / traj_duration_, t2 = t * t, t3 = t2 * t, t4 = t3 * t, t5 = t4 * t;
-
-    x = coeffs_[0] + t * coeffs_[1] + t2 * coeffs_[2] + t3 * coeffs_[3] + t4 * coeffs_[4] + t5 * coeffs_[5];
-    v = coeffs_[1] + 2 * t * coeffs_[2] + 3 * t2 * coeffs_[3] + 4 * t3 * coeffs_[4] + 5 * t4 * coeffs_[5];
-    a = 2 * coeffs_[2] + 6 * t * coeffs_[3] + 12 * t2 * coeffs_[4] + 20 * t3 * coeffs_[5];
-    j = 6 * coeffs_[3] + 24 * t * coeffs_[4] + 60 * t2 * coeffs_[5];
-
-    yaw_des = yaw_coeffs_[0] + t * yaw_coeffs_[1] + t2 * yaw_coeffs_[2] + t3 * yaw_coeffs_[3];
-    yaw_dot_des = yaw_coeffs_[1] + 2 * t * yaw_coeffs_[2] + 3 * t2 * yaw_coeffs_[3];
-
-    // Scale based on the trajectory duration
-    v = v / traj_duration_;
-    a = a / (traj_duration_ * traj_duration_);
-    j = j / (traj_duration_ * traj_duration_ * traj_duration_);
-    yaw_dot_des = yaw_dot_des / traj_duration_;
-  }
+    evaluate(traj_time, x, v, a, j, yaw_des, yaw_dot_des);
   else  // (traj_time < 0) can happen when t_start is set
     ROS_INFO_THROTTLE(1, "Trajectory hasn't started yet");
 
@@ -324,7 +296,7 @@ kr_mav_msgs::PositionCommand::ConstPtr LineTrackerMinJerk::update(const nav_msgs
 
   ICs_.set_from_cmd(cmd);
 
-  if(!goal_reached_)
+  if(!goal_reached_ && tracker_server_->isActive())
   {
     kr_tracker_msgs::LineTrackerFeedback feedback;
     feedback.distance_from_goal = (current_pos_ - goal_).norm();
@@ -334,6 +306,16 @@ kr_mav_msgs::PositionCommand::ConstPtr LineTrackerMinJerk::update(const nav_msgs
   return cmd;
 }
 
+void LineTrackerMinJerk::observe(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  current_pos_(0) = msg->pose.pose.position.x;
+  current_pos_(1) = msg->pose.pose.position.y;
+  current_pos_(2) = msg->pose.pose.position.z;
+
+  pos_set_ = true;
+  ICs_.set_from_odom(msg);
+}
+
 void LineTrackerMinJerk::goal_callback()
 {
   // If another goal is already active, cancel that goal
@@ -350,14 +332,44 @@ void LineTrackerMinJerk::goal_callback()
   current_traj_length_ = 0.0;
 
   // If preempt has been requested, then set this goal to preempted
-  // and make no changes to the tracker state.
+  // and stop the previous one.
   if(tracker_server_->isPreemptRequested())
   {
     ROS_INFO("LineTrackerMinJerk going to goal (%f, %f, %f, %f) preempted.", msg->x, msg->y, msg->z, msg->yaw);
     tracker_server_->setPreempted();
+    hold_position();
     return;
   }
 
+  // The action of the previous goal is over, but its trajectory goes on until this one starts
+  if(msg->queue && active_ && !goal_reached_)
+  {
+    // The trajectory of a queued goal starts when the previous one ends
+    if(msg->t_start != ros::Time(0))
+    {
+      ROS_WARN("LineTrackerMinJerk queued goal (%f, %f, %f) aborted, it cannot have a start time.", msg->x, msg->y,
+               msg->z);
+      tracker_server_->setAborted();
+      return;
+    }
+
+    QueuedGoal queued;
+    queued.goal = Eigen::Vector3f(msg->x, msg->y, msg->z);
+    queued.yaw = msg->yaw;
+    queued.v_des = (msg->v_des > 0.0) ? msg->v_des : default_v_des_;
+    queued.a_des = (msg->a_des > 0.0) ? msg->a_des : default_a_des_;
+    queued.duration = msg->duration;
+    queued.relative = msg->relative;
+    queued.planned = false;
+    queued_goals_.push_back(queued);
+    if(!goal_set_)
+      plan_queued_goals();
+    ROS_DEBUG("LineTrackerMinJerk goal (%f, %f, %f) queued, %zu goals queued.", msg->x, msg->y, msg->z,
+              queued_goals_.size());
+    return;
+  }
+  queued_goals_.clear();
+
   goal_(0) = msg->x;
   goal_(1) = msg->y;
   goal_(2) = msg->z;
@@ -365,7 +377,7 @@ void LineTrackerMinJerk::goal_callback()
   goal_duration_ = msg->duration;
   if(msg->t_start != ros::Time(0))
   {
-    traj_start_ = msg->t_start;
+    traj_start_ = fromRosTime(msg->t_start);
     traj_start_set_ = true;
   }
   else
@@ -385,6 +397,15 @@ void LineTrackerMinJerk::goal_callback()
 
   goal_set_ = true;
   goal_reached_ = false;
+
+  if(msg->activate && !requestActivation(msg->send_time))
+  {
+    ROS_WARN("LineTrackerMinJerk goal (%f, %f, %f) aborted, could not activate the tracker.", goal_(0), goal_(1),
+             goal_(2));
+    tracker_server_->setAborted();
+    goal_set_ = false;
+    goal_reached_ = true;
+  }
 }
 
 void LineTrackerMinJerk::preempt_callback()
@@ -400,18 +421,240 @@ void LineTrackerMinJerk::preempt_callback()
     tracker_server_->setPreempted();
   }
 
+  // Otherwise goal_callback replaces or queues behind the goal
+  if(!tracker_server_->isNewGoalAvailable())
+    hold_position();
+}
+
+void LineTrackerMinJerk::hold_position()
+{
   // TODO: How much overshoot will this cause at high velocities?
   goal_ = ICs_.pos();
 
+  queued_goals_.clear();
   goal_set_ = false;
   goal_reached_ = true;
 }
 
+void LineTrackerMinJerk::plan_queued_goals()
+{
+  // The state at the end of the trajectory in progress
+  Eigen::Vector3f x, v, a, j;
+  float yaw, yaw_dot;
+  evaluate_end(coeffs_, yaw_coeffs_, traj_duration_, x, v, a, j, yaw, yaw_dot);
+  Eigen::Vector3f goal = goal_;
+  float goal_yaw = goal_yaw_;
+
+  for(QueuedGoal &queued : queued_goals_)
+  {
+    if(!queued.planned)
+    {
+      if(queued.relative)
+      {
+        queued.goal += goal;
+        queued.yaw += goal_yaw;
+      }
+      plan(x, v, a, yaw, yaw_dot, queued.goal, queued.yaw, queued.v_des, queued.a_des, queued.duration,
+           queued.traj_duration, queued.coeffs, queued.yaw_coeffs);
+      queued.planned = true;
+    }
+    evaluate_end(queued.coeffs, queued.yaw_coeffs, queued.traj_duration, x, v, a, j, yaw, yaw_dot);
+    goal = queued.goal;
+    goal_yaw = queued.yaw;
+  }
+}
+
+void LineTrackerMinJerk::start_queued_goal()
+{
+  const QueuedGoal &next = queued_goals_.front();
+
+  traj_start_ += ros::Duration(traj_duration_);
+  traj_start_set_ = true;
+
+  goal_ = next.goal;
+  goal_yaw_ = next.yaw;
+  goal_duration_ = next.duration;
+  v_des_ = next.v_des;
+  a_des_ = next.a_des;
+  traj_duration_ = next.traj_duration;
+  std::copy(next.coeffs, next.coeffs + 6, coeffs_);
+  std::copy(next.yaw_coeffs, next.yaw_coeffs + 4, yaw_coeffs_);
+  queued_goals_.pop_front();
+}
+
+void LineTrackerMinJerk::plan(const Eigen::Vector3f &xi, const Eigen::Vector3f &vi, const Eigen::Vector3f &ai,
+                              float yawi, float yaw_dot_i, const Eigen::Vector3f &goal, float &goal_yaw, float v_des,
+                              float a_des, const ros::Duration &goal_duration, float &duration,
+                              Eigen::Vector3f coeffs[6], float yaw_coeffs[4]) const
+{
+  bool duration_set = false;
+  duration = 0.5f;
+
+  // TODO: This should probably be after duration is determined
+  if(goal_duration.toSec() > duration)
+  {
+    duration = goal_duration.toSec();
+    duration_set = true;
+  }
+
+  // Min-Jerk trajectory
+  const float total_dist = (goal - xi).norm();
+  const Eigen::Vector3f dir = (goal - xi) / total_dist;
+  const float vel_proj = vi.dot(dir);
+
+  const float t_ramp = (v_des - vel_proj) / a_des;
+
+  const float distance_to_v_des = vel_proj * t_ramp + 0.5f * a_des * t_ramp * t_ramp;
+  const float distance_v_des_to_stop = 0.5f * v_des * v_des / a_des;
+
+  const float ramping_distance = distance_to_v_des + distance_v_des_to_stop;
+
+  if(!duration_set)  // If duration is not set by the goal callback
+  {
+    if(total_dist > ramping_distance)
+    {
+      float t = (v_des - vel_proj) / a_des                 // Ramp up
+                + (total_dist - ramping_distance) / v_des  // Constant velocity
+                + v_des / a_des;                           // Ramp down
+
+      duration = std::max(duration, t);
+    }
+    else
+    {
+      // In this case, v_des is not reached. Assume bang bang acceleration.
+
+      float vo = vel_proj;
+      float distance_to_stop = 0.5f * vo * vo / a_des;
+
+      float t_dir;  // The time required for the component along dir
+      if(vo > 0.0f && total_dist < distance_to_stop)
+      {
+        // Currently traveling towards the goal and need to overshoot
+
+        t_dir = vo / a_des + std::sqrt(2.0f) * std::sqrt(vo * vo - 2.0f * a_des * total_dist) / a_des;
+      }
+      else
+      {
+        // Ramp up to a velocity towards the goal before ramping down
+
+        t_dir = -vo / a_des + std::sqrt(2.0f) * std::sqrt(vo * vo + 2.0f * a_des * total_dist) / a_des;
+      }
+      duration = std::max(duration, t_dir);
+
+      // The velocity component orthogonal to dir
+      float v_ortho = (vi - dir * vo).norm();
+      float t_non_dir = v_ortho / a_des                       // Ramp to zero velocity
+                        + std::sqrt(2.0f) * v_ortho / a_des;  // Get back to the dir line
+
+      duration = std::max(duration, t_non_dir);
+    }
+  }
+
+  // Find shortest angle and direction to go from yaw_ to goal_yaw
+  float yaw_dist, yaw_dir;
+  yaw_dist = goal_yaw - yawi;
+  const float pi(M_PI);  // Defined so as to force float type
+  yaw_dist = std::fmod(yaw_dist, 2 * pi);
+  if(yaw_dist > pi)
+    yaw_dist -= 2 * pi;
+  else if(yaw_dist < -pi)
+    yaw_dist += 2 * pi;
+  yaw_dir = (yaw_dist >= 0) ? 1 : -1;
+  yaw_dist = std::abs(yaw_dist);
+  goal_yaw = yawi + yaw_dir * yaw_dist;
+
+  // Consider yaw in the trajectory duration
+  if(!duration_set)  // Only if duration is not set from goal
+  {
+    if(yaw_dist > yaw_v_des_ * yaw_v_des_ / yaw_a_des_)
+      duration = std::max(duration, yaw_dist / yaw_v_des_ + yaw_v_des_ / yaw_a_des_);
+    else
+      duration = std::max(duration, 2 * std::sqrt(yaw_dist / yaw_a_des_));
+  }
+
+  // TODO: Should consider yaw_dot_. See hover() in MAVManager
+
+  gen_trajectory(xi, goal, vi, Eigen::Vector3f::Zero(), ai, Eigen::Vector3f::Zero(), yawi, goal_yaw, yaw_dot_i, 0,
+                 duration, coeffs, yaw_coeffs);
+}
+
+void LineTrackerMinJerk::evaluate(float traj_time, Eigen::Vector3f &x, Eigen::Vector3f &v, Eigen::Vector3f &a,
+                                  Eigen::Vector3f &j, float &yaw, float &yaw_dot) const
+{
+  if(traj_time >= traj_duration_)
+  {
+    x = goal_;
+    v = a = j = Eigen::Vector3f::Zero();
+    yaw = goal_yaw_;
+    yaw_dot = 0;
+    return;
+  }
+
+  const float t = std::max(traj_time, 0.0f) / traj_duration_, t2 = t * t, t3 = t2 * t, t4 = t3 * t, t5 = t4 * t;
+
+  x = coeffs_[0] + t * coeffs_[1] + t2 * coeffs_[2] + t3 * coeffs_[3] + t4 * coeffs_[4] + t5 * coeffs_[5];
+  yaw = yaw_coeffs_[0] + t * yaw_coeffs_[1] + t2 * yaw_coeffs_[2] + t3 * yaw_coeffs_[3];
+  if(traj_time < 0)
+  {
+    // Holding the start before the trajectory begins
+    v = a = j = Eigen::Vector3f::Zero();
+    yaw_dot = 0;
+    return;
+  }
+
+  v = coeffs_[1] + 2 * t * coeffs_[2] + 3 * t2 * coeffs_[3] + 4 * t3 * coeffs_[4] + 5 * t4 * coeffs_[5];
+  a = 2 * coeffs_[2] + 6 * t * coeffs_[3] + 12 * t2 * coeffs_[4] + 20 * t3 * coeffs_[5];
+  j = 6 * coeffs_[3] + 24 * t * coeffs_[4] + 60 * t2 * coeffs_[5];
+  yaw_dot = yaw_coeffs_[1] + 2 * t * yaw_coeffs_[2] + 3 * t2 * yaw_coeffs_[3];
+
+  // Scale based on the trajectory duration
+  v = v / traj_duration_;
+  a = a / (traj_duration_ * traj_duration_);
+  j = j / (traj_duration_ * traj_duration_ * traj_duration_);
+  yaw_dot = yaw_dot / traj_duration_;
+}
+
+void LineTrackerMinJerk::evaluate_end(const Eigen::Vector3f coeffs[6], const float yaw_coeffs[4], float duration,
+                                      Eigen::Vector3f &x, Eigen::Vector3f &v, Eigen::Vector3f &a, Eigen::Vector3f &j,
+                                      float &yaw, float &yaw_dot)
+{
+  x = coeffs[0] + coeffs[1] + coeffs[2] + coeffs[3] + coeffs[4] + coeffs[5];
+  v = (coeffs[1] + 2 * coeffs[2] + 3 * coeffs[3] + 4 * coeffs[4] + 5 * coeffs[5]) / duration;
+  a = (2 * coeffs[2] + 6 * coeffs[3] + 12 * coeffs[4] + 20 * coeffs[5]) / (duration * duration);
+  j = (6 * coeffs[3] + 24 * coeffs[4] + 60 * coeffs[5]) / (duration * duration * duration);
+  yaw = yaw_coeffs[0] + yaw_coeffs[1] + yaw_coeffs[2] + yaw_coeffs[3];
+  yaw_dot = (yaw_coeffs[1] + 2 * yaw_coeffs[2] + 3 * yaw_coeffs[3]) / duration;
+}
+
+bool LineTrackerMinJerk::preview(const ros::Time &t0, float dt, unsigned int n,
+                                 kr_tracker_msgs::TrackerPreview &preview) const
+{
+  // The trajectory for a new goal is only computed in the next update
+  if(!active_ || goal_set_)
+    return false;
+
+  const float traj_time = (t0 - traj_start_).toSec();
+  Eigen::Vector3f x, v, a, j;
+  float yaw, yaw_dot;
+  for(unsigned int i = 0; i < n; i++)
+  {
+    if(goal_reached_)
+      setPreviewSample(preview, i, goal_, Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero(), goal_yaw_, 0);
+    else
+    {
+      evaluate(traj_time + i * dt, x, v, a, j, yaw, yaw_dot);
+      setPreviewSample(preview, i, x, v, a, yaw, yaw_dot);
+    }
+  }
+  preview.num_samples = n;
+  return true;
+}
+
 void LineTrackerMinJerk::gen_trajectory(const Eigen::Vector3f &xi, const Eigen::Vector3f &xf, const Eigen::Vector3f &vi,
                                         const Eigen::Vector3f &vf, const Eigen::Vector3f &ai, const Eigen::Vector3f &af,
                                         const float &yawi, const float &yawf, const float &yaw_dot_i,
                                         const float &yaw_dot_f, float dt, Eigen::Vector3f coeffs[6],
-                                        float yaw_coeffs[4])
+                                        float yaw_coeffs[4]) const
 {
   // We can use a dt of 1 to ensure that our system will be numerically conditioned.
   // For more information, see line_tracker_min_jerk_numerical_issues.m
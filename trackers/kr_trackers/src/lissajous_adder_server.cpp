@@ -1,6 +1,6 @@
-#include <actionlib/server/simple_action_server.h>
 #include <kr_tracker_msgs/LissajousAdderAction.h>
 #include <kr_tracker_msgs/TrackerStatus.h>
+#include <kr_trackers/goal_server.h>
 #include <kr_trackers/initial_conditions.h>
 #include <kr_trackers/lissajous_generator.h>
 #include <kr_trackers_manager/Tracker.h>
@@ -15,17 +15,24 @@ class LissajousAdder : public kr_trackers_manager::Tracker
  public:
   LissajousAdder(void);
   void Initialize(const ros::NodeHandle &nh);
+  bool InitializeOffline(const kr_trackers_manager::OfflineParams &params);
+  bool replay(const std::string &topic, const uint8_t *data, uint32_t size);
   bool Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd);
   void Deactivate(void);
 
   kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &msg);
+  void observe(const nav_msgs::Odometry::ConstPtr &msg) {}
   uint8_t status() const;
 
  private:
+  // Read the params and set up the action server, from a ros::NodeHandle or OfflineParams
+  template <typename NodeHandle>
+  void init(const NodeHandle &priv_nh);
+
   void goal_callback(void);
   void preempt_callback(void);
 
-  typedef actionlib::SimpleActionServer<kr_tracker_msgs::LissajousAdderAction> ServerType;
+  typedef GoalServer<kr_tracker_msgs::LissajousAdderAction> ServerType;
   std::shared_ptr<ServerType> tracker_server_;
   ros::Publisher path_pub_;
 
@@ -39,11 +46,10 @@ class LissajousAdder : public kr_trackers_manager::Tracker
 
 LissajousAdder::LissajousAdder(void) : traj_start_set_(false) {}
 
-void LissajousAdder::Initialize(const ros::NodeHandle &nh)
+template <typename NodeHandle>
+void LissajousAdder::init(const NodeHandle &priv_nh)
 {
-  ros::NodeHandle priv_nh(nh, "lissajous_adder");
-  priv_nh.param<std::string>("frame_id", frame_id_, "world");
-  path_pub_ = priv_nh.advertise<nav_msgs::Path>("lissajous_path", 1);
+  priv_nh.param("frame_id", frame_id_, std::string("world"));
 
   tracker_server_ = std::shared_ptr<ServerType>(new ServerType(priv_nh, "LissajousAdder", false));
   tracker_server_->registerGoalCallback(boost::bind(&LissajousAdder::goal_callback, this));
@@ -51,6 +57,24 @@ void LissajousAdder::Initialize(const ros::NodeHandle &nh)
   tracker_server_->start();
 }
 
+void LissajousAdder::Initialize(const ros::NodeHandle &nh)
+{
+  ros::NodeHandle priv_nh(nh, "lissajous_adder");
+  init(priv_nh);
+  path_pub_ = priv_nh.advertise<nav_msgs::Path>("lissajous_path", 1);
+}
+
+bool LissajousAdder::InitializeOffline(const kr_trackers_manager::OfflineParams &params)
+{
+  init(kr_trackers_manager::OfflineParams(params, "lissajous_adder"));
+  return true;
+}
+
+bool LissajousAdder::replay(const std::string &topic, const uint8_t *data, uint32_t size)
+{
+  return tracker_server_->replay(topic, data, size);
+}
+
 bool LissajousAdder::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
 {
   // Only allow activation if a goal has been set
@@ -61,7 +85,7 @@ bool LissajousAdder::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
       ROS_WARN("LissajousAdder::Activate: goal_set is true but action server has no active goal - not activating.");
       return false;
     }
-    return (generator_1_.activate() && generator_2_.activate());
+    return (generator_1_.activate(now()) && generator_2_.activate(now()));
   }
   return false;
 }
@@ -86,6 +110,8 @@ kr_mav_msgs::PositionCommand::ConstPtr LissajousAdder::update(const nav_msgs::Od
     return kr_mav_msgs::PositionCommand::Ptr();
   }
 
+  const ros::Time t_now = now();
+
   if(!traj_start_set_)
   {
     traj_start_set_ = true;
@@ -100,7 +126,7 @@ kr_mav_msgs::PositionCommand::ConstPtr LissajousAdder::update(const nav_msgs::Od
     double dt = 0.1;
     nav_msgs::Path path1, path2;
     path1.header.frame_id = frame_id_;
-    path1.header.stamp = ros::Time::now();
+    path1.header.stamp = t_now;
     generator_1_.generatePath(path1, initial_pt, dt);
     generator_2_.generatePath(path2, initial_pt2, dt);
     for(unsigned int i = 0; i < path1.poses.size(); i++)
@@ -109,19 +135,20 @@ kr_mav_msgs::PositionCommand::ConstPtr LissajousAdder::update(const nav_msgs::Od
       path1.poses[i].pose.position.y += path2.poses[i].pose.position.y;
       path1.poses[i].pose.position.z += path2.poses[i].pose.position.z;
     }
-    path_pub_.publish(path1);
+    if(path_pub_)
+      path_pub_.publish(path1);
   }
 
   // Set gains
-  kr_mav_msgs::PositionCommand::Ptr cmd1 = generator_1_.getPositionCmd();
-  kr_mav_msgs::PositionCommand::Ptr cmd2 = generator_2_.getPositionCmd();
+  kr_mav_msgs::PositionCommand::Ptr cmd1 = generator_1_.getPositionCmd(t_now);
+  kr_mav_msgs::PositionCommand::Ptr cmd2 = generator_2_.getPositionCmd(t_now);
   if(cmd1 == NULL && cmd2 == NULL)
   {
     return cmd1;
   }
   else
   {
-    cmd1->header.stamp = ros::Time::now();
+    cmd1->header.stamp = t_now;
     cmd1->header.frame_id = msg->header.frame_id;
     cmd1->position.x += ICs_.pos()(0) + cmd2->position.x;
     cmd1->position.y += ICs_.pos()(1) + cmd2->position.y;
@@ -141,7 +168,7 @@ kr_mav_msgs::PositionCommand::ConstPtr LissajousAdder::update(const nav_msgs::Od
     if(!generator_1_.status() || !generator_2_.status())
     {
       kr_tracker_msgs::LissajousAdderFeedback feedback;
-      feedback.time_to_completion = std::max(generator_1_.timeRemaining(), generator_2_.timeRemaining());
+      feedback.time_to_completion = std::max(generator_1_.timeRemaining(t_now), generator_2_.timeRemaining(t_now));
       tracker_server_->publishFeedback(feedback);
 
       Eigen::Vector3d position_current =
@@ -156,7 +183,7 @@ kr_mav_msgs::PositionCommand::ConstPtr LissajousAdder::update(const nav_msgs::Od
       result.y = msg->pose.pose.position.y;
       result.z = msg->pose.pose.position.z;
       result.yaw = ICs_.yaw();  // TODO: Change this to the yaw from msg
-      result.duration = std::max(generator_1_.timeElapsed(), generator_2_.timeElapsed());
+      result.duration = std::max(generator_1_.timeElapsed(t_now), generator_2_.timeElapsed(t_now));
       result.length = distance_traveled_;
       tracker_server_->setSucceeded(result);
     }
@@ -189,8 +216,9 @@ void LissajousAdder::goal_callback(void)
   generator_1_.setParams(msg, 0);
   generator_2_.setParams(msg, 1);
   distance_traveled_ = 0;
-  generator_1_.activate();
-  generator_2_.activate();
+  const ros::Time t_now = now();
+  generator_1_.activate(t_now);
+  generator_2_.activate(t_now);
 }
 
 void LissajousAdder::preempt_callback(void)
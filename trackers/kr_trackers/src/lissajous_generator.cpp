@@ -96,7 +96,7 @@ void LissajousGenerator::setParams(const kr_tracker_msgs::LissajousAdderGoal::Co
   goal_reached_ = false;
 }
 
-const kr_mav_msgs::PositionCommand::Ptr LissajousGenerator::getPositionCmd(void)
+const kr_mav_msgs::PositionCommand::Ptr LissajousGenerator::getPositionCmd(const ros::Time &t_now)
 {
   if(!active_)
   {
@@ -107,9 +107,36 @@ const kr_mav_msgs::PositionCommand::Ptr LissajousGenerator::getPositionCmd(void)
   kr_mav_msgs::PositionCommand::Ptr cmd(new kr_mav_msgs::PositionCommand);
 
   // Get elapsed time
-  ros::Time current_time = ros::Time::now();
-  ros::Duration elapsed_time = current_time - start_time_;
-  double t = elapsed_time.toSec();
+  double t = (t_now - start_time_).toSec();
+
+  Eigen::Vector3f pos, vel, acc, jrk;
+  double yaw, yaw_dot;
+  evaluate(t, pos, vel, acc, jrk, yaw, yaw_dot);
+  if(t > total_time_)
+  {
+    goal_set_ = false;
+    goal_reached_ = true;
+  }
+  cmd->position.x = pos(0), cmd->position.y = pos(1), cmd->position.z = pos(2);
+  cmd->velocity.x = vel(0), cmd->velocity.y = vel(1), cmd->velocity.z = vel(2);
+  cmd->acceleration.x = acc(0), cmd->acceleration.y = acc(1), cmd->acceleration.z = acc(2);
+  cmd->jerk.x = jrk(0), cmd->jerk.y = jrk(1), cmd->jerk.z = jrk(2);
+  cmd->yaw = yaw;
+  cmd->yaw_dot = yaw_dot;
+  return cmd;
+}
+
+void LissajousGenerator::evaluate(double t, Eigen::Vector3f &pos, Eigen::Vector3f &vel, Eigen::Vector3f &acc,
+                                  Eigen::Vector3f &jrk, double &yaw, double &yaw_dot) const
+{
+  if(t > total_time_)
+  {
+    pos = vel = acc = jrk = Eigen::Vector3f::Zero();
+    yaw = 0;
+    yaw_dot = 0;
+    return;
+  }
+
   double t2 = t * t;
   double t3 = t2 * t;
   double t4 = t3 * t;
@@ -119,96 +146,71 @@ const kr_mav_msgs::PositionCommand::Ptr LissajousGenerator::getPositionCmd(void)
   double t8 = t7 * t;
   double s, sdot, sddot, sdddot;
 
-  Eigen::Vector3f pos, vel, acc, jrk;
-  double yaw, yaw_dot;
-  if(t > total_time_)
+  if(t < ramp_time_)
   {
-    pos = Eigen::Vector3f::Zero();
-    yaw = 0;
-    cmd->position.x = pos(0), cmd->position.y = pos(1), cmd->position.z = pos(2);
-    cmd->velocity.x = 0, cmd->velocity.y = 0, cmd->velocity.z = 0;
-    cmd->acceleration.x = 0, cmd->acceleration.y = 0, cmd->acceleration.z = 0;
-    cmd->jerk.x = 0, cmd->jerk.y = 0, cmd->jerk.z = 0;
-    cmd->yaw = yaw;
-    cmd->yaw_dot = 0;
-    goal_set_ = false;
-    goal_reached_ = true;
+    s = a7_ * t8 / 8.0 + a6_ * t7 / 7.0 + a5_ * t6 / 6.0 + a4_ * t5 / 5.0;
+    sdot = a7_ * t7 + a6_ * t6 + a5_ * t5 + a4_ * t4;
+    sddot = 7.0 * a7_ * t6 + 6.0 * a6_ * t5 + 5.0 * a5_ * t4 + 4.0 * a4_ * t3;
+    sdddot = 42.0 * a7_ * t5 + 30.0 * a6_ * t4 + 20.0 * a5_ * t3 + 12.0 * a4_ * t2;
+  }
+  else if(t < total_time_ - ramp_time_)
+  {
+    s = ramp_s_ + t - ramp_time_;
+    sdot = 1;
+    sddot = 0;
+    sdddot = 0;
   }
   else
   {
-    if(t < ramp_time_)
-    {
-      s = a7_ * t8 / 8.0 + a6_ * t7 / 7.0 + a5_ * t6 / 6.0 + a4_ * t5 / 5.0;
-      sdot = a7_ * t7 + a6_ * t6 + a5_ * t5 + a4_ * t4;
-      sddot = 7.0 * a7_ * t6 + 6.0 * a6_ * t5 + 5.0 * a5_ * t4 + 4.0 * a4_ * t3;
-      sdddot = 42.0 * a7_ * t5 + 30.0 * a6_ * t4 + 20.0 * a5_ * t3 + 12.0 * a4_ * t2;
-    }
-    else if(t < total_time_ - ramp_time_)
-    {
-      s = ramp_s_ + t - ramp_time_;
-      sdot = 1;
-      sddot = 0;
-      sdddot = 0;
-    }
-    else
-    {
-      double te = total_time_ - t;
-      double te2 = te * te;
-      double te3 = te2 * te;
-      double te4 = te3 * te;
-      double te5 = te4 * te;
-      double te6 = te5 * te;
-      double te7 = te6 * te;
-      double te8 = te7 * te;
-
-      s = 2.0 * ramp_s_ + const_time_ - a7_ * te8 / 8.0 - a6_ * te7 / 7.0 - a5_ * te6 / 6.0 - a4_ * te5 / 5.0;
-      sdot = a7_ * te7 + a6_ * te6 + a5_ * te5 + a4_ * te4;
-      sddot = -7.0 * a7_ * te6 - 6.0 * a6_ * te5 - 5.0 * a5_ * te4 - 4.0 * a4_ * te3;
-      sdddot = 42.0 * a7_ * te5 + 30.0 * a6_ * te4 + 20.0 * a5_ * te3 + 12.0 * a4_ * te2;
-    }
-    double T = period_;
-    double T2 = T * T;
-    double T3 = T2 * T;
-    pos(0) = x_amp_ * (1 - std::cos(2 * M_PI * x_num_periods_ * s / T));
-    pos(1) = y_amp_ * std::sin(2 * M_PI * y_num_periods_ * s / T);
-    pos(2) = z_amp_ * std::sin(2 * M_PI * z_num_periods_ * s / T);
-    vel(0) = x_amp_ * 2 * M_PI * x_num_periods_ * std::sin(2 * M_PI * x_num_periods_ * s / T) * sdot / T;
-    vel(1) = y_amp_ * 2 * M_PI * y_num_periods_ * std::cos(2 * M_PI * y_num_periods_ * s / T) * sdot / T;
-    vel(2) = z_amp_ * 2 * M_PI * z_num_periods_ * std::cos(2 * M_PI * z_num_periods_ * s / T) * sdot / T;
-    acc(0) = x_amp_ * (4 * M_PI * M_PI * x_num_periods_ * x_num_periods_ * std::cos(2 * M_PI * x_num_periods_ * s / T) *
-                           sdot * sdot / T2 +
-                       2 * M_PI * x_num_periods_ * std::sin(2 * M_PI * x_num_periods_ * s / T) * sddot / T);
-    acc(1) = y_amp_ * (-4 * M_PI * M_PI * y_num_periods_ * y_num_periods_ *
-                           std::sin(2 * M_PI * y_num_periods_ * s / T) * sdot * sdot / T2 +
-                       2 * M_PI * y_num_periods_ * std::cos(2 * M_PI * y_num_periods_ * s / T) * sddot / T);
-    acc(2) = z_amp_ * (-4 * M_PI * M_PI * z_num_periods_ * z_num_periods_ *
-                           std::sin(2 * M_PI * z_num_periods_ * s / T) * sdot * sdot / T2 +
-                       2 * M_PI * z_num_periods_ * std::cos(2 * M_PI * z_num_periods_ * s / T) * sddot / T);
-    jrk(0) = x_amp_ * (-8 * M_PI * M_PI * M_PI * x_num_periods_ * x_num_periods_ * x_num_periods_ *
-                           std::sin(2 * M_PI * x_num_periods_ * s / T) * sdot * sdot * sdot / T3 +
-                       4 * M_PI * M_PI * x_num_periods_ * x_num_periods_ * std::cos(2 * M_PI * x_num_periods_ * s / T) *
-                           sdot * sddot / T2 +
-                       2 * M_PI * x_num_periods_ * std::sin(2 * M_PI * x_num_periods_ * s / T) * sdddot / T);
-    jrk(1) = y_amp_ * (-8 * M_PI * M_PI * M_PI * y_num_periods_ * y_num_periods_ * y_num_periods_ *
-                           std::cos(2 * M_PI * y_num_periods_ * s / T) * sdot * sdot * sdot / T3 -
-                       4 * M_PI * M_PI * y_num_periods_ * y_num_periods_ * std::sin(2 * M_PI * y_num_periods_ * s / T) *
-                           sdot * sddot / T2 +
-                       2 * M_PI * y_num_periods_ * std::cos(2 * M_PI * y_num_periods_ * s / T) * sdddot / T);
-    jrk(2) = z_amp_ * (-8 * M_PI * M_PI * M_PI * z_num_periods_ * z_num_periods_ * z_num_periods_ *
-                           std::cos(2 * M_PI * z_num_periods_ * s / T) * sdot * sdot * sdot / T3 -
-                       4 * M_PI * M_PI * z_num_periods_ * z_num_periods_ * std::sin(2 * M_PI * z_num_periods_ * s / T) *
-                           sdot * sddot / T2 +
-                       2 * M_PI * z_num_periods_ * std::cos(2 * M_PI * z_num_periods_ * s / T) * sdddot / T);
-    yaw = yaw_amp_ * (1 - std::cos(2 * M_PI * yaw_num_periods_ * s / T));
-    yaw_dot = yaw_amp_ * 2 * M_PI * yaw_num_periods_ * std::sin(2 * M_PI * yaw_num_periods_ * s / T) * sdot / T;
-    cmd->position.x = pos(0), cmd->position.y = pos(1), cmd->position.z = pos(2);
-    cmd->velocity.x = vel(0), cmd->velocity.y = vel(1), cmd->velocity.z = vel(2);
-    cmd->acceleration.x = acc(0), cmd->acceleration.y = acc(1), cmd->acceleration.z = acc(2);
-    cmd->jerk.x = jrk(0), cmd->jerk.y = jrk(1), cmd->jerk.z = jrk(2);
-    cmd->yaw = yaw;
-    cmd->yaw_dot = yaw_dot;
+    double te = total_time_ - t;
+    double te2 = te * te;
+    double te3 = te2 * te;
+    double te4 = te3 * te;
+    double te5 = te4 * te;
+    double te6 = te5 * te;
+    double te7 = te6 * te;
+    double te8 = te7 * te;
+
+    s = 2.0 * ramp_s_ + const_time_ - a7_ * te8 / 8.0 - a6_ * te7 / 7.0 - a5_ * te6 / 6.0 - a4_ * te5 / 5.0;
+    sdot = a7_ * te7 + a6_ * te6 + a5_ * te5 + a4_ * te4;
+    sddot = -7.0 * a7_ * te6 - 6.0 * a6_ * te5 - 5.0 * a5_ * te4 - 4.0 * a4_ * te3;
+    sdddot = 42.0 * a7_ * te5 + 30.0 * a6_ * te4 + 20.0 * a5_ * te3 + 12.0 * a4_ * te2;
   }
-  return cmd;
+  double T = period_;
+  double T2 = T * T;
+  double T3 = T2 * T;
+  pos(0) = x_amp_ * (1 - std::cos(2 * M_PI * x_num_periods_ * s / T));
+  pos(1) = y_amp_ * std::sin(2 * M_PI * y_num_periods_ * s / T);
+  pos(2) = z_amp_ * std::sin(2 * M_PI * z_num_periods_ * s / T);
+  vel(0) = x_amp_ * 2 * M_PI * x_num_periods_ * std::sin(2 * M_PI * x_num_periods_ * s / T) * sdot / T;
+  vel(1) = y_amp_ * 2 * M_PI * y_num_periods_ * std::cos(2 * M_PI * y_num_periods_ * s / T) * sdot / T;
+  vel(2) = z_amp_ * 2 * M_PI * z_num_periods_ * std::cos(2 * M_PI * z_num_periods_ * s / T) * sdot / T;
+  acc(0) = x_amp_ * (4 * M_PI * M_PI * x_num_periods_ * x_num_periods_ * std::cos(2 * M_PI * x_num_periods_ * s / T) *
+                         sdot * sdot / T2 +
+                     2 * M_PI * x_num_periods_ * std::sin(2 * M_PI * x_num_periods_ * s / T) * sddot / T);
+  acc(1) = y_amp_ * (-4 * M_PI * M_PI * y_num_periods_ * y_num_periods_ *
+                         std::sin(2 * M_PI * y_num_periods_ * s / T) * sdot * sdot / T2 +
+                     2 * M_PI * y_num_periods_ * std::cos(2 * M_PI * y_num_periods_ * s / T) * sddot / T);
+  acc(2) = z_amp_ * (-4 * M_PI * M_PI * z_num_periods_ * z_num_periods_ *
+                         std::sin(2 * M_PI * z_num_periods_ * s / T) * sdot * sdot / T2 +
+                     2 * M_PI * z_num_periods_ * std::cos(2 * M_PI * z_num_periods_ * s / T) * sddot / T);
+  jrk(0) = x_amp_ * (-8 * M_PI * M_PI * M_PI * x_num_periods_ * x_num_periods_ * x_num_periods_ *
+                         std::sin(2 * M_PI * x_num_periods_ * s / T) * sdot * sdot * sdot / T3 +
+                     4 * M_PI * M_PI * x_num_periods_ * x_num_periods_ * std::cos(2 * M_PI * x_num_periods_ * s / T) *
+                         sdot * sddot / T2 +
+                     2 * M_PI * x_num_periods_ * std::sin(2 * M_PI * x_num_periods_ * s / T) * sdddot / T);
+  jrk(1) = y_amp_ * (-8 * M_PI * M_PI * M_PI * y_num_periods_ * y_num_periods_ * y_num_periods_ *
+                         std::cos(2 * M_PI * y_num_periods_ * s / T) * sdot * sdot * sdot / T3 -
+                     4 * M_PI * M_PI * y_num_periods_ * y_num_periods_ * std::sin(2 * M_PI * y_num_periods_ * s / T) *
+                         sdot * sddot / T2 +
+                     2 * M_PI * y_num_periods_ * std::cos(2 * M_PI * y_num_periods_ * s / T) * sdddot / T);
+  jrk(2) = z_amp_ * (-8 * M_PI * M_PI * M_PI * z_num_periods_ * z_num_periods_ * z_num_periods_ *
+                         std::cos(2 * M_PI * z_num_periods_ * s / T) * sdot * sdot * sdot / T3 -
+                     4 * M_PI * M_PI * z_num_periods_ * z_num_periods_ * std::sin(2 * M_PI * z_num_periods_ * s / T) *
+                         sdot * sddot / T2 +
+                     2 * M_PI * z_num_periods_ * std::cos(2 * M_PI * z_num_periods_ * s / T) * sdddot / T);
+  yaw = yaw_amp_ * (1 - std::cos(2 * M_PI * yaw_num_periods_ * s / T));
+  yaw_dot = yaw_amp_ * 2 * M_PI * yaw_num_periods_ * std::sin(2 * M_PI * yaw_num_periods_ * s / T) * sdot / T;
 }
 
 void LissajousGenerator::generatePath(nav_msgs::Path &path, geometry_msgs::Point &initial_pt, double dt)
@@ -231,12 +233,12 @@ void LissajousGenerator::generatePath(nav_msgs::Path &path, geometry_msgs::Point
   }
 }
 
-bool LissajousGenerator::activate(void)
+bool LissajousGenerator::activate(const ros::Time &t)
 {
   if(goal_set_)
   {
     active_ = true;
-    start_time_ = ros::Time::now();
+    start_time_ = t;
   }
   return active_;
 }
@@ -247,7 +249,7 @@ void LissajousGenerator::deactivate(void)
   active_ = false;
 }
 
-bool LissajousGenerator::isActive(void)
+bool LissajousGenerator::isActive(void) const
 {
   return active_;
 }
@@ -262,15 +264,12 @@ bool LissajousGenerator::status() const
   return goal_reached_ ? kr_tracker_msgs::TrackerStatus::SUCCEEDED : kr_tracker_msgs::TrackerStatus::ACTIVE;
 }
 
-float LissajousGenerator::timeRemaining(void)
+float LissajousGenerator::timeRemaining(const ros::Time &t) const
 {
-  ros::Time t_now = ros::Time::now();
-  float time_elapsed = (t_now - start_time_).toSec();
-  return total_time_ - time_elapsed;
+  return total_time_ - timeElapsed(t);
 }
 
-float LissajousGenerator::timeElapsed(void)
+float LissajousGenerator::timeElapsed(const ros::Time &t) const
 {
-  ros::Time t_now = ros::Time::now();
-  return (t_now - start_time_).toSec();
+  return (t - start_time_).toSec();
 }
@@ -1,8 +1,9 @@
-#include <actionlib/server/simple_action_server.h>
 #include <kr_tracker_msgs/LissajousTrackerAction.h>
 #include <kr_tracker_msgs/TrackerStatus.h>
+#include <kr_trackers/goal_server.h>
 #include <kr_trackers/initial_conditions.h>
 #include <kr_trackers/lissajous_generator.h>
+#include <kr_trackers/preview.h>
 #include <kr_trackers_manager/Tracker.h>
 #include <std_srvs/Trigger.h>
 
@@ -15,17 +16,26 @@ class LissajousTracker : public kr_trackers_manager::Tracker
  public:
   LissajousTracker(void);
   void Initialize(const ros::NodeHandle &nh);
+  bool InitializeOffline(const kr_trackers_manager::OfflineParams &params);
+  bool replay(const std::string &topic, const uint8_t *data, uint32_t size);
   bool Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd);
   void Deactivate(void);
 
   kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &msg);
+  void observe(const nav_msgs::Odometry::ConstPtr &msg) {}
   uint8_t status() const;
 
+  bool preview(const ros::Time &t0, float dt, unsigned int n, kr_tracker_msgs::TrackerPreview &preview) const;
+
  private:
+  // Read the params and set up the action server, from a ros::NodeHandle or OfflineParams
+  template <typename NodeHandle>
+  void init(const NodeHandle &priv_nh);
+
   void goal_callback(void);
   void preempt_callback(void);
 
-  typedef actionlib::SimpleActionServer<kr_tracker_msgs::LissajousTrackerAction> ServerType;
+  typedef GoalServer<kr_tracker_msgs::LissajousTrackerAction> ServerType;
   std::shared_ptr<ServerType> tracker_server_;
   ros::Publisher path_pub_;
 
@@ -39,11 +49,10 @@ class LissajousTracker : public kr_trackers_manager::Tracker
 
 LissajousTracker::LissajousTracker(void) : traj_start_set_(false) {}
 
-void LissajousTracker::Initialize(const ros::NodeHandle &nh)
+template <typename NodeHandle>
+void LissajousTracker::init(const NodeHandle &priv_nh)
 {
-  ros::NodeHandle priv_nh(nh, "lissajous_tracker");
-  priv_nh.param<std::string>("frame_id", frame_id_, "world");
-  path_pub_ = priv_nh.advertise<nav_msgs::Path>("lissajous_path", 1);
+  priv_nh.param("frame_id", frame_id_, std::string("world"));
 
   tracker_server_ = std::shared_ptr<ServerType>(new ServerType(priv_nh, "LissajousTracker", false));
   tracker_server_->registerGoalCallback(boost::bind(&LissajousTracker::goal_callback, this));
@@ -51,6 +60,24 @@ void LissajousTracker::Initialize(const ros::NodeHandle &nh)
   tracker_server_->start();
 }
 
+void LissajousTracker::Initialize(const ros::NodeHandle &nh)
+{
+  ros::NodeHandle priv_nh(nh, "lissajous_tracker");
+  init(priv_nh);
+  path_pub_ = priv_nh.advertise<nav_msgs::Path>("lissajous_path", 1);
+}
+
+bool LissajousTracker::InitializeOffline(const kr_trackers_manager::OfflineParams &params)
+{
+  init(kr_trackers_manager::OfflineParams(params, "lissajous_tracker"));
+  return true;
+}
+
+bool LissajousTracker::replay(const std::string &topic, const uint8_t *data, uint32_t size)
+{
+  return tracker_server_->replay(topic, data, size);
+}
+
 bool LissajousTracker::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
 {
   // Only allow activation if a goal has been set
@@ -61,7 +88,7 @@ bool LissajousTracker::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cm
       ROS_WARN("LissajousTracker::Activate: goal_set is true but action server has no active goal - not activating.");
       return false;
     }
-    return generator_.activate();
+    return generator_.activate(now());
   }
   return false;
 }
@@ -85,6 +112,8 @@ kr_mav_msgs::PositionCommand::ConstPtr LissajousTracker::update(const nav_msgs::
     return kr_mav_msgs::PositionCommand::Ptr();
   }
 
+  const ros::Time t_now = now();
+
   if(!traj_start_set_)
   {
     traj_start_set_ = true;
@@ -99,20 +128,21 @@ kr_mav_msgs::PositionCommand::ConstPtr LissajousTracker::update(const nav_msgs::
     double dt = 0.1;
     nav_msgs::Path path;
     path.header.frame_id = frame_id_;
-    path.header.stamp = ros::Time::now();
+    path.header.stamp = t_now;
     generator_.generatePath(path, initial_pt, dt);
-    path_pub_.publish(path);
+    if(path_pub_)
+      path_pub_.publish(path);
   }
 
   // Set gains
-  kr_mav_msgs::PositionCommand::Ptr cmd = generator_.getPositionCmd();
+  kr_mav_msgs::PositionCommand::Ptr cmd = generator_.getPositionCmd(t_now);
   if(cmd == NULL)
   {
     return cmd;
   }
   else
   {
-    cmd->header.stamp = ros::Time::now();
+    cmd->header.stamp = t_now;
     cmd->header.frame_id = msg->header.frame_id;
     cmd->position.x += ICs_.pos()(0);
     cmd->position.y += ICs_.pos()(1);
@@ -123,7 +153,7 @@ kr_mav_msgs::PositionCommand::ConstPtr LissajousTracker::update(const nav_msgs::
     if(!generator_.status())
     {
       kr_tracker_msgs::LissajousTrackerFeedback feedback;
-      feedback.time_to_completion = generator_.timeRemaining();
+      feedback.time_to_completion = generator_.timeRemaining(t_now);
       tracker_server_->publishFeedback(feedback);
 
       Eigen::Vector3d position_current =
@@ -138,7 +168,7 @@ kr_mav_msgs::PositionCommand::ConstPtr LissajousTracker::update(const nav_msgs::
       result.y = msg->pose.pose.position.y;
       result.z = msg->pose.pose.position.z;
       result.yaw = ICs_.yaw();  // TODO: Change this to the yaw from msg
-      result.duration = generator_.timeElapsed();
+      result.duration = generator_.timeElapsed(t_now);
       result.length = distance_traveled_;
       tracker_server_->setSucceeded(result);
     }
@@ -152,6 +182,25 @@ uint8_t LissajousTracker::status() const
                                        static_cast<uint8_t>(kr_tracker_msgs::TrackerStatus::SUCCEEDED);
 }
 
+bool LissajousTracker::preview(const ros::Time &t0, float dt, unsigned int n,
+                               kr_tracker_msgs::TrackerPreview &preview) const
+{
+  // The start position is only known after the next update
+  if(!generator_.isActive() || !traj_start_set_)
+    return false;
+
+  const double t = generator_.timeElapsed(t0);
+  Eigen::Vector3f pos, vel, acc, jrk;
+  double yaw, yaw_dot;
+  for(unsigned int i = 0; i < n; i++)
+  {
+    generator_.evaluate(t + i * dt, pos, vel, acc, jrk, yaw, yaw_dot);
+    setPreviewSample(preview, i, pos + ICs_.pos(), vel, acc, yaw + ICs_.yaw(), yaw_dot);
+  }
+  preview.num_samples = n;
+  return true;
+}
+
 void LissajousTracker::goal_callback(void)
 {
   // If another goal is already active, cancel that goal
@@ -178,7 +227,7 @@ void LissajousTracker::goal_callback(void)
 
   traj_start_set_ = false;
   distance_traveled_ = 0;
-  generator_.activate();
+  generator_.activate(now());
 }
 
 void LissajousTracker::preempt_callback(void)
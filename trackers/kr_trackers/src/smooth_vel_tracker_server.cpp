@@ -1,7 +1,8 @@
-#include <actionlib/server/simple_action_server.h>
 #include <kr_tracker_msgs/LineTrackerAction.h>
 #include <kr_tracker_msgs/TrackerStatus.h>
+#include <kr_trackers/goal_server.h>
 #include <kr_trackers/initial_conditions.h>
+#include <kr_trackers/preview.h>
 #include <kr_trackers_manager/Tracker.h>
 #include <ros/ros.h>
 
@@ -14,17 +15,30 @@ class SmoothVelTracker : public kr_trackers_manager::Tracker
   SmoothVelTracker(void);
 
   void Initialize(const ros::NodeHandle &nh);
+  bool InitializeOffline(const kr_trackers_manager::OfflineParams &params);
+  bool replay(const std::string &topic, const uint8_t *data, uint32_t size);
   bool Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd);
   void Deactivate(void);
 
   kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &msg);
+  void observe(const nav_msgs::Odometry::ConstPtr &msg);
   uint8_t status() const;
 
+  bool preview(const ros::Time &t0, float dt, unsigned int n, kr_tracker_msgs::TrackerPreview &preview) const;
+
  private:
+  // Read the params and set up the action server, from a ros::NodeHandle or OfflineParams
+  template <typename NodeHandle>
+  void init(const NodeHandle &priv_nh);
+
   void goal_callback();
   void preempt_callback();
 
-  using ServerType = actionlib::SimpleActionServer<kr_tracker_msgs::LineTrackerAction>;
+  // Evaluate the trajectory at t seconds from start_time_
+  void evaluate(float t, Eigen::Vector3f &pos, Eigen::Vector3f &vel, Eigen::Vector3f &acc, Eigen::Vector3f &jrk,
+                float &yaw, float &yaw_dot) const;
+
+  using ServerType = GoalServer<kr_tracker_msgs::LineTrackerAction>;
 
   // Action server that takes a goal.
   // Must be a pointer, because plugin does not support a constructor
@@ -48,10 +62,9 @@ class SmoothVelTracker : public kr_trackers_manager::Tracker
 
 SmoothVelTracker::SmoothVelTracker(void) : goal_set_(false), goal_reached_(true), active_(false) {}
 
-void SmoothVelTracker::Initialize(const ros::NodeHandle &nh)
+template <typename NodeHandle>
+void SmoothVelTracker::init(const NodeHandle &priv_nh)
 {
-  ros::NodeHandle priv_nh(nh, "smooth_vel_tracker");
-
   // Set up the action server.
   tracker_server_ = std::unique_ptr<ServerType>(new ServerType(priv_nh, "SmoothVelTracker", false));
   tracker_server_->registerGoalCallback(boost::bind(&SmoothVelTracker::goal_callback, this));
@@ -60,6 +73,23 @@ void SmoothVelTracker::Initialize(const ros::NodeHandle &nh)
   tracker_server_->start();
 }
 
+void SmoothVelTracker::Initialize(const ros::NodeHandle &nh)
+{
+  ros::NodeHandle priv_nh(nh, "smooth_vel_tracker");
+  init(priv_nh);
+}
+
+bool SmoothVelTracker::InitializeOffline(const kr_trackers_manager::OfflineParams &params)
+{
+  init(kr_trackers_manager::OfflineParams(params, "smooth_vel_tracker"));
+  return true;
+}
+
+bool SmoothVelTracker::replay(const std::string &topic, const uint8_t *data, uint32_t size)
+{
+  return tracker_server_->replay(topic, data, size);
+}
+
 bool SmoothVelTracker::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
 {
   // Only allow activation if a goal has been set
@@ -97,7 +127,7 @@ kr_mav_msgs::PositionCommand::ConstPtr SmoothVelTracker::update(const nav_msgs::
 
   prev_pos_ = current_pos;
 
-  const ros::Time t_now = ros::Time::now();
+  const ros::Time t_now = now();
 
   if(goal_set_)
   {
@@ -111,28 +141,20 @@ kr_mav_msgs::PositionCommand::ConstPtr SmoothVelTracker::update(const nav_msgs::
   cmd->header.frame_id = msg->header.frame_id;
 
   // Get elapsed time
-  const ros::Duration elapsed_time = t_now - start_time_;
-  const float t = elapsed_time.toSec();
-  const float ts = t / ramp_time_;  // scaled time
-  const float ts2 = ts * ts;
-  const float ts3 = ts2 * ts;
-  const float ts4 = ts3 * ts;
-  const float ts5 = ts4 * ts;
-  const float ts6 = ts5 * ts;
-  const float ts7 = ts6 * ts;
-  const float ts8 = ts7 * ts;
+  const float t = (t_now - start_time_).toSec();
 
-  // Test each case to generate trajectory
   Eigen::Vector3f pos, vel, acc, jrk;
+  float yaw, yaw_dot;
+  evaluate(t, pos, vel, acc, jrk, yaw, yaw_dot);
+  cmd->position.x = pos(0), cmd->position.y = pos(1), cmd->position.z = pos(2);
+  cmd->velocity.x = vel(0), cmd->velocity.y = vel(1), cmd->velocity.z = vel(2);
+  cmd->acceleration.x = acc(0), cmd->acceleration.y = acc(1), cmd->acceleration.z = acc(2);
+  cmd->jerk.x = jrk(0), cmd->jerk.y = jrk(1), cmd->jerk.z = jrk(2);
+  cmd->yaw = yaw;
+  cmd->yaw_dot = yaw_dot;
+
   if(t > total_time_)
   {
-    pos = start_pos_ + total_dist_ * dir_;
-    cmd->position.x = pos(0), cmd->position.y = pos(1), cmd->position.z = pos(2);
-    cmd->velocity.x = 0, cmd->velocity.y = 0, cmd->velocity.z = 0;
-    cmd->acceleration.x = 0, cmd->acceleration.y = 0, cmd->acceleration.z = 0;
-    cmd->jerk.x = 0, cmd->jerk.y = 0, cmd->jerk.z = 0;
-    cmd->yaw = goal_yaw_;
-    cmd->yaw_dot = 0;
     goal_reached_ = true;
     if(tracker_server_->isActive())
     {
@@ -149,6 +171,45 @@ kr_mav_msgs::PositionCommand::ConstPtr SmoothVelTracker::update(const nav_msgs::
       current_traj_length_ = 0.0;
     }
   }
+
+  ICs_.set_from_cmd(cmd);
+
+  if(!goal_reached_)
+  {
+    kr_tracker_msgs::LineTrackerFeedback feedback;
+    Eigen::Vector3f goal = start_pos_ + total_dist_ * dir_;
+    feedback.distance_from_goal = (current_pos - goal).norm();
+    tracker_server_->publishFeedback(feedback);
+  }
+
+  return cmd;
+}
+
+void SmoothVelTracker::observe(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  ICs_.set_from_odom(msg);
+}
+
+void SmoothVelTracker::evaluate(float t, Eigen::Vector3f &pos, Eigen::Vector3f &vel, Eigen::Vector3f &acc,
+                                Eigen::Vector3f &jrk, float &yaw, float &yaw_dot) const
+{
+  const float ts = t / ramp_time_;  // scaled time
+  const float ts2 = ts * ts;
+  const float ts3 = ts2 * ts;
+  const float ts4 = ts3 * ts;
+  const float ts5 = ts4 * ts;
+  const float ts6 = ts5 * ts;
+  const float ts7 = ts6 * ts;
+  const float ts8 = ts7 * ts;
+
+  // Test each case to generate trajectory
+  if(t > total_time_)
+  {
+    pos = start_pos_ + total_dist_ * dir_;
+    vel = acc = jrk = Eigen::Vector3f::Zero();
+    yaw = goal_yaw_;
+    yaw_dot = 0;
+  }
   else if(t < ramp_time_)
   {
     float dist = ramp_time_ * (vel_coeffs_(0) / 2 * ts2 + vel_coeffs_(1) / 3 * ts3 + vel_coeffs_(2) / 4 * ts4 +
@@ -166,29 +227,22 @@ kr_mav_msgs::PositionCommand::ConstPtr SmoothVelTracker::update(const nav_msgs::
     vel = speed * dir_;
     acc = accel * dir_;
     jrk = jerk * dir_;
-    cmd->position.x = pos(0), cmd->position.y = pos(1), cmd->position.z = pos(2);
-    cmd->velocity.x = vel(0), cmd->velocity.y = vel(1), cmd->velocity.z = vel(2);
-    cmd->acceleration.x = acc(0), cmd->acceleration.y = acc(1), cmd->acceleration.z = acc(2);
-    cmd->jerk.x = jrk(0), cmd->jerk.y = jrk(1), cmd->jerk.z = jrk(2);
-    cmd->yaw = start_yaw_ + yaw_dot_max_ / (2 * ramp_time_) * t * t;
-    cmd->yaw_dot = yaw_dot_max_ / ramp_time_ * t;
+    yaw = start_yaw_ + yaw_dot_max_ / (2 * ramp_time_) * t * t;
+    yaw_dot = yaw_dot_max_ / ramp_time_ * t;
   }
   else if(t < total_time_ - ramp_time_)
   {
     float dist = ramp_dist_ + target_speed_ * (t - ramp_time_);
     pos = start_pos_ + dist * dir_;
     vel = target_speed_ * dir_;
-    cmd->position.x = pos(0), cmd->position.y = pos(1), cmd->position.z = pos(2);
-    cmd->velocity.x = vel(0), cmd->velocity.y = vel(1), cmd->velocity.z = vel(2);
-    cmd->acceleration.x = 0, cmd->acceleration.y = 0, cmd->acceleration.z = 0;
-    cmd->jerk.x = 0, cmd->jerk.y = 0, cmd->jerk.z = 0;
-    cmd->yaw = start_yaw_ + yaw_dot_max_ * (t - ramp_time_ / 2);
-    cmd->yaw_dot = yaw_dot_max_;
+    acc = jrk = Eigen::Vector3f::Zero();
+    yaw = start_yaw_ + yaw_dot_max_ * (t - ramp_time_ / 2);
+    yaw_dot = yaw_dot_max_;
   }
   else
   {
-    const float te = total_time_ - elapsed_time.toSec();  // time from end
-    const float tes = te / ramp_time_;                    // scaled time from end
+    const float te = total_time_ - t;   // time from end
+    const float tes = te / ramp_time_;  // scaled time from end
     const float tes2 = tes * tes;
     const float tes3 = tes2 * tes;
     const float tes4 = tes3 * tes;
@@ -214,24 +268,28 @@ kr_mav_msgs::PositionCommand::ConstPtr SmoothVelTracker::update(const nav_msgs::
     vel = speed * dir_;
     acc = -accel * dir_;
     jrk = jerk * dir_;
-    cmd->position.x = pos(0), cmd->position.y = pos(1), cmd->position.z = pos(2);
-    cmd->velocity.x = vel(0), cmd->velocity.y = vel(1), cmd->velocity.z = vel(2);
-    cmd->acceleration.x = acc(0), cmd->acceleration.y = acc(1), cmd->acceleration.z = acc(2);
-    cmd->jerk.x = jrk(0), cmd->jerk.y = jrk(1), cmd->jerk.z = jrk(2);
-    cmd->yaw = goal_yaw_ - yaw_dot_max_ / (2 * ramp_time_) * (total_time_ - t) * (total_time_ - t);
-    cmd->yaw_dot = yaw_dot_max_ - yaw_dot_max_ / ramp_time_ * (t - total_time_ + ramp_time_);
+    yaw = goal_yaw_ - yaw_dot_max_ / (2 * ramp_time_) * (total_time_ - t) * (total_time_ - t);
+    yaw_dot = yaw_dot_max_ - yaw_dot_max_ / ramp_time_ * (t - total_time_ + ramp_time_);
   }
-  ICs_.set_from_cmd(cmd);
+}
 
-  if(!goal_reached_)
+bool SmoothVelTracker::preview(const ros::Time &t0, float dt, unsigned int n,
+                               kr_tracker_msgs::TrackerPreview &preview) const
+{
+  // The start time is only set in the next update
+  if(!active_ || goal_set_)
+    return false;
+
+  const float t = (t0 - start_time_).toSec();
+  Eigen::Vector3f pos, vel, acc, jrk;
+  float yaw, yaw_dot;
+  for(unsigned int i = 0; i < n; i++)
   {
-    kr_tracker_msgs::LineTrackerFeedback feedback;
-    Eigen::Vector3f goal = start_pos_ + total_dist_ * dir_;
-    feedback.distance_from_goal = (current_pos - goal).norm();
-    tracker_server_->publishFeedback(feedback);
+    evaluate(std::max(t + i * dt, 0.0f), pos, vel, acc, jrk, yaw, yaw_dot);
+    setPreviewSample(preview, i, pos, vel, acc, yaw, yaw_dot);
   }
-
-  return cmd;
+  preview.num_samples = n;
+  return true;
 }
 
 void SmoothVelTracker::preempt_callback()
@@ -240,7 +298,7 @@ void SmoothVelTracker::preempt_callback()
   tracker_server_->setPreempted();
 
   // TODO: How much overshoot will this cause at high velocities?
-  total_time_ = (ros::Time::now() - start_time_).toSec();
+  total_time_ = (now() - start_time_).toSec();
   total_dist_ = (ICs_.pos() - start_pos_).norm();
   dir_ = (ICs_.pos() - start_pos_).normalized();
   goal_set_ = false;
@@ -1,9 +1,16 @@
 #include <kr_trackers/traj_gen.h>
 
 #include <Eigen/LU>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 TrajectoryGenerator::TrajectoryGenerator(unsigned int continuous_derivative_order, unsigned int minimize_derivative)
-    : N_(2 * (continuous_derivative_order + 1)), R_(minimize_derivative)
+    : N_(2 * (continuous_derivative_order + 1)),
+      R_(minimize_derivative),
+      max_vel_(std::numeric_limits<float>::infinity()),
+      max_acc_(std::numeric_limits<float>::infinity()),
+      max_jrk_(std::numeric_limits<float>::infinity())
 {
 }
 
@@ -13,7 +20,7 @@ void TrajectoryGenerator::setInitialConditions(const Vec3f &pos, const vec_Vec3f
   waypoints_.push_back(pos);
 
   initial_derivatives_.clear();
-  initial_derivatives_.resize(N_ / 2);
+  initial_derivatives_.resize(N_ / 2, Vec3f::Zero());
   for(size_t i = 0; i < std::min(initial_derivatives_.size(), derivatives.size()); ++i)
   {
     initial_derivatives_[i] = derivatives[i];
@@ -34,6 +41,9 @@ void TrajectoryGenerator::clearWaypoints(void)
   coefficients_.clear();
   waypoint_times_.clear();
   initial_derivatives_.clear();
+  input_waypoints_.clear();
+  input_times_.clear();
+  knot_index_.clear();
 }
 
 std::vector<float> TrajectoryGenerator::computeTimesTrapezoidSpeed(float v_des, float a_des) const
@@ -113,6 +123,11 @@ const std::vector<float> &TrajectoryGenerator::getWaypointTimes() const
   return waypoint_times_;
 }
 
+Eigen::MatrixX3f TrajectoryGenerator::getCoefficients(const unsigned int segment) const
+{
+  return coefficients_[segment];
+}
+
 float TrajectoryGenerator::getTotalTime() const
 {
   return waypoint_times_.back();
@@ -147,7 +162,26 @@ bool TrajectoryGenerator::calculate(const std::vector<float> &waypoint_times)
     return false;
   }
 
-  const unsigned int num_waypoints = waypoints_.size();
+  // End at rest
+  const vec_Vec3f final_derivatives(N_ / 2, Vec3f::Zero());
+  if(!solve(waypoints_, waypoint_times, initial_derivatives_, final_derivatives, coefficients_))
+    return false;
+
+  waypoint_times_ = waypoint_times;
+
+  input_waypoints_ = waypoints_;
+  input_times_ = waypoint_times_;
+  knot_index_.resize(waypoints_.size());
+  for(unsigned int i = 0; i < knot_index_.size(); i++)
+    knot_index_[i] = i;
+  return true;
+}
+
+bool TrajectoryGenerator::solve(const vec_Vec3f &waypoints, const std::vector<float> &waypoint_times,
+                                const vec_Vec3f &initial_derivatives, const vec_Vec3f &final_derivatives,
+                                vec_MatrixX3f &coefficients) const
+{
+  const unsigned int num_waypoints = waypoints.size();
   const unsigned int num_segments = num_waypoints - 1;
   // printf("num_segments: %d\n", num_segments);
 
@@ -155,40 +189,8 @@ bool TrajectoryGenerator::calculate(const std::vector<float> &waypoint_times)
   Eigen::MatrixXf Q = Eigen::MatrixXf::Zero(num_segments * N_, num_segments * N_);  // Quadratic cost matrix
   for(unsigned int i = 0; i < num_segments; i++)
   {
-    float seg_time = waypoint_times[i + 1] - waypoint_times[i];
-    for(unsigned int n = 0; n < N_; n++)
-    {
-      // A_0
-      if(n < N_ / 2)
-      {
-        int val = 1;
-        for(unsigned int m = 0; m < n; m++)
-          val *= (n - m);
-        A(i * N_ + n, i * N_ + n) = val;
-      }
-      // A_T
-      for(unsigned int r = 0; r < N_ / 2; r++)
-      {
-        if(r <= n)
-        {
-          int val = 1;
-          for(unsigned int m = 0; m < r; m++)
-            val *= (n - m);
-          A(i * N_ + N_ / 2 + r, i * N_ + n) = val * powInt(seg_time, n - r);
-        }
-      }
-      // Q
-      for(unsigned int r = 0; r < N_; r++)
-      {
-        if(r >= R_ && n >= R_)
-        {
-          int val = 1;
-          for(unsigned int m = 0; m < R_; m++)
-            val *= (r - m) * (n - m);
-          Q(i * N_ + r, i * N_ + n) = 2 * val * powInt(seg_time, r + n - 2 * R_ + 1) / (r + n - 2 * R_ + 1);
-        }
-      }
-    }
+    const float seg_time = waypoint_times[i + 1] - waypoint_times[i];
+    segmentMatrices(seg_time, A.block(i * N_, i * N_, N_, N_), Q.block(i * N_, i * N_, N_, N_));
   }
   const unsigned int num_fixed_derivatives = num_waypoints - 2 + N_;
   const unsigned int num_free_derivatives = num_waypoints * N_ / 2 - num_fixed_derivatives;
@@ -227,21 +229,21 @@ bool TrajectoryGenerator::calculate(const std::vector<float> &waypoint_times)
   // Fixed derivatives
   Eigen::MatrixX3f Df = Eigen::MatrixX3f(num_fixed_derivatives, 3);
   // First point
-  Df.row(0) = waypoints_[0].transpose();
+  Df.row(0) = waypoints[0].transpose();
   for(unsigned int i = 1; i < N_ / 2; i++)
   {
-    Df.row(i) = initial_derivatives_[i - 1].transpose();
+    Df.row(i) = initial_derivatives[i - 1].transpose();
   }
   // Middle waypoints
   for(unsigned int i = 1; i < num_waypoints - 1; i++)
   {
-    Df.row((N_ / 2) - 1 + i) = waypoints_[i].transpose();
+    Df.row((N_ / 2) - 1 + i) = waypoints[i].transpose();
   }
   // End point
-  Df.row(N_ / 2 + (num_waypoints - 2)) = waypoints_[num_waypoints - 1].transpose();
+  Df.row(N_ / 2 + (num_waypoints - 2)) = waypoints[num_waypoints - 1].transpose();
   for(unsigned int i = 1; i < N_ / 2; i++)
   {
-    Df.row((N_ / 2) + (num_waypoints - 2) + i) = Vec3f::Zero().transpose();
+    Df.row((N_ / 2) + (num_waypoints - 2) + i) = final_derivatives[i - 1].transpose();
   }
   // std::cout << "Df:\n" << Df << std::endl;
   Eigen::MatrixX3f D = Eigen::MatrixX3f(num_waypoints * N_ / 2, 3);
@@ -254,55 +256,335 @@ bool TrajectoryGenerator::calculate(const std::vector<float> &waypoint_times)
   }
   Eigen::MatrixX3f d = M * D;
   // std::cout << "d:\n" << d << std::endl;
-  coefficients_.clear();
+  coefficients.clear();
+  coefficients.reserve(num_segments);
   for(unsigned int i = 0; i < num_segments; i++)
   {
     const Eigen::MatrixX3f p = A.block(i * N_, i * N_, N_, N_).partialPivLu().solve(d.block(i * N_, 0, N_, 3));
     // std::cout << "p:\n" << p << std::endl;
-    coefficients_.push_back(p);
+    coefficients.push_back(p);
   }
-  waypoint_times_ = waypoint_times;
   return true;
 }
 
-bool TrajectoryGenerator::getCommand(const float time, Vec3f &pos, Vec3f &vel, Vec3f &acc, Vec3f &jrk) const
+void TrajectoryGenerator::segmentMatrices(const float seg_time, Eigen::Ref<Eigen::MatrixXf> A,
+                                          Eigen::Ref<Eigen::MatrixXf> Q) const
+{
+  for(unsigned int n = 0; n < N_; n++)
+  {
+    // A_0
+    if(n < N_ / 2)
+    {
+      int val = 1;
+      for(unsigned int m = 0; m < n; m++)
+        val *= (n - m);
+      A(n, n) = val;
+    }
+    // A_T
+    for(unsigned int r = 0; r < N_ / 2; r++)
+    {
+      if(r <= n)
+      {
+        int val = 1;
+        for(unsigned int m = 0; m < r; m++)
+          val *= (n - m);
+        A(N_ / 2 + r, n) = val * powInt(seg_time, n - r);
+      }
+    }
+    // Q
+    for(unsigned int r = 0; r < N_; r++)
+    {
+      if(r >= R_ && n >= R_)
+      {
+        int val = 1;
+        for(unsigned int m = 0; m < R_; m++)
+          val *= (r - m) * (n - m);
+        Q(r, n) = 2 * val * powInt(seg_time, r + n - 2 * R_ + 1) / (r + n - 2 * R_ + 1);
+      }
+    }
+  }
+}
+
+bool TrajectoryGenerator::commandSegment(const float time, unsigned int &segment) const
 {
   if(time < 0)
     return false;
 
-  int cur_idx = -1;
   for(unsigned int i = 1; i < waypoint_times_.size(); i++)
   {
     if(time <= waypoint_times_[i])
     {
-      cur_idx = i - 1;
-      break;
+      segment = i - 1;
+      return true;
     }
   }
-  if(cur_idx == -1)
+  return false;
+}
+
+bool TrajectoryGenerator::getCommand(const float time, Vec3f &pos, Vec3f &vel, Vec3f &acc, Vec3f &jrk) const
+{
+  unsigned int segment;
+  if(!commandSegment(time, segment))
     return false;
 
-  const float t_traj = time - waypoint_times_[cur_idx];
-  const Eigen::MatrixX3f &p = coefficients_[cur_idx];
+  evaluate(segment, time - waypoint_times_[segment], pos, vel, acc, jrk);
+  return true;
+}
+
+void TrajectoryGenerator::evaluate(const unsigned int segment, const float t, Vec3f &pos, Vec3f &vel, Vec3f &acc,
+                                   Vec3f &jrk) const
+{
+  const Eigen::MatrixX3f &p = coefficients_[segment];
   pos = Vec3f::Zero();
   for(unsigned int i = 0; i < p.rows(); i++)
-    pos += p.row(i).transpose() * powInt(t_traj, i);
+    pos += p.row(i).transpose() * powInt(t, i);
 
   vel = Vec3f::Zero();
   for(unsigned int i = 1; i < p.rows(); i++)
-    vel += p.row(i).transpose() * (i * powInt(t_traj, i - 1));
+    vel += p.row(i).transpose() * (i * powInt(t, i - 1));
 
   acc = Vec3f::Zero();
   for(unsigned int i = 2; i < p.rows(); i++)
-    acc += p.row(i).transpose() * (i * (i - 1) * powInt(t_traj, i - 2));
+    acc += p.row(i).transpose() * (i * (i - 1) * powInt(t, i - 2));
 
   jrk = Vec3f::Zero();
   for(unsigned int i = 3; i < p.rows(); i++)
-    jrk += p.row(i).transpose() * (i * (i - 1) * (i - 2) * powInt(t_traj, i - 3));
+    jrk += p.row(i).transpose() * (i * (i - 1) * (i - 2) * powInt(t, i - 3));
+}
 
+unsigned int TrajectoryGenerator::findSegment(const float time) const
+{
+  unsigned int idx = 0;
+  while(idx + 2 < waypoint_times_.size() && time >= waypoint_times_[idx + 1])
+    idx++;
+  return idx;
+}
+
+void TrajectoryGenerator::getDerivatives(const unsigned int segment, const float t, vec_Vec3f &derivatives) const
+{
+  // Position and the derivatives which are kept continuous
+  const Eigen::MatrixX3f &p = coefficients_[segment];
+  derivatives.assign(N_ / 2, Vec3f::Zero());
+  for(unsigned int r = 0; r < N_ / 2; r++)
+  {
+    for(unsigned int i = r; i < p.rows(); i++)
+    {
+      float val = 1;
+      for(unsigned int m = 0; m < r; m++)
+        val *= (i - m);
+      derivatives[r] += p.row(i).transpose() * (val * powInt(t, i - r));
+    }
+  }
+}
+
+bool TrajectoryGenerator::replan(const float time, const vec_Vec3f &waypoints, const std::vector<float> &waypoint_times,
+                                 const unsigned int window)
+{
+  if(coefficients_.empty() || waypoints.size() < 2 || waypoint_times.size() != waypoints.size())
+    return false;
+
+  // Cannot splice onto a trajectory which has already finished, the caller should start a new one from the current
+  // state instead
+  if(time >= waypoint_times_.back())
+    return false;
+
+  const unsigned int num_old = input_waypoints_.size();
+  const unsigned int num_new = waypoints.size();
+  const int offset = static_cast<int>(num_new) - static_cast<int>(num_old);
+
+  // A waypoint is unchanged if both its position and the duration of the segment leading to it are the same as given
+  // by the caller last time
+  const auto unchanged = [&](unsigned int i_old, unsigned int i_new) {
+    const float eps = 1e-4f;
+    if((waypoints[i_new] - input_waypoints_[i_old]).norm() > eps)
+      return false;
+    if(i_old == 0 || i_new == 0)
+      return i_old == i_new && std::abs(waypoint_times[0] - input_times_[0]) < eps;
+    const float old_duration = input_times_[i_old] - input_times_[i_old - 1];
+    const float new_duration = waypoint_times[i_new] - waypoint_times[i_new - 1];
+    return std::abs(new_duration - old_duration) < eps;
+  };
+
+  // First and last changed waypoint, the unchanged tail is matched from the end so that insertions and deletions
+  // in the middle keep it
+  unsigned int first = 0;
+  while(first < std::min(num_old, num_new) && unchanged(first, first))
+    first++;
+  if(first == num_old && first == num_new)
+    return true;
+
+  unsigned int last = num_new - 1;
+  while(last > first && static_cast<int>(last) - offset > static_cast<int>(first) && unchanged(last - offset, last))
+    last--;
+
+  // The waypoint we are currently flying away from
+  unsigned int current = 0;
+  while(current + 2 < num_old && time >= waypoint_times_[knot_index_[current + 1]])
+    current++;
+  if(first <= current)
+    return false;
+
+  // The duration of the segment ending at new waypoint i. The unchanged segments keep the timing they are flown with,
+  // which can differ from the caller's after optimizeWaypointTimes().
+  const auto duration = [&](unsigned int i) {
+    if(i < first)
+      return waypoint_times_[knot_index_[i]] - waypoint_times_[knot_index_[i - 1]];
+    if(i > last)
+      return waypoint_times_[knot_index_[i - offset]] - waypoint_times_[knot_index_[i - offset - 1]];
+    return waypoint_times[i] - waypoint_times[i - 1];
+  };
+
+  // Start of the re-solved part, either an existing knot or, if the segment being flown changes, a new knot at the
+  // current time
+  unsigned int start, start_knot;
+  float first_duration;
+  vec_Vec3f initial_state;
+  vec_Vec3f knots;
+  std::vector<float> knot_times;
+  vec_MatrixX3f coefficients;
+  std::vector<unsigned int> knot_index;
+  if(first >= current + 2)
+  {
+    start = std::max(current + 1, first - 1 > window ? first - 1 - window : 0);
+    start_knot = knot_index_[start];
+    getDerivatives(start_knot - 1, waypoint_times_[start_knot] - waypoint_times_[start_knot - 1], initial_state);
+    first_duration = duration(start + 1);
+
+    knots.assign(waypoints_.begin(), waypoints_.begin() + start_knot + 1);
+    knot_times.assign(waypoint_times_.begin(), waypoint_times_.begin() + start_knot + 1);
+    coefficients.assign(coefficients_.begin(), coefficients_.begin() + start_knot);
+    knot_index.assign(knot_index_.begin(), knot_index_.begin() + start + 1);
+  }
+  else
+  {
+    start = current;
+    first_duration = duration(start + 1) - (time - waypoint_times_[knot_index_[start]]);
+    if(first_duration <= 0)
+      return false;
+
+    const unsigned int segment = findSegment(time);
+    getDerivatives(segment, time - waypoint_times_[segment], initial_state);
+
+    // The current segment is kept up to the current time, its coefficients are relative to its start so they stay
+    // valid for the shortened segment
+    knots.assign(waypoints_.begin(), waypoints_.begin() + segment + 1);
+    knot_times.assign(waypoint_times_.begin(), waypoint_times_.begin() + segment + 1);
+    coefficients.assign(coefficients_.begin(), coefficients_.begin() + segment + 1);
+    knot_index.assign(knot_index_.begin(), knot_index_.begin() + start + 1);
+    knots.push_back(initial_state[0]);
+    knot_times.push_back(time);
+  }
+
+  // End of the re-solved part, either the final waypoint or the knot where the unchanged tail starts
+  unsigned int end = last + 1 + window;
+  unsigned int tail_knot = 0;
+  vec_Vec3f final_state(N_ / 2, Vec3f::Zero());
+  if(end < num_new - 1)
+  {
+    tail_knot = knot_index_[end - offset];
+    getDerivatives(tail_knot, 0, final_state);
+  }
+  else
+    end = num_new - 1;
+
+  vec_Vec3f local_waypoints(1, knots.back());
+  std::vector<float> durations(1, first_duration);
+  for(unsigned int i = start + 1; i <= end; i++)
+  {
+    local_waypoints.push_back(waypoints[i]);
+    if(i > start + 1)
+      durations.push_back(duration(i));
+  }
+  const vec_Vec3f initial_derivatives(initial_state.begin() + 1, initial_state.end());
+  const vec_Vec3f final_derivatives(final_state.begin() + 1, final_state.end());
+
+  // The re-solved segments are stretched until they respect the limits given to optimizeWaypointTimes(), but unlike
+  // the full solve they are never shortened. Stretching a segment by k scales its velocity by 1/k, its acceleration by
+  // 1/k^2 and its jerk by 1/k^3.
+  std::vector<float> local_times;
+  vec_MatrixX3f local_coefficients;
+  for(int iter = 0;; iter++)
+  {
+    local_times.assign(1, knot_times.back());
+    for(const float d : durations)
+      local_times.push_back(local_times.back() + d);
+    if(!solve(local_waypoints, local_times, initial_derivatives, final_derivatives, local_coefficients))
+      return false;
+
+    bool within_limits = true;
+    for(unsigned int i = 0; i < durations.size(); i++)
+    {
+      float seg_max_vel, seg_max_acc, seg_max_jrk;
+      calcMax(local_coefficients[i], durations[i], seg_max_vel, seg_max_acc, seg_max_jrk);
+      const float stretch = std::max({seg_max_vel / max_vel_, std::sqrt(seg_max_acc / max_acc_),
+                                      std::cbrt(seg_max_jrk / max_jrk_)});
+      if(stretch > 1)
+      {
+        durations[i] *= std::max(stretch, 1.035f);
+        within_limits = false;
+      }
+    }
+    if(within_limits)
+      break;
+    if(iter == 20)
+      return false;
+  }
+
+  for(unsigned int i = start + 1; i <= end; i++)
+  {
+    knots.push_back(waypoints[i]);
+    knot_times.push_back(local_times[i - start]);
+    knot_index.push_back(knots.size() - 1);
+  }
+  coefficients.insert(coefficients.end(), local_coefficients.begin(), local_coefficients.end());
+
+  if(end < num_new - 1)
+  {
+    // The unchanged tail only moves in time
+    const float time_shift = local_times.back() - waypoint_times_[tail_knot];
+    const unsigned int end_knot = knots.size() - 1;
+    for(unsigned int k = tail_knot + 1; k < waypoints_.size(); k++)
+    {
+      knots.push_back(waypoints_[k]);
+      knot_times.push_back(waypoint_times_[k] + time_shift);
+    }
+    coefficients.insert(coefficients.end(), coefficients_.begin() + tail_knot, coefficients_.end());
+    for(unsigned int i = end + 1; i < num_new; i++)
+      knot_index.push_back(knot_index_[i - offset] - tail_knot + end_knot);
+  }
+
+  waypoints_ = knots;
+  waypoint_times_ = knot_times;
+  coefficients_ = coefficients;
+  input_waypoints_ = waypoints;
+  input_times_ = waypoint_times;
+  knot_index_ = knot_index;
   return true;
 }
 
+void TrajectoryGenerator::calcMax(const Eigen::MatrixX3f &p, const float seg_duration, float &max_vel, float &max_acc,
+                                  float &max_jrk)
+{
+  // Sampled like calcMaxPerSegment()
+  const unsigned int num_samples_per_seg = 10;
+  const float dt = seg_duration / num_samples_per_seg;
+  max_vel = 0, max_acc = 0, max_jrk = 0;
+  for(unsigned int sample_idx = 0; sample_idx < num_samples_per_seg; ++sample_idx)
+  {
+    const float t = sample_idx * dt;
+    Vec3f vel = Vec3f::Zero(), acc = Vec3f::Zero(), jrk = Vec3f::Zero();
+    for(unsigned int i = 1; i < p.rows(); i++)
+      vel += p.row(i).transpose() * (i * powInt(t, i - 1));
+    for(unsigned int i = 2; i < p.rows(); i++)
+      acc += p.row(i).transpose() * (i * (i - 1) * powInt(t, i - 2));
+    for(unsigned int i = 3; i < p.rows(); i++)
+      jrk += p.row(i).transpose() * (i * (i - 1) * (i - 2) * powInt(t, i - 3));
+    max_vel = std::max(max_vel, vel.norm());
+    max_acc = std::max(max_acc, acc.norm());
+    max_jrk = std::max(max_jrk, jrk.norm());
+  }
+}
+
 void TrajectoryGenerator::calcMaxPerSegment(std::vector<float> &max_vel, std::vector<float> &max_acc,
                                             std::vector<float> &max_jrk) const
 {
@@ -318,22 +600,12 @@ void TrajectoryGenerator::calcMaxPerSegment(std::vector<float> &max_vel, std::ve
     for(unsigned int sample_idx = 0; sample_idx < num_samples_per_seg; ++sample_idx)
     {
       const float t_traj = sample_idx * dt;
-      const Eigen::MatrixX3f &p = coefficients_[seg_idx];
-      Vec3f vel = Vec3f::Zero();
-      for(unsigned int i = 1; i < p.rows(); i++)
-        vel += p.row(i).transpose() * (i * powInt(t_traj, i - 1));
+      Vec3f pos, vel, acc, jrk;
+      evaluate(seg_idx, t_traj, pos, vel, acc, jrk);
       if(vel.norm() > seg_max_vel)
         seg_max_vel = vel.norm();
-
-      Vec3f acc = Vec3f::Zero();
-      for(unsigned int i = 2; i < p.rows(); i++)
-        acc += p.row(i).transpose() * (i * (i - 1) * powInt(t_traj, i - 2));
       if(acc.norm() > seg_max_acc)
         seg_max_acc = acc.norm();
-
-      Vec3f jrk = Vec3f::Zero();
-      for(unsigned int i = 3; i < p.rows(); i++)
-        jrk += p.row(i).transpose() * (i * (i - 1) * (i - 2) * powInt(t_traj, i - 3));
       if(jrk.norm() > seg_max_jrk)
         seg_max_jrk = jrk.norm();
     }
@@ -350,6 +622,13 @@ void TrajectoryGenerator::calcMaxPerSegment(std::vector<float> &max_vel, std::ve
 
 void TrajectoryGenerator::optimizeWaypointTimes(const float max_vel, const float max_acc, const float max_jrk)
 {
+  max_vel_ = max_vel;
+  max_acc_ = max_acc;
+  max_jrk_ = max_jrk;
+
+  // calculate() is used for the retimed solves, but replan() compares against the times given by the caller
+  const std::vector<float> input_times = input_times_;
+
   std::vector<float> segment_times;
   for(unsigned int i = 0; i < waypoint_times_.size() - 1; ++i)
     segment_times.push_back(waypoint_times_[i + 1] - waypoint_times_[i]);
@@ -409,4 +688,5 @@ void TrajectoryGenerator::optimizeWaypointTimes(const float max_vel, const float
       break;
     }
   }
+  input_times_ = input_times;
 }
@@ -0,0 +1,154 @@
+#include <kr_trackers/trajectory_file.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+static const char kTrajectoryFileMagic[4] = {'K', 'R', 'T', 'J'};
+static const uint32_t kTrajectoryFileVersion = 1;
+static const unsigned int kMaxCoefficients = 16;
+
+bool writeTrajectoryFile(const std::string &filename, const TrajectoryGenerator &traj_gen)
+{
+  const std::vector<float> &waypoint_times = traj_gen.getWaypointTimes();
+  if(waypoint_times.size() < 2)
+    return false;
+
+  TrajectoryFileHeader header;
+  std::memcpy(header.magic, kTrajectoryFileMagic, sizeof(header.magic));
+  header.version = kTrajectoryFileVersion;
+  header.num_segments = waypoint_times.size() - 1;
+  header.num_coefficients = traj_gen.getCoefficients(0).rows();
+
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if(!file)
+    return false;
+
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(waypoint_times.data()), waypoint_times.size() * sizeof(float));
+  for(unsigned int i = 0; i < header.num_segments; i++)
+  {
+    const Eigen::MatrixX3f p = traj_gen.getCoefficients(i);
+    file.write(reinterpret_cast<const char *>(p.data()), p.size() * sizeof(float));
+  }
+  return static_cast<bool>(file);
+}
+
+TrajectoryFile::TrajectoryFile()
+    : data_(nullptr), size_(0), num_coefficients_(0), num_segments_(0), times_(nullptr), coefficients_(nullptr)
+{
+}
+
+TrajectoryFile::~TrajectoryFile()
+{
+  close();
+}
+
+bool TrajectoryFile::open(const std::string &filename)
+{
+  close();
+
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    error_ = std::strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(TrajectoryFileHeader)))
+  {
+    error_ = "file too small";
+    ::close(fd);
+    return false;
+  }
+
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if(data == MAP_FAILED)
+  {
+    error_ = std::strerror(errno);
+    return false;
+  }
+
+  const TrajectoryFileHeader *header = static_cast<const TrajectoryFileHeader *>(data);
+  const size_t num_segments = header->num_segments, num_coefficients = header->num_coefficients;
+  const size_t expected_size = sizeof(TrajectoryFileHeader) + (num_segments + 1) * sizeof(float) +
+                               num_segments * num_coefficients * 3 * sizeof(float);
+  if(std::memcmp(header->magic, kTrajectoryFileMagic, sizeof(header->magic)) != 0 ||
+     header->version != kTrajectoryFileVersion)
+    error_ = "not a trajectory file or unsupported version";
+  else if(header->num_segments == 0 || header->num_coefficients == 0)
+    error_ = "empty trajectory";
+  else if(header->num_coefficients > kMaxCoefficients)
+    error_ = "polynomial order too high";
+  else if(static_cast<size_t>(st.st_size) != expected_size)
+    error_ = "file size does not match header";
+  else
+    error_.clear();
+
+  if(!error_.empty())
+  {
+    munmap(data, st.st_size);
+    return false;
+  }
+
+  data_ = data;
+  size_ = st.st_size;
+  filename_ = filename;
+  num_segments_ = header->num_segments;
+  num_coefficients_ = header->num_coefficients;
+  times_ = reinterpret_cast<const float *>(header + 1);
+  coefficients_ = times_ + num_segments_ + 1;
+  return true;
+}
+
+void TrajectoryFile::close()
+{
+  if(data_ != nullptr)
+    munmap(data_, size_);
+
+  data_ = nullptr;
+  size_ = 0;
+  filename_.clear();
+  num_coefficients_ = num_segments_ = 0;
+  times_ = coefficients_ = nullptr;
+}
+
+void TrajectoryFile::getCommand(float time, Vec3f &pos, Vec3f &vel, Vec3f &acc, Vec3f &jrk) const
+{
+  time = std::min(std::max(time, times_[0]), times_[num_segments_]);
+
+  // Last waypoint time not after the requested time, limited to the last segment
+  const unsigned int segment =
+      std::min<unsigned int>(std::upper_bound(times_ + 1, times_ + num_segments_ + 1, time) - (times_ + 1),
+                             num_segments_ - 1);
+  const float t = time - times_[segment];
+
+  const Eigen::Map<const Eigen::MatrixX3f> p(coefficients_ + segment * num_coefficients_ * 3, num_coefficients_, 3);
+  float t_pow[kMaxCoefficients];
+  t_pow[0] = 1;
+  for(unsigned int i = 1; i < num_coefficients_; i++)
+    t_pow[i] = t_pow[i - 1] * t;
+
+  pos = Vec3f::Zero();
+  vel = Vec3f::Zero();
+  acc = Vec3f::Zero();
+  jrk = Vec3f::Zero();
+  for(unsigned int i = 0; i < num_coefficients_; i++)
+  {
+    pos += p.row(i).transpose() * t_pow[i];
+    if(i >= 1)
+      vel += p.row(i).transpose() * (i * t_pow[i - 1]);
+    if(i >= 2)
+      acc += p.row(i).transpose() * (i * (i - 1) * t_pow[i - 2]);
+    if(i >= 3)
+      jrk += p.row(i).transpose() * (i * (i - 1) * (i - 2) * t_pow[i - 3]);
+  }
+}
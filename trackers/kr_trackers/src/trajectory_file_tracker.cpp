@@ -0,0 +1,382 @@
+#include <ros/ros.h>
+
+#include <memory>
+
+#include <kr_mav_msgs/PositionCommand.h>
+#include <kr_tracker_msgs/TrackerStatus.h>
+#include <kr_tracker_msgs/TrajectoryFileTrackerAction.h>
+#include <kr_trackers/goal_server.h>
+#include <kr_trackers/initial_conditions.h>
+#include <kr_trackers/preview.h>
+#include <kr_trackers/trajectory_file.h>
+#include <kr_trackers_manager/Tracker.h>
+
+class TrajectoryFileTracker : public kr_trackers_manager::Tracker
+{
+ public:
+  TrajectoryFileTracker(void);
+
+  void Initialize(const ros::NodeHandle &nh);
+  bool InitializeOffline(const kr_trackers_manager::OfflineParams &params);
+  bool replay(const std::string &topic, const uint8_t *data, uint32_t size);
+  bool Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd);
+  void Deactivate(void);
+
+  kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &msg);
+  void observe(const nav_msgs::Odometry::ConstPtr &msg);
+
+  uint8_t status() const;
+
+  bool preview(const ros::Time &t0, float dt, unsigned int n, kr_tracker_msgs::TrackerPreview &preview) const;
+
+ private:
+  // Read the params and set up the action server, from a ros::NodeHandle or OfflineParams
+  template <typename NodeHandle>
+  void init(const NodeHandle &priv_nh);
+
+  void goal_callback();
+
+  void preempt_callback();
+
+  void stop_playback();
+
+  // Whether the trajectory at start_time starts from the initial conditions, so it can be played back without a jump
+  bool check_start(const TrajectoryFile &traj_file, float start_time) const;
+
+  typedef GoalServer<kr_tracker_msgs::TrajectoryFileTrackerAction> ServerType;
+
+  // Action server that takes a goal.
+  // Must be a pointer because plugin does not support a constructor with inputs, but an action server must be
+  // initialized with a Nodehandle.
+  std::unique_ptr<ServerType> tracker_server_;
+
+  // The precomputed trajectory, kept mapped after the goal is done so that repeating it does not reopen the file
+  std::unique_ptr<TrajectoryFile> traj_file_;
+  std::string trajectory_dir_;
+  float max_start_distance_;
+  float max_start_velocity_;
+
+  Eigen::Vector3f current_pos_;
+
+  bool pos_set_, goal_set_, goal_reached_;
+  bool active_;
+
+  InitialConditions ICs_;
+  ros::Time traj_start_;
+  float traj_start_time_;  // Time along the trajectory at traj_start_, or the time being held once the goal is done
+
+  float current_traj_length_;
+};
+
+TrajectoryFileTracker::TrajectoryFileTracker(void)
+    : traj_file_(new TrajectoryFile()),
+      pos_set_(false),
+      goal_set_(false),
+      goal_reached_(true),
+      active_(false),
+      traj_start_time_(0)
+{
+}
+
+template <typename NodeHandle>
+void TrajectoryFileTracker::init(const NodeHandle &priv_nh)
+{
+  priv_nh.param("trajectory_dir", trajectory_dir_, std::string(""));
+  priv_nh.param("max_start_distance", max_start_distance_, 0.5f);
+  priv_nh.param("max_start_velocity", max_start_velocity_, 0.5f);
+
+  // Set up the action server.
+  tracker_server_.reset(new ServerType(priv_nh, "TrajectoryFileTracker", false));
+  tracker_server_->registerGoalCallback(boost::bind(&TrajectoryFileTracker::goal_callback, this));
+  tracker_server_->registerPreemptCallback(boost::bind(&TrajectoryFileTracker::preempt_callback, this));
+
+  tracker_server_->start();
+}
+
+void TrajectoryFileTracker::Initialize(const ros::NodeHandle &nh)
+{
+  ros::NodeHandle priv_nh(nh, "trajectory_file_tracker");
+  init(priv_nh);
+}
+
+bool TrajectoryFileTracker::InitializeOffline(const kr_trackers_manager::OfflineParams &params)
+{
+  init(kr_trackers_manager::OfflineParams(params, "trajectory_file_tracker"));
+  return true;
+}
+
+bool TrajectoryFileTracker::replay(const std::string &topic, const uint8_t *data, uint32_t size)
+{
+  return tracker_server_->replay(topic, data, size);
+}
+
+bool TrajectoryFileTracker::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
+{
+  // Only allow activation if a goal has been set
+  if(goal_set_ && pos_set_)
+  {
+    if(!tracker_server_->isActive())
+    {
+      ROS_WARN(
+          "TrajectoryFileTracker::Activate: goal_set_ is true but action server has no active goal - not activating.");
+      active_ = false;
+      return false;
+    }
+
+    // The goal was checked against the initial conditions at the time, playback starts from the command handed over
+    if(cmd)
+    {
+      ICs_.set_from_cmd(cmd);
+      if(!check_start(*traj_file_, traj_start_time_))
+      {
+        ROS_WARN("TrajectoryFileTracker::Activate: the trajectory does not start from the current command.");
+        tracker_server_->setAborted();
+        goal_set_ = false;
+        goal_reached_ = true;
+        active_ = false;
+        return false;
+      }
+    }
+    active_ = true;
+
+    current_pos_ = ICs_.pos();
+    current_traj_length_ = 0.0;
+  }
+  return active_;
+}
+
+void TrajectoryFileTracker::Deactivate(void)
+{
+  if(tracker_server_->isActive())
+  {
+    ROS_WARN("TrajectoryFileTracker::Deactivate: deactivated tracker while still tracking the goal.");
+    tracker_server_->setAborted();
+  }
+
+  // The initial conditions are kept, they hold where the playback stopped for resuming it
+  goal_set_ = false;
+  active_ = false;
+}
+
+kr_mav_msgs::PositionCommand::ConstPtr TrajectoryFileTracker::update(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  pos_set_ = true;
+  ICs_.set_from_odom(msg);
+
+  if(!active_)
+  {
+    return kr_mav_msgs::PositionCommand::Ptr();
+  }
+
+  const ros::Time t_now = now();
+
+  // Record distance between last position and current.
+  const Eigen::Vector3f pos(msg->pose.pose.position.x, msg->pose.pose.position.y, msg->pose.pose.position.z);
+  current_traj_length_ += (pos - current_pos_).norm();
+  current_pos_ = pos;
+
+  auto cmd = boost::make_shared<kr_mav_msgs::PositionCommand>();
+  cmd->header.stamp = t_now;
+  cmd->header.frame_id = msg->header.frame_id;
+
+  if(goal_set_)
+  {
+    // Nothing to solve, playback starts right away from the requested time
+    traj_start_ = t_now;
+    goal_set_ = false;
+  }
+
+  const float total_time = traj_file_->getTotalTime();
+  float traj_time = traj_start_time_;
+  if(!goal_reached_)
+    traj_time += (t_now - traj_start_).toSec();
+
+  Eigen::Vector3f x, v, a, j;
+  traj_file_->getCommand(traj_time, x, v, a, j);
+
+  if(goal_reached_)
+  {
+    if(tracker_server_->isActive())
+      ROS_ERROR("TrajectoryFileTracker::update: Action server not completed");
+
+    v = a = j = Eigen::Vector3f::Zero();
+  }
+  else if(traj_time >= total_time)  // Reached goal
+  {
+    kr_tracker_msgs::TrajectoryFileTrackerResult result;
+    result.total_time = traj_time - traj_start_time_;
+    result.total_distance_travelled = current_traj_length_;
+    tracker_server_->setSucceeded(result);
+
+    current_traj_length_ = 0.0;
+    ROS_DEBUG_THROTTLE(1, "Reached goal");
+    v = a = j = Eigen::Vector3f::Zero();
+    traj_start_time_ = total_time;
+    goal_reached_ = true;
+  }
+  else
+  {
+    kr_tracker_msgs::TrajectoryFileTrackerFeedback feedback;
+    feedback.remaining_time = total_time - traj_time;
+    feedback.trajectory_time = traj_time;
+    tracker_server_->publishFeedback(feedback);
+  }
+
+  cmd->position.x = x(0), cmd->position.y = x(1), cmd->position.z = x(2);
+  cmd->yaw = ICs_.yaw();
+  cmd->yaw_dot = 0;
+  cmd->velocity.x = v(0), cmd->velocity.y = v(1), cmd->velocity.z = v(2);
+  cmd->acceleration.x = a(0), cmd->acceleration.y = a(1), cmd->acceleration.z = a(2);
+  cmd->jerk.x = j(0), cmd->jerk.y = j(1), cmd->jerk.z = j(2);
+
+  ICs_.set_from_cmd(cmd);
+  return cmd;
+}
+
+void TrajectoryFileTracker::observe(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  pos_set_ = true;
+  ICs_.set_from_odom(msg);
+}
+
+bool TrajectoryFileTracker::preview(const ros::Time &t0, float dt, unsigned int n,
+                                    kr_tracker_msgs::TrackerPreview &preview) const
+{
+  // Playback of a new goal only starts in the next update
+  if(!active_ || goal_set_ || !traj_file_->isOpen())
+    return false;
+
+  const float total_time = traj_file_->getTotalTime();
+  const float traj_time = goal_reached_ ? traj_start_time_ : traj_start_time_ + (t0 - traj_start_).toSec();
+  Eigen::Vector3f x, v, a, j;
+  for(unsigned int i = 0; i < n; i++)
+  {
+    const float t = goal_reached_ ? traj_time : traj_time + i * dt;
+    traj_file_->getCommand(t, x, v, a, j);
+    if(goal_reached_ || t >= total_time)
+      v = a = Eigen::Vector3f::Zero();
+    setPreviewSample(preview, i, x, v, a, ICs_.yaw(), 0);
+  }
+  preview.num_samples = n;
+  return true;
+}
+
+void TrajectoryFileTracker::goal_callback()
+{
+  // If another goal is already active, cancel that goal and track this one instead.
+  if(tracker_server_->isActive())
+  {
+    ROS_INFO("TrajectoryFileTracker goal aborted");
+    tracker_server_->setAborted();
+  }
+
+  // Pointer to the recieved goal.
+  const auto msg = tracker_server_->acceptNewGoal();
+
+  current_traj_length_ = 0.0;
+
+  // If preempt has been requested, then set this goal to preempted and make no changes to the tracker state.
+  if(tracker_server_->isPreemptRequested())
+  {
+    ROS_INFO("TrajectoryFileTracker preempted");
+    tracker_server_->setPreempted();
+    return;
+  }
+
+  std::string filename = msg->filename;
+  if(!filename.empty() && filename[0] != '/' && !trajectory_dir_.empty())
+    filename = trajectory_dir_ + "/" + filename;
+
+  // Keep playing back the current file until the new one is known to be valid
+  std::unique_ptr<TrajectoryFile> traj_file;
+  if(filename != traj_file_->filename())
+  {
+    traj_file.reset(new TrajectoryFile());
+    if(!traj_file->open(filename))
+    {
+      ROS_WARN("TrajectoryFileTracker: Could not load %s: %s", filename.c_str(), traj_file->error().c_str());
+      tracker_server_->setAborted();
+      stop_playback();
+      return;
+    }
+  }
+  const TrajectoryFile &goal_file = traj_file ? *traj_file : *traj_file_;
+
+  if(msg->start_time < 0 || msg->start_time >= goal_file.getTotalTime())
+  {
+    ROS_WARN("TrajectoryFileTracker: start_time %g outside of the trajectory [0, %g)", msg->start_time,
+             goal_file.getTotalTime());
+    tracker_server_->setAborted();
+    stop_playback();
+    return;
+  }
+
+  if(!check_start(goal_file, msg->start_time))
+  {
+    tracker_server_->setAborted();
+    stop_playback();
+    return;
+  }
+
+  if(traj_file)
+    traj_file_ = std::move(traj_file);
+  traj_start_time_ = msg->start_time;
+  goal_set_ = true;
+  goal_reached_ = false;
+}
+
+void TrajectoryFileTracker::preempt_callback()
+{
+  if(tracker_server_->isActive())
+  {
+    ROS_INFO("TrajectoryFileTracker aborted");
+    tracker_server_->setAborted();
+  }
+  else
+  {
+    ROS_INFO("TrajectoryFileTracker preempted");
+    tracker_server_->setPreempted();
+  }
+
+  stop_playback();
+}
+
+void TrajectoryFileTracker::stop_playback()
+{
+  // Hold the current point of the trajectory
+  if(active_ && !goal_set_ && !goal_reached_)
+    traj_start_time_ += (now() - traj_start_).toSec();
+
+  goal_set_ = false;
+  goal_reached_ = true;
+}
+
+bool TrajectoryFileTracker::check_start(const TrajectoryFile &traj_file, float start_time) const
+{
+  // The trajectory is not re-solved from the current state, so it has to start close to the current position
+  Eigen::Vector3f x, v, a, j;
+  traj_file.getCommand(start_time, x, v, a, j);
+  if(!pos_set_ || (x - ICs_.pos()).norm() > max_start_distance_)
+  {
+    ROS_WARN("TrajectoryFileTracker: Trajectory at t = %g is further than %g m from the current position", start_time,
+             max_start_distance_);
+    return false;
+  }
+  // Nor would a jump of the velocity be smoothed, e.g. when resuming mid-trajectory while still moving
+  if((v - ICs_.vel()).norm() > max_start_velocity_)
+  {
+    ROS_WARN("TrajectoryFileTracker: Trajectory velocity at t = %g differs by more than %g m/s from the current one",
+             start_time, max_start_velocity_);
+    return false;
+  }
+  return true;
+}
+
+uint8_t TrajectoryFileTracker::status() const
+{
+  return tracker_server_->isActive() ? static_cast<uint8_t>(kr_tracker_msgs::TrackerStatus::ACTIVE) :
+                                       static_cast<uint8_t>(kr_tracker_msgs::TrackerStatus::SUCCEEDED);
+}
+
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(TrajectoryFileTracker, kr_trackers_manager::Tracker);
@@ -0,0 +1,386 @@
+#include <ros/ros.h>
+
+#include <boost/circular_buffer.hpp>
+#include <memory>
+
+#include <kr_mav_msgs/PositionCommand.h>
+#include <kr_tracker_msgs/TrackerStatus.h>
+#include <kr_tracker_msgs/TrajectoryChunk.h>
+#include <kr_trackers/initial_conditions.h>
+#include <kr_trackers/preview.h>
+#include <kr_trackers/traj_gen_fixed.h>
+#include <kr_trackers_manager/Tracker.h>
+
+/**
+ * Tracker for trajectories which are too long to be sent in one goal. The trajectory is streamed in chunks of
+ * waypoints and only a bounded number of solved segments is kept. Each new chunk is solved together with the last
+ * segments which have not been started yet, starting from the state at the end of the segment being flown, so the
+ * command stays continuous across chunks. If the stream stops, the trajectory ends at rest at the last waypoint.
+ */
+class TrajectoryStreamTracker : public kr_trackers_manager::Tracker
+{
+ public:
+  TrajectoryStreamTracker(void);
+
+  void Initialize(const ros::NodeHandle &nh);
+  bool InitializeOffline(const kr_trackers_manager::OfflineParams &params);
+  bool replay(const std::string &topic, const uint8_t *data, uint32_t size);
+  bool Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd);
+  void Deactivate(void);
+
+  kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &msg);
+  void observe(const nav_msgs::Odometry::ConstPtr &msg);
+
+  uint8_t status() const;
+
+  bool preview(const ros::Time &t0, float dt, unsigned int n, kr_tracker_msgs::TrackerPreview &preview) const;
+
+ private:
+  struct Segment
+  {
+    float start_time, duration;
+    Eigen::MatrixX3f coefficients;
+    Eigen::Vector3f end;
+  };
+
+  // Read the params, from a ros::NodeHandle or OfflineParams
+  template <typename NodeHandle>
+  void init(const NodeHandle &priv_nh);
+
+  void chunk_callback(const kr_tracker_msgs::TrajectoryChunk::ConstPtr &msg);
+
+  // Solve the pending waypoints and append them to the segments
+  void stitch(float traj_time);
+
+  ros::Subscriber sub_chunk_;
+
+  std::unique_ptr<TrajectoryGenerator> traj_gen_;
+
+  // Solved segments, starting with the one being flown
+  boost::circular_buffer<Segment> segments_;
+
+  // Received waypoints which have not been solved yet, a duration <= 0 means it has to be computed
+  TrajectoryGenerator::vec_Vec3f pending_waypoints_;
+  std::vector<float> pending_durations_;
+
+  bool pos_set_, active_, restart_, done_;
+  float max_v_des_, max_a_des_, low_buffer_time_;
+  int resolve_segments_;
+
+  InitialConditions ICs_;
+  ros::Time traj_start_;
+  float remaining_time_;
+};
+
+static void evaluate(const Eigen::MatrixX3f &p, float t, Eigen::Vector3f &pos, Eigen::Vector3f &vel,
+                     Eigen::Vector3f &acc, Eigen::Vector3f &jrk)
+{
+  // At most 8 coefficients since the continuous derivative order is limited to 3
+  float t_pow[8];
+  t_pow[0] = 1;
+  for(unsigned int i = 1; i < p.rows(); i++)
+    t_pow[i] = t_pow[i - 1] * t;
+
+  pos = vel = acc = jrk = Eigen::Vector3f::Zero();
+  for(unsigned int i = 0; i < p.rows(); i++)
+  {
+    pos += p.row(i).transpose() * t_pow[i];
+    if(i >= 1)
+      vel += p.row(i).transpose() * (i * t_pow[i - 1]);
+    if(i >= 2)
+      acc += p.row(i).transpose() * (i * (i - 1) * t_pow[i - 2]);
+    if(i >= 3)
+      jrk += p.row(i).transpose() * (i * (i - 1) * (i - 2) * t_pow[i - 3]);
+  }
+}
+
+TrajectoryStreamTracker::TrajectoryStreamTracker(void)
+    : pos_set_(false), active_(false), restart_(false), done_(true), remaining_time_(0)
+{
+}
+
+template <typename NodeHandle>
+void TrajectoryStreamTracker::init(const NodeHandle &priv_nh)
+{
+  priv_nh.param("max_vel_des", max_v_des_, 1.0f);
+  priv_nh.param("max_acc_des", max_a_des_, 1.0f);
+
+  // The continuity at the chunk boundaries uses the commanded velocity, acceleration and jerk
+  int continuous_derivative_order, derivative_order_to_minimize;
+  priv_nh.param("continuous_derivative_order", continuous_derivative_order, 2);
+  priv_nh.param("derivative_order_to_minimize", derivative_order_to_minimize, 3);
+  continuous_derivative_order = std::min(std::max(0, continuous_derivative_order), 3);
+  derivative_order_to_minimize = std::max(1, derivative_order_to_minimize);
+  traj_gen_ = makeTrajectoryGenerator(continuous_derivative_order, derivative_order_to_minimize);
+
+  int max_segments;
+  priv_nh.param("max_segments", max_segments, 200);
+  segments_.set_capacity(std::max(2, max_segments));
+  // The last segment always ends at rest, it has to be solved again for the trajectory not to stop at each chunk
+  priv_nh.param("resolve_segments", resolve_segments_, 2);
+  resolve_segments_ = std::max(1, resolve_segments_);
+  priv_nh.param("low_buffer_time", low_buffer_time_, 5.0f);
+}
+
+void TrajectoryStreamTracker::Initialize(const ros::NodeHandle &nh)
+{
+  ros::NodeHandle priv_nh(nh, "trajectory_stream_tracker");
+  init(priv_nh);
+  sub_chunk_ = priv_nh.subscribe("chunk", 10, &TrajectoryStreamTracker::chunk_callback, this,
+                                 ros::TransportHints().tcpNoDelay());
+}
+
+bool TrajectoryStreamTracker::InitializeOffline(const kr_trackers_manager::OfflineParams &params)
+{
+  init(kr_trackers_manager::OfflineParams(params, "trajectory_stream_tracker"));
+  return true;
+}
+
+bool TrajectoryStreamTracker::replay(const std::string &topic, const uint8_t *data, uint32_t size)
+{
+  if(topic != "trajectory_stream_tracker/chunk")
+    return false;
+  chunk_callback(kr_trackers_manager::deserializeReplayMessage<kr_tracker_msgs::TrajectoryChunk>(data, size));
+  return true;
+}
+
+bool TrajectoryStreamTracker::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
+{
+  // Only allow activation once the first chunk has been received
+  if(pos_set_ && !pending_waypoints_.empty())
+  {
+    restart_ = true;
+    active_ = true;
+  }
+  return active_;
+}
+
+void TrajectoryStreamTracker::Deactivate(void)
+{
+  ICs_.reset();
+  segments_.clear();
+  pending_waypoints_.clear();
+  pending_durations_.clear();
+  active_ = false;
+  done_ = true;
+}
+
+kr_mav_msgs::PositionCommand::ConstPtr TrajectoryStreamTracker::update(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  pos_set_ = true;
+  ICs_.set_from_odom(msg);
+
+  if(!active_)
+  {
+    return kr_mav_msgs::PositionCommand::Ptr();
+  }
+
+  const ros::Time t_now = now();
+
+  auto cmd = boost::make_shared<kr_mav_msgs::PositionCommand>();
+  cmd->header.stamp = t_now;
+  cmd->header.frame_id = msg->header.frame_id;
+
+  if(restart_)
+  {
+    segments_.clear();
+    traj_start_ = t_now;
+  }
+  const float traj_time = (t_now - traj_start_).toSec();
+
+  // Drop the segments which were already flown
+  while(segments_.size() > 1 && segments_.front().start_time + segments_.front().duration <= traj_time)
+    segments_.pop_front();
+
+  if(!pending_waypoints_.empty())
+    stitch(traj_time);
+  restart_ = false;
+
+  Eigen::Vector3f x(ICs_.pos()), v(Eigen::Vector3f::Zero()), a(Eigen::Vector3f::Zero()), j(Eigen::Vector3f::Zero());
+  if(!segments_.empty())
+  {
+    const Segment &last = segments_.back();
+    remaining_time_ = last.start_time + last.duration - traj_time;
+    if(remaining_time_ <= 0)  // Reached the end of the streamed trajectory
+    {
+      if(!done_)
+        ROS_DEBUG("TrajectoryStreamTracker: Reached the end of the trajectory");
+      x = last.end;
+      remaining_time_ = 0;
+      done_ = true;
+    }
+    else
+    {
+      auto seg = segments_.begin();
+      while(seg->start_time + seg->duration <= traj_time)
+        ++seg;
+      evaluate(seg->coefficients, std::max(0.0f, traj_time - seg->start_time), x, v, a, j);
+      done_ = false;
+    }
+  }
+
+  cmd->position.x = x(0), cmd->position.y = x(1), cmd->position.z = x(2);
+  cmd->yaw = ICs_.yaw();
+  cmd->yaw_dot = 0;
+  cmd->velocity.x = v(0), cmd->velocity.y = v(1), cmd->velocity.z = v(2);
+  cmd->acceleration.x = a(0), cmd->acceleration.y = a(1), cmd->acceleration.z = a(2);
+  cmd->jerk.x = j(0), cmd->jerk.y = j(1), cmd->jerk.z = j(2);
+
+  ICs_.set_from_cmd(cmd);
+  return cmd;
+}
+
+void TrajectoryStreamTracker::observe(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  pos_set_ = true;
+  ICs_.set_from_odom(msg);
+}
+
+bool TrajectoryStreamTracker::preview(const ros::Time &t0, float dt, unsigned int n,
+                                      kr_tracker_msgs::TrackerPreview &preview) const
+{
+  // Only the segments solved so far, waypoints received since the last update are not included yet
+  if(!active_ || restart_ || segments_.empty())
+    return false;
+
+  const float traj_time = (t0 - traj_start_).toSec();
+  const Segment &last = segments_.back();
+  auto seg = segments_.begin();
+  Eigen::Vector3f x, v, a, j;
+  for(unsigned int i = 0; i < n; i++)
+  {
+    const float t = traj_time + i * dt;
+    if(t >= last.start_time + last.duration)
+    {
+      setPreviewSample(preview, i, last.end, Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero(), ICs_.yaw(), 0);
+      continue;
+    }
+    // Samples are in increasing time, so the search continues from the segment of the previous sample
+    while(seg->start_time + seg->duration <= t)
+      ++seg;
+    evaluate(seg->coefficients, std::max(0.0f, t - seg->start_time), x, v, a, j);
+    setPreviewSample(preview, i, x, v, a, ICs_.yaw(), 0);
+  }
+  preview.num_samples = n;
+  return true;
+}
+
+void TrajectoryStreamTracker::stitch(const float traj_time)
+{
+  // The segments from index k on have not been started and are solved again with the new waypoints
+  TrajectoryGenerator::vec_Vec3f derivatives(3);
+  Eigen::Vector3f knot;
+  float knot_time;
+  size_t k;
+  if(restart_ || segments_.empty())
+  {
+    knot = ICs_.pos();
+    derivatives[0] = ICs_.vel();
+    derivatives[1] = ICs_.acc();
+    derivatives[2] = ICs_.jrk();
+    knot_time = traj_time;
+    k = 0;
+  }
+  else
+  {
+    k = segments_.size();
+    while(k > 1 && segments_.size() - k < static_cast<size_t>(resolve_segments_) &&
+          segments_[k - 1].start_time > traj_time)
+      k--;
+    const Segment &prev = segments_[k - 1];
+    evaluate(prev.coefficients, prev.duration, knot, derivatives[0], derivatives[1], derivatives[2]);
+    // If the end of the trajectory was already reached, continue from there now, it is at rest
+    knot_time = std::max(prev.start_time + prev.duration, traj_time);
+  }
+
+  traj_gen_->setInitialConditions(knot, derivatives);
+  std::vector<float> waypoint_times(1, 0);
+  for(size_t i = k; i < segments_.size(); i++)
+  {
+    traj_gen_->addWaypoint(segments_[i].end);
+    waypoint_times.push_back(waypoint_times.back() + segments_[i].duration);
+  }
+  Eigen::Vector3f prev_waypoint = k < segments_.size() ? segments_.back().end : knot;
+  for(size_t i = 0; i < pending_waypoints_.size(); i++)
+  {
+    float duration = pending_durations_[i];
+    if(duration <= 0)
+    {
+      const float dist = (pending_waypoints_[i] - prev_waypoint).norm();
+      duration = std::max(dist / (max_v_des_ / 2), 2 * std::sqrt(dist / max_a_des_));
+      duration = std::max(duration, 1e-2f);
+    }
+    traj_gen_->addWaypoint(pending_waypoints_[i]);
+    waypoint_times.push_back(waypoint_times.back() + duration);
+    prev_waypoint = pending_waypoints_[i];
+  }
+  pending_waypoints_.clear();
+  pending_durations_.clear();
+
+  // Pushing to a full circular_buffer would overwrite the segment being flown, so the waypoints are dropped instead
+  if(waypoint_times.size() - 1 > segments_.capacity() - k)
+  {
+    ROS_WARN("TrajectoryStreamTracker: Buffer full, dropping the received waypoints");
+    return;
+  }
+
+  if(!traj_gen_->calculate(waypoint_times))
+  {
+    ROS_ERROR("TrajectoryStreamTracker: Failed to calculate the trajectory, dropping the received waypoints");
+    return;
+  }
+
+  segments_.erase_end(segments_.size() - k);
+  for(size_t i = 0; i + 1 < waypoint_times.size(); i++)
+  {
+    Segment seg;
+    seg.start_time = knot_time + waypoint_times[i];
+    seg.duration = waypoint_times[i + 1] - waypoint_times[i];
+    seg.coefficients = traj_gen_->getCoefficients(i);
+    evaluate(seg.coefficients, seg.duration, seg.end, derivatives[0], derivatives[1], derivatives[2]);
+    segments_.push_back(seg);
+  }
+}
+
+void TrajectoryStreamTracker::chunk_callback(const kr_tracker_msgs::TrajectoryChunk::ConstPtr &msg)
+{
+  if(msg->waypoints.empty() ||
+     (!msg->segment_durations.empty() && msg->segment_durations.size() != msg->waypoints.size()))
+  {
+    ROS_WARN("TrajectoryStreamTracker: Invalid chunk received! Ignoring");
+    return;
+  }
+
+  // The segments already flown are only dropped in update, so this is conservative
+  const size_t num_buffered = msg->start ? 0 : (restart_ ? 0 : segments_.size()) + pending_waypoints_.size();
+  if(num_buffered + msg->waypoints.size() > segments_.capacity())
+  {
+    ROS_WARN("TrajectoryStreamTracker: Buffer full, dropping chunk of %zu waypoints", msg->waypoints.size());
+    return;
+  }
+
+  if(msg->start)
+  {
+    pending_waypoints_.clear();
+    pending_durations_.clear();
+    restart_ = true;
+  }
+
+  for(size_t i = 0; i < msg->waypoints.size(); i++)
+  {
+    const auto &p = msg->waypoints[i];
+    pending_waypoints_.push_back(Eigen::Vector3f(p.x, p.y, p.z));
+    pending_durations_.push_back(msg->segment_durations.empty() ? 0 : msg->segment_durations[i]);
+  }
+}
+
+uint8_t TrajectoryStreamTracker::status() const
+{
+  if(done_ && pending_waypoints_.empty())
+    return kr_tracker_msgs::TrackerStatus::SUCCEEDED;
+  return remaining_time_ < low_buffer_time_ ? static_cast<uint8_t>(kr_tracker_msgs::TrackerStatus::BUFFER_LOW) :
+                                              static_cast<uint8_t>(kr_tracker_msgs::TrackerStatus::ACTIVE);
+}
+
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(TrajectoryStreamTracker, kr_trackers_manager::Tracker);
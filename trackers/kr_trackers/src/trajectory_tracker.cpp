@@ -4,12 +4,13 @@
 #include <memory>
 //#include <tf/transform_datatypes.h>
 
-#include <actionlib/server/simple_action_server.h>
 #include <kr_mav_msgs/PositionCommand.h>
 #include <kr_tracker_msgs/TrackerStatus.h>
 #include <kr_tracker_msgs/TrajectoryTrackerAction.h>
+#include <kr_trackers/goal_server.h>
 #include <kr_trackers/initial_conditions.h>
-#include <kr_trackers/traj_gen.h>
+#include <kr_trackers/preview.h>
+#include <kr_trackers/traj_gen_fixed.h>
 #include <kr_trackers_manager/Tracker.h>
 
 class TrajectoryTracker : public kr_trackers_manager::Tracker
@@ -18,19 +19,30 @@ class TrajectoryTracker : public kr_trackers_manager::Tracker
   TrajectoryTracker(void);
 
   void Initialize(const ros::NodeHandle &nh);
+  bool InitializeOffline(const kr_trackers_manager::OfflineParams &params);
+  bool replay(const std::string &topic, const uint8_t *data, uint32_t size);
   bool Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd);
   void Deactivate(void);
 
   kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &msg);
+  void observe(const nav_msgs::Odometry::ConstPtr &msg);
 
   uint8_t status() const;
 
+  bool preview(const ros::Time &t0, float dt, unsigned int n, kr_tracker_msgs::TrackerPreview &preview) const;
+
  private:
+  // Read the params and set up the action server, from a ros::NodeHandle or OfflineParams
+  template <typename NodeHandle>
+  void init(const NodeHandle &priv_nh);
+
   void goal_callback();
 
   void preempt_callback();
 
-  typedef actionlib::SimpleActionServer<kr_tracker_msgs::TrajectoryTrackerAction> ServerType;
+  bool replan_incremental(const ros::Time &t_now);
+
+  typedef GoalServer<kr_tracker_msgs::TrajectoryTrackerAction> ServerType;
 
   // Action server that takes a goal.
   // Must be a pointer because plugin does not support a constructor with inputs, but an action server must be
@@ -45,6 +57,12 @@ class TrajectoryTracker : public kr_trackers_manager::Tracker
   float max_v_des_, max_a_des_;
   bool active_;
 
+  // Incremental replanning of the trajectory being flown when a new goal only changes part of it
+  bool incremental_replan_, traj_running_;
+  int replan_window_;
+  TrajectoryGenerator::vec_Vec3f traj_waypoints_;
+  std::vector<float> traj_waypoint_times_;
+
   InitialConditions ICs_;
   ros::Time traj_start_;
   float traj_total_time_;
@@ -54,12 +72,14 @@ class TrajectoryTracker : public kr_trackers_manager::Tracker
   float current_traj_length_;
 };
 
-TrajectoryTracker::TrajectoryTracker(void) : pos_set_(false), goal_set_(false), goal_reached_(true), active_(false) {}
-
-void TrajectoryTracker::Initialize(const ros::NodeHandle &nh)
+TrajectoryTracker::TrajectoryTracker(void)
+    : pos_set_(false), goal_set_(false), goal_reached_(true), active_(false), traj_running_(false)
 {
-  ros::NodeHandle priv_nh(nh, "trajectory_tracker");
+}
 
+template <typename NodeHandle>
+void TrajectoryTracker::init(const NodeHandle &priv_nh)
+{
   priv_nh.param("max_vel_des", max_v_des_, 1.0f);
   priv_nh.param("max_acc_des", max_a_des_, 1.0f);
 
@@ -69,8 +89,12 @@ void TrajectoryTracker::Initialize(const ros::NodeHandle &nh)
   continuous_derivative_order = std::max(0, continuous_derivative_order);
   derivative_order_to_minimize = std::max(1, derivative_order_to_minimize);
 
-  // Trajectory Generator
-  traj_gen_.reset(new TrajectoryGenerator(continuous_derivative_order, derivative_order_to_minimize));
+  priv_nh.param("incremental_replan", incremental_replan_, false);
+  priv_nh.param("replan_window", replan_window_, 2);
+  replan_window_ = std::max(0, replan_window_);
+
+  // Trajectory Generator, fixed-order specializations are used for min-jerk and min-snap unless replan() is needed
+  traj_gen_ = makeTrajectoryGenerator(continuous_derivative_order, derivative_order_to_minimize, incremental_replan_);
 
   // Set up the action server.
   tracker_server_.reset(new ServerType(priv_nh, "TrajectoryTracker", false));
@@ -80,6 +104,23 @@ void TrajectoryTracker::Initialize(const ros::NodeHandle &nh)
   tracker_server_->start();
 }
 
+void TrajectoryTracker::Initialize(const ros::NodeHandle &nh)
+{
+  ros::NodeHandle priv_nh(nh, "trajectory_tracker");
+  init(priv_nh);
+}
+
+bool TrajectoryTracker::InitializeOffline(const kr_trackers_manager::OfflineParams &params)
+{
+  init(kr_trackers_manager::OfflineParams(params, "trajectory_tracker"));
+  return true;
+}
+
+bool TrajectoryTracker::replay(const std::string &topic, const uint8_t *data, uint32_t size)
+{
+  return tracker_server_->replay(topic, data, size);
+}
+
 bool TrajectoryTracker::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
 {
   // Only allow activation if a goal has been set
@@ -109,6 +150,7 @@ void TrajectoryTracker::Deactivate(void)
   ICs_.reset();
   goal_set_ = false;
   active_ = false;
+  traj_running_ = false;
 }
 
 kr_mav_msgs::PositionCommand::ConstPtr TrajectoryTracker::update(const nav_msgs::Odometry::ConstPtr &msg)
@@ -121,7 +163,7 @@ kr_mav_msgs::PositionCommand::ConstPtr TrajectoryTracker::update(const nav_msgs:
     return kr_mav_msgs::PositionCommand::Ptr();
   }
 
-  const ros::Time t_now = ros::Time::now();
+  const ros::Time t_now = now();
 
   // Record distance between last position and current.
   const float dx =
@@ -141,36 +183,44 @@ kr_mav_msgs::PositionCommand::ConstPtr TrajectoryTracker::update(const nav_msgs:
 
   if(goal_set_)
   {
-    traj_start_ = t_now;
-
-    std::vector<Eigen::Vector3f, Eigen::aligned_allocator<Eigen::Vector3f>> ic;
-    ic.push_back(ICs_.vel());
-    ic.push_back(ICs_.acc());
-    ic.push_back(ICs_.jrk());
-
-    traj_gen_->setInitialConditions(ICs_.pos(), ic);
-    for(const auto &p : goal_.waypoints)
-    {
-      traj_gen_->addWaypoint(Eigen::Vector3f(p.position.x, p.position.y, p.position.z));
-    }
-    std::vector<float> waypoint_times;
-    waypoint_times.reserve(goal_.waypoints.size());
-    if(goal_.waypoint_times.size() == 0)
+    if(!(incremental_replan_ && traj_running_ && replan_incremental(t_now)))
     {
-      waypoint_times = traj_gen_->computeTimesTrapezoidSpeed(max_v_des_ / 2, max_a_des_ / 2);
+      traj_start_ = t_now;
+
+      std::vector<Eigen::Vector3f, Eigen::aligned_allocator<Eigen::Vector3f>> ic;
+      ic.push_back(ICs_.vel());
+      ic.push_back(ICs_.acc());
+      ic.push_back(ICs_.jrk());
+
+      traj_gen_->setInitialConditions(ICs_.pos(), ic);
+      traj_waypoints_.assign(1, ICs_.pos());
+      for(const auto &p : goal_.waypoints)
+      {
+        traj_gen_->addWaypoint(Eigen::Vector3f(p.position.x, p.position.y, p.position.z));
+        traj_waypoints_.push_back(Eigen::Vector3f(p.position.x, p.position.y, p.position.z));
+      }
+      std::vector<float> waypoint_times;
+      waypoint_times.reserve(goal_.waypoints.size());
+      if(goal_.waypoint_times.size() == 0)
+      {
+        waypoint_times = traj_gen_->computeTimesTrapezoidSpeed(max_v_des_ / 2, max_a_des_ / 2);
+      }
+      else
+      {
+        waypoint_times.push_back(0);  // Time for the current state
+        for(const auto &t : goal_.waypoint_times)
+          waypoint_times.push_back(t);
+      }
+
+      traj_gen_->calculate(waypoint_times);
+      float max_jerk_des = 100;
+      traj_gen_->optimizeWaypointTimes(max_v_des_, max_a_des_, max_jerk_des);
+
+      traj_total_time_ = traj_gen_->getTotalTime();
+      // The times as computed here, which replan() compares the next goal with
+      traj_waypoint_times_ = waypoint_times;
     }
-    else
-    {
-      waypoint_times.push_back(0);  // Time for the current state
-      for(const auto &t : goal_.waypoint_times)
-        waypoint_times.push_back(t);
-    }
-
-    traj_gen_->calculate(waypoint_times);
-    float max_jerk_des = 100;
-    traj_gen_->optimizeWaypointTimes(max_v_des_, max_a_des_, max_jerk_des);
-
-    traj_total_time_ = traj_gen_->getTotalTime();
+    traj_running_ = true;
 
     goal_set_ = false;
   }
@@ -214,6 +264,7 @@ kr_mav_msgs::PositionCommand::ConstPtr TrajectoryTracker::update(const nav_msgs:
     yaw_des = ICs_.yaw();
     yaw_dot_des = 0;
     goal_reached_ = true;
+    traj_running_ = false;
   }
   else if(traj_time >= 0)
   {
@@ -241,6 +292,38 @@ kr_mav_msgs::PositionCommand::ConstPtr TrajectoryTracker::update(const nav_msgs:
   return cmd;
 }
 
+void TrajectoryTracker::observe(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  pos_set_ = true;
+  ICs_.set_from_odom(msg);
+}
+
+bool TrajectoryTracker::preview(const ros::Time &t0, float dt, unsigned int n,
+                                kr_tracker_msgs::TrackerPreview &preview) const
+{
+  // The trajectory for a new goal is only computed in the next update
+  if(!active_ || goal_set_ || goal_.waypoints.empty())
+    return false;
+
+  const auto last_waypoint_pos = goal_.waypoints.back().position;
+  const Eigen::Vector3f goal(last_waypoint_pos.x, last_waypoint_pos.y, last_waypoint_pos.z);
+
+  const float traj_time = (t0 - traj_start_).toSec();
+  Eigen::Vector3f x, v, a, j;
+  for(unsigned int i = 0; i < n; i++)
+  {
+    const float t = traj_time + i * dt;
+    if(goal_reached_ || t >= traj_total_time_)
+      setPreviewSample(preview, i, goal, Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero(), ICs_.yaw(), 0);
+    else if(traj_gen_->getCommand(std::max(t, 0.0f), x, v, a, j))
+      setPreviewSample(preview, i, x, v, a, ICs_.yaw(), 0);
+    else
+      setPreviewSample(preview, i, ICs_.pos(), Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero(), ICs_.yaw(), 0);
+  }
+  preview.num_samples = n;
+  return true;
+}
+
 void TrajectoryTracker::goal_callback()
 {
   // If another goal is already active, cancel that goal and track this one instead.
@@ -302,6 +385,69 @@ void TrajectoryTracker::preempt_callback()
 
   goal_set_ = false;
   goal_reached_ = true;
+  traj_running_ = false;
+}
+
+bool TrajectoryTracker::replan_incremental(const ros::Time &t_now)
+{
+  // The new goal is the complete route, the trajectory keeps its original start so its time frame does not change
+  TrajectoryGenerator::vec_Vec3f waypoints;
+  waypoints.reserve(goal_.waypoints.size() + 1);
+  waypoints.push_back(traj_waypoints_.front());
+  for(const auto &p : goal_.waypoints)
+    waypoints.push_back(Eigen::Vector3f(p.position.x, p.position.y, p.position.z));
+
+  std::vector<float> waypoint_times;
+  waypoint_times.reserve(waypoints.size());
+  waypoint_times.push_back(0);
+  if(goal_.waypoint_times.size() > 0)
+  {
+    for(const auto &t : goal_.waypoint_times)
+      waypoint_times.push_back(t);
+  }
+  else
+  {
+    // Keep the segment times of the unchanged waypoints at both ends of the route so that the generator can keep
+    // those segments, only the changed segments get new times
+    const unsigned int num_old = traj_waypoints_.size(), num_new = waypoints.size();
+    const int offset = static_cast<int>(num_new) - static_cast<int>(num_old);
+    const auto same = [&](unsigned int i_old, unsigned int i_new) {
+      return (waypoints[i_new] - traj_waypoints_[i_old]).norm() < 1e-4f;
+    };
+    unsigned int first = 0;
+    while(first < std::min(num_old, num_new) && same(first, first))
+      first++;
+    unsigned int last = num_new - 1;
+    while(last > first && static_cast<int>(last) - offset > static_cast<int>(first) && same(last - offset, last))
+      last--;
+
+    for(unsigned int i = 1; i < num_new; i++)
+    {
+      float duration;
+      if(i < first)
+        duration = traj_waypoint_times_[i] - traj_waypoint_times_[i - 1];
+      else if(i >= last + 2)
+        duration = traj_waypoint_times_[i - offset] - traj_waypoint_times_[i - offset - 1];
+      else
+      {
+        const float dist = (waypoints[i] - waypoints[i - 1]).norm();
+        duration = std::max(dist / (max_v_des_ / 2), 2 * std::sqrt(dist / max_a_des_));
+      }
+      waypoint_times.push_back(waypoint_times.back() + duration);
+    }
+  }
+
+  const float traj_time = (t_now - traj_start_).toSec();
+  if(!traj_gen_->replan(traj_time, waypoints, waypoint_times, replan_window_))
+  {
+    ROS_DEBUG("TrajectoryTracker: incremental replan not possible, recomputing the whole trajectory");
+    return false;
+  }
+
+  traj_waypoints_ = waypoints;
+  traj_waypoint_times_ = waypoint_times;
+  traj_total_time_ = traj_gen_->getTotalTime();
+  return true;
 }
 
 uint8_t TrajectoryTracker::status() const
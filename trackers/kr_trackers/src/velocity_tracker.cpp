@@ -10,10 +10,13 @@ class VelocityTracker : public kr_trackers_manager::Tracker
   VelocityTracker(void);
 
   void Initialize(const ros::NodeHandle &nh);
+  bool InitializeOffline(const kr_trackers_manager::OfflineParams &params);
+  bool replay(const std::string &topic, const uint8_t *data, uint32_t size);
   bool Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd);
   void Deactivate(void);
 
   kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &msg);
+  void observe(const nav_msgs::Odometry::ConstPtr &msg);
   uint8_t status() const;
 
  private:
@@ -21,15 +24,15 @@ class VelocityTracker : public kr_trackers_manager::Tracker
 
   ros::Subscriber sub_vel_cmd_, sub_position_vel_cmd_;
   kr_mav_msgs::PositionCommand position_cmd_;
-  bool odom_set_, active_, use_position_gains_;
+  bool active_, use_position_gains_;
   double last_t_;
-  double pos_[3], cur_yaw_;
+  nav_msgs::Odometry::ConstPtr odom_;
   ros::Time last_cmd_time_;
 
   float timeout_;
 };
 
-VelocityTracker::VelocityTracker(void) : odom_set_(false), active_(false), use_position_gains_(false), last_t_(0) {}
+VelocityTracker::VelocityTracker(void) : active_(false), use_position_gains_(false), last_t_(0) {}
 
 void VelocityTracker::Initialize(const ros::NodeHandle &nh)
 {
@@ -40,6 +43,21 @@ void VelocityTracker::Initialize(const ros::NodeHandle &nh)
       priv_nh.subscribe("goal", 10, &VelocityTracker::velocity_cmd_cb, this, ros::TransportHints().tcpNoDelay());
 }
 
+bool VelocityTracker::InitializeOffline(const kr_trackers_manager::OfflineParams &params)
+{
+  kr_trackers_manager::OfflineParams priv_params(params, "velocity_tracker");
+  priv_params.param("timeout", timeout_, 0.5f);
+  return true;
+}
+
+bool VelocityTracker::replay(const std::string &topic, const uint8_t *data, uint32_t size)
+{
+  if(topic != "velocity_tracker/goal")
+    return false;
+  velocity_cmd_cb(kr_trackers_manager::deserializeReplayMessage<kr_tracker_msgs::VelocityGoal>(data, size));
+  return true;
+}
+
 bool VelocityTracker::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd)
 {
   if(cmd)
@@ -49,12 +67,10 @@ bool VelocityTracker::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd
 
     active_ = true;
   }
-  else if(odom_set_)
+  else if(odom_)
   {
-    position_cmd_.position.x = pos_[0];
-    position_cmd_.position.y = pos_[1];
-    position_cmd_.position.z = pos_[2];
-    position_cmd_.yaw = cur_yaw_;
+    position_cmd_.position = odom_->pose.pose.position;
+    position_cmd_.yaw = tf::getYaw(odom_->pose.pose.orientation);
 
     active_ = true;
   }
@@ -65,22 +81,18 @@ bool VelocityTracker::Activate(const kr_mav_msgs::PositionCommand::ConstPtr &cmd
 void VelocityTracker::Deactivate(void)
 {
   active_ = false;
-  odom_set_ = false;
+  odom_.reset();
   last_t_ = 0;
 }
 
 kr_mav_msgs::PositionCommand::ConstPtr VelocityTracker::update(const nav_msgs::Odometry::ConstPtr &msg)
 {
-  pos_[0] = msg->pose.pose.position.x;
-  pos_[1] = msg->pose.pose.position.y;
-  pos_[2] = msg->pose.pose.position.z;
-  cur_yaw_ = tf::getYaw(msg->pose.pose.orientation);
-  odom_set_ = true;
+  odom_ = msg;
 
   if(!active_)
     return kr_mav_msgs::PositionCommand::Ptr();
 
-  if((ros::Time::now() - last_cmd_time_).toSec() > timeout_)
+  if((now() - last_cmd_time_).toSec() > timeout_)
   {
     // TODO: How much overshoot will this cause at high velocities?
     // Ideally ramp down?
@@ -100,9 +112,9 @@ kr_mav_msgs::PositionCommand::ConstPtr VelocityTracker::update(const nav_msgs::O
   }
 
   if(last_t_ == 0)
-    last_t_ = ros::Time::now().toSec();
+    last_t_ = now().toSec();
 
-  const double t_now = ros::Time::now().toSec();
+  const double t_now = now().toSec();
   const double dt = t_now - last_t_;
   last_t_ = t_now;
 
@@ -119,9 +131,7 @@ kr_mav_msgs::PositionCommand::ConstPtr VelocityTracker::update(const nav_msgs::O
     position_cmd_.kx[0] = 0, position_cmd_.kx[1] = 0, position_cmd_.kx[2] = 0;
     position_cmd_.use_msg_gains_flags = kr_mav_msgs::PositionCommand::USE_MSG_GAINS_POSITION_ALL;
 
-    position_cmd_.position.x = pos_[0];
-    position_cmd_.position.y = pos_[1];
-    position_cmd_.position.z = pos_[2];
+    position_cmd_.position = msg->pose.pose.position;
   }
   position_cmd_.yaw = position_cmd_.yaw + dt * position_cmd_.yaw_dot;
 
@@ -131,6 +141,11 @@ kr_mav_msgs::PositionCommand::ConstPtr VelocityTracker::update(const nav_msgs::O
   return kr_mav_msgs::PositionCommand::ConstPtr(new kr_mav_msgs::PositionCommand(position_cmd_));
 }
 
+void VelocityTracker::observe(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  odom_ = msg;
+}
+
 void VelocityTracker::velocity_cmd_cb(const kr_tracker_msgs::VelocityGoal::ConstPtr &msg)
 {
   // ROS_INFO("VelocityTracker goal (%2.2f, %2.2f, %2.2f, %2.2f)", msg->vx, msg->vy, msg->vz, msg->vyaw);
@@ -141,7 +156,7 @@ void VelocityTracker::velocity_cmd_cb(const kr_tracker_msgs::VelocityGoal::Const
 
   use_position_gains_ = msg->use_position_gains;
 
-  last_cmd_time_ = ros::Time::now();
+  last_cmd_time_ = now();
 }
 
 uint8_t VelocityTracker::status() const
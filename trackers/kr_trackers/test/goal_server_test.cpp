@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <kr_tracker_msgs/LineTrackerAction.h>
+#include <kr_trackers/goal_server.h>
+
+typedef GoalServer<kr_tracker_msgs::LineTrackerAction> ServerType;
+
+template <typename M>
+static std::vector<uint8_t> serialize(const M &msg)
+{
+  std::vector<uint8_t> data(ros::serialization::serializationLength(msg));
+  ros::serialization::OStream stream(data.data(), data.size());
+  ros::serialization::serialize(stream, msg);
+  return data;
+}
+
+// A server without a ROS master, as a tracker initialized with InitializeOffline() has it
+class GoalServerTest : public ::testing::Test
+{
+ protected:
+  GoalServerTest()
+      : server_(kr_trackers_manager::OfflineParams(kr_trackers_manager::OfflineParams(), "line_tracker_min_jerk"),
+                "LineTracker", false),
+        num_goals_(0),
+        num_preempts_(0)
+  {
+    server_.registerGoalCallback([this]() { num_goals_++; });
+    server_.registerPreemptCallback([this]() { num_preempts_++; });
+    server_.start();
+  }
+
+  bool sendGoal(const std::string &id, double stamp, float x)
+  {
+    kr_tracker_msgs::LineTrackerActionGoal goal;
+    goal.goal_id.id = id;
+    goal.goal_id.stamp = ros::Time(stamp);
+    goal.goal.x = x;
+    const std::vector<uint8_t> data = serialize(goal);
+    return server_.replay("line_tracker_min_jerk/LineTracker/goal", data.data(), data.size());
+  }
+
+  bool cancel(const std::string &id, double stamp)
+  {
+    actionlib_msgs::GoalID goal_id;
+    goal_id.id = id;
+    goal_id.stamp = ros::Time(stamp);
+    const std::vector<uint8_t> data = serialize(goal_id);
+    return server_.replay("line_tracker_min_jerk/LineTracker/cancel", data.data(), data.size());
+  }
+
+  ServerType server_;
+  unsigned int num_goals_, num_preempts_;
+};
+
+TEST_F(GoalServerTest, AcceptsGoal)
+{
+  EXPECT_FALSE(server_.isActive());
+  ASSERT_TRUE(sendGoal("a", 1.0, 1.0f));
+  EXPECT_EQ(num_goals_, 1u);
+  EXPECT_EQ(num_preempts_, 0u);
+  EXPECT_TRUE(server_.isNewGoalAvailable());
+
+  const ServerType::GoalConstPtr goal = server_.acceptNewGoal();
+  ASSERT_TRUE(goal != NULL);
+  EXPECT_FLOAT_EQ(goal->x, 1.0f);
+  EXPECT_TRUE(server_.isActive());
+  EXPECT_FALSE(server_.isNewGoalAvailable());
+  EXPECT_FALSE(server_.isPreemptRequested());
+
+  server_.setSucceeded();
+  EXPECT_FALSE(server_.isActive());
+  EXPECT_TRUE(server_.acceptNewGoal() == NULL);
+}
+
+TEST_F(GoalServerTest, OtherTopics)
+{
+  const std::vector<uint8_t> data = serialize(kr_tracker_msgs::LineTrackerActionGoal());
+  EXPECT_FALSE(server_.replay("line_tracker_distance/LineTracker/goal", data.data(), data.size()));
+  EXPECT_FALSE(server_.replay("line_tracker_min_jerk/LineTracker/result", data.data(), data.size()));
+  EXPECT_FALSE(server_.replay("line_tracker_min_jerk/LineTrackerX/goal", data.data(), data.size()));
+  EXPECT_EQ(num_goals_, 0u);
+}
+
+TEST_F(GoalServerTest, NewGoalPreemptsActiveGoal)
+{
+  ASSERT_TRUE(sendGoal("a", 1.0, 1.0f));
+  server_.acceptNewGoal();
+
+  ASSERT_TRUE(sendGoal("b", 2.0, 2.0f));
+  EXPECT_EQ(num_preempts_, 1u);
+  EXPECT_EQ(num_goals_, 2u);
+  EXPECT_TRUE(server_.isPreemptRequested());
+
+  const ServerType::GoalConstPtr goal = server_.acceptNewGoal();
+  ASSERT_TRUE(goal != NULL);
+  EXPECT_FLOAT_EQ(goal->x, 2.0f);
+  EXPECT_FALSE(server_.isPreemptRequested());
+  EXPECT_TRUE(server_.isActive());
+
+  // Goals older than the current one are dropped
+  ASSERT_TRUE(sendGoal("c", 1.5, 3.0f));
+  EXPECT_EQ(num_goals_, 2u);
+  EXPECT_FALSE(server_.isNewGoalAvailable());
+}
+
+TEST_F(GoalServerTest, CancelPreemptsGoal)
+{
+  ASSERT_TRUE(sendGoal("a", 1.0, 1.0f));
+  server_.acceptNewGoal();
+
+  ASSERT_TRUE(cancel("b", 0));
+  EXPECT_EQ(num_preempts_, 0u);
+
+  ASSERT_TRUE(cancel("a", 0));
+  EXPECT_EQ(num_preempts_, 1u);
+  EXPECT_TRUE(server_.isPreemptRequested());
+
+  // Only the first cancel request preempts the goal
+  ASSERT_TRUE(cancel("", 0));
+  EXPECT_EQ(num_preempts_, 1u);
+
+  server_.setPreempted();
+  EXPECT_FALSE(server_.isActive());
+}
+
+TEST_F(GoalServerTest, CancelPendingGoal)
+{
+  ASSERT_TRUE(sendGoal("a", 1.0, 1.0f));
+
+  // Cancels all the goals sent up to the stamp, the goal is preempted as soon as it is accepted
+  ASSERT_TRUE(cancel("", 1.0));
+  EXPECT_EQ(num_preempts_, 0u);
+  ASSERT_TRUE(server_.acceptNewGoal() != NULL);
+  EXPECT_TRUE(server_.isPreemptRequested());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::Time::init();
+  return RUN_ALL_TESTS();
+}
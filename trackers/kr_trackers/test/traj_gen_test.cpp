@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+#include <kr_trackers/traj_gen_fixed.h>
+
+using Vec3f = TrajectoryGenerator::Vec3f;
+using vec_Vec3f = TrajectoryGenerator::vec_Vec3f;
+
+static vec_Vec3f makeWaypoints()
+{
+  vec_Vec3f waypoints;
+  waypoints.push_back(Vec3f(0, 0, 1));
+  waypoints.push_back(Vec3f(1, 0, 1));
+  waypoints.push_back(Vec3f(2, 1, 1.5));
+  waypoints.push_back(Vec3f(3, 1, 2));
+  waypoints.push_back(Vec3f(4, 0, 2));
+  waypoints.push_back(Vec3f(5, 0, 1));
+  return waypoints;
+}
+
+static std::vector<float> makeTimes(unsigned int num_waypoints)
+{
+  std::vector<float> times;
+  for(unsigned int i = 0; i < num_waypoints; i++)
+    times.push_back(2.0f * i);
+  return times;
+}
+
+static void calculate(TrajectoryGenerator &traj_gen, const vec_Vec3f &waypoints, const std::vector<float> &times)
+{
+  traj_gen.setInitialConditions(waypoints[0], vec_Vec3f());
+  for(size_t i = 1; i < waypoints.size(); i++)
+    traj_gen.addWaypoint(waypoints[i]);
+  ASSERT_TRUE(traj_gen.calculate(times));
+}
+
+static void expectSameCommands(const TrajectoryGenerator &a, float a_start, const TrajectoryGenerator &b, float b_start,
+                               float duration)
+{
+  for(float t = 0; t < duration; t += 0.05f)
+  {
+    Vec3f a_pos, a_vel, a_acc, a_jrk, b_pos, b_vel, b_acc, b_jrk;
+    ASSERT_TRUE(a.getCommand(a_start + t, a_pos, a_vel, a_acc, a_jrk));
+    ASSERT_TRUE(b.getCommand(b_start + t, b_pos, b_vel, b_acc, b_jrk));
+    EXPECT_LT((a_pos - b_pos).norm(), 1e-3f) << "t = " << t;
+    EXPECT_LT((a_vel - b_vel).norm(), 1e-3f) << "t = " << t;
+    EXPECT_LT((a_acc - b_acc).norm(), 1e-2f) << "t = " << t;
+  }
+}
+
+TEST(TrajGenTest, ReplanKeepsFlownPrefix)
+{
+  const vec_Vec3f waypoints = makeWaypoints();
+  const std::vector<float> times = makeTimes(waypoints.size());
+  TrajectoryGenerator original(2, 3), traj_gen(2, 3);
+  calculate(original, waypoints, times);
+  calculate(traj_gen, waypoints, times);
+
+  vec_Vec3f new_waypoints = waypoints;
+  new_waypoints.back() = Vec3f(5, 2, 1);
+  ASSERT_TRUE(traj_gen.replan(1.0f, new_waypoints, times, 1));
+
+  // Only the last segments around the change are solved again
+  expectSameCommands(original, 0, traj_gen, 0, times[3]);
+  Vec3f pos, vel, acc, jrk;
+  ASSERT_TRUE(traj_gen.getCommand(traj_gen.getTotalTime(), pos, vel, acc, jrk));
+  EXPECT_LT((pos - new_waypoints.back()).norm(), 1e-3f);
+}
+
+TEST(TrajGenTest, ReplanUnchangedAfterOptimize)
+{
+  const vec_Vec3f waypoints = makeWaypoints();
+  const std::vector<float> times = makeTimes(waypoints.size());
+  TrajectoryGenerator original(2, 3), traj_gen(2, 3);
+  calculate(original, waypoints, times);
+  original.optimizeWaypointTimes(1.0f, 1.0f, 100.0f);
+  calculate(traj_gen, waypoints, times);
+  traj_gen.optimizeWaypointTimes(1.0f, 1.0f, 100.0f);
+  ASSERT_NE(traj_gen.getWaypointTimes(), times);
+
+  // The caller's own times are compared, not the optimized ones
+  ASSERT_TRUE(traj_gen.replan(1.0f, waypoints, times, 1));
+  EXPECT_EQ(traj_gen.getWaypointTimes(), original.getWaypointTimes());
+  expectSameCommands(original, 0, traj_gen, 0, original.getTotalTime());
+
+  vec_Vec3f new_waypoints = waypoints;
+  new_waypoints.back() = Vec3f(5, 1, 1);
+  ASSERT_TRUE(traj_gen.replan(1.0f, new_waypoints, times, 0));
+  const float splice_time = original.getWaypointTimes()[waypoints.size() - 2];
+  expectSameCommands(original, 0, traj_gen, 0, splice_time);
+}
+
+TEST(TrajGenTest, ReplanMatchesFullSolve)
+{
+  const vec_Vec3f waypoints = makeWaypoints();
+  const std::vector<float> times = makeTimes(waypoints.size());
+  TrajectoryGenerator traj_gen(2, 3);
+  calculate(traj_gen, waypoints, times);
+
+  // With a window reaching back to waypoint 2, the part after it is a full solve from the state at waypoint 2
+  const unsigned int start = 2;
+  Vec3f pos, vel, acc, jrk;
+  ASSERT_TRUE(traj_gen.getCommand(times[start], pos, vel, acc, jrk));
+
+  vec_Vec3f new_waypoints = waypoints;
+  new_waypoints[4] = Vec3f(4, -1, 2.5);
+  ASSERT_TRUE(traj_gen.replan(0.5f, new_waypoints, times, 1));
+
+  TrajectoryGenerator full(2, 3);
+  full.setInitialConditions(pos, vec_Vec3f{vel, acc});
+  std::vector<float> full_times(1, 0);
+  for(size_t i = start + 1; i < new_waypoints.size(); i++)
+  {
+    full.addWaypoint(new_waypoints[i]);
+    full_times.push_back(times[i] - times[start]);
+  }
+  ASSERT_TRUE(full.calculate(full_times));
+  expectSameCommands(traj_gen, times[start], full, 0, full.getTotalTime());
+}
+
+TEST(TrajGenTest, ReplanRespectsLimits)
+{
+  const float max_vel = 1.5f, max_acc = 1.0f, max_jrk = 100.0f;
+  const vec_Vec3f waypoints = makeWaypoints();
+  const std::vector<float> times = makeTimes(waypoints.size());
+  TrajectoryGenerator traj_gen(2, 3);
+  calculate(traj_gen, waypoints, times);
+  traj_gen.optimizeWaypointTimes(max_vel, max_acc, max_jrk);
+
+  std::vector<float> seg_max_vel, seg_max_acc, seg_max_jrk;
+  traj_gen.calcMaxPerSegment(seg_max_vel, seg_max_acc, seg_max_jrk);
+  for(size_t i = 0; i < seg_max_vel.size(); i++)
+  {
+    ASSERT_LE(seg_max_vel[i], max_vel);
+    ASSERT_LE(seg_max_acc[i], max_acc);
+  }
+
+  // A far away goal in the same time would exceed the limits
+  vec_Vec3f new_waypoints = waypoints;
+  new_waypoints.back() = Vec3f(12, 0, 1);
+  ASSERT_TRUE(traj_gen.replan(1.0f, new_waypoints, times, 1));
+
+  seg_max_vel.clear(), seg_max_acc.clear(), seg_max_jrk.clear();
+  traj_gen.calcMaxPerSegment(seg_max_vel, seg_max_acc, seg_max_jrk);
+  for(size_t i = 0; i < seg_max_vel.size(); i++)
+  {
+    EXPECT_LE(seg_max_vel[i], max_vel) << "segment " << i;
+    EXPECT_LE(seg_max_acc[i], max_acc) << "segment " << i;
+  }
+}
+
+template <typename Fixed>
+static void expectSameAsDynamic(unsigned int continuous_derivative_order, unsigned int minimize_derivative)
+{
+  const vec_Vec3f waypoints = makeWaypoints();
+  const std::vector<float> times = makeTimes(waypoints.size());
+  const vec_Vec3f initial_derivatives{Vec3f(0.5f, 0.2f, 0), Vec3f(0.1f, 0, -0.3f), Vec3f(0, 0.4f, 0)};
+  TrajectoryGenerator dynamic(continuous_derivative_order, minimize_derivative);
+  Fixed fixed;
+  TrajectoryGenerator *const traj_gens[] = {&dynamic, &fixed};
+  for(TrajectoryGenerator *traj_gen : traj_gens)
+  {
+    traj_gen->setInitialConditions(waypoints[0], initial_derivatives);
+    for(size_t i = 1; i < waypoints.size(); i++)
+      traj_gen->addWaypoint(waypoints[i]);
+    ASSERT_TRUE(traj_gen->calculate(times));
+  }
+
+  for(unsigned int i = 0; i + 1 < waypoints.size(); i++)
+    EXPECT_TRUE(fixed.getCoefficients(i).isApprox(dynamic.getCoefficients(i), 1e-3f)) << "segment " << i;
+  expectSameCommands(dynamic, 0, fixed, 0, dynamic.getTotalTime());
+
+  std::vector<float> dynamic_vel, dynamic_acc, dynamic_jrk, fixed_vel, fixed_acc, fixed_jrk;
+  dynamic.calcMaxPerSegment(dynamic_vel, dynamic_acc, dynamic_jrk);
+  fixed.calcMaxPerSegment(fixed_vel, fixed_acc, fixed_jrk);
+  ASSERT_EQ(fixed_vel.size(), dynamic_vel.size());
+  for(size_t i = 0; i < fixed_vel.size(); i++)
+  {
+    EXPECT_NEAR(fixed_vel[i], dynamic_vel[i], 1e-3f);
+    EXPECT_NEAR(fixed_acc[i], dynamic_acc[i], 1e-2f);
+  }
+}
+
+TEST(TrajGenTest, FixedMinJerkMatchesDynamic)
+{
+  expectSameAsDynamic<MinJerkTrajectoryGenerator>(2, 3);
+}
+
+TEST(TrajGenTest, FixedMinSnapMatchesDynamic)
+{
+  expectSameAsDynamic<MinSnapTrajectoryGenerator>(3, 4);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
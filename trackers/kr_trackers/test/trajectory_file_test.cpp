@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <kr_trackers/traj_gen_fixed.h>
+#include <kr_trackers/trajectory_file.h>
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+
+using Vec3f = TrajectoryGenerator::Vec3f;
+using vec_Vec3f = TrajectoryGenerator::vec_Vec3f;
+
+class TrajectoryFileTest : public ::testing::Test
+{
+ protected:
+  void SetUp() override
+  {
+    char filename[] = "/tmp/trajectory_file_testXXXXXX";
+    const int fd = mkstemp(filename);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    filename_ = filename;
+  }
+
+  void TearDown() override { std::remove(filename_.c_str()); }
+
+  static void calculate(TrajectoryGenerator &traj_gen)
+  {
+    traj_gen.setInitialConditions(Vec3f(0, 0, 1), vec_Vec3f{Vec3f(0.2f, 0, 0)});
+    traj_gen.addWaypoint(Vec3f(1, 0, 1));
+    traj_gen.addWaypoint(Vec3f(2, 1, 1.5));
+    traj_gen.addWaypoint(Vec3f(3, 1, 2));
+    ASSERT_TRUE(traj_gen.calculate({0, 1.5f, 3.5f, 5}));
+  }
+
+  std::string filename_;
+};
+
+TEST_F(TrajectoryFileTest, RoundTrip)
+{
+  MinJerkTrajectoryGenerator traj_gen;
+  calculate(traj_gen);
+  ASSERT_TRUE(writeTrajectoryFile(filename_, traj_gen));
+
+  TrajectoryFile traj_file;
+  ASSERT_TRUE(traj_file.open(filename_)) << traj_file.error();
+  EXPECT_EQ(traj_file.filename(), filename_);
+  EXPECT_EQ(traj_file.numSegments(), 3u);
+  EXPECT_FLOAT_EQ(traj_file.getTotalTime(), traj_gen.getTotalTime());
+
+  for(float t = 0; t <= traj_gen.getTotalTime(); t += 0.1f)
+  {
+    Vec3f pos, vel, acc, jrk, file_pos, file_vel, file_acc, file_jrk;
+    ASSERT_TRUE(traj_gen.getCommand(t, pos, vel, acc, jrk));
+    traj_file.getCommand(t, file_pos, file_vel, file_acc, file_jrk);
+    EXPECT_LT((pos - file_pos).norm(), 1e-5f) << "t = " << t;
+    EXPECT_LT((vel - file_vel).norm(), 1e-5f) << "t = " << t;
+    EXPECT_LT((acc - file_acc).norm(), 1e-4f) << "t = " << t;
+    EXPECT_LT((jrk - file_jrk).norm(), 1e-3f) << "t = " << t;
+  }
+
+  // Times outside of the trajectory are clamped to its ends
+  Vec3f pos, vel, acc, jrk;
+  traj_file.getCommand(traj_gen.getTotalTime() + 10, pos, vel, acc, jrk);
+  EXPECT_LT((pos - Vec3f(3, 1, 2)).norm(), 1e-4f);
+  traj_file.getCommand(-1, pos, vel, acc, jrk);
+  EXPECT_LT((pos - Vec3f(0, 0, 1)).norm(), 1e-4f);
+
+  traj_file.close();
+  EXPECT_FALSE(traj_file.isOpen());
+}
+
+TEST_F(TrajectoryFileTest, RejectsTruncatedFile)
+{
+  TrajectoryGenerator traj_gen(2, 3);
+  calculate(traj_gen);
+  ASSERT_TRUE(writeTrajectoryFile(filename_, traj_gen));
+  ASSERT_EQ(truncate(filename_.c_str(), sizeof(TrajectoryFileHeader) + 8), 0);
+
+  TrajectoryFile traj_file;
+  EXPECT_FALSE(traj_file.open(filename_));
+  EXPECT_FALSE(traj_file.isOpen());
+  EXPECT_FALSE(traj_file.error().empty());
+}
+
+TEST_F(TrajectoryFileTest, RejectsOtherFile)
+{
+  std::ofstream(filename_) << "not a trajectory file, but long enough for the header";
+
+  TrajectoryFile traj_file;
+  EXPECT_FALSE(traj_file.open(filename_));
+  EXPECT_FALSE(traj_file.isOpen());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -2,9 +2,13 @@
 #define TRACKERS_MANAGER_TRACKER_H_
 
 #include <kr_mav_msgs/PositionCommand.h>
+#include <kr_tracker_msgs/TrackerPreview.h>
+#include <kr_trackers_manager/offline_params.h>
 #include <nav_msgs/Odometry.h>
 #include <ros/ros.h>
 
+#include <functional>
+
 namespace kr_trackers_manager
 {
 class Tracker
@@ -19,6 +23,30 @@ class Tracker
    */
   virtual void Initialize(const ros::NodeHandle &nh) = 0;
 
+  /**
+   * @brief Initialize the tracker without a ROS master, e.g. to replay a bag offline. Like Initialize(), but the params
+   * are read from params and no topics are set up, the messages the tracker would receive are given to replay()
+   * instead. Optional, the default implementation returns false for trackers which cannot run offline.
+   *
+   * @param params The params of the kr_trackers_manager's namespace.
+   *
+   * @return True if the tracker was initialized.
+   */
+  virtual bool InitializeOffline(const OfflineParams &params) { return false; }
+
+  /**
+   * @brief Give a tracker initialized with InitializeOffline() a message recorded on one of its topics, e.g. a goal or
+   * cancel request for its action server.
+   *
+   * @param topic The topic relative to the kr_trackers_manager's namespace, e.g.
+   * "line_tracker_min_jerk/LineTracker/goal".
+   * @param data The serialized message.
+   * @param size The size of the serialized message.
+   *
+   * @return True if the topic is one of the tracker's.
+   */
+  virtual bool replay(const std::string &topic, const uint8_t *data, uint32_t size) { return false; }
+
   /**
    * @brief Activate the tracker. This indicates that the tracker should get ready to publish commands.
    *
@@ -35,9 +63,8 @@ class Tracker
   virtual void Deactivate(void) = 0;
 
   /**
-   * @brief Get the current command output from the tracker.
-   * Note that this function is still called even if the tracker has not been activated. This is for cases when the
-   * tracker would want to use the previous robot odometry to compute current commands.
+   * @brief Get the current command output from the tracker. Only called when the tracker has been activated, the
+   * odometry is given to observe() otherwise.
    *
    * @param msg The current odometry message which should be used by the tracker to generate the command.
    *
@@ -46,12 +73,85 @@ class Tracker
    */
   virtual kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &msg) = 0;
 
+  /**
+   * @brief Get the odometry while the tracker is not active. This is for cases when the tracker would want to use the
+   * previous robot odometry when it gets a goal or is activated, so it should only keep what it needs, e.g. the
+   * message pointer, and leave the processing until the odometry is used.
+   * The default implementation calls update() and ignores the command, for trackers which do not separate the two.
+   *
+   * @param msg The current odometry message.
+   */
+  virtual void observe(const nav_msgs::Odometry::ConstPtr &msg) { update(msg); }
+
   /**
    * @brief Get status of the tracker. Only called when the tracker has been activated.
    *
    * @return The tracker status (see the options in the TrackerStatus message).
    */
   virtual uint8_t status() const = 0;
+
+  /**
+   * @brief Get the commands the tracker would output over a future time horizon, assuming nothing changes its goal.
+   * Only called when the tracker has been activated. Optional, the default implementation provides no preview.
+   *
+   * @param t0 The time of the first sample.
+   * @param dt The time between samples.
+   * @param n The number of samples, at most TrackerPreview::MAX_SAMPLES.
+   * @param preview Message to fill with the samples and num_samples, the header, tracker and dt are set by the caller.
+   *
+   * @return True if the preview was filled, false if the tracker cannot provide one.
+   */
+  virtual bool preview(const ros::Time &t0, float dt, unsigned int n, kr_tracker_msgs::TrackerPreview &preview) const
+  {
+    return false;
+  }
+
+  /**
+   * @brief Set the time source used by the tracker instead of ros::Time::now(). The kr_trackers_manager sets it to
+   * the stamp of the odometry being processed, so the output only depends on the input messages and can be replayed
+   * faster than real time.
+   *
+   * @param clock Function returning the current time, an empty function restores ros::Time::now().
+   */
+  void setClock(const std::function<ros::Time()> &clock) { clock_ = clock; }
+
+  /**
+   * @brief Set the function used by the tracker to make itself the active tracker, e.g. when it gets a goal which asks
+   * for it. Set by the kr_trackers_manager.
+   *
+   * @param activate Function taking the tracker and the time the request was sent, returning true if the tracker is
+   * active afterwards.
+   */
+  void setActivationCallback(const std::function<bool(Tracker *, const ros::Time &)> &activate)
+  {
+    activate_ = activate;
+  }
+
+ protected:
+  /**
+   * @brief The current time for the tracker, should be used instead of ros::Time::now().
+   */
+  ros::Time now() const { return clock_ ? clock_() : ros::Time::now(); }
+
+  /**
+   * @brief Convert a ROS time, e.g. a start time given in a goal, to the time of the tracker so it can be compared with
+   * now(). The two differ when the kr_trackers_manager uses the odometry stamps as the time of the trackers.
+   */
+  ros::Time fromRosTime(const ros::Time &t) const { return clock_ ? t + (clock_() - ros::Time::now()) : t; }
+
+  /**
+   * @brief Ask the kr_trackers_manager to make this the active tracker, as a call to its transition service would. Must
+   * be called from the callbacks of the tracker, which run in the thread of the kr_trackers_manager.
+   *
+   * @param request_time When the request was sent, to report the switching latency.
+   *
+   * @return True if the tracker is active.
+   */
+  bool requestActivation(const ros::Time &request_time) { return activate_ ? activate_(this, request_time) : false; }
+
+ private:
+  std::function<ros::Time()> clock_;
+  std::function<bool(Tracker *, const ros::Time &)> activate_;
 };
 
 }  // namespace kr_trackers_manager
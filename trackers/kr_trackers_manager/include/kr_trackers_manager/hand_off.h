@@ -0,0 +1,32 @@
+#ifndef TRACKERS_MANAGER_HAND_OFF_H_
+#define TRACKERS_MANAGER_HAND_OFF_H_
+
+#include <kr_mav_msgs/PositionCommand.h>
+
+#include <string>
+
+namespace kr_trackers_manager
+{
+/**
+ * @brief How far the first command of a tracker taking over may be from the last command of the tracker it replaces.
+ */
+struct HandOffLimits
+{
+  float position;
+  float velocity;
+  float acceleration;
+};
+
+/**
+ * @brief Check that the first command of a tracker taking over continues the last command of the active tracker, both
+ * computed for the same odometry.
+ *
+ * @param message Describes the jumps if they are over the limits.
+ *
+ * @return True if the position, velocity and acceleration are all within the limits.
+ */
+bool checkHandOff(const kr_mav_msgs::PositionCommand &last, const kr_mav_msgs::PositionCommand &first,
+                  const HandOffLimits &limits, std::string &message);
+}  // namespace kr_trackers_manager
+
+#endif  // TRACKERS_MANAGER_HAND_OFF_H_
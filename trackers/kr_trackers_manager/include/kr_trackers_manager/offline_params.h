@@ -0,0 +1,90 @@
+#ifndef TRACKERS_MANAGER_OFFLINE_PARAMS_H_
+#define TRACKERS_MANAGER_OFFLINE_PARAMS_H_
+
+#include <ros/serialization.h>
+#include <xmlrpcpp/XmlRpcValue.h>
+
+#include <boost/make_shared.hpp>
+#include <memory>
+#include <string>
+
+namespace kr_trackers_manager
+{
+/**
+ * @brief Params held in an XmlRpc struct instead of the parameter server, for running trackers without a ROS master.
+ * Has the param interface of a ros::NodeHandle, so the same code can read the params from either.
+ */
+class OfflineParams
+{
+ public:
+  /**
+   * @param params Struct with the params, in the layout they would have on the parameter server.
+   */
+  explicit OfflineParams(const XmlRpc::XmlRpcValue &params = XmlRpc::XmlRpcValue());
+
+  /**
+   * @brief The params in the namespace ns of parent, as ros::NodeHandle(parent, ns) would see them.
+   */
+  OfflineParams(const OfflineParams &parent, const std::string &ns);
+
+  /**
+   * @brief The namespace relative to the params given to the first constructor, empty for those.
+   */
+  const std::string &getNamespace() const { return namespace_; }
+
+  bool hasParam(const std::string &key) const;
+
+  bool getParam(const std::string &key, XmlRpc::XmlRpcValue &value) const;
+  bool getParam(const std::string &key, std::string &value) const;
+  bool getParam(const std::string &key, double &value) const;
+  bool getParam(const std::string &key, float &value) const;
+  bool getParam(const std::string &key, int &value) const;
+  bool getParam(const std::string &key, bool &value) const;
+
+  /**
+   * @brief Get a param, or the default if it is not set or has another type.
+   *
+   * @return True if the param was set.
+   */
+  template <typename T>
+  bool param(const std::string &key, T &value, const T &default_value) const
+  {
+    if(getParam(key, value))
+      return true;
+    value = default_value;
+    return false;
+  }
+
+  template <typename T>
+  T param(const std::string &key, const T &default_value) const
+  {
+    T value;
+    param(key, value, default_value);
+    return value;
+  }
+
+ private:
+  // The value for key in the namespace, NULL if it is not set
+  XmlRpc::XmlRpcValue *find(const std::string &key) const;
+
+  // Shared with the children, XmlRpcValue copies its members
+  std::shared_ptr<XmlRpc::XmlRpcValue> params_;
+  std::string namespace_;
+};
+
+/**
+ * @brief Deserialize a message given to Tracker::replay(). Throws ros::serialization::StreamOverrunException if the
+ * data is too short for the message.
+ */
+template <typename M>
+boost::shared_ptr<M> deserializeReplayMessage(const uint8_t *data, uint32_t size)
+{
+  boost::shared_ptr<M> msg = boost::make_shared<M>();
+  ros::serialization::IStream stream(const_cast<uint8_t *>(data), size);
+  ros::serialization::deserialize(stream, *msg);
+  return msg;
+}
+
+}  // namespace kr_trackers_manager
+
+#endif
@@ -0,0 +1,28 @@
+#include <kr_trackers_manager/hand_off.h>
+
+#include <cmath>
+#include <cstdio>
+
+template <typename T>
+static float distance(const T &a, const T &b)
+{
+  return std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) + (a.z - b.z) * (a.z - b.z));
+}
+
+namespace kr_trackers_manager
+{
+bool checkHandOff(const kr_mav_msgs::PositionCommand &last, const kr_mav_msgs::PositionCommand &first,
+                  const HandOffLimits &limits, std::string &message)
+{
+  const float position_jump = distance(first.position, last.position);
+  const float velocity_jump = distance(first.velocity, last.velocity);
+  const float acceleration_jump = distance(first.acceleration, last.acceleration);
+  if(position_jump <= limits.position && velocity_jump <= limits.velocity && acceleration_jump <= limits.acceleration)
+    return true;
+
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), "%.2f m, %.2f m/s and %.2f m/s^2", position_jump, velocity_jump, acceleration_jump);
+  message = buffer;
+  return false;
+}
+}  // namespace kr_trackers_manager
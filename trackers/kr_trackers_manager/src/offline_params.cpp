@@ -0,0 +1,98 @@
+#include <kr_trackers_manager/offline_params.h>
+
+#include <sstream>
+
+namespace kr_trackers_manager
+{
+OfflineParams::OfflineParams(const XmlRpc::XmlRpcValue &params)
+    : params_(std::make_shared<XmlRpc::XmlRpcValue>(params))
+{
+}
+
+OfflineParams::OfflineParams(const OfflineParams &parent, const std::string &ns)
+    : params_(parent.params_), namespace_(parent.namespace_.empty() ? ns : parent.namespace_ + "/" + ns)
+{
+}
+
+XmlRpc::XmlRpcValue *OfflineParams::find(const std::string &key) const
+{
+  XmlRpc::XmlRpcValue *value = params_.get();
+  std::istringstream path(namespace_ + "/" + key);
+  std::string name;
+  while(std::getline(path, name, '/'))
+  {
+    if(name.empty())
+      continue;
+    if(value->getType() != XmlRpc::XmlRpcValue::TypeStruct || !value->hasMember(name))
+      return NULL;
+    value = &(*value)[name];
+  }
+  return value;
+}
+
+bool OfflineParams::hasParam(const std::string &key) const
+{
+  return find(key) != NULL;
+}
+
+bool OfflineParams::getParam(const std::string &key, XmlRpc::XmlRpcValue &value) const
+{
+  const XmlRpc::XmlRpcValue *v = find(key);
+  if(v == NULL)
+    return false;
+  value = *v;
+  return true;
+}
+
+bool OfflineParams::getParam(const std::string &key, std::string &value) const
+{
+  XmlRpc::XmlRpcValue *v = find(key);
+  if(v == NULL || v->getType() != XmlRpc::XmlRpcValue::TypeString)
+    return false;
+  value = static_cast<std::string &>(*v);
+  return true;
+}
+
+bool OfflineParams::getParam(const std::string &key, double &value) const
+{
+  // Integers are accepted for doubles, as by ros::NodeHandle
+  XmlRpc::XmlRpcValue *v = find(key);
+  if(v == NULL)
+    return false;
+  if(v->getType() == XmlRpc::XmlRpcValue::TypeDouble)
+    value = static_cast<double &>(*v);
+  else if(v->getType() == XmlRpc::XmlRpcValue::TypeInt)
+    value = static_cast<int &>(*v);
+  else
+    return false;
+  return true;
+}
+
+bool OfflineParams::getParam(const std::string &key, float &value) const
+{
+  double d;
+  if(!getParam(key, d))
+    return false;
+  value = d;
+  return true;
+}
+
+bool OfflineParams::getParam(const std::string &key, int &value) const
+{
+  XmlRpc::XmlRpcValue *v = find(key);
+  if(v == NULL || v->getType() != XmlRpc::XmlRpcValue::TypeInt)
+    return false;
+  value = static_cast<int &>(*v);
+  return true;
+}
+
+bool OfflineParams::getParam(const std::string &key, bool &value) const
+{
+  XmlRpc::XmlRpcValue *v = find(key);
+  if(v == NULL || v->getType() != XmlRpc::XmlRpcValue::TypeBoolean)
+    return false;
+  value = static_cast<bool &>(*v);
+  return true;
+}
+
+}  // namespace kr_trackers_manager
@@ -1,11 +1,20 @@
+#include <kr_flight_recorder/flight_recorder.h>
+#include <kr_flight_recorder/records.h>
+#include <kr_tracker_msgs/TrackerPreview.h>
 #include <kr_tracker_msgs/TrackerStatus.h>
 #include <kr_tracker_msgs/Transition.h>
 #include <kr_trackers_manager/Tracker.h>
+#include <kr_trackers_manager/hand_off.h>
 #include <nav_msgs/Odometry.h>
 #include <nodelet/nodelet.h>
 #include <pluginlib/class_loader.h>
 #include <ros/ros.h>
 
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
 class TrackersManager : public nodelet::Nodelet
 {
  public:
@@ -16,19 +25,79 @@ class TrackersManager : public nodelet::Nodelet
 
  private:
   void odom_callback(const nav_msgs::Odometry::ConstPtr &msg);
+  void cmd_callback(const ros::TimerEvent &e);
+  void update_active_tracker(const nav_msgs::Odometry::ConstPtr &msg);
   bool transition_callback(kr_tracker_msgs::Transition::Request &req, kr_tracker_msgs::Transition::Response &res);
+  bool transition_when_done_callback(kr_tracker_msgs::Transition::Request &req,
+                                     kr_tracker_msgs::Transition::Response &res);
+  bool activation_callback(kr_trackers_manager::Tracker *tracker, const ros::Time &request_time);
+  bool transition(const std::map<std::string, kr_trackers_manager::Tracker *>::iterator &it, std::string &message);
+  void set_active_tracker(const std::map<std::string, kr_trackers_manager::Tracker *>::iterator &it);
+  // Switches to the armed tracker if its first command continues the last one, keeps the active tracker otherwise
+  void hand_off(const nav_msgs::Odometry::ConstPtr &msg);
+  void preview_callback(const ros::TimerEvent &e);
+  void record_update(const nav_msgs::Odometry &odom, float update_time, uint8_t status);
+  void publish_status(const ros::Time &stamp, uint8_t status);
+  ros::Time odom_clock_now() const;
 
   ros::Subscriber sub_odom_;
-  ros::Publisher pub_cmd_, pub_status_;
-  ros::ServiceServer srv_tracker_;
+  ros::Publisher pub_cmd_, pub_status_, pub_preview_;
+  ros::ServiceServer srv_tracker_, srv_tracker_when_done_;
+  ros::Timer preview_timer_, cmd_timer_;
+  float preview_dt_;
+  int preview_samples_;
   pluginlib::ClassLoader<kr_trackers_manager::Tracker> tracker_loader_;
   kr_trackers_manager::Tracker *active_tracker_;
+  std::string active_tracker_name_;
   std::map<std::string, kr_trackers_manager::Tracker *> tracker_map_;
+  // All the trackers except the active one, which only observe the odometry
+  std::vector<kr_trackers_manager::Tracker *> inactive_trackers_;
   kr_mav_msgs::PositionCommand::ConstPtr cmd_;
+
+  // Tracker switched to at the first update after the active tracker succeeded, tracker_map_.end() if none. Set by
+  // transition_when_done, cleared by any other transition.
+  std::map<std::string, kr_trackers_manager::Tracker *>::iterator armed_tracker_;
+  kr_trackers_manager::HandOffLimits handoff_limits_;
+
+  // With a command rate set, the active tracker is updated by cmd_timer_ with the latest odometry instead of on each
+  // odometry message, as long as the odometry was received within odom_timeout_
+  nav_msgs::Odometry::ConstPtr odom_;
+  ros::Time odom_receive_time_;
+  ros::Duration odom_timeout_;
+
+  // With use_odom_clock_, the trackers get the time from the odometry stamps instead of ros::Time::now(), so that
+  // their output does not depend on when the messages are processed
+  bool use_odom_clock_;
+  ros::Time tracker_time_;
+
+  // The status is published when it changes and at status_period_ otherwise
+  ros::Duration status_period_;
+  ros::Time last_status_time_;
+  uint8_t last_status_;
+  bool status_published_;
+  // Echoed in the status, so that the sender of a goal activating its tracker knows when it was handled
+  ros::Time activation_request_;
+  bool activation_succeeded_;
+
+  // Latency of the transitions requested by the trackers, from the request being sent to the tracker being active
+  unsigned int num_requested_transitions_;
+  double total_transition_latency_, max_transition_latency_;
+
+  // Set when the flight_log param names a file
+  std::unique_ptr<kr_flight_recorder::FlightRecorder> recorder_;
 };
 
 TrackersManager::TrackersManager(void)
-    : tracker_loader_("kr_trackers_manager", "kr_trackers_manager::Tracker"), active_tracker_(NULL)
+    : tracker_loader_("kr_trackers_manager", "kr_trackers_manager::Tracker"),
+      active_tracker_(NULL),
+      armed_tracker_(tracker_map_.end()),
+      use_odom_clock_(false),
+      last_status_(0),
+      status_published_(false),
+      activation_succeeded_(false),
+      num_requested_transitions_(0),
+      total_transition_latency_(0),
+      max_transition_latency_(0)
 {
 }
 
@@ -55,6 +124,8 @@ void TrackersManager::onInit(void)
 {
   ros::NodeHandle priv_nh(getPrivateNodeHandle());
 
+  priv_nh.param("use_odom_clock", use_odom_clock_, false);
+
   XmlRpc::XmlRpcValue tracker_list;
   priv_nh.getParam("trackers", tracker_list);
   ROS_ASSERT(tracker_list.getType() == XmlRpc::XmlRpcValue::TypeArray);
@@ -69,6 +140,11 @@ void TrackersManager::onInit(void)
 #else
       kr_trackers_manager::Tracker *c = tracker_loader_.createClassInstance(tracker_name);
 #endif
+      if(use_odom_clock_)
+        c->setClock([this]() { return tracker_time_; });
+      c->setActivationCallback([this](kr_trackers_manager::Tracker *tracker, const ros::Time &request_time) {
+        return activation_callback(tracker, request_time);
+      });
       c->Initialize(priv_nh);
       tracker_map_.insert(std::make_pair(tracker_name, c));
     }
@@ -82,36 +158,183 @@ void TrackersManager::onInit(void)
     }
   }
 
+  for(const auto &tracker : tracker_map_)
+    inactive_trackers_.push_back(tracker.second);
+
+  double status_rate;
+  priv_nh.param("status_rate", status_rate, 10.0);
+  status_period_ = status_rate > 0 ? ros::Duration(1.0 / status_rate) : ros::Duration(0);
+
   pub_cmd_ = priv_nh.advertise<kr_mav_msgs::PositionCommand>("cmd", 10);
   pub_status_ = priv_nh.advertise<kr_tracker_msgs::TrackerStatus>("status", 10);
 
   sub_odom_ = priv_nh.subscribe("odom", 10, &TrackersManager::odom_callback, this, ros::TransportHints().tcpNoDelay());
 
+  double cmd_rate, odom_timeout;
+  priv_nh.param("cmd_rate", cmd_rate, 0.0);
+  priv_nh.param("odom_timeout", odom_timeout, 0.1);
+  odom_timeout_ = ros::Duration(odom_timeout);
+  if(cmd_rate > 0)
+    cmd_timer_ = priv_nh.createTimer(ros::Duration(1.0 / cmd_rate), &TrackersManager::cmd_callback, this);
+
   srv_tracker_ = priv_nh.advertiseService("transition", &TrackersManager::transition_callback, this);
+  srv_tracker_when_done_ =
+      priv_nh.advertiseService("transition_when_done", &TrackersManager::transition_when_done_callback, this);
+  priv_nh.param("max_handoff_position_jump", handoff_limits_.position, 0.2f);
+  priv_nh.param("max_handoff_velocity_jump", handoff_limits_.velocity, 0.1f);
+  priv_nh.param("max_handoff_acceleration_jump", handoff_limits_.acceleration, 0.5f);
+
+  // Binary record of each update of the active tracker, converted with flight_log_to_csv
+  std::string flight_log;
+  priv_nh.param("flight_log", flight_log, std::string());
+  if(!flight_log.empty())
+  {
+    int buffer_size, log_size_mb;
+    priv_nh.param("flight_log_buffer", buffer_size, 4096);
+    priv_nh.param("flight_log_size_mb", log_size_mb, 64);
+    recorder_.reset(new kr_flight_recorder::FlightRecorder(kr_flight_recorder::TrackerRecord::TYPE,
+                                                           sizeof(kr_flight_recorder::TrackerRecord), buffer_size));
+    if(!recorder_->open(flight_log, static_cast<size_t>(log_size_mb) << 20))
+      recorder_.reset();
+  }
+
+  // Preview of the reference from the active tracker, for controllers which need to look ahead
+  double preview_rate;
+  priv_nh.param("preview_rate", preview_rate, 0.0);
+  priv_nh.param("preview_dt", preview_dt_, 0.05f);
+  priv_nh.param("preview_samples", preview_samples_, 20);
+  preview_samples_ =
+      std::min(std::max(1, preview_samples_), static_cast<int>(kr_tracker_msgs::TrackerPreview::MAX_SAMPLES));
+  if(preview_rate > 0 && preview_dt_ > 0)
+  {
+    pub_preview_ = priv_nh.advertise<kr_tracker_msgs::TrackerPreview>("preview", 10);
+    preview_timer_ = priv_nh.createTimer(ros::Duration(1.0 / preview_rate), &TrackersManager::preview_callback, this);
+  }
 }
 
 void TrackersManager::odom_callback(const nav_msgs::Odometry::ConstPtr &msg)
 {
-  std::map<std::string, kr_trackers_manager::Tracker *>::iterator it;
-  for(it = tracker_map_.begin(); it != tracker_map_.end(); it++)
+  odom_ = msg;
+  odom_receive_time_ = ros::Time::now();
+  tracker_time_ = msg->header.stamp;
+
+  for(kr_trackers_manager::Tracker *tracker : inactive_trackers_)
+    tracker->observe(msg);
+
+  if(cmd_timer_.isValid())
+    return;
+
+  update_active_tracker(msg);
+}
+
+void TrackersManager::cmd_callback(const ros::TimerEvent &e)
+{
+  if(odom_ == NULL)
+    return;
+
+  const ros::Duration odom_age = ros::Time::now() - odom_receive_time_;
+  if(odom_age > odom_timeout_)
   {
-    if(it->second == active_tracker_)
-    {
-      cmd_ = it->second->update(msg);
-      if(cmd_ != NULL)
-        pub_cmd_.publish(cmd_);
-
-      kr_tracker_msgs::TrackerStatus::Ptr status_msg(new kr_tracker_msgs::TrackerStatus);
-      status_msg->header.stamp = msg->header.stamp;
-      status_msg->tracker = it->first;
-      status_msg->status = it->second->status();
-      pub_status_.publish(status_msg);
-    }
-    else
-    {
-      it->second->update(msg);
-    }
+    NODELET_WARN_THROTTLE(1, "No odometry received for %g s, not publishing commands", odom_age.toSec());
+    return;
+  }
+
+  // The odometry is reused until the next one arrives, so the time is advanced from its stamp
+  tracker_time_ = odom_clock_now();
+  update_active_tracker(odom_);
+}
+
+void TrackersManager::update_active_tracker(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  if(active_tracker_ == NULL)
+    return;
+
+  const auto update_start = std::chrono::steady_clock::now();
+  cmd_ = active_tracker_->update(msg);
+  if(armed_tracker_ != tracker_map_.end() && active_tracker_->status() == kr_tracker_msgs::TrackerStatus::SUCCEEDED)
+    hand_off(msg);
+  const float update_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - update_start).count();
+  if(cmd_ != NULL)
+    pub_cmd_.publish(cmd_);
+
+  const uint8_t status = active_tracker_->status();
+  if(recorder_)
+    record_update(*msg, update_time, status);
+  const ros::Duration since_status = msg->header.stamp - last_status_time_;
+  if(!status_published_ || status != last_status_ || since_status >= status_period_ || since_status < ros::Duration(0))
+    publish_status(msg->header.stamp, status);
+}
+
+void TrackersManager::publish_status(const ros::Time &stamp, uint8_t status)
+{
+  kr_tracker_msgs::TrackerStatus::Ptr status_msg(new kr_tracker_msgs::TrackerStatus);
+  status_msg->header.stamp = stamp;
+  status_msg->tracker = active_tracker_name_;
+  status_msg->status = status;
+  status_msg->activation_request = activation_request_;
+  status_msg->activation_succeeded = activation_succeeded_;
+  pub_status_.publish(status_msg);
+
+  last_status_ = status;
+  last_status_time_ = stamp;
+  status_published_ = true;
+}
+
+void TrackersManager::record_update(const nav_msgs::Odometry &odom, float update_time, uint8_t status)
+{
+  kr_flight_recorder::TrackerRecord r = {};
+  r.stamp = ros::Time::now().toNSec();
+  r.odom_stamp = odom.header.stamp.toNSec();
+  r.pos[0] = odom.pose.pose.position.x;
+  r.pos[1] = odom.pose.pose.position.y;
+  r.pos[2] = odom.pose.pose.position.z;
+  r.vel[0] = odom.twist.twist.linear.x;
+  r.vel[1] = odom.twist.twist.linear.y;
+  r.vel[2] = odom.twist.twist.linear.z;
+  if(cmd_ != NULL)
+  {
+    r.has_cmd = 1;
+    r.cmd_pos[0] = cmd_->position.x;
+    r.cmd_pos[1] = cmd_->position.y;
+    r.cmd_pos[2] = cmd_->position.z;
+    r.cmd_vel[0] = cmd_->velocity.x;
+    r.cmd_vel[1] = cmd_->velocity.y;
+    r.cmd_vel[2] = cmd_->velocity.z;
+    r.cmd_acc[0] = cmd_->acceleration.x;
+    r.cmd_acc[1] = cmd_->acceleration.y;
+    r.cmd_acc[2] = cmd_->acceleration.z;
+    r.cmd_jrk[0] = cmd_->jerk.x;
+    r.cmd_jrk[1] = cmd_->jerk.y;
+    r.cmd_jrk[2] = cmd_->jerk.z;
+    r.cmd_yaw = cmd_->yaw;
+    r.cmd_yaw_dot = cmd_->yaw_dot;
   }
+  r.update_time = update_time;
+  r.status = status;
+  strncpy(r.tracker, active_tracker_name_.c_str(), sizeof(r.tracker) - 1);
+  recorder_->record(r);
+}
+
+void TrackersManager::preview_callback(const ros::TimerEvent &e)
+{
+  if(active_tracker_ == NULL || pub_preview_.getNumSubscribers() == 0)
+    return;
+
+  kr_tracker_msgs::TrackerPreview::Ptr preview_msg(new kr_tracker_msgs::TrackerPreview);
+  preview_msg->header.stamp = use_odom_clock_ ? odom_clock_now() : ros::Time::now();
+  if(cmd_ != NULL)
+    preview_msg->header.frame_id = cmd_->header.frame_id;
+  preview_msg->tracker = active_tracker_name_;
+  preview_msg->dt = preview_dt_;
+  if(active_tracker_->preview(preview_msg->header.stamp, preview_dt_, preview_samples_, *preview_msg))
+    pub_preview_.publish(preview_msg);
+}
+
+ros::Time TrackersManager::odom_clock_now() const
+{
+  if(odom_ == NULL)
+    return ros::Time();
+  return odom_->header.stamp + (ros::Time::now() - odom_receive_time_);
 }
 
 bool TrackersManager::transition_callback(kr_tracker_msgs::Transition::Request &req,
@@ -125,32 +348,148 @@ bool TrackersManager::transition_callback(kr_tracker_msgs::Transition::Request &
     NODELET_WARN_STREAM(res.message);
     return true;
   }
-  if(active_tracker_ == it->second)
+
+  res.success = transition(it, res.message);
+  return true;
+}
+
+bool TrackersManager::transition_when_done_callback(kr_tracker_msgs::Transition::Request &req,
+                                                    kr_tracker_msgs::Transition::Response &res)
+{
+  // An empty tracker cancels the switch
+  if(req.tracker.empty())
   {
+    armed_tracker_ = tracker_map_.end();
     res.success = true;
-    res.message = std::string("Tracker ") + req.tracker + std::string(" already active");
-    NODELET_INFO_STREAM(res.message);
+    res.message = "No tracker armed";
     return true;
   }
 
-  if(!it->second->Activate(cmd_))
+  const std::map<std::string, kr_trackers_manager::Tracker *>::iterator it = tracker_map_.find(req.tracker);
+  if(it == tracker_map_.end() || it->second == active_tracker_)
   {
     res.success = false;
-    res.message = std::string("Failed to activate tracker ") + req.tracker + std::string(", cannot transition");
+    res.message = (it == tracker_map_.end() ? std::string("Cannot find tracker ") : std::string("Already active ")) +
+                  req.tracker + std::string(", cannot arm it");
     NODELET_WARN_STREAM(res.message);
     return true;
   }
 
+  armed_tracker_ = it;
+  res.success = true;
+  res.message = std::string("Tracker ") + it->first + std::string(" armed");
+  NODELET_INFO_STREAM(res.message);
+  return true;
+}
+
+void TrackersManager::hand_off(const nav_msgs::Odometry::ConstPtr &msg)
+{
+  const std::map<std::string, kr_trackers_manager::Tracker *>::iterator it = armed_tracker_;
+  armed_tracker_ = tracker_map_.end();
+
+  // Deactivating the armed tracker aborts its goal, so whoever armed it knows it did not start
+  if(!it->second->Activate(cmd_))
+  {
+    NODELET_WARN_STREAM("Failed to activate the armed tracker " << it->first << ", keeping " << active_tracker_name_);
+    it->second->Deactivate();
+    return;
+  }
+
+  // Both commands are for the same odometry, so they should match where one trajectory hands off to the next
+  const kr_mav_msgs::PositionCommand::ConstPtr cmd = it->second->update(msg);
+  std::string message;
+  if(cmd != NULL && cmd_ != NULL && !kr_trackers_manager::checkHandOff(*cmd_, *cmd, handoff_limits_, message))
+  {
+    NODELET_WARN("Armed tracker %s starts %s away from the command, keeping %s", it->first.c_str(), message.c_str(),
+                 active_tracker_name_.c_str());
+    it->second->Deactivate();
+    return;
+  }
+
+  active_tracker_->Deactivate();
+  set_active_tracker(it);
+  cmd_ = cmd;
+  NODELET_INFO_STREAM("Handed off to tracker " << it->first);
+}
+
+bool TrackersManager::activation_callback(kr_trackers_manager::Tracker *tracker, const ros::Time &request_time)
+{
+  std::map<std::string, kr_trackers_manager::Tracker *>::iterator it = tracker_map_.begin();
+  while(it != tracker_map_.end() && it->second != tracker)
+    it++;
+  if(it == tracker_map_.end())
+    return false;
+
+  const bool was_active = (active_tracker_ == tracker);
+  std::string message;
+  const bool activated = transition(it, message);
+
+  // Answered right away, also when the tracker was active already or could not be activated, instead of leaving the
+  // sender waiting for the next update or the result of the goal
+  if(!request_time.isZero())
+  {
+    activation_request_ = request_time;
+    activation_succeeded_ = activated;
+    publish_status(use_odom_clock_ ? odom_clock_now() : ros::Time::now(),
+                   active_tracker_ != NULL ? active_tracker_->status() : last_status_);
+  }
+  if(!activated)
+    return false;
+
+  // The latency from the request being sent, which includes the time to deliver the goal carrying it
+  if(!was_active && !request_time.isZero())
+  {
+    const double latency = (ros::Time::now() - request_time).toSec();
+    num_requested_transitions_++;
+    total_transition_latency_ += latency;
+    max_transition_latency_ = std::max(max_transition_latency_, latency);
+    NODELET_INFO("%s on request, %.1f ms after it was sent (mean %.1f ms, max %.1f ms over %u requests)",
+                 message.c_str(), 1e3 * latency, 1e3 * total_transition_latency_ / num_requested_transitions_,
+                 1e3 * max_transition_latency_, num_requested_transitions_);
+  }
+  return true;
+}
+
+bool TrackersManager::transition(const std::map<std::string, kr_trackers_manager::Tracker *>::iterator &it,
+                                 std::string &message)
+{
+  if(active_tracker_ == it->second)
+  {
+    message = std::string("Tracker ") + it->first + std::string(" already active");
+    NODELET_INFO_STREAM(message);
+    return true;
+  }
+
+  if(!it->second->Activate(cmd_))
+  {
+    message = std::string("Failed to activate tracker ") + it->first + std::string(", cannot transition");
+    NODELET_WARN_STREAM(message);
+    return false;
+  }
+
   if(active_tracker_ != NULL)
   {
     active_tracker_->Deactivate();
   }
 
-  active_tracker_ = it->second;
-  res.success = true;
-  res.message = std::string("Successfully activated tracker ") + req.tracker;
+  armed_tracker_ = tracker_map_.end();
+  set_active_tracker(it);
+  message = std::string("Successfully activated tracker ") + it->first;
   return true;
 }
 
+void TrackersManager::set_active_tracker(const std::map<std::string, kr_trackers_manager::Tracker *>::iterator &it)
+{
+  active_tracker_ = it->second;
+  active_tracker_name_ = it->first;
+  inactive_trackers_.clear();
+  for(const auto &tracker : tracker_map_)
+  {
+    if(tracker.second != active_tracker_)
+      inactive_trackers_.push_back(tracker.second);
+  }
+  status_published_ = false;
+}
+
 #include <pluginlib/class_list_macros.h>
 PLUGINLIB_EXPORT_CLASS(TrackersManager, nodelet::Nodelet);
@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include <kr_trackers_manager/hand_off.h>
+
+#include <cmath>
+
+static const kr_trackers_manager::HandOffLimits kLimits = {0.2f, 0.1f, 0.5f};
+
+static kr_mav_msgs::PositionCommand command(float x, float vx, float ax)
+{
+  kr_mav_msgs::PositionCommand cmd;
+  cmd.position.x = x;
+  cmd.position.z = 1;
+  cmd.velocity.x = vx;
+  cmd.acceleration.x = ax;
+  return cmd;
+}
+
+TEST(HandOffTest, Continuous)
+{
+  std::string message;
+  EXPECT_TRUE(kr_trackers_manager::checkHandOff(command(1, 0.5, 0.2), command(1.01, 0.52, 0.3), kLimits, message));
+  EXPECT_TRUE(message.empty());
+}
+
+TEST(HandOffTest, RejectsPositionJump)
+{
+  std::string message;
+  EXPECT_FALSE(kr_trackers_manager::checkHandOff(command(1, 0, 0), command(1.3, 0, 0), kLimits, message));
+  EXPECT_FALSE(message.empty());
+}
+
+TEST(HandOffTest, RejectsVelocityJump)
+{
+  // The next trajectory starting at rest while the last one is still moving
+  std::string message;
+  EXPECT_FALSE(kr_trackers_manager::checkHandOff(command(1, 0.3, 0), command(1, 0, 0), kLimits, message));
+}
+
+TEST(HandOffTest, RejectsAccelerationJump)
+{
+  std::string message;
+  EXPECT_FALSE(kr_trackers_manager::checkHandOff(command(1, 0, 0), command(1, 0, 1.0), kLimits, message));
+}
+
+TEST(HandOffTest, RejectsInvalidCommand)
+{
+  std::string message;
+  EXPECT_FALSE(kr_trackers_manager::checkHandOff(command(1, 0, 0), command(NAN, 0, 0), kLimits, message));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <kr_trackers_manager/offline_params.h>
+
+static XmlRpc::XmlRpcValue makeParams()
+{
+  XmlRpc::XmlRpcValue params;
+  params["use_odom_clock"] = true;
+  params["line_tracker_min_jerk"]["default_v_des"] = 2.0;
+  params["line_tracker_min_jerk"]["default_a_des"] = 1;
+  params["trajectory_tracker"]["replan_window"] = 3;
+  params["trajectory_file_tracker"]["trajectory_dir"] = std::string("/tmp");
+  params["gains"]["pos"]["x"] = 7.4;
+  return params;
+}
+
+TEST(OfflineParamsTest, Types)
+{
+  const kr_trackers_manager::OfflineParams params(makeParams());
+  EXPECT_TRUE(params.getNamespace().empty());
+
+  bool use_odom_clock = false;
+  EXPECT_TRUE(params.param("use_odom_clock", use_odom_clock, false));
+  EXPECT_TRUE(use_odom_clock);
+
+  // Integers are accepted for doubles and floats, but not the other way round
+  double d;
+  float f;
+  int i;
+  EXPECT_TRUE(params.getParam("line_tracker_min_jerk/default_v_des", d));
+  EXPECT_DOUBLE_EQ(d, 2.0);
+  EXPECT_TRUE(params.getParam("line_tracker_min_jerk/default_a_des", f));
+  EXPECT_FLOAT_EQ(f, 1.0f);
+  EXPECT_FALSE(params.getParam("line_tracker_min_jerk/default_v_des", i));
+  EXPECT_TRUE(params.getParam("trajectory_tracker/replan_window", i));
+  EXPECT_EQ(i, 3);
+
+  std::string s;
+  EXPECT_TRUE(params.getParam("trajectory_file_tracker/trajectory_dir", s));
+  EXPECT_EQ(s, "/tmp");
+  EXPECT_FALSE(params.getParam("trajectory_tracker/replan_window", s));
+}
+
+TEST(OfflineParamsTest, Defaults)
+{
+  const kr_trackers_manager::OfflineParams params(makeParams());
+
+  double v_des;
+  EXPECT_FALSE(params.param("line_tracker_min_jerk/default_yaw_v_des", v_des, 0.8));
+  EXPECT_DOUBLE_EQ(v_des, 0.8);
+  EXPECT_FALSE(params.hasParam("velocity_tracker/timeout"));
+  EXPECT_EQ(params.param("velocity_tracker/timeout", 0.5f), 0.5f);
+
+  // A param below another one is not found
+  EXPECT_FALSE(params.hasParam("use_odom_clock/x"));
+
+  // A param with another type is replaced by the default
+  std::string s;
+  EXPECT_FALSE(params.param("gains/pos/x", s, std::string("none")));
+  EXPECT_EQ(s, "none");
+}
+
+TEST(OfflineParamsTest, Namespaces)
+{
+  const kr_trackers_manager::OfflineParams params(makeParams());
+  const kr_trackers_manager::OfflineParams line_tracker(params, "line_tracker_min_jerk");
+  EXPECT_EQ(line_tracker.getNamespace(), "line_tracker_min_jerk");
+  EXPECT_EQ(line_tracker.param("default_v_des", 0.0), 2.0);
+  EXPECT_FALSE(line_tracker.hasParam("use_odom_clock"));
+
+  const kr_trackers_manager::OfflineParams pos(kr_trackers_manager::OfflineParams(params, "gains"), "pos");
+  EXPECT_EQ(pos.getNamespace(), "gains/pos");
+  EXPECT_DOUBLE_EQ(pos.param("x", 0.0), 7.4);
+
+  // A namespace which does not exist has no params
+  const kr_trackers_manager::OfflineParams missing(params, "velocity_tracker");
+  EXPECT_EQ(missing.param("timeout", 0.5f), 0.5f);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include <kr_trackers_manager/Tracker.h>
+
+// Only the time of the Tracker interface is used
+class ClockTracker : public kr_trackers_manager::Tracker
+{
+ public:
+  void Initialize(const ros::NodeHandle &) {}
+  bool Activate(const kr_mav_msgs::PositionCommand::ConstPtr &) { return true; }
+  void Deactivate(void) {}
+  kr_mav_msgs::PositionCommand::ConstPtr update(const nav_msgs::Odometry::ConstPtr &)
+  {
+    return kr_mav_msgs::PositionCommand::ConstPtr();
+  }
+  uint8_t status() const { return 0; }
+
+  using Tracker::fromRosTime;
+  using Tracker::now;
+};
+
+TEST(TrackerClockTest, RosTime)
+{
+  ros::Time::setNow(ros::Time(100.0));
+  ClockTracker tracker;
+  EXPECT_EQ(tracker.now(), ros::Time(100.0));
+  EXPECT_EQ(tracker.fromRosTime(ros::Time(102.5)), ros::Time(102.5));
+}
+
+TEST(TrackerClockTest, OdomClockOffset)
+{
+  // Odometry stamped far from the ROS time, e.g. from a bag replayed without sim time
+  const ros::Duration odom_offset(-960.0);
+  ros::Time::setNow(ros::Time(1000.0));
+  ClockTracker tracker;
+  tracker.setClock([odom_offset]() { return ros::Time::now() + odom_offset; });
+  EXPECT_EQ(tracker.now(), ros::Time(40.0));
+
+  // A goal starting 2 s from now in ROS time starts 2 s from now for the tracker
+  const ros::Time t_start = ros::Time::now() + ros::Duration(2.0);
+  EXPECT_EQ(tracker.fromRosTime(t_start), ros::Time(42.0));
+  EXPECT_DOUBLE_EQ((tracker.now() - tracker.fromRosTime(t_start)).toSec(), -2.0);
+
+  ros::Time::setNow(ros::Time(1003.0));
+  EXPECT_DOUBLE_EQ((tracker.now() - tracker.fromRosTime(t_start)).toSec(), 1.0);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::Time::init();
+  return RUN_ALL_TESTS();
+}